@@ -0,0 +1,192 @@
+// Compares the engines in db/ head to head on long keys with long shared
+// prefixes: inserts and lookups in random order, short scans from random
+// starts, and the bytes each engine allocates per key.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "art.hpp"
+#include "masstree.hpp"
+
+using namespace art;
+
+namespace {
+constexpr size_t SCANS = 1000;
+constexpr size_t SCAN_LENGTH = 100;
+
+// Counts the bytes its clients hold.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t in_use = 0;
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        in_use += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+        in_use -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+struct Result {
+    double insert_ns;
+    double lookup_ns;
+    double scan_ns;
+    double bytes_per_key;
+};
+
+// Object paths of 40 to 120 bytes under a few thousand tenant and service
+// prefixes, as in an object store's metadata index. The unique part ends
+// within the first 40 bytes, and version suffixes pad the rest.
+std::vector<std::string> makeKeys(size_t n, uint32_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    char buf[160];
+    for (size_t i = 0; i < n; i++) {
+        auto len = std::snprintf(
+            buf, sizeof(buf),
+            "tenants/%03u/svc/%02u/obj/%016llx/versions/",
+            unsigned(rng() % 200), unsigned(rng() % 20),
+            static_cast<unsigned long long>(rng()));
+        std::string key(buf, len);
+        key.resize(40 + rng() % 81, '0');
+        keys.push_back(std::move(key));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+template <typename F> double nanosPer(size_t ops, F &&run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / double(ops);
+}
+
+Slice slice(const std::string &s) { return std::string_view(s); }
+
+Result runArt(const std::vector<std::string> &keys,
+              const std::vector<std::string> &starts) {
+    Result result{};
+#ifdef ARTIKV_COMPRESSED_REFS
+    // Nodes must come from the global arena; count what it hands out.
+    auto before = NodeArena::global().reserved();
+    ART tree;
+#else
+    CountingResource counting;
+    ART tree(&counting);
+#endif
+    uint64_t value = 0;
+    result.insert_ns = nanosPer(keys.size(), [&] {
+        for (auto &key : keys) {
+            value++;
+            tree.insert(slice(key),
+                        std::string(reinterpret_cast<char *>(&value),
+                                    sizeof(value)));
+        }
+    });
+#ifdef ARTIKV_COMPRESSED_REFS
+    result.bytes_per_key =
+        double(NodeArena::global().reserved() - before) / keys.size();
+#else
+    result.bytes_per_key = double(counting.in_use) / keys.size();
+#endif
+    size_t found = 0;
+    result.lookup_ns = nanosPer(keys.size(), [&] {
+        for (auto &key : keys) {
+            found += tree.search(slice(key)).has_value();
+        }
+    });
+    size_t pairs = 0;
+    auto scan_ns = nanosPer(1, [&] {
+        for (auto &start : starts) {
+            pairs += tree.scan(slice(start), SCAN_LENGTH).size();
+        }
+    });
+    result.scan_ns = scan_ns / double(std::max<size_t>(pairs, 1));
+    if (found != keys.size()) {
+        std::cerr << "ART lost keys\n";
+    }
+    return result;
+}
+
+Result runMasstree(const std::vector<std::string> &keys,
+                   const std::vector<std::string> &starts) {
+    Result result{};
+    CountingResource counting;
+    Masstree tree(&counting);
+    uint64_t value = 0;
+    result.insert_ns = nanosPer(keys.size(), [&] {
+        for (auto &key : keys) {
+            value++;
+            tree.insert(slice(key),
+                        Slice(reinterpret_cast<const uint8_t *>(&value),
+                              sizeof(value)));
+        }
+    });
+    result.bytes_per_key = double(counting.in_use) / keys.size();
+    size_t found = 0;
+    result.lookup_ns = nanosPer(keys.size(), [&] {
+        for (auto &key : keys) {
+            found += tree.search(slice(key)).has_value();
+        }
+    });
+    size_t pairs = 0;
+    auto scan_ns = nanosPer(1, [&] {
+        for (auto &start : starts) {
+            pairs += tree.scan(slice(start), SCAN_LENGTH).size();
+        }
+    });
+    result.scan_ns = scan_ns / double(std::max<size_t>(pairs, 1));
+    if (found != keys.size()) {
+        std::cerr << "Masstree lost keys\n";
+    }
+    return result;
+}
+
+void print(const char *engine, const Result &result) {
+    std::printf("%-10s %14.1f %14.1f %14.1f %12.1f\n", engine,
+                result.insert_ns, result.lookup_ns, result.scan_ns,
+                result.bytes_per_key);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t n = 1000000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--keys" && i + 1 < argc) {
+            n = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--keys N] [--seed N]\n";
+            return 1;
+        }
+    }
+    auto keys = makeKeys(n, seed);
+    auto starts = makeKeys(SCANS, seed + 1);
+    std::printf("%zu keys of 40 to 120 bytes\n", keys.size());
+    std::printf("%-10s %14s %14s %14s %12s\n", "engine", "insert ns/op",
+                "lookup ns/op", "scan ns/pair", "bytes/key");
+    print("ART", runArt(keys, starts));
+    print("Masstree", runMasstree(keys, starts));
+    return 0;
+}
@@ -1,11 +1,59 @@
 #include "art.hpp"
+#include "epoch.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <random>
 #include <span>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <utility>
 
 using namespace art;
 
-Node* findChild(Node* node, unsigned char byte) {
+namespace {
+
+// Leaves gathered and prefetched at a time by Iterator::next_batch.
+constexpr size_t BATCH_WINDOW = 16;
+// Subtrees a writer evicts at most per insert once the tree is over budget.
+constexpr size_t BALANCE_UNITS = 4;
+// Failed samples or candidates after which a replacement run gives up.
+constexpr size_t MAX_REPLACEMENT_MISSES = 64;
+// Levels of the tree a learned root covers, counting the root's.
+constexpr size_t LEARNED_LEVELS = 3;
+// Subtrees a learned root jumps to at most; more stop it a level higher.
+constexpr size_t MAX_ANCHORS = size_t(1) << 16;
+// Positions a segment of a learned root may predict off by.
+constexpr size_t LEARNED_ERROR = 8;
+// Misses a learned root takes, on top of one per subtree, and writes, on top
+// of one per key, before a writer retrains it.
+constexpr size_t MIN_RETRAIN_MISSES = 64;
+
+template <size_t N>
+NodeRef *findSlot(std::array<std::atomic<unsigned char>, N> &keys,
+                  std::array<NodeRef, N> &children, size_t count,
+                  unsigned char byte) {
+    for (size_t i = 0; i < count; i++) {
+        if (keys[i].load(std::memory_order_relaxed) == byte &&
+            children[i].load(std::memory_order_acquire) != nullptr) {
+            return &children[i];
+        }
+    }
+    return nullptr;
+}
+
+NodeRef* findChild(Node* node, unsigned char byte) {
     switch (node->type) {
     case NodeType::Node4: {
         auto n = static_cast<Node4 *>(node);
@@ -29,23 +77,28 @@ Node* findChild(Node* node, unsigned char byte) {
     }
 }
 
+Node* loadChild(Node* node, unsigned char byte) {
+    auto slot = findChild(node, byte);
+    return slot == nullptr ? nullptr : slot->load(std::memory_order_acquire);
+}
+
 void addChild(Node* node, unsigned char byte, Node* child) {
     switch (node->type) {
     case NodeType::Node4: {
         auto n = static_cast<Node4 *>(node);
-        n->addChild(byte, child);
+        return n->addChild(byte, child);
     }
     case NodeType::Node16: {
         auto n = static_cast<Node16 *>(node);
-        n->addChild(byte, child);
+        return n->addChild(byte, child);
     }
     case NodeType::Node48: {
         auto n = static_cast<Node48 *>(node);
-        n->addChild(byte, child);
+        return n->addChild(byte, child);
     }
     case NodeType::Node256: {
         auto n = static_cast<Node256 *>(node);
-        n->addChild(byte, child);
+        return n->addChild(byte, child);
     }
     default:{
         throw "unknown node type";
@@ -53,6 +106,3114 @@ void addChild(Node* node, unsigned char byte, Node* child) {
     }
 }
 
+void removeChild(Node* node, unsigned char byte) {
+    switch (node->type) {
+    case NodeType::Node4:
+        return static_cast<Node4 *>(node)->removeChild(byte);
+    case NodeType::Node16:
+        return static_cast<Node16 *>(node)->removeChild(byte);
+    case NodeType::Node48:
+        return static_cast<Node48 *>(node)->removeChild(byte);
+    case NodeType::Node256:
+        return static_cast<Node256 *>(node)->removeChild(byte);
+    default:
+        throw "unknown node type";
+    }
+}
+
+bool isFull(Node* node) {
+    switch (node->type) {
+    case NodeType::Node4:
+        return static_cast<Node4 *>(node)->isFull();
+    case NodeType::Node16:
+        return static_cast<Node16 *>(node)->isFull();
+    case NodeType::Node48:
+        return static_cast<Node48 *>(node)->isFull();
+    case NodeType::Node256:
+        return static_cast<Node256 *>(node)->isFull();
+    default:
+        throw "unknown node type";
+    }
+}
+
+// Calls `f(byte, child)` for every child of `node` in key order.
+template <typename F> void forEachChild(Node* node, F&& f) {
+    switch (node->type) {
+    case NodeType::Node4:
+        return static_cast<Node4 *>(node)->forEachChild(f);
+    case NodeType::Node16:
+        return static_cast<Node16 *>(node)->forEachChild(f);
+    case NodeType::Node48:
+        return static_cast<Node48 *>(node)->forEachChild(f);
+    case NodeType::Node256:
+        return static_cast<Node256 *>(node)->forEachChild(f);
+    default:
+        throw "unknown node type";
+    }
+}
+
+Node* nextChild(Node* node, unsigned from, unsigned char& byte) {
+    switch (node->type) {
+    case NodeType::Node4:
+        return static_cast<Node4 *>(node)->nextChild(from, byte);
+    case NodeType::Node16:
+        return static_cast<Node16 *>(node)->nextChild(from, byte);
+    case NodeType::Node48:
+        return static_cast<Node48 *>(node)->nextChild(from, byte);
+    case NodeType::Node256:
+        return static_cast<Node256 *>(node)->nextChild(from, byte);
+    default:
+        throw "unknown node type";
+    }
+}
+
+Node* lastChild(Node* node, unsigned char& byte) {
+    switch (node->type) {
+    case NodeType::Node4:
+        return static_cast<Node4 *>(node)->lastChild(byte);
+    case NodeType::Node16:
+        return static_cast<Node16 *>(node)->lastChild(byte);
+    case NodeType::Node48:
+        return static_cast<Node48 *>(node)->lastChild(byte);
+    case NodeType::Node256:
+        return static_cast<Node256 *>(node)->lastChild(byte);
+    default:
+        throw "unknown node type";
+    }
+}
+
 bool isLeaf(Node* node) {
     return NodeType::Leaf == node->type;
-}
\ No newline at end of file
+}
+
+bool isEvicted(Node* node) {
+    return NodeType::Evicted == node->type;
+}
+
+bool isBucket(Node* node) {
+    return NodeType::Bucket == node->type;
+}
+
+// Whether `node` is one of the four inner node types.
+bool isInner(Node* node) {
+    return !isLeaf(node) && !isEvicted(node) && !isBucket(node);
+}
+
+// Nonzero 16-bit hash of a key, kept in the slots that point at its leaf.
+uint16_t keyFingerprint(Slice key) {
+    auto h = std::hash<std::string_view>()(std::string_view(
+        reinterpret_cast<const char *>(key.data()), key.size()));
+    auto fp = uint16_t(h >> 48);
+    return fp != 0 ? fp : 1;
+}
+
+void putU32(std::vector<uint8_t> &out, size_t value) {
+    auto v = uint32_t(value);
+    auto *bytes = reinterpret_cast<const uint8_t *>(&v);
+    out.insert(out.end(), bytes, bytes + sizeof(v));
+}
+
+uint32_t getU32(const uint8_t *&in) {
+    uint32_t v;
+    std::memcpy(&v, in, sizeof(v));
+    in += sizeof(v);
+    return v;
+}
+
+template <typename T, typename... Args>
+T *create(std::pmr::memory_resource *resource, Args &&...args) {
+    void *p = resource->allocate(sizeof(T), alignof(T));
+    try {
+        return new (p) T(std::forward<Args>(args)...);
+    } catch (...) {
+        resource->deallocate(p, sizeof(T), alignof(T));
+        throw;
+    }
+}
+
+template <typename T> void destroy(std::pmr::memory_resource *resource, T *node) {
+    std::destroy_at(node);
+    resource->deallocate(node, sizeof(T), alignof(T));
+}
+
+InnerNode* newNode(NodeType type, std::pmr::memory_resource *resource) {
+    switch (type) {
+    case NodeType::Node4:
+        return create<Node4>(resource);
+    case NodeType::Node16:
+        return create<Node16>(resource);
+    case NodeType::Node48:
+        return create<Node48>(resource);
+    case NodeType::Node256:
+        return create<Node256>(resource);
+    default:
+        throw "unknown node type";
+    }
+}
+
+void destroyNode(std::pmr::memory_resource *resource, Node *node) {
+    switch (node->type) {
+    case NodeType::Node4:
+        return destroy(resource, static_cast<Node4 *>(node));
+    case NodeType::Node16:
+        return destroy(resource, static_cast<Node16 *>(node));
+    case NodeType::Node48:
+        return destroy(resource, static_cast<Node48 *>(node));
+    case NodeType::Node256:
+        return destroy(resource, static_cast<Node256 *>(node));
+    case NodeType::Evicted: {
+        auto *stub = static_cast<EvictedNode *>(node);
+        destroy(resource, stub->anchorLeaf());
+        return destroy(resource, stub);
+    }
+    case NodeType::Bucket: {
+        // The leaves belong to whoever retires the bucket.
+        auto *bucket = static_cast<BucketNode *>(node);
+        auto bytes = BucketNode::bytes(bucket->size());
+        std::destroy_at(bucket);
+        return resource->deallocate(bucket, bytes, alignof(BucketNode));
+    }
+    default:
+        return destroy(resource, static_cast<LeafNode *>(node));
+    }
+}
+
+size_t capacity(NodeType type) {
+    switch (type) {
+    case NodeType::Node4:
+        return Node4::CAPACITY;
+    case NodeType::Node16:
+        return Node16::CAPACITY;
+    case NodeType::Node48:
+        return Node48::CAPACITY;
+    default:
+        return Node256::CAPACITY;
+    }
+}
+
+NodeType grownType(NodeType type) {
+    switch (type) {
+    case NodeType::Node4:
+        return NodeType::Node16;
+    case NodeType::Node16:
+        return NodeType::Node48;
+    default:
+        return NodeType::Node256;
+    }
+}
+
+NodeType shrunkType(NodeType type) {
+    switch (type) {
+    case NodeType::Node256:
+        return NodeType::Node48;
+    case NodeType::Node48:
+        return NodeType::Node16;
+    default:
+        return NodeType::Node4;
+    }
+}
+
+// A node is replaced by the next smaller type once this few children remain.
+// The gaps to the smaller capacities keep a node from flapping between two
+// types when a key is inserted and removed repeatedly.
+size_t shrinkThreshold(NodeType type) {
+    switch (type) {
+    case NodeType::Node16:
+        return 3;
+    case NodeType::Node48:
+        return 12;
+    case NodeType::Node256:
+        return 37;
+    default:
+        return 0;
+    }
+}
+
+// The first `width` bytes of `key` as a big-endian integer, padded with
+// zeros when the key is shorter.
+uint64_t keyValue(Slice key, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; i++) {
+        value = value << 8 | (i < size_t(key.size()) ? key[i] : 0);
+    }
+    return value;
+}
+
+// `value` with byte `pos` of its `width`-byte big-endian form set to `byte`.
+uint64_t withByte(uint64_t value, size_t width, size_t pos,
+                  unsigned char byte) {
+    if (pos >= width) {
+        return value;
+    }
+    return value | uint64_t(byte) << (8 * (width - 1 - pos));
+}
+
+// Leaves and checkpoints hold 32-bit lengths. Checked before the descent,
+// so that no lock is held when it throws.
+void checkLengths(Slice key, std::span<const uint8_t> value) {
+    if (size_t(key.size()) > UINT32_MAX) {
+        throw std::length_error("key exceeds 4 GiB");
+    }
+    if (value.size() > UINT32_MAX) {
+        throw std::length_error("value exceeds 4 GiB");
+    }
+}
+
+} // namespace
+
+// A piecewise-linear model from integer keys to the subtrees of one level of
+// the tree. Every anchor node is flagged: the writer that replaces one points
+// its anchor at the replacement, or at nothing, before retiring it. Bulk
+// changes bump `anchor_version` instead, which voids the whole model.
+struct ART::LearnedRoot {
+    struct Anchor {
+        Anchor(uint64_t low, InnerNode *node, size_t depth)
+            : low(low), node(node), depth(depth) {}
+        Anchor(const Anchor &other)
+            : low(other.low), node(other.node.load(std::memory_order_relaxed)),
+              depth(other.depth) {}
+
+        // Smallest key below the node.
+        uint64_t low;
+        // Null once the keys below `low`'s first `depth` bytes no longer
+        // start a node at that depth.
+        std::atomic<InnerNode *> node;
+        // Key depth at which the node's compressed path starts.
+        size_t depth;
+    };
+    // Predicts anchor `first + slope * (key - low)` for keys from `low` up
+    // to the next segment's.
+    struct Segment {
+        uint64_t low;
+        size_t first;
+        double slope;
+    };
+    struct Model {
+        uint64_t version;
+        // In key order.
+        std::vector<Anchor> anchors;
+        std::vector<Segment> segments;
+
+        void fit();
+        // The last anchor whose low is not above `value`, SIZE_MAX if none.
+        size_t find(uint64_t value) const;
+    };
+
+    explicit LearnedRoot(size_t key_width) : key_width(key_width) {}
+    ~LearnedRoot() { delete model.load(std::memory_order_relaxed); }
+
+    size_t key_width;
+    std::atomic<Model *> model{nullptr};
+    // Lookups of keys the model covers that still descended from the root,
+    // and writes, since the last training.
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> writes{0};
+    // The counts at which a writer retrains.
+    std::atomic<size_t> miss_limit{MIN_RETRAIN_MISSES};
+    std::atomic<size_t> write_limit{MIN_RETRAIN_MISSES};
+    // Serializes training and anchor updates.
+    std::mutex mutex;
+};
+
+// Greedy segmentation: a segment grows while some slope keeps every anchor
+// it covers within LEARNED_ERROR positions of its prediction.
+void ART::LearnedRoot::Model::fit() {
+    segments.clear();
+    size_t first = 0;
+    double lo = 0;
+    double hi = std::numeric_limits<double>::infinity();
+    auto close = [&] {
+        auto slope = std::isinf(hi) ? 0.0 : (lo + hi) / 2;
+        segments.push_back({anchors[first].low, first, slope});
+    };
+    for (size_t i = 1; i < anchors.size(); i++) {
+        auto dx = double(anchors[i].low - anchors[first].low);
+        auto dy = double(i - first);
+        auto below = std::max(lo, (dy - double(LEARNED_ERROR)) / dx);
+        auto above = std::min(hi, (dy + double(LEARNED_ERROR)) / dx);
+        if (below > above) {
+            close();
+            first = i;
+            lo = 0;
+            hi = std::numeric_limits<double>::infinity();
+            continue;
+        }
+        lo = below;
+        hi = above;
+    }
+    if (!anchors.empty()) {
+        close();
+    }
+}
+
+size_t ART::LearnedRoot::Model::find(uint64_t value) const {
+    if (segments.empty() || value < segments[0].low) {
+        return SIZE_MAX;
+    }
+    // Last segment whose low is not above `value`, without branches on the
+    // comparisons.
+    auto *segment = segments.data();
+    for (auto n = segments.size(); n > 1;) {
+        auto half = n / 2;
+        segment = segment[half].low <= value ? segment + half : segment;
+        n -= half;
+    }
+    auto first = segment->first;
+    auto end = segment + 1 == segments.data() + segments.size()
+                   ? anchors.size()
+                   : segment[1].first;
+    auto offset = segment->slope * double(value - segment->low);
+    auto i = offset >= double(end - 1 - first) ? end - 1
+                                               : first + size_t(offset);
+    // The prediction is at most LEARNED_ERROR off for an anchor's low, and
+    // one more for keys between two lows.
+    while (anchors[i].low > value) {
+        i--;
+    }
+    while (i + 1 < end && anchors[i + 1].low <= value) {
+        i++;
+    }
+    return i;
+}
+
+struct ART::Eviction {
+    struct Candidate {
+        // Smallest key below `node`, which leads back to it.
+        ARTData anchor;
+        size_t depth;
+        InnerNode *node;
+        // Replacement run that queued it.
+        uint64_t round;
+    };
+
+    Eviction(const EvictionOptions &options)
+        : options(options), file(options.path), rng(std::random_device{}()) {}
+
+    EvictionOptions options;
+    PageFile file;
+    std::atomic<size_t> evicted_pairs{0};
+    // Serializes replacement runs; loading subtrees back does not take it.
+    std::mutex mutex;
+    std::deque<Candidate> cooling;
+    uint64_t round = 0;
+    std::minstd_rand rng;
+};
+
+NodeRef *Node4::findChild(unsigned char byte) {
+    return findSlot(keys, children,
+                    compact_count.load(std::memory_order_acquire), byte);
+}
+
+void Node4::addChild(unsigned char byte, Node *child) {
+    auto pos = compact_count.load(std::memory_order_relaxed);
+    keys[pos].store(byte, std::memory_order_relaxed);
+    children[pos].store(child, std::memory_order_release);
+    compact_count.store(pos + 1, std::memory_order_release);
+    children_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Node4::removeChild(unsigned char byte) {
+    findChild(byte)->store(nullptr, std::memory_order_release);
+    children_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+NodeRef *Node16::findChild(unsigned char byte) {
+    return findSlot(keys, children,
+                    compact_count.load(std::memory_order_acquire), byte);
+}
+
+void Node16::addChild(unsigned char byte, Node *child) {
+    auto pos = compact_count.load(std::memory_order_relaxed);
+    keys[pos].store(byte, std::memory_order_relaxed);
+    children[pos].store(child, std::memory_order_release);
+    compact_count.store(pos + 1, std::memory_order_release);
+    children_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Node16::removeChild(unsigned char byte) {
+    findChild(byte)->store(nullptr, std::memory_order_release);
+    children_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+Node48::Node48() : InnerNode(NodeType::Node48) {
+    for (auto &k : keys) {
+        k.store(EMPTY, std::memory_order_relaxed);
+    }
+}
+
+NodeRef *Node48::findChild(unsigned char byte) {
+    auto idx = keys[byte].load(std::memory_order_acquire);
+    return idx == EMPTY ? nullptr : &children[idx];
+}
+
+void Node48::addChild(unsigned char byte, Node *child) {
+    auto pos = compact_count.load(std::memory_order_relaxed);
+    children[pos].store(child, std::memory_order_release);
+    keys[byte].store(pos, std::memory_order_release);
+    occupied.set(byte);
+    compact_count.store(pos + 1, std::memory_order_release);
+    children_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Node48::removeChild(unsigned char byte) {
+    auto idx = keys[byte].load(std::memory_order_relaxed);
+    occupied.clear(byte);
+    keys[byte].store(EMPTY, std::memory_order_release);
+    children[idx].store(nullptr, std::memory_order_release);
+    children_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+NodeRef *Node256::findChild(unsigned char byte) { return &children[byte]; }
+
+void Node256::addChild(unsigned char byte, Node *child) {
+    children[byte].store(child, std::memory_order_release);
+    occupied.set(byte);
+    children_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Node256::removeChild(unsigned char byte) {
+    occupied.clear(byte);
+    children[byte].store(nullptr, std::memory_order_release);
+    children_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+LeafNode::LeafNode(Slice key, std::span<const uint8_t> val, size_t capacity,
+                   std::pmr::memory_resource *resource)
+    : Node(NodeType::Leaf), key(key.begin(), key.end(), resource),
+      words((std::max(capacity, val.size()) + 7) / 8, resource),
+      len(uint32_t(val.size())) {
+    if (val.size() > UINT32_MAX) {
+        throw std::length_error("value exceeds 4 GiB");
+    }
+    fingerprint = keyFingerprint(key);
+    if (!val.empty()) {
+        std::memcpy(words.data(), val.data(), val.size());
+    }
+}
+
+LeafNode::LeafNode(Slice key, SharedValue *shared,
+                   std::pmr::memory_resource *resource)
+    : Node(NodeType::Leaf), key(key.begin(), key.end(), resource),
+      words(resource), len(shared->size), shared(shared) {
+    fingerprint = keyFingerprint(key);
+}
+
+LeafNode::~LeafNode() {
+    if (shared != nullptr) {
+        shared->store->release(shared);
+    }
+}
+
+// The words are copied with relaxed atomic accesses, so a reader racing an
+// in-place update sees some mix of old and new bytes rather than undefined
+// behavior, and the sequence check then throws that copy away.
+size_t LeafNode::readValue(std::span<uint8_t> out) const {
+    if (shared != nullptr) {
+        if (shared->size <= out.size() && shared->size > 0) {
+            std::memcpy(out.data(), shared->data(), shared->size);
+        }
+        return shared->size;
+    }
+    auto *source = const_cast<uint64_t *>(words.data());
+    while (true) {
+        auto before = seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        size_t n = len.load(std::memory_order_relaxed);
+        if (n <= out.size()) {
+            for (size_t i = 0; i * 8 < n; i++) {
+                auto word =
+                    std::atomic_ref(source[i]).load(std::memory_order_relaxed);
+                std::memcpy(out.data() + i * 8, &word, std::min<size_t>(8, n - i * 8));
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == before) {
+            return n;
+        }
+    }
+}
+
+void LeafNode::assignValue(std::span<const uint8_t> value) {
+    auto before = seq.load(std::memory_order_relaxed);
+    seq.store(before + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i * 8 < value.size(); i++) {
+        uint64_t word = 0;
+        std::memcpy(&word, value.data() + i * 8,
+                    std::min<size_t>(8, value.size() - i * 8));
+        std::atomic_ref(words[i]).store(word, std::memory_order_relaxed);
+    }
+    len.store(uint32_t(value.size()), std::memory_order_relaxed);
+    seq.store(before + 2, std::memory_order_release);
+}
+
+uint32_t BucketNode::head(Slice key, size_t offset) {
+    uint32_t head = 0;
+    for (size_t i = 0; i < sizeof(head); i++) {
+        auto pos = offset + i;
+        head = head << 8 | (pos < size_t(key.size()) ? key[pos] : 0);
+    }
+    return head;
+}
+
+LeafNode *BucketNode::find(Slice key) const {
+    if (size_t(key.size()) < offset) {
+        return nullptr;
+    }
+    auto wanted = head(key, offset);
+    auto *h = heads();
+    // Counted rather than searched, so that the loop has no early exit.
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        pos += h[i] < wanted;
+    }
+    for (; pos < count && h[pos] == wanted; pos++) {
+        auto *leaf = leaves()[pos];
+        if (leaf->key.size() == size_t(key.size()) &&
+            std::memcmp(leaf->key.data(), key.data(), key.size()) == 0) {
+            return leaf;
+        }
+    }
+    return nullptr;
+}
+
+size_t BucketNode::lowerBound(Slice key) const {
+    // Heads only order keys that share the leaves' common prefix.
+    auto &common = leaves()[0]->key;
+    auto n = std::min(size_t(offset), size_t(key.size()));
+    auto cmp = n == 0 ? 0 : std::memcmp(common.data(), key.data(), n);
+    if (cmp != 0) {
+        return cmp > 0 ? 0 : count;
+    }
+    if (size_t(key.size()) < offset) {
+        return 0;
+    }
+    auto wanted = head(key, offset);
+    auto *h = heads();
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        pos += h[i] < wanted;
+    }
+    for (; pos < count && h[pos] == wanted; pos++) {
+        auto &k = leaves()[pos]->key;
+        if (!std::lexicographical_compare(k.begin(), k.end(), key.begin(),
+                                          key.end())) {
+            break;
+        }
+    }
+    return pos;
+}
+
+ART::ART(std::pmr::memory_resource *resource) : resource(resource) {
+#ifdef ARTIKV_COMPRESSED_REFS
+    if (!resource->is_equal(NodeArena::global())) {
+        throw std::invalid_argument(
+            "compressed references need nodes from NodeArena::global()");
+    }
+#endif
+}
+
+ART::~ART() {
+    freeSubtree(root.load(std::memory_order_relaxed));
+    if (resource != std::pmr::new_delete_resource() || store != nullptr) {
+        // Nodes retired earlier still sit in reclamation lists and would be
+        // returned to the resource after the caller has released it, or
+        // drop their values into a store that no longer exists.
+        assert(!Epoch::global().inside() &&
+               "a tree cannot wait for reclamation inside an epoch");
+        Epoch::global().synchronize();
+    }
+}
+
+// The key as the tree stores it: `key` itself, or its encoding, written to
+// `buffer`, when keys are compressed.
+Slice ART::storedKey(Slice key, ARTData &buffer) const {
+    if (compressor == nullptr) {
+        return key;
+    }
+    compressor->encode(key, buffer);
+    return Slice(buffer.data(), buffer.size());
+}
+
+// Appends the plain key of `leaf` to `out`.
+template <typename Bytes>
+void ART::appendKey(const LeafNode *leaf, Bytes &out) const {
+    if (compressor != nullptr) {
+        compressor->decode(leaf->key, out);
+    } else {
+        out.insert(out.end(), leaf->key.begin(), leaf->key.end());
+    }
+}
+
+void ART::insert(Slice key, OwnedSlice value) {
+    auto bytes = value.as_span();
+    checkLengths(key, bytes);
+    ARTData buffer;
+    key = storedKey(key, buffer);
+    auto before = tree_size.load(std::memory_order_relaxed);
+    while (!tryInsert(key, bytes, nullptr)) {
+    }
+    if (ranked && tree_size.load(std::memory_order_relaxed) != before) {
+        countPath(key, true);
+    }
+    if (eviction != nullptr) {
+        balance();
+    }
+    if (learned != nullptr) {
+        retrainIfDue();
+    }
+}
+
+void ART::insert_hint(Finger &finger, Slice key, OwnedSlice value) {
+    auto bytes = value.as_span();
+    checkLengths(key, bytes);
+    ARTData buffer;
+    key = storedKey(key, buffer);
+    auto before = tree_size.load(std::memory_order_relaxed);
+    while (!tryInsert(key, bytes, &finger)) {
+        finger.path.clear();
+    }
+    if (ranked && tree_size.load(std::memory_order_relaxed) != before) {
+        countPath(key, true);
+    }
+    if (eviction != nullptr) {
+        balance();
+    }
+    if (learned != nullptr) {
+        retrainIfDue();
+    }
+}
+
+std::optional<std::span<uint8_t>> ART::search(Slice key) {
+    ARTData buffer;
+    return searchFrom(nullptr, storedKey(key, buffer));
+}
+
+std::optional<std::span<uint8_t>> ART::search_hint(Finger &finger,
+                                                   Slice key) {
+    ARTData buffer;
+    return searchFrom(&finger, storedKey(key, buffer));
+}
+
+std::pmr::vector<std::optional<std::span<uint8_t>>>
+ART::search_batch(std::span<const Slice> keys,
+                  std::pmr::memory_resource *scratch) {
+    std::pmr::vector<std::optional<std::span<uint8_t>>> results(scratch);
+    results.reserve(keys.size());
+    Finger finger(scratch);
+    ARTData buffer;
+    for (auto &key : keys) {
+        buffer.clear();
+        results.push_back(searchFrom(&finger, storedKey(key, buffer)));
+    }
+    return results;
+}
+
+std::pmr::vector<bool> ART::read_batch(std::span<const Slice> keys,
+                                      ValueBatch &values,
+                                      std::pmr::memory_resource *scratch) {
+    std::pmr::vector<bool> found(scratch);
+    found.reserve(keys.size());
+    values.clear();
+    values.offsets.push_back(0);
+    Finger finger(scratch);
+    ARTData buffer;
+    Epoch::Guard guard;
+    for (auto &key : keys) {
+        buffer.clear();
+        auto *leaf = findLeaf(&finger, storedKey(key, buffer));
+        found.push_back(leaf != nullptr);
+        if (leaf != nullptr) {
+            leaf->appendValue(values.data);
+        }
+        values.offsets.push_back(values.data.size());
+    }
+    return found;
+}
+
+std::optional<std::span<uint8_t>> ART::searchFrom(Finger *finger,
+                                                  Slice key) {
+    Epoch::Guard guard;
+    auto *leaf = findLeaf(finger, key);
+    if (leaf == nullptr) {
+        return std::nullopt;
+    }
+    return leaf->value();
+}
+
+std::optional<ARTData> ART::read(Slice key) {
+    ARTData buffer;
+    key = storedKey(key, buffer);
+    Epoch::Guard guard;
+    auto *leaf = findLeaf(nullptr, key);
+    if (leaf == nullptr) {
+        return std::nullopt;
+    }
+    ARTData out;
+    leaf->appendValue(out);
+    return out;
+}
+
+std::optional<size_t> ART::read(Slice key, std::span<uint8_t> out) {
+    ARTData buffer;
+    key = storedKey(key, buffer);
+    Epoch::Guard guard;
+    auto *leaf = findLeaf(nullptr, key);
+    if (leaf == nullptr) {
+        return std::nullopt;
+    }
+    return leaf->readValue(out);
+}
+
+// Finds the leaf of `key`; the caller is inside an epoch.
+LeafNode *ART::findLeaf(Finger *finger, Slice key) {
+    NodeRef *slot = &root;
+    WriteLock *slot_lock = &root_lock;
+    size_t depth = 0;
+    auto version = resume(finger, key, slot, slot_lock, depth);
+    // A leaf whose fingerprint differs from the key's cannot match, so it
+    // is rejected from the slot alone, without loading the leaf.
+    uint16_t wanted = 0;
+    auto follow = [&](NodeRef *ref) -> Node * {
+        auto [child, tag] = ref->load_tagged(std::memory_order_acquire);
+        if (tag != 0) {
+            if (wanted == 0) {
+                wanted = keyFingerprint(key);
+            }
+            if (tag != wanted) {
+                return nullptr;
+            }
+        }
+        return child;
+    };
+    Node *node = nullptr;
+    if (finger == nullptr && learned != nullptr) {
+        node = jumpTarget(key, depth);
+    }
+    if (node == nullptr) {
+        node = follow(slot);
+    }
+    LeafNode *result = nullptr;
+    while (node != nullptr) {
+        if (isLeaf(node)) {
+            auto *leaf = static_cast<LeafNode *>(node);
+            if (leafMatches(leaf, key)) {
+                result = leaf;
+            }
+            break;
+        }
+        if (isBucket(node)) {
+            result = static_cast<BucketNode *>(node)->find(key);
+            break;
+        }
+        if (isEvicted(node)) {
+            // Load the subtree back and look again from the root.
+            faultIn(static_cast<EvictedNode *>(node));
+            if (finger != nullptr) {
+                finger->path.clear();
+            }
+            version = structure_version.load(std::memory_order_seq_cst);
+            slot = &root;
+            slot_lock = &root_lock;
+            depth = 0;
+            node = follow(&root);
+            continue;
+        }
+        auto *inner = static_cast<InnerNode *>(node);
+        inner->touch();
+        if (finger != nullptr) {
+            finger->path.push_back({inner, slot, slot_lock, depth});
+        }
+        if (!prefixMatches(inner, key, depth)) {
+            break;
+        }
+        depth += inner->partial_len;
+        if (depth == size_t(key.size())) {
+            node = follow(&inner->prefix_leaf);
+            continue;
+        }
+        slot = findChild(inner, key[depth++]);
+        slot_lock = &inner->lock;
+        node = slot == nullptr ? nullptr : follow(slot);
+    }
+    record(finger, key, version, false, SIZE_MAX);
+    return result;
+}
+
+void ART::remove(Slice key) {
+    ARTData buffer;
+    key = storedKey(key, buffer);
+    if (ranked) {
+        Epoch::Guard guard;
+        if (findLeaf(nullptr, key) != nullptr) {
+            countPath(key, false);
+        }
+    }
+    while (!tryRemove(key)) {
+    }
+    if (learned != nullptr) {
+        retrainIfDue();
+    }
+}
+
+size_t ART::remove_prefix(Slice prefix) {
+    auto detached = detach_prefix(prefix);
+    auto removed = std::exchange(detached.pairs, 0);
+    if (auto *node = std::exchange(detached.node, nullptr)) {
+        if (removed == 0) {
+            removed = countLeaves(node);
+            tree_size.fetch_sub(removed, std::memory_order_relaxed);
+        }
+        Epoch::global().retire(
+            node,
+            [](void *ptr, void *ctx) {
+                destroyTree(static_cast<std::pmr::memory_resource *>(ctx),
+                            static_cast<Node *>(ptr));
+            },
+            resource);
+    }
+    return removed;
+}
+
+ART::Detached ART::detach_prefix(Slice prefix) {
+    if (eviction != nullptr || compressor != nullptr) {
+        throw std::invalid_argument(
+            "prefix removal needs plain keys and no eviction");
+    }
+    Detached detached;
+    detached.tree = this;
+    while (!tryDetachPrefix(prefix, detached)) {
+    }
+    if (learned != nullptr) {
+        retrainIfDue();
+    }
+    return detached;
+}
+
+ART::Detached ART::detach_prefix(Slice prefix, size_t pairs) {
+    auto detached = detach_prefix(prefix);
+    if (detached.node != nullptr && detached.pairs == 0) {
+        detached.pairs = pairs;
+        tree_size.fetch_sub(pairs, std::memory_order_relaxed);
+    }
+    return detached;
+}
+
+ART::Detached::Detached(Detached &&other) noexcept
+    : tree(other.tree), node(std::exchange(other.node, nullptr)),
+      pairs(std::exchange(other.pairs, 0)) {}
+
+ART::Detached &ART::Detached::operator=(Detached &&other) noexcept {
+    if (this != &other) {
+        release();
+        tree = other.tree;
+        node = std::exchange(other.node, nullptr);
+        pairs = std::exchange(other.pairs, 0);
+    }
+    return *this;
+}
+
+ART::Detached::~Detached() { release(); }
+
+size_t ART::Detached::release() {
+    auto count = pairs;
+    if (node != nullptr) {
+        if (count == 0) {
+            count = countLeaves(node);
+            tree->tree_size.fetch_sub(count, std::memory_order_relaxed);
+        }
+        // Readers that found the subtree before it was unlinked may still be
+        // inside it; none can reach it afterwards.
+        Epoch::global().synchronize();
+        destroyTree(tree->resource, node);
+    }
+    node = nullptr;
+    pairs = 0;
+    return count;
+}
+
+size_t ART::size() { return tree_size.load(std::memory_order_relaxed); }
+
+ART::Iterator ART::begin(std::pmr::memory_resource *scratch) {
+    Iterator it(this, scratch);
+    it.push(root.load(std::memory_order_acquire));
+    return it;
+}
+
+// Makes `node` the next thing the iterator looks at: a leaf becomes the
+// current position, an inner node is descended into.
+void ART::Iterator::push(Node *node) {
+    node = tree->resolve(node);
+    if (node == nullptr) {
+        next();
+    } else if (isLeaf(node)) {
+        leaf = static_cast<LeafNode *>(node);
+    } else if (isBucket(node)) {
+        bucket = static_cast<BucketNode *>(node);
+        bucket_next = 0;
+        next();
+    } else {
+        stack.push_back({static_cast<InnerNode *>(node), 0, false});
+        next();
+    }
+}
+
+std::span<const uint8_t> ART::Iterator::key() const {
+    if (tree->compressor == nullptr) {
+        return leaf->key;
+    }
+    if (decoded_leaf != leaf) {
+        decoded.clear();
+        tree->appendKey(leaf, decoded);
+        decoded_leaf = leaf;
+    }
+    return decoded;
+}
+
+void ART::Iterator::next() {
+    leaf = nullptr;
+    if (bucket != nullptr) {
+        if (bucket_next < bucket->size()) {
+            leaf = bucket->leaves()[bucket_next++];
+            return;
+        }
+        bucket = nullptr;
+    }
+    while (!stack.empty()) {
+        auto &frame = stack.back();
+        if (!frame.prefix_leaf_done) {
+            frame.prefix_leaf_done = true;
+            auto *pl = frame.node->prefix_leaf.load(std::memory_order_acquire);
+            if (pl != nullptr) {
+                leaf = static_cast<LeafNode *>(pl);
+                return;
+            }
+        }
+        unsigned char byte = 0;
+        auto *child = frame.next_byte < 256
+                          ? nextChild(frame.node, frame.next_byte, byte)
+                          : nullptr;
+        if (child == nullptr) {
+            stack.pop_back();
+            continue;
+        }
+        frame.next_byte = byte + 1u;
+        child = tree->resolve(child);
+        if (child == nullptr) {
+            continue;
+        }
+        if (isLeaf(child)) {
+            leaf = static_cast<LeafNode *>(child);
+            return;
+        }
+        if (isBucket(child)) {
+            bucket = static_cast<BucketNode *>(child);
+            leaf = bucket->leaves()[0];
+            bucket_next = 1;
+            return;
+        }
+        stack.push_back({static_cast<InnerNode *>(child), 0, false});
+    }
+}
+
+size_t ART::Iterator::next_batch(size_t n, KeyBatch &keys,
+                                ValueBatch &values) {
+    keys.clear();
+    values.clear();
+    keys.offsets.push_back(0);
+    values.offsets.push_back(0);
+    size_t count = 0;
+    std::array<LeafNode *, BATCH_WINDOW> window;
+    while (count < n && valid()) {
+        size_t gathered = 0;
+        for (; gathered < window.size() && count + gathered < n && valid();
+             next()) {
+            window[gathered++] = leaf;
+            __builtin_prefetch(leaf->key.data());
+            __builtin_prefetch(leaf->value().data());
+        }
+        for (size_t i = 0; i < gathered; i++) {
+            auto *l = window[i];
+            tree->appendKey(l, keys.data);
+            keys.offsets.push_back(keys.data.size());
+            l->appendValue(values.data);
+            values.offsets.push_back(values.data.size());
+        }
+        count += gathered;
+    }
+    return count;
+}
+
+ART::Iterator ART::lower_bound(Slice key,
+                               std::pmr::memory_resource *scratch) {
+    ARTData buffer;
+    return lowerBound(storedKey(key, buffer), scratch);
+}
+
+ART::Iterator ART::lowerBound(Slice key, std::pmr::memory_resource *scratch) {
+    Iterator it(this, scratch);
+    Node *node = root.load(std::memory_order_acquire);
+    size_t depth = 0;
+    auto keyLen = size_t(key.size());
+    while (node != nullptr) {
+        if (isLeaf(node)) {
+            auto *leaf = static_cast<LeafNode *>(node);
+            if (!std::lexicographical_compare(leaf->key.begin(),
+                                              leaf->key.end(), key.begin(),
+                                              key.end())) {
+                it.leaf = leaf;
+                return it;
+            }
+            break;
+        }
+        if (isBucket(node)) {
+            it.bucket = static_cast<BucketNode *>(node);
+            it.bucket_next = it.bucket->lowerBound(key);
+            break;
+        }
+        if (isEvicted(node)) {
+            faultIn(static_cast<EvictedNode *>(node));
+            it.stack.clear();
+            node = root.load(std::memory_order_acquire);
+            depth = 0;
+            continue;
+        }
+        auto *inner = static_cast<InnerNode *>(node);
+        auto [path, len] = pathBytes(inner, depth);
+        if (path == nullptr) {
+            break;
+        }
+        auto n = std::min(len, keyLen - depth);
+        auto cmp = std::memcmp(path, key.data() + depth, n);
+        if (cmp > 0 || (cmp == 0 && n < len)) {
+            // Every key below `inner` is greater than `key`.
+            it.push(inner);
+            return it;
+        }
+        if (cmp < 0) {
+            break;
+        }
+        depth += len;
+        if (depth == keyLen) {
+            it.stack.push_back({inner, 0, false});
+            break;
+        }
+        auto byte = key[depth++];
+        it.stack.push_back({inner, byte + 1u, true});
+        node = loadChild(inner, byte);
+    }
+    it.next();
+    return it;
+}
+
+std::vector<ARTData> ART::sample(size_t count) {
+    Epoch::Guard guard;
+    std::vector<ARTData> keys;
+    std::minstd_rand rng(std::random_device{}());
+    std::vector<Node *> choices;
+    for (size_t i = 0; i < count; i++) {
+        Node *node = root.load(std::memory_order_acquire);
+        while (node != nullptr && isInner(node)) {
+            auto *inner = static_cast<InnerNode *>(node);
+            choices.clear();
+            if (auto *pl = inner->prefix_leaf.load(std::memory_order_acquire)) {
+                choices.push_back(pl);
+            }
+            forEachChild(inner, [&](unsigned char, Node *child) {
+                choices.push_back(child);
+            });
+            node = choices.empty() ? nullptr : choices[rng() % choices.size()];
+        }
+        if (node == nullptr) {
+            break;
+        }
+        if (isBucket(node)) {
+            auto *bucket = static_cast<BucketNode *>(node);
+            node = bucket->leaves()[rng() % bucket->size()];
+        }
+        // An evicted subtree is sampled through its smallest key.
+        auto *leaf = isEvicted(node)
+                         ? static_cast<EvictedNode *>(node)->anchor
+                         : static_cast<LeafNode *>(node);
+        appendKey(leaf, keys.emplace_back());
+    }
+    return keys;
+}
+
+std::pmr::vector<ART::ScanEntry>
+ART::scan(Slice start, size_t limit, std::pmr::memory_resource *scratch) {
+    std::pmr::vector<ScanEntry> entries(scratch);
+    for (auto it = lower_bound(start, scratch);
+         it.valid() && entries.size() < limit; it.next()) {
+        auto key = it.key();
+        auto &entry = entries.emplace_back(
+            std::piecewise_construct,
+            std::forward_as_tuple(key.begin(), key.end()),
+            std::forward_as_tuple());
+        it.leaf->appendValue(entry.second);
+    }
+    return entries;
+}
+
+void ART::merge(ART &other) {
+    if (!resource->is_equal(*other.resource) || compressor != other.compressor ||
+        store != nullptr || other.store != nullptr || eviction != nullptr ||
+        other.eviction != nullptr || ranked || other.ranked ||
+        bucket_capacity != 0 || other.bucket_capacity != 0) {
+        // Nodes cannot change hands between resources, keys are encoded for
+        // their own tree, leaves hold references into their own tree's value
+        // store, stubs name pages of their own tree's file, and buckets are
+        // only split by inserts: copy the pairs over.
+        for (auto it = other.begin(); it.valid(); it.next()) {
+            insert(Slice(it.key().data(), it.key().size()),
+                   ARTData(it.value().begin(), it.value().end()));
+        }
+        other.freeSubtree(other.root.exchange(nullptr));
+        other.tree_size.store(0);
+        other.structure_version.fetch_add(1, std::memory_order_seq_cst);
+        other.anchor_version.fetch_add(1, std::memory_order_seq_cst);
+        return;
+    }
+    size_t duplicates = 0;
+    auto *a = root.load(std::memory_order_relaxed);
+    auto *b = other.root.exchange(nullptr, std::memory_order_relaxed);
+    root.store(mergeNodes(a, b, 0, true, duplicates),
+               std::memory_order_release);
+    tree_size.fetch_add(other.tree_size.exchange(0) - duplicates,
+                        std::memory_order_relaxed);
+    structure_version.fetch_add(1, std::memory_order_seq_cst);
+    anchor_version.fetch_add(1, std::memory_order_seq_cst);
+    other.anchor_version.fetch_add(1, std::memory_order_seq_cst);
+}
+
+// Merges subtree `b` into subtree `a`, both hanging at `depth`, and returns
+// the root of the result. `b_wins` says whose leaf survives a duplicate key.
+// Nodes are changed in place and freed directly: neither subtree may be
+// reachable by another thread.
+Node *ART::mergeNodes(Node *a, Node *b, size_t depth, bool b_wins,
+                      size_t &duplicates) {
+    if (a == nullptr || b == nullptr) {
+        return a == nullptr ? b : a;
+    }
+    auto [pa, la] = pathBytes(a, depth);
+    auto [pb, lb] = pathBytes(b, depth);
+    // Let `a` be the one whose path ends first; on a tie, the leaf.
+    if (lb < la || (la == lb && isLeaf(b) && !isLeaf(a))) {
+        std::swap(a, b);
+        std::swap(pa, pb);
+        std::swap(la, lb);
+        b_wins = !b_wins;
+    }
+    size_t common = 0;
+    while (common < la && pa[common] == pb[common]) {
+        common++;
+    }
+
+    if (common < la) {
+        // The paths diverge: both hang below a new node.
+        auto *split = newNode(NodeType::Node4, resource);
+        split->setPrefix(pa, common);
+        attach(split, a, depth, depth + common);
+        attach(split, b, depth, depth + common);
+        return split;
+    }
+
+    if (isLeaf(a)) {
+        if (isLeaf(b) && la == lb) {
+            duplicates++;
+            destroyNode(resource, b_wins ? a : b);
+            return b_wins ? b : a;
+        }
+        if (la == lb) {
+            // `a` ends exactly where the prefix of inner node `b` does.
+            auto *inner = static_cast<InnerNode *>(b);
+            auto *old = inner->prefix_leaf.load(std::memory_order_relaxed);
+            auto *merged = mergeNodes(old, a, depth + lb, !b_wins, duplicates);
+            inner->prefix_leaf.store(merged, std::memory_order_relaxed);
+            return inner;
+        }
+        auto *split = newNode(NodeType::Node4, resource);
+        split->setPrefix(pa, la);
+        split->prefix_leaf.store(a, std::memory_order_relaxed);
+        attach(split, b, depth, depth + la);
+        return split;
+    }
+
+    auto *inner = static_cast<InnerNode *>(a);
+    auto below = depth + la + 1;
+    auto existingChild = [&](unsigned char byte) -> NodeRef * {
+        auto *slot = findChild(inner, byte);
+        if (slot == nullptr || slot->load(std::memory_order_relaxed) == nullptr) {
+            return nullptr;
+        }
+        return slot;
+    };
+    if (la < lb) {
+        // `b` hangs below one of the children of `a`.
+        auto *slot = existingChild(pb[la]);
+        if (slot == nullptr) {
+            attach(inner, b, depth, depth + la);
+            return inner;
+        }
+        if (!isLeaf(b)) {
+            static_cast<InnerNode *>(b)->setPrefix(pb + la + 1, lb - la - 1);
+        }
+        auto *existing = slot->load(std::memory_order_relaxed);
+        slot->store(mergeNodes(existing, b, below, b_wins, duplicates),
+                    std::memory_order_relaxed);
+        return inner;
+    }
+    // Same path: fold the entries of `b` into `a`.
+    auto *other = static_cast<InnerNode *>(b);
+    auto *pl = other->prefix_leaf.load(std::memory_order_relaxed);
+    if (pl != nullptr) {
+        auto *old = inner->prefix_leaf.load(std::memory_order_relaxed);
+        inner->prefix_leaf.store(
+            mergeNodes(old, pl, depth + la, b_wins, duplicates),
+            std::memory_order_relaxed);
+    }
+    forEachChild(other, [&](unsigned char byte, Node *child) {
+        if (auto *slot = existingChild(byte)) {
+            auto *existing = slot->load(std::memory_order_relaxed);
+            slot->store(mergeNodes(existing, child, below, b_wins, duplicates),
+                        std::memory_order_relaxed);
+        } else {
+            addChildGrowing(inner, byte, child);
+        }
+    });
+    destroyNode(resource, other);
+    return inner;
+}
+
+// Hangs `child`, whose path starts at `depth`, below the unshared node
+// `node`, whose path ends at `end`. An inner child loses the bytes up to and
+// including the one it now hangs by from its prefix.
+void ART::attach(InnerNode *&node, Node *child, size_t depth, size_t end) {
+    if (isLeaf(child)) {
+        auto *leaf = static_cast<LeafNode *>(child);
+        if (leaf->key.size() == end) {
+            node->prefix_leaf.store(leaf, std::memory_order_relaxed);
+        } else {
+            addChildGrowing(node, leaf->key[end], leaf);
+        }
+        return;
+    }
+    auto [path, len] = pathBytes(child, depth);
+    auto skip = end - depth;
+    auto byte = path[skip];
+    static_cast<InnerNode *>(child)->setPrefix(path + skip + 1,
+                                               len - skip - 1);
+    addChildGrowing(node, byte, child);
+}
+
+// Adds a child to an unshared node, replacing the node with a larger copy
+// first if it is full.
+void ART::addChildGrowing(InnerNode *&node, unsigned char byte, Node *child) {
+    if (isFull(node)) {
+        auto count = node->children_count.load(std::memory_order_relaxed);
+        auto type = count < capacity(node->type) ? node->type
+                                                 : grownType(node->type);
+        auto *bigger = rebuild(node, type);
+        destroyNode(resource, node);
+        node = bigger;
+    }
+    addChild(node, byte, child);
+}
+
+// Returns the full path `node` covers starting at `depth`: the rest of the
+// key for a leaf, the compressed path for an inner node. The pointer is null
+// if the bytes beyond MAX_PARTIAL_LEN could not be recovered from a leaf.
+std::pair<const uint8_t *, size_t> ART::pathBytes(Node *node, size_t depth) {
+    if (isLeaf(node)) {
+        auto *leaf = static_cast<LeafNode *>(node);
+        return {leaf->key.data() + depth, leaf->key.size() - depth};
+    }
+    auto *inner = static_cast<InnerNode *>(node);
+    if (inner->partial_len <= MAX_PARTIAL_LEN) {
+        return {inner->partial_key.data(), inner->partial_len};
+    }
+    auto *any = minLeaf(inner);
+    if (any == nullptr) {
+        return {nullptr, inner->partial_len};
+    }
+    return {any->key.data() + depth, inner->partial_len};
+}
+
+// One attempt at an insert. Returns false when a concurrent writer changed a
+// node this one was about to lock, in which case the caller starts over.
+bool ART::tryInsert(Slice key, std::span<const uint8_t> value,
+                    Finger *finger) {
+    Epoch::Guard guard;
+    NodeRef *slot = &root;
+    WriteLock *slot_lock = &root_lock;
+    size_t depth = 0;
+    auto version = resume(finger, key, slot, slot_lock, depth);
+    Node *node = slot->load(std::memory_order_acquire);
+    // Records the path for the next hinted operation. `replaced` says that
+    // this insert swapped out the last node on the path.
+    auto finish = [&](bool replaced) {
+        if (finger != nullptr) {
+            record(finger, key, version, replaced,
+                   finger->path.size() - (replaced ? 1 : 0));
+        }
+        return true;
+    };
+
+    // Locks the owner of `slot` and checks that it still holds `expected`.
+    auto lockSlot = [&](Node *expected) {
+        slot_lock->lock();
+        if (slot_lock->isObsolete() ||
+            slot->load(std::memory_order_relaxed) != expected) {
+            slot_lock->unlock();
+            return false;
+        }
+        return true;
+    };
+
+    while (true) {
+        if (node == nullptr) {
+            if (!lockSlot(nullptr)) {
+                return false;
+            }
+            slot->store(newLeaf(key, value), std::memory_order_release);
+            slot_lock->unlock();
+            tree_size.fetch_add(1, std::memory_order_relaxed);
+            return finish(false);
+        }
+
+        if (isLeaf(node)) {
+            auto *leaf = static_cast<LeafNode *>(node);
+            if (!lockSlot(leaf)) {
+                return false;
+            }
+            bool same_key = leafMatches(leaf, key);
+            if (same_key && leaf->fits(value.size()) &&
+                value.size() < dedup_min_bytes) {
+                leaf->assignValue(value);
+                slot_lock->unlock();
+                return finish(false);
+            }
+            auto *fresh = newLeaf(key, value);
+            if (same_key) {
+                slot->store(fresh, std::memory_order_release);
+                slot_lock->unlock();
+                retire(leaf);
+                return finish(false);
+            }
+            if (bucket_capacity != 0) {
+                auto fresh_first = !std::lexicographical_compare(
+                    leaf->key.begin(), leaf->key.end(), key.begin(), key.end());
+                std::array<LeafNode *, 2> pair{fresh_first ? fresh : leaf,
+                                               fresh_first ? leaf : fresh};
+                slot->store(newBucket(pair), std::memory_order_release);
+                slot_lock->unlock();
+                tree_size.fetch_add(1, std::memory_order_relaxed);
+                return finish(false);
+            }
+            size_t common = 0;
+            auto limit = std::min(leaf->key.size(), size_t(key.size()));
+            while (depth + common < limit &&
+                   leaf->key[depth + common] == key[depth + common]) {
+                common++;
+            }
+            auto *split = newNode(NodeType::Node4, resource);
+            split->setPrefix(key.data() + depth, common);
+            split->leaves.store(1, std::memory_order_relaxed);
+            placeLeaf(split, leaf, depth + common);
+            placeLeaf(split, fresh, depth + common);
+            slot->store(split, std::memory_order_release);
+            slot_lock->unlock();
+            tree_size.fetch_add(1, std::memory_order_relaxed);
+            return finish(false);
+        }
+
+        if (isBucket(node)) {
+            auto *bucket = static_cast<BucketNode *>(node);
+            if (!lockSlot(bucket)) {
+                return false;
+            }
+            auto *leaves = bucket->leaves();
+            auto count = bucket->size();
+            auto pos = bucket->lowerBound(key);
+            if (pos < count && leafMatches(leaves[pos], key)) {
+                auto *leaf = leaves[pos];
+                if (leaf->fits(value.size()) &&
+                    value.size() < dedup_min_bytes) {
+                    leaf->assignValue(value);
+                    slot_lock->unlock();
+                    return finish(false);
+                }
+                std::vector<LeafNode *> updated(leaves, leaves + count);
+                updated[pos] = newLeaf(key, value);
+                slot->store(newBucket(updated), std::memory_order_release);
+                slot_lock->unlock();
+                retire(bucket);
+                retire(leaf);
+                return finish(false);
+            }
+            std::vector<LeafNode *> grown(leaves, leaves + pos);
+            grown.push_back(newLeaf(key, value));
+            grown.insert(grown.end(), leaves + pos, leaves + count);
+            Node *replacement;
+            if (grown.size() <= bucket_capacity) {
+                replacement = newBucket(grown);
+            } else {
+                // Overflow: inner nodes take over from the bucket's depth.
+                // Counts leave out the new key, which `insert` adds along
+                // its path.
+                replacement = buildSubtree(grown, depth);
+                for (Node *n = replacement; ranked && n != nullptr && isInner(n);) {
+                    auto *inner = static_cast<InnerNode *>(n);
+                    inner->leaves.fetch_sub(1, std::memory_order_relaxed);
+                    auto end = depth + inner->partial_len;
+                    if (end == size_t(key.size())) {
+                        break;
+                    }
+                    n = loadChild(inner, key[end]);
+                    depth = end + 1;
+                }
+            }
+            slot->store(replacement, std::memory_order_release);
+            slot_lock->unlock();
+            retire(bucket);
+            tree_size.fetch_add(1, std::memory_order_relaxed);
+            return finish(false);
+        }
+        if (isEvicted(node)) {
+            faultIn(static_cast<EvictedNode *>(node));
+            return false;
+        }
+        auto *inner = static_cast<InnerNode *>(node);
+        inner->touch();
+        if (finger != nullptr) {
+            finger->path.push_back({inner, slot, slot_lock, depth});
+        }
+        auto mismatch = prefixMismatch(inner, key, depth);
+        if (!mismatch) {
+            return false;
+        }
+        if (*mismatch < inner->partial_len) {
+            // The key leaves the compressed path: a new Node4 takes the
+            // common part and a copy of `inner` keeps the rest.
+            auto *any = minLeaf(inner);
+            if (any == nullptr || !lockSlot(inner)) {
+                return false;
+            }
+            inner->lock.lock();
+            if (inner->lock.isObsolete()) {
+                inner->lock.unlock();
+                slot_lock->unlock();
+                return false;
+            }
+            auto skip = *mismatch + 1;
+            auto *rest = rebuild(inner, inner->type);
+            rest->setPrefix(any->key.data() + depth + skip,
+                            inner->partial_len - skip);
+            auto *split = newNode(NodeType::Node4, resource);
+            split->setPrefix(key.data() + depth, *mismatch);
+            split->leaves.store(rest->leaves.load(std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+            addChild(split, any->key[depth + *mismatch], rest);
+            placeLeaf(split, newLeaf(key, value), depth + *mismatch);
+            inheritAnchor(inner, split);
+            slot->store(split, std::memory_order_release);
+            inner->lock.markObsolete();
+            inner->lock.unlock();
+            slot_lock->unlock();
+            retireReplaced(inner, split);
+            tree_size.fetch_add(1, std::memory_order_relaxed);
+            return finish(true);
+        }
+        depth += inner->partial_len;
+
+        if (depth == size_t(key.size())) {
+            inner->lock.lock();
+            if (inner->lock.isObsolete()) {
+                inner->lock.unlock();
+                return false;
+            }
+            auto *old = static_cast<LeafNode *>(
+                inner->prefix_leaf.load(std::memory_order_relaxed));
+            if (old != nullptr && old->fits(value.size()) &&
+                value.size() < dedup_min_bytes) {
+                old->assignValue(value);
+                inner->lock.unlock();
+                return finish(false);
+            }
+            inner->prefix_leaf.store(newLeaf(key, value),
+                                     std::memory_order_release);
+            inner->lock.unlock();
+            if (old != nullptr) {
+                retire(old);
+            } else {
+                tree_size.fetch_add(1, std::memory_order_relaxed);
+            }
+            return finish(false);
+        }
+
+        auto byte = key[depth];
+        auto *child_slot = findChild(inner, byte);
+        auto *child = child_slot == nullptr
+                          ? nullptr
+                          : child_slot->load(std::memory_order_acquire);
+        if (child != nullptr) {
+            slot = child_slot;
+            slot_lock = &inner->lock;
+            node = child;
+            depth++;
+            continue;
+        }
+
+        // Growing replaces `inner`, so its parent slot has to be locked
+        // first to keep the top-down lock order.
+        bool grow = isFull(inner);
+        if (grow && !lockSlot(inner)) {
+            return false;
+        }
+        inner->lock.lock();
+        if (inner->lock.isObsolete() || loadChild(inner, byte) != nullptr ||
+            (!grow && isFull(inner))) {
+            inner->lock.unlock();
+            if (grow) {
+                slot_lock->unlock();
+            }
+            return false;
+        }
+        auto *fresh = newLeaf(key, value);
+        if (!grow) {
+            addChild(inner, byte, fresh);
+            inner->lock.unlock();
+            tree_size.fetch_add(1, std::memory_order_relaxed);
+            return finish(false);
+        }
+        auto count = inner->children_count.load(std::memory_order_relaxed);
+        auto type = count < capacity(inner->type) ? inner->type
+                                                  : grownType(inner->type);
+        auto *bigger = rebuild(inner, type);
+        addChild(bigger, byte, fresh);
+        inheritAnchor(inner, bigger);
+        slot->store(bigger, std::memory_order_release);
+        inner->lock.markObsolete();
+        inner->lock.unlock();
+        slot_lock->unlock();
+        retireReplaced(inner, bigger);
+        tree_size.fetch_add(1, std::memory_order_relaxed);
+        return finish(true);
+    }
+}
+
+bool ART::tryRemove(Slice key) {
+    Epoch::Guard guard;
+    NodeRef *parent_slot = nullptr;
+    WriteLock *parent_slot_lock = nullptr;
+    InnerNode *parent = nullptr;
+    size_t parent_depth = 0;
+    NodeRef *slot = &root;
+    Node *node = slot->load(std::memory_order_acquire);
+    size_t depth = 0;
+
+    while (node != nullptr) {
+        if (isLeaf(node)) {
+            auto *leaf = static_cast<LeafNode *>(node);
+            if (!leafMatches(leaf, key)) {
+                return true;
+            }
+            if (parent != nullptr) {
+                return removeLeaf(parent_slot, parent_slot_lock, parent,
+                                  parent_depth, slot, leaf);
+            }
+            return removeRoot(leaf);
+        }
+        if (isBucket(node)) {
+            auto *bucket = static_cast<BucketNode *>(node);
+            auto *leaf = bucket->find(key);
+            if (leaf == nullptr) {
+                return true;
+            }
+            std::vector<LeafNode *> rest;
+            rest.reserve(bucket->size() - 1);
+            for (size_t i = 0; i < bucket->size(); i++) {
+                if (bucket->leaves()[i] != leaf) {
+                    rest.push_back(bucket->leaves()[i]);
+                }
+            }
+            if (!replaceInBucket(slot, parent == nullptr ? &root_lock
+                                                         : &parent->lock,
+                                 bucket, rest)) {
+                return false;
+            }
+            retire(leaf);
+            tree_size.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        if (isEvicted(node)) {
+            faultIn(static_cast<EvictedNode *>(node));
+            return false;
+        }
+
+        auto *inner = static_cast<InnerNode *>(node);
+        inner->touch();
+        if (!prefixMatches(inner, key, depth)) {
+            return true;
+        }
+        parent_slot_lock = parent == nullptr ? &root_lock : &parent->lock;
+        parent_slot = slot;
+        parent = inner;
+        parent_depth = depth;
+        depth += inner->partial_len;
+        if (depth == size_t(key.size())) {
+            slot = &inner->prefix_leaf;
+        } else {
+            slot = findChild(inner, key[depth++]);
+            if (slot == nullptr) {
+                return true;
+            }
+        }
+        node = slot->load(std::memory_order_acquire);
+    }
+    return true;
+}
+
+// Unlinks `leaf` when it is the whole tree.
+// Finds the highest node whose keys all start with `prefix` and unlinks it
+// the way a leaf is unlinked. Returns false if a concurrent writer got in
+// the way.
+bool ART::tryDetachPrefix(Slice prefix, Detached &detached) {
+    Epoch::Guard guard;
+    // The inner nodes above the subtree, whose leaf counts include it.
+    std::vector<InnerNode *> ancestors;
+    NodeRef *parent_slot = nullptr;
+    WriteLock *parent_slot_lock = nullptr;
+    size_t parent_depth = 0;
+    NodeRef *slot = &root;
+    Node *node = slot->load(std::memory_order_acquire);
+    unsigned char byte = 0;
+    size_t depth = 0;
+    auto prefixLen = size_t(prefix.size());
+    while (node != nullptr && isInner(node)) {
+        auto *inner = static_cast<InnerNode *>(node);
+        auto [path, len] = pathBytes(inner, depth);
+        if (path == nullptr) {
+            return false;
+        }
+        auto n = std::min(len, prefixLen - depth);
+        if (n != 0 && std::memcmp(path, prefix.data() + depth, n) != 0) {
+            return true;
+        }
+        if (depth + len >= prefixLen) {
+            break;
+        }
+        parent_slot_lock = ancestors.empty() ? &root_lock
+                                             : &ancestors.back()->lock;
+        parent_slot = slot;
+        parent_depth = depth;
+        ancestors.push_back(inner);
+        depth += len;
+        byte = prefix[depth++];
+        slot = findChild(inner, byte);
+        if (slot == nullptr) {
+            return true;
+        }
+        node = slot->load(std::memory_order_acquire);
+    }
+    if (node == nullptr) {
+        return true;
+    }
+    if (isLeaf(node)) {
+        auto *leaf = static_cast<LeafNode *>(node);
+        if (leaf->key.size() < prefixLen ||
+            !std::equal(prefix.begin(), prefix.end(), leaf->key.begin())) {
+            return true;
+        }
+    }
+    if (isBucket(node)) {
+        // A bucket under the prefix may hold keys outside it as well; those
+        // stay behind in a smaller bucket.
+        auto *bucket = static_cast<BucketNode *>(node);
+        std::vector<LeafNode *> kept;
+        std::vector<LeafNode *> matched;
+        for (size_t i = 0; i < bucket->size(); i++) {
+            auto *leaf = bucket->leaves()[i];
+            auto under = leaf->key.size() >= prefixLen &&
+                         std::equal(prefix.begin(), prefix.end(),
+                                    leaf->key.begin());
+            (under ? matched : kept).push_back(leaf);
+        }
+        if (matched.empty()) {
+            return true;
+        }
+        if (!kept.empty()) {
+            auto *owner = ancestors.empty() ? &root_lock
+                                            : &ancestors.back()->lock;
+            if (!replaceInBucket(slot, owner, bucket, kept)) {
+                return false;
+            }
+            for (auto *inner : ancestors) {
+                if (ranked) {
+                    inner->leaves.fetch_sub(matched.size(),
+                                            std::memory_order_relaxed);
+                }
+            }
+            for (auto *leaf : matched) {
+                retire(leaf);
+            }
+            detached.pairs = matched.size();
+            tree_size.fetch_sub(detached.pairs, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Counts drop before the unlink, which may copy them into a new node.
+    size_t count = ranked ? leafCount(node) : 0;
+    for (auto *inner : ancestors) {
+        inner->leaves.fetch_sub(count, std::memory_order_relaxed);
+    }
+    bool unlinked;
+    if (ancestors.empty()) {
+        root_lock.lock();
+        unlinked = root.load(std::memory_order_relaxed) == node;
+        if (unlinked) {
+            root.store(nullptr, std::memory_order_release);
+        }
+        root_lock.unlock();
+    } else {
+        unlinked = unlink(parent_slot, parent_slot_lock, ancestors.back(),
+                          parent_depth, slot, node, byte);
+    }
+    if (!unlinked) {
+        for (auto *inner : ancestors) {
+            inner->leaves.fetch_add(count, std::memory_order_relaxed);
+        }
+        return false;
+    }
+    if (isInner(node)) {
+        // Writers that reach the node from now on start over from the root.
+        auto *inner = static_cast<InnerNode *>(node);
+        inner->lock.lock();
+        inner->lock.markObsolete();
+        inner->lock.unlock();
+        structure_version.fetch_add(1, std::memory_order_seq_cst);
+        anchor_version.fetch_add(1, std::memory_order_seq_cst);
+    }
+    // An unranked tree counts the subtree when it is released.
+    detached.node = node;
+    detached.pairs = count;
+    tree_size.fetch_sub(count, std::memory_order_relaxed);
+    return true;
+}
+
+bool ART::removeRoot(LeafNode *leaf) {
+    root_lock.lock();
+    if (root.load(std::memory_order_relaxed) != leaf) {
+        root_lock.unlock();
+        return false;
+    }
+    root.store(nullptr, std::memory_order_release);
+    root_lock.unlock();
+    retire(leaf);
+    tree_size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+ART::KeyValue ART::copyOut(LeafNode *leaf) const {
+    KeyValue pair;
+    appendKey(leaf, pair.first);
+    leaf->appendValue(pair.second);
+    return pair;
+}
+
+std::optional<ART::KeyValue> ART::min() { return peek(false); }
+
+std::optional<ART::KeyValue> ART::max() { return peek(true); }
+
+std::optional<ART::KeyValue> ART::pop_min() { return pop(false); }
+
+std::optional<ART::KeyValue> ART::pop_max() { return pop(true); }
+
+// Slot of the smallest (or largest) entry of `node`: the prefix leaf sorts
+// before every child. Returns nullptr if a concurrent removal left `node`
+// without entries.
+NodeRef *ART::edgeSlot(InnerNode *node, bool largest) {
+    if (!largest &&
+        node->prefix_leaf.load(std::memory_order_acquire) != nullptr) {
+        return &node->prefix_leaf;
+    }
+    unsigned char byte = 0;
+    auto *child = largest ? lastChild(node, byte) : nextChild(node, 0, byte);
+    if (child != nullptr) {
+        return findChild(node, byte);
+    }
+    if (largest &&
+        node->prefix_leaf.load(std::memory_order_acquire) != nullptr) {
+        return &node->prefix_leaf;
+    }
+    return nullptr;
+}
+
+std::optional<ART::KeyValue> ART::peek(bool largest) {
+    Epoch::Guard guard;
+    while (true) {
+        Node *node = root.load(std::memory_order_acquire);
+        if (node == nullptr) {
+            return std::nullopt;
+        }
+        while (node != nullptr && isInner(node)) {
+            auto *slot = edgeSlot(static_cast<InnerNode *>(node), largest);
+            node = slot == nullptr ? nullptr
+                                   : slot->load(std::memory_order_acquire);
+        }
+        if (node != nullptr && isEvicted(node)) {
+            faultIn(static_cast<EvictedNode *>(node));
+            continue;
+        }
+        if (node != nullptr && isBucket(node)) {
+            auto *bucket = static_cast<BucketNode *>(node);
+            return copyOut(bucket->leaves()[largest ? bucket->size() - 1 : 0]);
+        }
+        if (node != nullptr) {
+            auto *leaf = static_cast<LeafNode *>(node);
+            return copyOut(leaf);
+        }
+        // The descent ran into a node that was being emptied; the tree has
+        // already moved on from it.
+    }
+}
+
+std::optional<ART::KeyValue> ART::pop(bool largest) {
+    Epoch::Guard guard;
+    while (true) {
+        NodeRef *parent_slot = nullptr;
+        WriteLock *parent_slot_lock = nullptr;
+        InnerNode *parent = nullptr;
+        size_t parent_depth = 0;
+        NodeRef *slot = &root;
+        Node *node = slot->load(std::memory_order_acquire);
+        size_t depth = 0;
+        if (node == nullptr) {
+            return std::nullopt;
+        }
+        while (node != nullptr && isInner(node)) {
+            auto *inner = static_cast<InnerNode *>(node);
+            parent_slot_lock = parent == nullptr ? &root_lock : &parent->lock;
+            parent_slot = slot;
+            parent = inner;
+            parent_depth = depth;
+            depth += inner->partial_len + 1;
+            slot = edgeSlot(inner, largest);
+            node = slot == nullptr ? nullptr
+                                   : slot->load(std::memory_order_acquire);
+        }
+        if (node == nullptr) {
+            continue;
+        }
+        if (isEvicted(node)) {
+            faultIn(static_cast<EvictedNode *>(node));
+            continue;
+        }
+        if (isBucket(node)) {
+            auto *bucket = static_cast<BucketNode *>(node);
+            auto *leaves = bucket->leaves();
+            auto count = bucket->size();
+            auto *leaf = leaves[largest ? count - 1 : 0];
+            if (ranked) {
+                countPath(Slice(leaf->key.data(), leaf->key.size()), false);
+            }
+            std::span<LeafNode *const> rest(leaves + (largest ? 0 : 1),
+                                            count - 1);
+            if (replaceInBucket(slot,
+                                parent == nullptr ? &root_lock : &parent->lock,
+                                bucket, rest)) {
+                auto pair = copyOut(leaf);
+                retire(leaf);
+                tree_size.fetch_sub(1, std::memory_order_relaxed);
+                return pair;
+            }
+            continue;
+        }
+        auto *leaf = static_cast<LeafNode *>(node);
+        if (ranked) {
+            countPath(Slice(leaf->key.data(), leaf->key.size()), false);
+        }
+        // The leaf outlives its removal until `guard` is released.
+        bool removed = parent == nullptr
+                           ? removeRoot(leaf)
+                           : removeLeaf(parent_slot, parent_slot_lock, parent,
+                                        parent_depth, slot, leaf);
+        if (removed) {
+            return copyOut(leaf);
+        }
+    }
+}
+
+bool ART::removeLeaf(NodeRef *node_slot, WriteLock *node_slot_lock,
+                     InnerNode *node, size_t node_depth, NodeRef *slot,
+                     LeafNode *leaf) {
+    auto byte = slot == &node->prefix_leaf
+                    ? 0
+                    : leaf->key[node_depth + node->partial_len];
+    if (!unlink(node_slot, node_slot_lock, node, node_depth, slot, leaf,
+                byte)) {
+        return false;
+    }
+    retire(leaf);
+    tree_size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Unlinks `entry`, found in `slot` of `node` under `byte`. When the removal
+// leaves `node` underfull, `node` is replaced in `node_slot` by a smaller
+// node, or by its only remaining entry once a Node4 would be left with one.
+// `entry` itself is left to the caller.
+bool ART::unlink(NodeRef *node_slot, WriteLock *node_slot_lock,
+                 InnerNode *node, size_t node_depth, NodeRef *slot,
+                 Node *entry, unsigned char byte) {
+    bool is_prefix_leaf = slot == &node->prefix_leaf;
+    auto needsRebuild = [&] {
+        size_t children = node->children_count.load(std::memory_order_relaxed) -
+                          (is_prefix_leaf ? 0 : 1);
+        size_t entries = children;
+        if (!is_prefix_leaf &&
+            node->prefix_leaf.load(std::memory_order_relaxed) != nullptr) {
+            entries++;
+        }
+        if (node->type == NodeType::Node4) {
+            return entries <= 1;
+        }
+        return children <= shrinkThreshold(node->type);
+    };
+
+    bool rebuild_node = needsRebuild();
+    if (rebuild_node) {
+        node_slot_lock->lock();
+        if (node_slot_lock->isObsolete() ||
+            node_slot->load(std::memory_order_relaxed) != node) {
+            node_slot_lock->unlock();
+            return false;
+        }
+    }
+    auto unlockAll = [&] {
+        node->lock.unlock();
+        if (rebuild_node) {
+            node_slot_lock->unlock();
+        }
+    };
+    node->lock.lock();
+    if (node->lock.isObsolete() ||
+        slot->load(std::memory_order_relaxed) != entry ||
+        needsRebuild() != rebuild_node) {
+        unlockAll();
+        return false;
+    }
+
+    if (!rebuild_node) {
+        if (is_prefix_leaf) {
+            node->prefix_leaf.store(nullptr, std::memory_order_release);
+        } else {
+            removeChild(node, byte);
+        }
+        unlockAll();
+        return true;
+    }
+
+    Node *replacement = nullptr;
+    // The replacement when it is an inner node starting at `node_depth`.
+    InnerNode *successor = nullptr;
+    InnerNode *absorbed = nullptr;
+    if (node->type == NodeType::Node4) {
+        Node *other = nullptr;
+        if (!is_prefix_leaf) {
+            other = node->prefix_leaf.load(std::memory_order_relaxed);
+        }
+        if (other == nullptr) {
+            forEachChild(node, [&](unsigned char, Node *child) {
+                if (child != entry) {
+                    other = child;
+                }
+            });
+        }
+        if (isEvicted(other)) {
+            // The collapse needs the remaining subtree's nodes.
+            unlockAll();
+            faultIn(static_cast<EvictedNode *>(other));
+            return false;
+        }
+        if (isLeaf(other) || isBucket(other)) {
+            replacement = other;
+        } else {
+            // Path compression: the only child takes over this node's
+            // prefix and the byte that led to it.
+            absorbed = static_cast<InnerNode *>(other);
+            absorbed->lock.lock();
+            auto *any = minLeaf(absorbed);
+            if (absorbed->lock.isObsolete() || any == nullptr) {
+                absorbed->lock.unlock();
+                unlockAll();
+                return false;
+            }
+            auto *merged = rebuild(absorbed, absorbed->type);
+            merged->setPrefix(any->key.data() + node_depth,
+                              node->partial_len + 1 + absorbed->partial_len);
+            replacement = successor = merged;
+        }
+    } else {
+        auto *smaller = rebuild(node, shrunkType(node->type));
+        if (is_prefix_leaf) {
+            smaller->prefix_leaf.store(nullptr, std::memory_order_relaxed);
+        } else {
+            removeChild(smaller, byte);
+        }
+        replacement = successor = smaller;
+    }
+
+    if (successor != nullptr) {
+        inheritAnchor(node, successor);
+    }
+    node_slot->store(replacement, std::memory_order_release);
+    node->lock.markObsolete();
+    if (absorbed != nullptr) {
+        // Its keys now start higher up, in `merged`, so an anchor on it is
+        // dropped.
+        absorbed->lock.markObsolete();
+        absorbed->lock.unlock();
+        retireReplaced(absorbed);
+    }
+    unlockAll();
+    retireReplaced(node, successor);
+    return true;
+}
+
+LeafNode *ART::minLeaf(Node *node) {
+    while (node != nullptr && !isLeaf(node)) {
+        if (isEvicted(node)) {
+            return static_cast<EvictedNode *>(node)->anchor;
+        }
+        if (isBucket(node)) {
+            return static_cast<BucketNode *>(node)->leaves()[0];
+        }
+        auto *inner = static_cast<InnerNode *>(node);
+        auto *leaf = inner->prefix_leaf.load(std::memory_order_acquire);
+        if (leaf != nullptr) {
+            return static_cast<LeafNode *>(leaf);
+        }
+        unsigned char byte = 0;
+        node = nextChild(inner, 0, byte);
+    }
+    return static_cast<LeafNode *>(node);
+}
+
+bool ART::leafMatches(LeafNode *leaf, Slice key) {
+    return leaf->key.size() == size_t(key.size()) &&
+           std::memcmp(leaf->key.data(), key.data(), key.size()) == 0;
+}
+
+// Optimistic prefix check used by readers: only the stored bytes of the
+// compressed path are compared, the final leaf comparison covers the rest.
+bool ART::prefixMatches(InnerNode *node, Slice key, size_t depth) {
+    if (depth + node->partial_len > size_t(key.size())) {
+        return false;
+    }
+    auto stored = std::min(node->partial_len, MAX_PARTIAL_LEN);
+    return std::memcmp(node->partial_key.data(), key.data() + depth, stored) ==
+           0;
+}
+
+// Returns the length of the common part of `key[depth..]` and the full
+// compressed path of `node`, or nothing if no leaf could be read to recover
+// the bytes beyond MAX_PARTIAL_LEN.
+std::optional<size_t> ART::prefixMismatch(InnerNode *node, Slice key,
+                                          size_t depth) {
+    auto stored = std::min(node->partial_len, MAX_PARTIAL_LEN);
+    size_t i = 0;
+    for (; i < stored; i++) {
+        if (depth + i >= size_t(key.size()) ||
+            node->partial_key[i] != key[depth + i]) {
+            return i;
+        }
+    }
+    if (node->partial_len <= MAX_PARTIAL_LEN) {
+        return i;
+    }
+    auto *any = minLeaf(node);
+    if (any == nullptr) {
+        return std::nullopt;
+    }
+    for (; i < node->partial_len; i++) {
+        if (depth + i >= size_t(key.size()) ||
+            any->key[depth + i] != key[depth + i]) {
+            return i;
+        }
+    }
+    return i;
+}
+
+// Puts `leaf` below a node that is not yet published. `depth` is where the
+// node's prefix ends.
+void ART::placeLeaf(InnerNode *node, LeafNode *leaf, size_t depth) {
+    if (leaf->key.size() == depth) {
+        node->prefix_leaf.store(leaf, std::memory_order_relaxed);
+    } else {
+        addChild(node, leaf->key[depth], leaf);
+    }
+}
+
+// Builds an unpublished bucket holding `leaves`, sorted by key.
+BucketNode *ART::newBucket(std::span<LeafNode *const> leaves) {
+    auto &first = leaves.front()->key;
+    auto &last = leaves.back()->key;
+    size_t offset = 0;
+    while (offset < first.size() && offset < last.size() &&
+           first[offset] == last[offset]) {
+        offset++;
+    }
+    auto count = leaves.size();
+    void *p = resource->allocate(BucketNode::bytes(count), alignof(BucketNode));
+    auto *bucket = new (p) BucketNode(uint32_t(count), uint32_t(offset));
+    auto *slots = const_cast<LeafNode **>(bucket->leaves());
+    auto *heads = const_cast<uint32_t *>(bucket->heads());
+    for (size_t i = 0; i < count; i++) {
+        slots[i] = leaves[i];
+        heads[i] = BucketNode::head(
+            Slice(leaves[i]->key.data(), leaves[i]->key.size()), offset);
+    }
+    return bucket;
+}
+
+// Swaps `bucket` in `slot` for one holding `leaves` instead, or the leaf
+// itself if only one is left. Leaves that drop out are left to the caller.
+// Returns false if a concurrent writer replaced the bucket first.
+bool ART::replaceInBucket(NodeRef *slot, WriteLock *slot_lock,
+                          BucketNode *bucket,
+                          std::span<LeafNode *const> leaves) {
+    slot_lock->lock();
+    if (slot_lock->isObsolete() ||
+        slot->load(std::memory_order_relaxed) != bucket) {
+        slot_lock->unlock();
+        return false;
+    }
+    Node *replacement =
+        leaves.size() == 1 ? static_cast<Node *>(leaves[0]) : newBucket(leaves);
+    slot->store(replacement, std::memory_order_release);
+    slot_lock->unlock();
+    retire(bucket);
+    return true;
+}
+
+// Builds an unpublished copy of `node` with type `type`, holding the same
+// prefix and entries.
+InnerNode *ART::rebuild(InnerNode *node, NodeType type) {
+    auto *copy = newNode(type, resource);
+    copy->partial_len = node->partial_len;
+    copy->partial_key = node->partial_key;
+    copy->leaves.store(node->leaves.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    copy->prefix_leaf.store(node->prefix_leaf.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+    forEachChild(node, [&](unsigned char byte, Node *child) {
+        addChild(copy, byte, child);
+    });
+    return copy;
+}
+
+// Points `slot`, `slot_lock` and `depth` at the deepest node of `finger`
+// that lies on the path of `key` and trims the finger to the nodes above it.
+// Returns the structure version the descent runs against.
+uint64_t ART::resume(Finger *finger, Slice key, NodeRef *&slot,
+                     WriteLock *&slot_lock, size_t &depth) {
+    auto version = structure_version.load(std::memory_order_seq_cst);
+    if (finger == nullptr) {
+        return version;
+    }
+    if (finger->tree != this || finger->version != version) {
+        finger->path.clear();
+        return version;
+    }
+    size_t common = 0;
+    auto limit = std::min(finger->key.size(), size_t(key.size()));
+    while (common < limit && finger->key[common] == key[common]) {
+        common++;
+    }
+    auto &path = finger->path;
+    while (!path.empty() && path.back().depth > common) {
+        path.pop_back();
+    }
+    if (!path.empty()) {
+        slot = path.back().slot;
+        slot_lock = path.back().slot_lock;
+        depth = path.back().depth;
+        path.pop_back();
+    }
+    return version;
+}
+
+// Keeps the first `keep` entries of the path just walked for the next hinted
+// operation, provided no other writer replaced an inner node meanwhile.
+void ART::record(Finger *finger, Slice key, uint64_t version, bool replaced,
+                 size_t keep) {
+    if (finger == nullptr) {
+        return;
+    }
+    auto expected = version + (replaced ? 1 : 0);
+    if (structure_version.load(std::memory_order_seq_cst) != expected) {
+        finger->path.clear();
+        return;
+    }
+    if (keep < finger->path.size()) {
+        finger->path.resize(keep);
+    }
+    finger->tree = this;
+    finger->version = expected;
+    finger->key.assign(key.begin(), key.end());
+}
+
+// Flags `successor`, which takes the slot of the learned root anchor `node`,
+// while the writer still holds both locks: whoever replaces `successor`
+// next then knows to carry the anchor on.
+void ART::inheritAnchor(InnerNode *node, InnerNode *successor) {
+    if (node->anchored.load(std::memory_order_seq_cst)) {
+        successor->anchored.store(true, std::memory_order_seq_cst);
+    }
+}
+
+// Retires an inner node that has just been swapped out of its slot. Fingers
+// may still point at it, so they are invalidated before it can be freed.
+// `successor`, if any, took the slot and holds the same keys from the same
+// depth.
+void ART::retireReplaced(InnerNode *node, InnerNode *successor) {
+    structure_version.fetch_add(1, std::memory_order_seq_cst);
+    // Pairs with the flag store in trainLearnedRoot: either that sees the
+    // version move, or this sees the flag.
+    if (node->anchored.load(std::memory_order_seq_cst)) {
+        repointAnchor(node, successor);
+    }
+    retire(node);
+}
+
+// Points the learned root anchor on `node`, which was just replaced, at
+// `successor`, or drops it. Only that subtree's jumps change. The mutex
+// orders this after a training that picked up `node`, and after a writer
+// that replaced `successor` in turn and left it obsolete; `successor` is
+// only trusted if it inherited the flag under the writer's locks.
+void ART::repointAnchor(InnerNode *node, InnerNode *successor) {
+    auto *any = minLeaf(node);
+    std::lock_guard lock(learned->mutex);
+    auto *model = learned->model.load(std::memory_order_relaxed);
+    if (model == nullptr) {
+        return;
+    }
+    auto &anchors = model->anchors;
+    auto owns = [&](size_t i) {
+        return anchors[i].node.load(std::memory_order_relaxed) == node;
+    };
+    size_t i = 0;
+    if (any != nullptr) {
+        i = model->find(keyValue(Slice(any->key.data(), any->key.size()),
+                                 learned->key_width));
+        // Otherwise the flag is left from an earlier model.
+        if (i == SIZE_MAX || !owns(i)) {
+            return;
+        }
+    } else {
+        while (i < anchors.size() && !owns(i)) {
+            i++;
+        }
+        if (i == anchors.size()) {
+            return;
+        }
+    }
+    if (successor != nullptr &&
+        (!successor->anchored.load(std::memory_order_seq_cst) ||
+         successor->lock.isObsolete())) {
+        successor = nullptr;
+    }
+    anchors[i].node.store(successor, std::memory_order_release);
+}
+
+void ART::enable_key_compression(
+    std::shared_ptr<const KeyCompressor> compressor) {
+    this->compressor = std::move(compressor);
+}
+
+void ART::enable_rank() {
+    if (eviction != nullptr) {
+        throw std::invalid_argument("rank cannot be combined with eviction");
+    }
+    ranked = true;
+}
+
+void ART::enable_learned_root(size_t key_width) {
+    if (key_width == 0 || key_width > sizeof(uint64_t)) {
+        throw std::invalid_argument("learned root needs keys of 1 to 8 bytes");
+    }
+    if (compressor != nullptr) {
+        throw std::invalid_argument("learned root needs plain keys");
+    }
+    learned = std::make_unique<LearnedRoot>(key_width);
+}
+
+size_t ART::retrain_learned_root() {
+    if (learned == nullptr) {
+        return 0;
+    }
+    std::lock_guard lock(learned->mutex);
+    return trainLearnedRoot();
+}
+
+// Subtrees the learned root can jump to right now.
+size_t ART::learned_jumps() {
+    if (learned == nullptr) {
+        return 0;
+    }
+    Epoch::Guard guard;
+    auto *model = learned->model.load(std::memory_order_acquire);
+    if (model == nullptr ||
+        model->version != anchor_version.load(std::memory_order_seq_cst)) {
+        return 0;
+    }
+    size_t jumps = 0;
+    for (auto &anchor : model->anchors) {
+        jumps += anchor.node.load(std::memory_order_acquire) != nullptr;
+    }
+    return jumps;
+}
+
+// The subtree the learned root predicts for `key`, with the depth its path
+// starts at, or nullptr to descend from the root. The caller is inside an
+// epoch. Only keys the model covers count as misses, and lookups never
+// retrain: retrainIfDue does on the next write.
+InnerNode *ART::jumpTarget(Slice key, size_t &depth) {
+    auto width = learned->key_width;
+    auto *model = learned->model.load(std::memory_order_acquire);
+    if (model == nullptr || size_t(key.size()) != width) {
+        return nullptr;
+    }
+    auto value = keyValue(key, width);
+    auto i = model->find(value);
+    if (i == SIZE_MAX) {
+        return nullptr;
+    }
+    auto &anchor = model->anchors[i];
+    // The anchor holds every key that shares its first bytes.
+    if ((value ^ anchor.low) >> (8 * (width - anchor.depth)) != 0) {
+        return nullptr;
+    }
+    auto *node = anchor.node.load(std::memory_order_acquire);
+    if (node != nullptr &&
+        model->version == anchor_version.load(std::memory_order_seq_cst)) {
+        depth = anchor.depth;
+        return node;
+    }
+    learned->misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+// Called after each write. Retrains the learned root once the lookups it
+// covers keep missing, or once the writes since the last training add up to
+// the tree's size then, so new key ranges are picked up too. A writer that
+// finds training under way leaves it to that one.
+void ART::retrainIfDue() {
+    auto due = [&] {
+        return learned->writes.load(std::memory_order_relaxed) >=
+                   learned->write_limit.load(std::memory_order_relaxed) ||
+               learned->misses.load(std::memory_order_relaxed) >=
+                   learned->miss_limit.load(std::memory_order_relaxed);
+    };
+    learned->writes.fetch_add(1, std::memory_order_relaxed);
+    if (!due()) {
+        return;
+    }
+    std::unique_lock lock(learned->mutex, std::try_to_lock);
+    if (lock.owns_lock() && due()) {
+        trainLearnedRoot();
+    }
+}
+
+// Replaces the learned root's model with one fitted to the current top
+// levels of the tree and returns its number of subtrees. The caller holds
+// the learned root's mutex.
+size_t ART::trainLearnedRoot() {
+    using Anchor = LearnedRoot::Anchor;
+    using Model = LearnedRoot::Model;
+    auto width = learned->key_width;
+    learned->misses.store(0, std::memory_order_relaxed);
+    learned->writes.store(0, std::memory_order_relaxed);
+    learned->write_limit.store(
+        MIN_RETRAIN_MISSES + tree_size.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    Epoch::Guard guard;
+    auto install = [&](Model *model) {
+        auto anchors = model == nullptr ? 0 : model->anchors.size();
+        learned->miss_limit.store(MIN_RETRAIN_MISSES + anchors,
+                                  std::memory_order_relaxed);
+        auto *old = learned->model.exchange(model, std::memory_order_acq_rel);
+        if (old != nullptr) {
+            Epoch::global().retire(old, [](void *ptr, void *) {
+                delete static_cast<Model *>(ptr);
+            });
+        }
+        return anchors;
+    };
+    // A writer replacing a node on the top levels meanwhile may miss the
+    // flags; give it a few tries before keeping the current model.
+    for (int attempt = 0; attempt < 3; attempt++) {
+        auto model = std::make_unique<Model>();
+        model->version = anchor_version.load(std::memory_order_seq_cst);
+        auto version = structure_version.load(std::memory_order_seq_cst);
+        auto *top = root.load(std::memory_order_acquire);
+        if (top == nullptr || !isInner(top)) {
+            return install(nullptr);
+        }
+        model->anchors.push_back({0, static_cast<InnerNode *>(top), 0});
+        size_t levels = 1;
+        for (; levels < LEARNED_LEVELS; levels++) {
+            std::vector<Anchor> anchors;
+            for (auto &anchor : model->anchors) {
+                auto low = anchor.low;
+                auto depth = anchor.depth;
+                auto *node = anchor.node.load(std::memory_order_relaxed);
+                auto [path, len] = pathBytes(node, depth);
+                if (path == nullptr) {
+                    continue;
+                }
+                for (size_t j = 0; j < len; j++) {
+                    low = withByte(low, width, depth + j, path[j]);
+                }
+                auto child_depth = depth + len + 1;
+                if (child_depth >= width) {
+                    continue;
+                }
+                forEachChild(node, [&](unsigned char byte, Node *child) {
+                    if (!isInner(child)) {
+                        return;
+                    }
+                    anchors.push_back({withByte(low, width, depth + len, byte),
+                                       static_cast<InnerNode *>(child),
+                                       child_depth});
+                });
+            }
+            if (anchors.empty() || anchors.size() > MAX_ANCHORS) {
+                break;
+            }
+            model->anchors = std::move(anchors);
+        }
+        if (levels == 1) {
+            // Nothing to skip below the root.
+            return install(nullptr);
+        }
+        for (auto &anchor : model->anchors) {
+            anchor.node.load(std::memory_order_relaxed)
+                ->anchored.store(true, std::memory_order_seq_cst);
+        }
+        if (structure_version.load(std::memory_order_seq_cst) != version) {
+            continue;
+        }
+        model->fit();
+        return install(model.release());
+    }
+    auto *model = learned->model.load(std::memory_order_relaxed);
+    return model == nullptr ? 0 : model->anchors.size();
+}
+
+// Adjusts the leaf counts of the inner nodes on the path of `key`, which is
+// in the tree. Only the writer changes the path, so it is stable meanwhile.
+void ART::countPath(Slice key, bool added) {
+    Epoch::Guard guard;
+    Node *node = root.load(std::memory_order_acquire);
+    size_t depth = 0;
+    while (node != nullptr && isInner(node)) {
+        auto *inner = static_cast<InnerNode *>(node);
+        if (added) {
+            inner->leaves.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            inner->leaves.fetch_sub(1, std::memory_order_relaxed);
+        }
+        depth += inner->partial_len;
+        if (depth == size_t(key.size())) {
+            break;
+        }
+        node = loadChild(inner, key[depth++]);
+    }
+}
+
+size_t ART::leafCount(Node *node) {
+    if (isLeaf(node)) {
+        return 1;
+    }
+    if (isBucket(node)) {
+        return static_cast<BucketNode *>(node)->size();
+    }
+    return static_cast<InnerNode *>(node)->leaves.load(
+        std::memory_order_relaxed);
+}
+
+size_t ART::rank(Slice key) {
+    ARTData buffer;
+    key = storedKey(key, buffer);
+    Epoch::Guard guard;
+    size_t rank = 0;
+    Node *node = root.load(std::memory_order_acquire);
+    size_t depth = 0;
+    auto keyLen = size_t(key.size());
+    while (node != nullptr) {
+        if (isLeaf(node)) {
+            auto *leaf = static_cast<LeafNode *>(node);
+            if (std::lexicographical_compare(leaf->key.begin(),
+                                             leaf->key.end(), key.begin(),
+                                             key.end())) {
+                rank++;
+            }
+            break;
+        }
+        if (isBucket(node)) {
+            rank += static_cast<BucketNode *>(node)->lowerBound(key);
+            break;
+        }
+        auto *inner = static_cast<InnerNode *>(node);
+        auto [path, len] = pathBytes(inner, depth);
+        if (path == nullptr) {
+            break;
+        }
+        auto n = std::min(len, keyLen - depth);
+        auto cmp = n == 0 ? 0 : std::memcmp(path, key.data() + depth, n);
+        if (cmp < 0) {
+            rank += leafCount(inner);
+            break;
+        }
+        if (cmp > 0 || n < len) {
+            break;
+        }
+        depth += len;
+        if (depth == keyLen) {
+            break;
+        }
+        if (inner->prefix_leaf.load(std::memory_order_acquire) != nullptr) {
+            rank++;
+        }
+        auto byte = key[depth++];
+        forEachChild(inner, [&](unsigned char b, Node *child) {
+            if (b < byte) {
+                rank += leafCount(child);
+            }
+        });
+        node = loadChild(inner, byte);
+    }
+    return rank;
+}
+
+ART::Iterator ART::seek_rank(size_t rank,
+                             std::pmr::memory_resource *scratch) {
+    Epoch::Guard guard;
+    Node *node = root.load(std::memory_order_acquire);
+    while (node != nullptr && !isLeaf(node)) {
+        if (isBucket(node)) {
+            auto *bucket = static_cast<BucketNode *>(node);
+            node = rank < bucket->size() ? bucket->leaves()[rank] : nullptr;
+            rank = 0;
+            break;
+        }
+        auto *inner = static_cast<InnerNode *>(node);
+        if (auto *pl = inner->prefix_leaf.load(std::memory_order_acquire)) {
+            if (rank == 0) {
+                node = pl;
+                break;
+            }
+            rank--;
+        }
+        Node *next = nullptr;
+        forEachChild(inner, [&](unsigned char, Node *child) {
+            if (next != nullptr) {
+                return;
+            }
+            auto count = leafCount(child);
+            if (rank < count) {
+                next = child;
+            } else {
+                rank -= count;
+            }
+        });
+        node = next;
+    }
+    if (node == nullptr || rank != 0) {
+        return Iterator(this, scratch);
+    }
+    auto *leaf = static_cast<LeafNode *>(node);
+    return lowerBound(Slice(leaf->key.data(), leaf->key.size()), scratch);
+}
+
+void ART::enable_dedup(size_t min_bytes) {
+    if (store == nullptr) {
+        store = std::make_unique<ValueStore>(resource);
+    }
+    dedup_min_bytes = min_bytes;
+}
+
+LeafNode *ART::newLeaf(Slice key, std::span<const uint8_t> value) {
+    if (value.size() >= dedup_min_bytes) {
+        auto *shared = store->acquire(value);
+        try {
+            return create<LeafNode>(resource, key, shared, resource);
+        } catch (...) {
+            store->release(shared);
+            throw;
+        }
+    }
+    return create<LeafNode>(resource, key, value,
+                            value.size() +
+                                value_slack.load(std::memory_order_relaxed),
+                            resource);
+}
+
+void ART::retire(Node *node) {
+    Epoch::global().retire(
+        node,
+        [](void *ptr, void *ctx) {
+            destroyNode(static_cast<std::pmr::memory_resource *>(ctx),
+                        static_cast<Node *>(ptr));
+        },
+        resource);
+}
+
+void ART::freeSubtree(Node *node) {
+    if (node == nullptr) {
+        return;
+    }
+    if (isEvicted(node)) {
+        auto *stub = static_cast<EvictedNode *>(node);
+        eviction->file.release(stub->page);
+        eviction->evicted_pairs.fetch_sub(stub->count,
+                                          std::memory_order_relaxed);
+    } else if (isBucket(node)) {
+        auto *bucket = static_cast<BucketNode *>(node);
+        for (size_t i = 0; i < bucket->size(); i++) {
+            destroyNode(resource, bucket->leaves()[i]);
+        }
+    } else if (!isLeaf(node)) {
+        auto *inner = static_cast<InnerNode *>(node);
+        freeSubtree(inner->prefix_leaf.load(std::memory_order_relaxed));
+        forEachChild(inner, [this](unsigned char, Node *child) {
+            freeSubtree(child);
+        });
+    }
+    destroyNode(resource, node);
+}
+
+// Destroys `node` and everything below it, none of it evicted.
+void ART::destroyTree(std::pmr::memory_resource *resource, Node *node) {
+    if (node == nullptr) {
+        return;
+    }
+    if (isBucket(node)) {
+        auto *bucket = static_cast<BucketNode *>(node);
+        for (size_t i = 0; i < bucket->size(); i++) {
+            destroyNode(resource, bucket->leaves()[i]);
+        }
+    } else if (!isLeaf(node)) {
+        auto *inner = static_cast<InnerNode *>(node);
+        destroyTree(resource,
+                    inner->prefix_leaf.load(std::memory_order_relaxed));
+        forEachChild(inner, [resource](unsigned char, Node *child) {
+            destroyTree(resource, child);
+        });
+    }
+    destroyNode(resource, node);
+}
+
+size_t ART::countLeaves(Node *node) {
+    if (node == nullptr) {
+        return 0;
+    }
+    if (isLeaf(node)) {
+        return 1;
+    }
+    if (isBucket(node)) {
+        return static_cast<BucketNode *>(node)->size();
+    }
+    auto *inner = static_cast<InnerNode *>(node);
+    size_t count =
+        countLeaves(inner->prefix_leaf.load(std::memory_order_acquire));
+    forEachChild(inner, [&count](unsigned char, Node *child) {
+        count += countLeaves(child);
+    });
+    return count;
+}
+
+void ART::enable_eviction(const EvictionOptions &options) {
+    if (ranked || bucket_capacity != 0) {
+        throw std::invalid_argument(
+            "eviction cannot be combined with rank or buckets");
+    }
+    eviction = std::make_unique<Eviction>(options);
+}
+
+void ART::enable_buckets(size_t capacity) {
+    if (capacity < 2 || capacity > BucketNode::MAX_CAPACITY) {
+        throw std::invalid_argument("bucket capacity out of range");
+    }
+    if (eviction != nullptr) {
+        throw std::invalid_argument("buckets cannot be combined with eviction");
+    }
+    bucket_capacity = capacity;
+}
+
+size_t ART::resident() const {
+    auto total = tree_size.load(std::memory_order_relaxed);
+    if (eviction == nullptr) {
+        return total;
+    }
+    auto evicted = eviction->evicted_pairs.load(std::memory_order_relaxed);
+    return total > evicted ? total - evicted : 0;
+}
+
+size_t ART::evict(size_t units) {
+    std::lock_guard lock(eviction->mutex);
+    return runReplacement(units, false);
+}
+
+// Called by writers: evicts a few subtrees while the tree is over budget,
+// unless another thread is already doing so.
+void ART::balance() {
+    auto limit = eviction->options.max_resident;
+    if (resident() <= limit) {
+        return;
+    }
+    std::unique_lock lock(eviction->mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    for (size_t i = 0; i < BALANCE_UNITS && resident() > limit; i++) {
+        if (runReplacement(1, true) == 0) {
+            break;
+        }
+    }
+}
+
+// Moves candidates through the cooling stage until `units` subtrees have
+// been written out. With `aged`, only candidates queued by an earlier run
+// are considered, so each one has had time to be touched. Runs under the
+// eviction mutex.
+size_t ART::runReplacement(size_t units, bool aged) {
+    Epoch::Guard guard;
+    auto &ev = *eviction;
+    auto round = ++ev.round;
+    std::vector<Node *> choices;
+    // Descends along random children to the first unit-sized subtree.
+    auto sampleUnit = [&]() -> bool {
+        Node *node = root.load(std::memory_order_acquire);
+        size_t depth = 0;
+        while (node != nullptr && !isLeaf(node) && !isEvicted(node)) {
+            auto *inner = static_cast<InnerNode *>(node);
+            if (depth >= ev.options.unit_depth) {
+                auto *any = minLeaf(inner);
+                if (any == nullptr ||
+                    inner->cooling.exchange(true, std::memory_order_relaxed)) {
+                    return false;
+                }
+                ev.cooling.push_back({ARTData(any->key.begin(), any->key.end()),
+                                      depth, inner, round});
+                return true;
+            }
+            choices.clear();
+            forEachChild(inner, [&](unsigned char, Node *child) {
+                choices.push_back(child);
+            });
+            if (choices.empty()) {
+                return false;
+            }
+            depth += inner->partial_len + 1;
+            node = choices[ev.rng() % choices.size()];
+        }
+        return false;
+    };
+
+    size_t evicted = 0;
+    size_t misses = 0;
+    while (evicted < units && misses < MAX_REPLACEMENT_MISSES) {
+        while (ev.cooling.size() < std::max<size_t>(ev.options.cooling, 1) &&
+               misses < MAX_REPLACEMENT_MISSES) {
+            if (!sampleUnit()) {
+                misses++;
+            }
+        }
+        if (ev.cooling.empty() || (aged && ev.cooling.front().round == round)) {
+            break;
+        }
+        auto candidate = std::move(ev.cooling.front());
+        ev.cooling.pop_front();
+        NodeRef *slot = nullptr;
+        WriteLock *slot_lock = nullptr;
+        Slice anchor(candidate.anchor.data(), candidate.anchor.size());
+        // A candidate that was touched or replaced while cooling stays.
+        if (!locate(anchor, candidate.depth, candidate.node, slot,
+                    slot_lock) ||
+            !candidate.node->cooling.load(std::memory_order_relaxed)) {
+            misses++;
+        } else if (evictUnit(slot, slot_lock, candidate.node,
+                             candidate.depth)) {
+            evicted++;
+        } else {
+            candidate.node->cooling.store(false, std::memory_order_relaxed);
+            misses++;
+        }
+    }
+    return evicted;
+}
+
+// Finds the slot that holds `target`, an inner node whose compressed path
+// starts at `depth` on the path of `anchor`.
+bool ART::locate(Slice anchor, size_t depth, InnerNode *target,
+                 NodeRef *&slot, WriteLock *&slot_lock) {
+    slot = &root;
+    slot_lock = &root_lock;
+    size_t d = 0;
+    Node *node = root.load(std::memory_order_acquire);
+    while (node != nullptr && !isLeaf(node) && !isEvicted(node)) {
+        auto *inner = static_cast<InnerNode *>(node);
+        if (d >= depth) {
+            return d == depth && inner == target;
+        }
+        d += inner->partial_len;
+        if (d >= size_t(anchor.size())) {
+            return false;
+        }
+        slot = findChild(inner, anchor[d]);
+        if (slot == nullptr) {
+            return false;
+        }
+        slot_lock = &inner->lock;
+        d++;
+        node = slot->load(std::memory_order_acquire);
+    }
+    return false;
+}
+
+// Writes the subtree of `node` to the page file and leaves a stub in its
+// slot. The whole subtree is locked top-down, the order writers lock in, so
+// no insert or removal can slip in while its pairs are copied out.
+bool ART::evictUnit(NodeRef *slot, WriteLock *slot_lock, InnerNode *node,
+                    size_t depth) {
+    slot_lock->lock();
+    if (slot_lock->isObsolete() ||
+        slot->load(std::memory_order_relaxed) != node) {
+        slot_lock->unlock();
+        return false;
+    }
+    std::vector<InnerNode *> locked;
+    std::vector<LeafNode *> leaves;
+    auto collect = [&](auto &self, InnerNode *inner) -> bool {
+        inner->lock.lock();
+        locked.push_back(inner);
+        if (inner->lock.isObsolete()) {
+            return false;
+        }
+        if (auto *pl = inner->prefix_leaf.load(std::memory_order_relaxed)) {
+            leaves.push_back(static_cast<LeafNode *>(pl));
+        }
+        bool ok = true;
+        forEachChild(inner, [&](unsigned char, Node *child) {
+            if (!ok) {
+                return;
+            }
+            if (isLeaf(child)) {
+                leaves.push_back(static_cast<LeafNode *>(child));
+            } else if (isEvicted(child)) {
+                ok = false;
+            } else {
+                ok = self(self, static_cast<InnerNode *>(child));
+            }
+        });
+        return ok;
+    };
+    auto unlockAll = [&] {
+        for (auto *inner : locked) {
+            inner->lock.unlock();
+        }
+        slot_lock->unlock();
+    };
+    if (!collect(collect, node) || leaves.empty()) {
+        unlockAll();
+        return false;
+    }
+
+    EvictedNode *stub = nullptr;
+    try {
+        // Page layout: pair count, then per pair the key and value lengths
+        // followed by the key and value bytes, in key order.
+        std::vector<uint8_t> page;
+        putU32(page, leaves.size());
+        for (auto *leaf : leaves) {
+            auto value = leaf->value();
+            putU32(page, leaf->key.size());
+            putU32(page, value.size());
+            page.insert(page.end(), leaf->key.begin(), leaf->key.end());
+            page.insert(page.end(), value.begin(), value.end());
+        }
+        auto extent = eviction->file.write(page);
+        LeafNode *anchor = nullptr;
+        try {
+            anchor = create<LeafNode>(
+                resource, Slice(leaves[0]->key.data(), leaves[0]->key.size()),
+                std::span<const uint8_t>(), 0, resource);
+            stub = create<EvictedNode>(resource, extent, leaves.size(), depth,
+                                       anchor);
+        } catch (...) {
+            if (anchor != nullptr) {
+                destroyNode(resource, anchor);
+            }
+            eviction->file.release(extent);
+            throw;
+        }
+    } catch (...) {
+        unlockAll();
+        throw;
+    }
+
+    slot->store(stub, std::memory_order_release);
+    for (auto *inner : locked) {
+        inner->lock.markObsolete();
+    }
+    unlockAll();
+    eviction->evicted_pairs.fetch_add(leaves.size(),
+                                      std::memory_order_relaxed);
+    structure_version.fetch_add(1, std::memory_order_seq_cst);
+    anchor_version.fetch_add(1, std::memory_order_seq_cst);
+    for (auto *inner : locked) {
+        retire(inner);
+    }
+    for (auto *leaf : leaves) {
+        retire(leaf);
+    }
+    return true;
+}
+
+// Loads the subtree of `stub` back into its slot. Returns the node now
+// found at the stub's position, which is the loaded subtree unless another
+// thread loaded it first and the tree changed since, or nullptr if nothing
+// is left there.
+Node *ART::faultIn(EvictedNode *stub) {
+    Epoch::Guard guard;
+    auto &anchor = stub->anchor->key;
+    Slice key(anchor.data(), anchor.size());
+    while (true) {
+        NodeRef *slot = &root;
+        WriteLock *slot_lock = &root_lock;
+        size_t depth = 0;
+        Node *node = root.load(std::memory_order_acquire);
+        while (node != stub) {
+            if (node == nullptr || isLeaf(node) || isEvicted(node)) {
+                return node;
+            }
+            auto *inner = static_cast<InnerNode *>(node);
+            if (depth + inner->partial_len >= stub->depth) {
+                return inner;
+            }
+            depth += inner->partial_len;
+            slot = findChild(inner, key[depth]);
+            if (slot == nullptr) {
+                return nullptr;
+            }
+            slot_lock = &inner->lock;
+            depth++;
+            node = slot->load(std::memory_order_acquire);
+        }
+        slot_lock->lock();
+        if (slot_lock->isObsolete() ||
+            slot->load(std::memory_order_relaxed) != stub) {
+            slot_lock->unlock();
+            continue;
+        }
+        Node *loaded = nullptr;
+        try {
+            loaded = loadSubtree(stub);
+        } catch (...) {
+            slot_lock->unlock();
+            throw;
+        }
+        slot->store(loaded, std::memory_order_release);
+        slot_lock->unlock();
+        eviction->file.release(stub->page);
+        eviction->evicted_pairs.fetch_sub(stub->count,
+                                          std::memory_order_relaxed);
+        retire(stub);
+        return loaded;
+    }
+}
+
+Node *ART::loadSubtree(EvictedNode *stub) {
+    auto page = eviction->file.read(stub->page);
+    const uint8_t *in = page.data();
+    auto count = getU32(in);
+    std::vector<LeafNode *> leaves;
+    leaves.reserve(count);
+    try {
+        for (uint32_t i = 0; i < count; i++) {
+            auto klen = getU32(in);
+            auto vlen = getU32(in);
+            leaves.push_back(newLeaf(Slice(in, klen),
+                                     std::span<const uint8_t>(in + klen, vlen)));
+            in += klen + vlen;
+        }
+    } catch (...) {
+        for (auto *leaf : leaves) {
+            destroyNode(resource, leaf);
+        }
+        throw;
+    }
+    return buildSubtree(leaves, stub->depth);
+}
+
+// Builds the subtree holding `leaves`, sorted by key, whose compressed path
+// starts at `depth`.
+Node *ART::buildSubtree(std::span<LeafNode *const> leaves, size_t depth) {
+    if (leaves.size() == 1) {
+        return leaves[0];
+    }
+    if (leaves.size() <= bucket_capacity) {
+        return newBucket(leaves);
+    }
+    auto &first = leaves.front()->key;
+    auto &last = leaves.back()->key;
+    // Keys are sorted, so the first and last share the longest common path.
+    size_t common = 0;
+    while (depth + common < first.size() && depth + common < last.size() &&
+           first[depth + common] == last[depth + common]) {
+        common++;
+    }
+    auto end = depth + common;
+    size_t begin = first.size() == end ? 1 : 0;
+    size_t groups = 0;
+    for (size_t i = begin; i < leaves.size(); i++) {
+        if (i == begin || leaves[i]->key[end] != leaves[i - 1]->key[end]) {
+            groups++;
+        }
+    }
+    auto type = groups <= 4    ? NodeType::Node4
+                : groups <= 16 ? NodeType::Node16
+                : groups <= 48 ? NodeType::Node48
+                               : NodeType::Node256;
+    auto *inner = newNode(type, resource);
+    inner->setPrefix(first.data() + depth, common);
+    inner->leaves.store(leaves.size(), std::memory_order_relaxed);
+    if (begin == 1) {
+        inner->prefix_leaf.store(leaves[0], std::memory_order_relaxed);
+    }
+    for (size_t i = begin; i < leaves.size();) {
+        auto byte = leaves[i]->key[end];
+        size_t j = i + 1;
+        while (j < leaves.size() && leaves[j]->key[end] == byte) {
+            j++;
+        }
+        addChild(inner, byte, buildSubtree(leaves.subspan(i, j - i), end + 1));
+        i = j;
+    }
+    return inner;
+}
+
+// Returns what an iterator should visit in place of `node`: the node
+// itself, or for a stub whatever holds its position once loaded.
+Node *ART::resolve(Node *node) {
+    while (node != nullptr && isEvicted(node)) {
+        node = faultIn(static_cast<EvictedNode *>(node));
+    }
+    return node;
+}
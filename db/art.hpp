@@ -1,99 +1,643 @@
 #pragma once
 #include <array>
 #include <atomic>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <span>
+#include <string>
 #include <string_view>
 #include <sys/types.h>
+#include <utility>
 #include <vector>
 
+#include "epoch.hpp"
+#include "key_compressor.hpp"
+#include "node_arena.hpp"
+#include "page_file.hpp"
 #include "slice.hpp"
+#include "value_store.hpp"
 
 namespace art {
 
 using ARTData = std::vector<uint8_t>;
-enum class NodeType : uint8_t { Node4, Node16, Node48, Node256, Leaf };
+enum class NodeType : uint8_t {
+  Node4,
+  Node16,
+  Node48,
+  Node256,
+  Leaf,
+  Evicted,
+  Bucket
+};
 inline constexpr size_t MAX_PARTIAL_LEN = 10;
 
 // Abstract base class of all type of node. It knows nothing but its type.
 class Node {
 public:
+  explicit Node(NodeType type) : type(type) {}
   virtual ~Node() = default;
 
   NodeType type;
+  // Nonzero hash of a leaf's key, 0 for every other node.
+  uint16_t fingerprint = 0;
+};
+
+#ifdef ARTIKV_COMPRESSED_REFS
+// Child reference stored as a 32-bit offset into `NodeArena::global()`, in
+// units of the arena's alignment; 0 is null. It offers the same interface
+// as the pointer-sized reference below, but has no room for fingerprints.
+class NodeRef {
+public:
+  NodeRef(Node *node = nullptr) : word(encode(node)) {}
+  NodeRef(const NodeRef &) = delete;
+  NodeRef &operator=(const NodeRef &) = delete;
+
+  Node *load(std::memory_order order = std::memory_order_seq_cst) const {
+    return decode(word.load(order));
+  }
+  void store(Node *node, std::memory_order order = std::memory_order_seq_cst) {
+    word.store(encode(node), order);
+  }
+  Node *exchange(Node *node,
+                 std::memory_order order = std::memory_order_seq_cst) {
+    return decode(word.exchange(encode(node), order));
+  }
+  std::pair<Node *, uint16_t>
+  load_tagged(std::memory_order order = std::memory_order_seq_cst) const {
+    return {load(order), 0};
+  }
+
+private:
+  static uint32_t encode(Node *node) {
+    if (node == nullptr) {
+      return 0;
+    }
+    auto offset = reinterpret_cast<const std::byte *>(node) -
+                  NodeArena::global().base();
+    return uint32_t(size_t(offset) / NodeArena::ALIGNMENT);
+  }
+  static Node *decode(uint32_t word) {
+    if (word == 0) {
+      return nullptr;
+    }
+    auto *p = NodeArena::global().base() + size_t(word) * NodeArena::ALIGNMENT;
+    return reinterpret_cast<Node *>(const_cast<std::byte *>(p));
+  }
+
+  std::atomic<uint32_t> word;
+};
+static_assert(sizeof(NodeRef) == 4);
+#else
+// Atomic child reference. User-space pointers leave the top 16 bits unused
+// on the 64-bit targets we build for, so the reference keeps the
+// fingerprint of a leaf there: a lookup can reject a leaf whose key differs
+// without loading it, and pointer and fingerprint are published together.
+class NodeRef {
+public:
+  NodeRef(Node *node = nullptr) : word(encode(node)) {}
+  NodeRef(const NodeRef &) = delete;
+  NodeRef &operator=(const NodeRef &) = delete;
+
+  Node *load(std::memory_order order = std::memory_order_seq_cst) const {
+    return decode(word.load(order));
+  }
+  void store(Node *node, std::memory_order order = std::memory_order_seq_cst) {
+    word.store(encode(node), order);
+  }
+  Node *exchange(Node *node,
+                 std::memory_order order = std::memory_order_seq_cst) {
+    return decode(word.exchange(encode(node), order));
+  }
+  // The node and its fingerprint, which is 0 unless the node is a leaf.
+  std::pair<Node *, uint16_t>
+  load_tagged(std::memory_order order = std::memory_order_seq_cst) const {
+    auto w = word.load(order);
+    return {decode(w), uint16_t(w >> TAG_SHIFT)};
+  }
+
+private:
+  static constexpr unsigned TAG_SHIFT = 48;
+
+  static uintptr_t encode(Node *node) {
+    if (node == nullptr) {
+      return 0;
+    }
+    return reinterpret_cast<uintptr_t>(node) |
+           uintptr_t(node->fingerprint) << TAG_SHIFT;
+  }
+  static Node *decode(uintptr_t word) {
+    return reinterpret_cast<Node *>(word &
+                                    ((uintptr_t(1) << TAG_SHIFT) - 1));
+  }
+
+  std::atomic<uintptr_t> word;
+};
+static_assert(sizeof(void *) == 8, "fingerprints need 64-bit pointers");
+#endif
+
+// The resource trees allocate nodes from unless told otherwise. With
+// compressed references it has to be the global node arena.
+inline std::pmr::memory_resource *default_node_resource() {
+#ifdef ARTIKV_COMPRESSED_REFS
+  return &NodeArena::global();
+#else
+  return std::pmr::get_default_resource();
+#endif
+}
+
+// Spin lock taken by writers before they modify a node. A node that has been
+// replaced is marked obsolete while still locked, so a writer that acquires
+// the lock afterwards knows to restart from the root. Readers never touch it.
+class WriteLock {
+public:
+  void lock() {
+    auto expected = word.load(std::memory_order_relaxed);
+    while (true) {
+      if (expected & LOCKED) {
+        expected = word.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (word.compare_exchange_weak(expected, expected | LOCKED,
+                                     std::memory_order_acquire)) {
+        return;
+      }
+    }
+  }
+  void unlock() { word.fetch_and(~LOCKED, std::memory_order_release); }
+  void markObsolete() { word.fetch_or(OBSOLETE, std::memory_order_relaxed); }
+  bool isObsolete() const {
+    return word.load(std::memory_order_relaxed) & OBSOLETE;
+  }
+
+private:
+  static constexpr uint32_t LOCKED = 1;
+  static constexpr uint32_t OBSOLETE = 2;
+  std::atomic<uint32_t> word{0};
 };
-using NodeRef = std::atomic<Node *>;
 
 // Abstract base class of all type of ART inner node, which stores the basic
 // info of a key path.
+//
+// The compressed path (`partial_len` and `partial_key`) never changes once a
+// node is reachable: a writer that has to shorten it installs a copy instead.
+// Only the first MAX_PARTIAL_LEN bytes are stored; the rest is read from any
+// leaf below the node when needed.
 class InnerNode : public Node {
 public:
+  using Node::Node;
   virtual ~InnerNode() = default;
-  
+
+  // Only valid before the node is published.
+  void setPrefix(const uint8_t *bytes, size_t len) {
+    partial_len = len;
+    for (size_t i = 0; i < len && i < MAX_PARTIAL_LEN; i++) {
+      partial_key[i] = bytes[i];
+    }
+  }
+
+  // Records an access for the eviction policy: a node waiting in the
+  // cooling stage that is touched gets a second chance.
+  void touch() {
+    if (cooling.load(std::memory_order_relaxed)) {
+      cooling.store(false, std::memory_order_relaxed);
+    }
+  }
+
 protected:
-  uint8_t children_count;
-  size_t partial_len;
-  std::array<unsigned char, MAX_PARTIAL_LEN> partial_key;
+  friend class ART;
+
+  WriteLock lock;
+  std::atomic<bool> cooling{false};
+  // Set once a learned root may jump straight to this node.
+  std::atomic<bool> anchored{false};
+  // Written under `lock`, read unlocked by writers planning a restructure.
+  std::atomic<uint16_t> children_count{0};
+  // Leaves below this node; only kept in trees with rank support.
+  std::atomic<size_t> leaves{0};
+  size_t partial_len = 0;
+  std::array<unsigned char, MAX_PARTIAL_LEN> partial_key{};
+  // Leaf whose key ends exactly where this node's prefix ends.
+  NodeRef prefix_leaf{nullptr};
 };
 
+namespace detail {
+// Visits the occupied slots of an append-only key array in key order.
+template <size_t N, typename F>
+void forEachSorted(const std::array<std::atomic<unsigned char>, N> &keys,
+                   const std::array<NodeRef, N> &children, size_t count,
+                   F &&f) {
+  std::array<std::pair<unsigned char, Node *>, N> sorted;
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    auto *child = children[i].load(std::memory_order_acquire);
+    if (child == nullptr) {
+      continue;
+    }
+    auto byte = keys[i].load(std::memory_order_relaxed);
+    auto pos = n++;
+    for (; pos > 0 && sorted[pos - 1].first > byte; pos--) {
+      sorted[pos] = sorted[pos - 1];
+    }
+    sorted[pos] = {byte, child};
+  }
+  for (size_t i = 0; i < n; i++) {
+    f(sorted[i].first, sorted[i].second);
+  }
+}
+
+// Returns the child with the smallest key byte not below `from`.
+template <size_t N>
+Node *nextSorted(const std::array<std::atomic<unsigned char>, N> &keys,
+                 const std::array<NodeRef, N> &children, size_t count,
+                 unsigned from, unsigned char &byte) {
+  Node *best = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    auto k = keys[i].load(std::memory_order_relaxed);
+    if (k < from || (best != nullptr && k >= byte)) {
+      continue;
+    }
+    if (auto *child = children[i].load(std::memory_order_acquire)) {
+      best = child;
+      byte = k;
+    }
+  }
+  return best;
+}
+
+// Returns the child with the largest key byte.
+template <size_t N>
+Node *lastSorted(const std::array<std::atomic<unsigned char>, N> &keys,
+                 const std::array<NodeRef, N> &children, size_t count,
+                 unsigned char &byte) {
+  Node *best = nullptr;
+  for (size_t i = 0; i < count; i++) {
+    auto k = keys[i].load(std::memory_order_relaxed);
+    if (best != nullptr && k <= byte) {
+      continue;
+    }
+    if (auto *child = children[i].load(std::memory_order_acquire)) {
+      best = child;
+      byte = k;
+    }
+  }
+  return best;
+}
+
+// One bit per key byte, set while a wide node has a child under that byte.
+// Writers set a bit after publishing the child and clear it before unlinking
+// the child, so a reader that finds a bit set and the child gone is racing a
+// removal and moves on.
+class Occupancy {
+public:
+  void set(unsigned char byte) {
+    words[byte / 64].fetch_or(bit(byte), std::memory_order_release);
+  }
+  void clear(unsigned char byte) {
+    words[byte / 64].fetch_and(~bit(byte), std::memory_order_release);
+  }
+  // Smallest occupied byte not below `from`, or 256.
+  unsigned next(unsigned from) const {
+    for (auto w = from / 64; w < 4; w++) {
+      auto word = words[w].load(std::memory_order_acquire);
+      if (w == from / 64) {
+        word &= ~uint64_t(0) << (from % 64);
+      }
+      if (word != 0) {
+        return w * 64 + std::countr_zero(word);
+      }
+    }
+    return 256;
+  }
+  // Largest occupied byte below `until`, or -1.
+  int prev(unsigned until) const {
+    for (int w = int(until + 63) / 64 - 1; w >= 0; w--) {
+      auto word = words[w].load(std::memory_order_acquire);
+      if (unsigned(w) == until / 64) {
+        word &= bit(until % 64) - 1;
+      }
+      if (word != 0) {
+        return w * 64 + 63 - std::countl_zero(word);
+      }
+    }
+    return -1;
+  }
+
+private:
+  static uint64_t bit(unsigned byte) { return uint64_t(1) << (byte % 64); }
+  std::array<std::atomic<uint64_t>, 4> words{};
+};
+
+// Walks the occupancy bits of a wide node upwards from `from` (or downwards
+// from the top) and returns the first child still present.
+template <typename Load>
+Node *scanOccupied(const Occupancy &occupied, unsigned from, bool downwards,
+                   unsigned char &byte, Load &&load) {
+  if (downwards) {
+    for (int b = occupied.prev(256); b >= 0; b = occupied.prev(b)) {
+      if (auto *child = load(unsigned(b))) {
+        byte = static_cast<unsigned char>(b);
+        return child;
+      }
+    }
+    return nullptr;
+  }
+  for (auto b = occupied.next(from); b < 256; b = occupied.next(b + 1)) {
+    if (auto *child = load(b)) {
+      byte = static_cast<unsigned char>(b);
+      return child;
+    }
+  }
+  return nullptr;
+}
+} // namespace detail
+
 // Smallest node type, which can store up to 4 child pointers.
-// Keys and pointers are stored at corresponding positions.
-// Keys are sorted.
+// Keys and pointers are stored at corresponding positions. New children are
+// appended behind `compact_count` and removed ones leave an empty slot, so a
+// reader never observes entries moving; slots are reclaimed when the node is
+// copied on growth.
 class Node4 : public InnerNode {
 public:
-  Node* findChild(unsigned char byte);
-  void addChild(unsigned char byte, Node* child);
+  static constexpr size_t CAPACITY = 4;
+
+  Node4() : InnerNode(NodeType::Node4) {}
+  NodeRef *findChild(unsigned char byte);
+  void addChild(unsigned char byte, Node *child);
+  void removeChild(unsigned char byte);
+  bool isFull() const {
+    return compact_count.load(std::memory_order_relaxed) == CAPACITY;
+  }
+  template <typename F> void forEachChild(F &&f) const {
+    detail::forEachSorted(keys, children,
+                          compact_count.load(std::memory_order_acquire), f);
+  }
+  Node *nextChild(unsigned from, unsigned char &byte) const {
+    return detail::nextSorted(keys, children,
+                              compact_count.load(std::memory_order_acquire),
+                              from, byte);
+  }
+  Node *lastChild(unsigned char &byte) const {
+    return detail::lastSorted(keys, children,
+                              compact_count.load(std::memory_order_acquire),
+                              byte);
+  }
 
 private:
-  std::array<unsigned char, 4> keys;
-  std::array<NodeRef, 4> children;
+  std::atomic<uint8_t> compact_count{0};
+  std::array<std::atomic<unsigned char>, 4> keys{};
+  std::array<NodeRef, 4> children{};
 };
 
 // Storing between 5 and 16 child pointers.
-// Keys and pointers are stored at corresponding positions.
-// Keys are sorted.
+// Keys and pointers are stored at corresponding positions, appended in the
+// same way as Node4.
 class Node16 : public InnerNode {
 public:
- Node* findChild(unsigned char byte);
- void addChild(unsigned char byte, Node* child);
+  static constexpr size_t CAPACITY = 16;
+
+  Node16() : InnerNode(NodeType::Node16) {}
+  NodeRef *findChild(unsigned char byte);
+  void addChild(unsigned char byte, Node *child);
+  void removeChild(unsigned char byte);
+  bool isFull() const {
+    return compact_count.load(std::memory_order_relaxed) == CAPACITY;
+  }
+  template <typename F> void forEachChild(F &&f) const {
+    detail::forEachSorted(keys, children,
+                          compact_count.load(std::memory_order_acquire), f);
+  }
+  Node *nextChild(unsigned from, unsigned char &byte) const {
+    return detail::nextSorted(keys, children,
+                              compact_count.load(std::memory_order_acquire),
+                              from, byte);
+  }
+  Node *lastChild(unsigned char &byte) const {
+    return detail::lastSorted(keys, children,
+                              compact_count.load(std::memory_order_acquire),
+                              byte);
+  }
 
 private:
-  std::array<unsigned char, 16> keys;
-  std::array<NodeRef, 16> children;
+  std::atomic<uint8_t> compact_count{0};
+  std::array<std::atomic<unsigned char>, 16> keys{};
+  std::array<NodeRef, 16> children{};
 };
 
 // Store between 17 and 48 child pointers.
-// Child pointers can be indexed directly by key.
+// Child pointers can be indexed directly by key. An occupancy bitmap over the
+// key bytes lets ordered scans find the next or last child without probing
+// all 256 index entries. Like Node4, new children are appended behind
+// `compact_count` and slots are never reused: a writer that read an index
+// before the byte was removed must not find another byte's child there.
+// Slots are reclaimed when the node is copied on growth or shrinking.
 class Node48 : public InnerNode {
 public:
-  Node* findChild(unsigned char byte);
-  void addChild(unsigned char byte, Node* child);
+  static constexpr size_t CAPACITY = 48;
+  static constexpr uint8_t EMPTY = 0xFF;
+
+  Node48();
+  NodeRef *findChild(unsigned char byte);
+  void addChild(unsigned char byte, Node *child);
+  void removeChild(unsigned char byte);
+  bool isFull() const {
+    return compact_count.load(std::memory_order_relaxed) == CAPACITY;
+  }
+  template <typename F> void forEachChild(F &&f) const {
+    for (auto byte = occupied.next(0); byte < 256;
+         byte = occupied.next(byte + 1)) {
+      if (auto *child = load(byte)) {
+        f(static_cast<unsigned char>(byte), child);
+      }
+    }
+  }
+  Node *nextChild(unsigned from, unsigned char &byte) const {
+    return detail::scanOccupied(occupied, from, false, byte,
+                                [&](unsigned b) { return load(b); });
+  }
+  Node *lastChild(unsigned char &byte) const {
+    return detail::scanOccupied(occupied, 0, true, byte,
+                                [&](unsigned b) { return load(b); });
+  }
 
 private:
-  std::array<unsigned char, 256> keys;
-  std::array<NodeRef, 48> children;
+  std::atomic<uint8_t> compact_count{0};
+  std::array<std::atomic<uint8_t>, 256> keys;
+  std::array<NodeRef, 48> children{};
+  detail::Occupancy occupied;
+
+  Node *load(unsigned byte) const {
+    auto idx = keys[byte].load(std::memory_order_acquire);
+    return idx == EMPTY ? nullptr
+                        : children[idx].load(std::memory_order_acquire);
+  }
 };
 
 // Store between 49 and 256 child pointers.
 // Key is the index or array `children`, child node can be found
-// by a single lookup.
+// by a single lookup. Like Node48, it keeps an occupancy bitmap so that
+// ordered scans skip empty bytes a word at a time.
 class Node256 : public InnerNode {
 public:
-  Node* findChild(unsigned char byte);
-  void addChild(unsigned char byte, Node* child);
+  static constexpr size_t CAPACITY = 256;
+
+  Node256() : InnerNode(NodeType::Node256) {}
+  NodeRef *findChild(unsigned char byte);
+  void addChild(unsigned char byte, Node *child);
+  void removeChild(unsigned char byte);
+  bool isFull() const { return false; }
+  template <typename F> void forEachChild(F &&f) const {
+    for (auto byte = occupied.next(0); byte < 256;
+         byte = occupied.next(byte + 1)) {
+      if (auto *child = children[byte].load(std::memory_order_acquire)) {
+        f(static_cast<unsigned char>(byte), child);
+      }
+    }
+  }
+  Node *nextChild(unsigned from, unsigned char &byte) const {
+    return detail::scanOccupied(occupied, from, false, byte, [&](unsigned b) {
+      return children[b].load(std::memory_order_acquire);
+    });
+  }
+  Node *lastChild(unsigned char &byte) const {
+    return detail::scanOccupied(occupied, 0, true, byte, [&](unsigned b) {
+      return children[b].load(std::memory_order_acquire);
+    });
+  }
 
 private:
-  std::array<NodeRef, 256> children;
+  std::array<NodeRef, 256> children{};
+  detail::Occupancy occupied;
 };
 
-// Leaf node which contains complete key/value data.
+// Leaf node which contains complete key/value data. The key never changes
+// once published. The value lives in 8-byte words with room for at least
+// `capacity` bytes, and an overwrite that fits is done in place under a
+// sequence lock: the writer makes `seq` odd, stores the words and the new
+// length, and makes it even again, while readers that copy the value retry
+// when `seq` moved under them. Larger overwrites install a new leaf.
+//
+// A leaf of a deduplicating tree may instead refer to a `SharedValue`, which
+// it holds a reference to until it is reclaimed. Such a leaf is never
+// updated in place.
 class LeafNode : public Node {
+public:
+  LeafNode(Slice key, std::span<const uint8_t> val, size_t capacity,
+           std::pmr::memory_resource *resource);
+  LeafNode(Slice key, SharedValue *shared,
+           std::pmr::memory_resource *resource);
+  ~LeafNode() override;
+
+  // The value bytes in place. They are only stable while no writer updates
+  // this leaf; `readValue` copies them consistently.
+  std::span<uint8_t> value() const {
+    if (shared != nullptr) {
+      return {const_cast<uint8_t *>(shared->data()), shared->size};
+    }
+    return {reinterpret_cast<uint8_t *>(const_cast<uint64_t *>(words.data())),
+            len.load(std::memory_order_acquire)};
+  }
+  // Copies the value into `out` if it fits and returns its size.
+  size_t readValue(std::span<uint8_t> out) const;
+  // Appends a consistent copy of the value to `out`.
+  template <typename Bytes> void appendValue(Bytes &out) const {
+    auto pos = out.size();
+    while (true) {
+      auto n = len.load(std::memory_order_relaxed);
+      out.resize(pos + n);
+      auto actual = readValue(std::span(out).subspan(pos));
+      if (actual <= n) {
+        out.resize(pos + actual);
+        return;
+      }
+    }
+  }
+  bool fits(size_t size) const {
+    return shared == nullptr && size <= words.size() * 8;
+  }
+  // Overwrites the value in place. The caller holds the lock of the slot
+  // that points at this leaf, which serializes writers, and `fits(value)`.
+  void assignValue(std::span<const uint8_t> value);
+
+private:
+  friend class ART;
+  friend class BucketNode;
+
+  std::pmr::vector<uint8_t> key;
+  std::pmr::vector<uint64_t> words;
+  std::atomic<uint32_t> len;
+  std::atomic<uint32_t> seq{0};
+  SharedValue *shared = nullptr;
+};
+
+// Sorted run of leaves that share the path down to the slot holding it, in
+// place of the small inner nodes that would tell them apart. A bucket never
+// changes once it is reachable: writers swap in a copy with a leaf added or
+// removed, and split it into inner nodes and smaller buckets when it would
+// grow past the tree's bucket capacity.
+//
+// The leaf pointers are followed by an array of heads: four key bytes of
+// each leaf from `offset`, where the keys start to differ, read big-endian
+// and zero-padded. Heads are in key order, so a lookup counts the heads below
+// its own in one pass over a flat array, which compilers vectorize, and only
+// loads the leaves whose head equals its own.
+class BucketNode : public Node {
+public:
+  static constexpr size_t MAX_CAPACITY = 64;
+
+  BucketNode(uint32_t count, uint32_t offset)
+      : Node(NodeType::Bucket), count(count), offset(offset) {}
+
+  size_t size() const { return count; }
+  LeafNode *const *leaves() const {
+    return reinterpret_cast<LeafNode *const *>(this + 1);
+  }
+  const uint32_t *heads() const {
+    return reinterpret_cast<const uint32_t *>(leaves() + count);
+  }
+  // The leaf with key `key`, if any.
+  LeafNode *find(Slice key) const;
+  // Position of the first leaf whose key is not less than `key`.
+  size_t lowerBound(Slice key) const;
+
+  // Bytes taken by a bucket of `count` leaves.
+  static size_t bytes(size_t count) {
+    return sizeof(BucketNode) + count * (sizeof(LeafNode *) + sizeof(uint32_t));
+  }
+  static uint32_t head(Slice key, size_t offset);
+
 private:
-  art::ARTData key;
-  art::ARTData val;
+  friend class ART;
+
+  uint32_t count;
+  uint32_t offset;
+};
+
+// Stands in the slot of a subtree that was written to the tree's page file.
+// It keeps the smallest key of the subtree in `anchor`, a leaf without a
+// value, so that compressed paths above it can still be read; the next
+// descent that needs the subtree loads it back in its place.
+class EvictedNode : public Node {
+public:
+  EvictedNode(PageFile::Extent page, size_t count, size_t depth,
+              LeafNode *anchor)
+      : Node(NodeType::Evicted), page(page), count(count), depth(depth),
+        anchor(anchor) {}
+
+  LeafNode *anchorLeaf() const { return anchor; }
+
+private:
+  friend class ART;
+
+  PageFile::Extent page;
+  // Pairs stored in the page.
+  size_t count;
+  // Key depth at which the subtree's compressed path starts.
+  size_t depth;
+  LeafNode *anchor;
 };
 
 /**
@@ -116,7 +660,17 @@ private:
  * The tree dynamically adjusts the node types as keys are added or removed to
  * provide space and performance efficiency.
  *
- * @note This implementation assumes unique keys for insertion.
+ * Concurrency follows the Read-Optimized Write EXclusion (ROWEX) protocol.
+ * Writers lock the nodes they modify, top-down, and publish every change
+ * with a single atomic store into a `NodeRef` slot: a child is appended to a
+ * node in place, and any change that would move existing entries (growing,
+ * shrinking, splitting a prefix) builds a replacement node and swaps it into
+ * the parent slot. Readers take no locks and never restart or validate; they
+ * only announce themselves to the reclamation epoch so that replaced nodes
+ * outlive them.
+ *
+ * Inserting an existing key replaces its value, in place when the new value
+ * fits in the leaf (see `LeafNode`).
  *
  * Usage example:
  * @code
@@ -131,12 +685,193 @@ private:
  */
 class ART {
 public:
+  /**
+   * Cached root-to-leaf path of the last operation made through it. A hinted
+   * operation resumes from the deepest cached node whose path the new key
+   * still follows, which skips most of the descent for keys that arrive in
+   * (nearly) sorted order.
+   *
+   * A finger belongs to one caller at a time and is not thread safe. It
+   * holds no locks and keeps nothing alive: it is discarded as soon as any
+   * inner node of the tree has been replaced since it was recorded. Its key
+   * and path buffers come from `resource`.
+   */
+  class Finger {
+  public:
+    Finger() = default;
+    explicit Finger(std::pmr::memory_resource *resource)
+        : key(resource), path(resource) {}
+
+  private:
+    friend class ART;
+
+    struct Entry {
+      InnerNode *node;
+      NodeRef *slot;
+      WriteLock *slot_lock;
+      size_t depth;
+    };
+
+    const ART *tree = nullptr;
+    uint64_t version = 0;
+    std::pmr::vector<uint8_t> key;
+    std::pmr::vector<Entry> path;
+  };
+
+  /**
+   * Packed column of byte strings, as filled by `Iterator::next_batch`:
+   * entry i is data[offsets[i], offsets[i + 1]).
+   */
+  struct ByteBatch {
+    explicit ByteBatch(std::pmr::memory_resource *resource =
+                           std::pmr::get_default_resource())
+        : data(resource), offsets(resource) {}
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    std::span<const uint8_t> operator[](size_t i) const {
+      return {data.data() + offsets[i], size_t(offsets[i + 1] - offsets[i])};
+    }
+    void clear() {
+      data.clear();
+      offsets.clear();
+    }
+
+    std::pmr::vector<uint8_t> data;
+    std::pmr::vector<uint64_t> offsets;
+  };
+  using KeyBatch = ByteBatch;
+  using ValueBatch = ByteBatch;
+
+  /**
+   * Pairs unlinked by `detach_prefix`. Readers no longer find them, but
+   * they stay allocated, and in the tree's `size`, until `release`, which
+   * may run on any thread outside an `Epoch::Guard`; the destructor releases
+   * a handle that was not. The tree must outlive the handle.
+   */
+  class Detached {
+  public:
+    Detached() = default;
+    Detached(Detached &&other) noexcept;
+    Detached &operator=(Detached &&other) noexcept;
+    ~Detached();
+
+    // Whether there is anything left to release.
+    explicit operator bool() const { return node != nullptr || pairs != 0; }
+
+    /**
+     * Counts the pairs, takes them out of the tree's `size`, waits until no
+     * reader can still be inside them and frees them, all on the calling
+     * thread.
+     *
+     * @return The number of pairs released.
+     */
+    size_t release();
+
+  private:
+    friend class ART;
+
+    ART *tree = nullptr;
+    Node *node = nullptr;
+    // Pairs already taken out of `size`; 0 while `node` is still uncounted.
+    size_t pairs = 0;
+  };
+
+  /**
+   * Forward iterator over the pairs of the tree in key order.
+   *
+   * The iterator is weakly consistent: every key present for the whole
+   * iteration is visited exactly once, while keys inserted or removed
+   * concurrently may or may not show up. It keeps its thread inside a
+   * reclamation epoch until it is destroyed, so nodes retired meanwhile are
+   * not freed; keep it short-lived and on the thread that created it. Its
+   * traversal stack comes from the scratch resource it was created with.
+   */
+  class Iterator {
+  public:
+    bool valid() const { return leaf != nullptr; }
+    void next();
+    // With key compression, the key is decoded into the iterator and valid
+    // until it moves.
+    std::span<const uint8_t> key() const;
+    /**
+     * Copies up to `n` pairs into `keys` and `values`, replacing their
+     * contents, and advances past them. Leaves are gathered a few at a time
+     * and their key and value bytes prefetched before they are copied.
+     *
+     * @return The number of pairs copied; 0 once the iterator is exhausted.
+     */
+    size_t next_batch(size_t n, KeyBatch &keys, ValueBatch &values);
+    // Points into the leaf, which the iterator's epoch keeps allocated until
+    // the iterator is destroyed, even if the key is overwritten, removed or
+    // evicted meanwhile. An in-place update changes the bytes; `read_value`
+    // is safe against that.
+    std::span<uint8_t> value() const { return leaf->value(); }
+    ARTData read_value() const {
+      ARTData out;
+      leaf->appendValue(out);
+      return out;
+    }
+
+  private:
+    friend class ART;
+
+    struct Frame {
+      InnerNode *node;
+      // Smallest key byte not visited yet; 256 once all children are done.
+      unsigned next_byte;
+      bool prefix_leaf_done;
+    };
+
+    Epoch::Guard guard;
+    ART *tree;
+    std::pmr::vector<Frame> stack;
+    LeafNode *leaf = nullptr;
+    // Bucket below the top frame and its next leaf to visit.
+    BucketNode *bucket = nullptr;
+    size_t bucket_next = 0;
+    // Decoded key of `decoded_leaf`.
+    mutable std::pmr::vector<uint8_t> decoded;
+    mutable LeafNode *decoded_leaf = nullptr;
+
+    Iterator(ART *tree, std::pmr::memory_resource *scratch)
+        : tree(tree), stack(scratch), decoded(scratch) {}
+    void push(Node *node);
+  };
+
+  using ScanEntry = std::pair<std::pmr::vector<uint8_t>, std::pmr::vector<uint8_t>>;
+  using KeyValue = std::pair<ARTData, ARTData>;
+
+  /**
+   * Creates an empty tree whose nodes and leaves are allocated from
+   * `resource`, which must outlive the tree. Unless it is the global
+   * new/delete resource, destroying the tree waits for every node it retired
+   * to be reclaimed, so the resource may be released right after.
+   *
+   * @throws std::invalid_argument in builds with `ARTIKV_COMPRESSED_REFS` if
+   * `resource` is not `NodeArena::global()`.
+   */
+  explicit ART(std::pmr::memory_resource *resource = default_node_resource());
+
+  /**
+   * With a resource other than the global new/delete one, or with
+   * deduplication enabled, waits for every thread in the process to leave
+   * the epoch it is in (see `Epoch::synchronize`), so it blocks behind long
+   * reads on any tree. The destroying thread must not be inside an epoch
+   * itself, through a live `Iterator` or `Epoch::Guard` on this tree or
+   * another, or it would wait for itself forever.
+   */
+  ~ART();
+  ART(const ART &) = delete;
+  ART &operator=(const ART &) = delete;
+
   /**
    * Inserts a new key-value pair into the ART.
    *
    * @param key key The key to insert, which is a byte stream.
    * @param value value The value to associate with the key, which is a byte
    * stream. This value is moved into the tree.
+   * @throws std::length_error if the key or the value exceeds 4 GiB, before
+   * the tree is touched.
    */
   void insert(Slice key, OwnedSlice value);
 
@@ -145,10 +880,211 @@ public:
    *
    * @param key the key for which to search. Before using it, you should convert
    * the object to a byte stream
-   * @return std::optional<ARTDataRef>
+   * @return std::optional<ARTDataRef> The span points into the leaf. The
+   * leaf is freed once it leaves the tree and no thread that was inside an
+   * epoch by then still is: when the key is overwritten or removed, and with
+   * eviction enabled when any insert evicts its subtree. Hold an
+   * `Epoch::Guard` across the call and every use of the span to keep it
+   * valid regardless. An overwrite that fits in the leaf changes the bytes
+   * in place, so threads that read while others overwrite should use `read`
+   * instead.
    */
   std::optional<std::span<uint8_t>> search(Slice key);
 
+  /**
+   * Copies out the value of `key`. The copy is consistent even while other
+   * threads overwrite the key in place.
+   */
+  std::optional<ARTData> read(Slice key);
+
+  /**
+   * Copies the value of `key` into `out` if it fits, consistently like
+   * `read`, without allocating.
+   *
+   * @return The value's size, or nothing if the key is absent.
+   */
+  std::optional<size_t> read(Slice key, std::span<uint8_t> out);
+
+  /**
+   * Makes new leaves reserve `bytes` beyond their value (rounded up to 8), so
+   * that overwrites growing the value by up to that much still happen in
+   * place. Overwrites of the same or a smaller size never allocate.
+   */
+  void set_value_slack(size_t bytes) {
+    value_slack.store(bytes, std::memory_order_relaxed);
+  }
+
+  /**
+   * Stores values of at least `min_bytes` once in a content-addressed
+   * `ValueStore`: leaves with equal values share one copy, which is freed
+   * when the last of them is reclaimed. Only values inserted afterwards are
+   * deduplicated. Call it before other threads use the tree.
+   */
+  void enable_dedup(size_t min_bytes);
+
+  // The tree's value store, or nullptr unless deduplication is enabled.
+  const ValueStore *value_store() const { return store.get(); }
+
+  struct EvictionOptions {
+    // File that receives evicted subtrees. The tree creates it and removes
+    // it when destroyed.
+    std::string path;
+    // Pairs kept in memory; writers evict cold subtrees beyond that.
+    size_t max_resident = size_t(1) << 20;
+    // Subtrees are evicted whole, starting from the first inner node whose
+    // compressed path starts at this key depth or deeper.
+    size_t unit_depth = 2;
+    // Candidates held in the cooling stage.
+    size_t cooling = 8;
+  };
+
+  /**
+   * Lets subtrees be evicted to a local file. A slot of an evicted subtree
+   * holds an `EvictedNode` naming its page instead of the subtree, and any
+   * operation that reaches it loads the subtree back in transparently.
+   *
+   * Replacement follows a cooling stage with a second chance: randomly
+   * sampled subtrees are marked cooling and queued, an operation that passes
+   * through a cooling subtree clears the mark, and subtrees that reach the
+   * head of the queue still marked are written out. Loading a subtree back
+   * takes the lock of the slot it hangs from, so readers that reach evicted
+   * data briefly act as writers. Only inserts evict, after they are done.
+   * Eviction retires the leaves it writes out, so spans from `search` and
+   * its variants only survive the next insert under an `Epoch::Guard`.
+   *
+   * Call it before other threads use the tree.
+   *
+   * @throws std::system_error if the file cannot be created,
+   * std::invalid_argument if rank support or buckets are enabled.
+   */
+  void enable_eviction(const EvictionOptions &options);
+
+  /**
+   * Runs the replacement policy until `units` subtrees have been evicted or
+   * no candidate is cold. Eviction must be enabled.
+   *
+   * @return The number of subtrees evicted.
+   */
+  size_t evict(size_t units);
+
+  // Pairs currently held in memory.
+  size_t resident() const;
+
+  /**
+   * Stores keys encoded by `compressor`, which preserves their order, so
+   * that inner node prefixes and leaves hold fewer bytes. Keys are encoded on
+   * the way in and decoded on the way out; callers see plain keys
+   * throughout. Call it on an empty tree before other threads use it.
+   */
+  void enable_key_compression(std::shared_ptr<const KeyCompressor> compressor);
+
+  /**
+   * Keeps in every inner node the number of leaves below it, so that `rank`
+   * and `seek_rank` take one descent rather than a walk over the keys.
+   * Counts are adjusted along the key's path after an insert and before a
+   * removal, which is exact only while one thread writes at a time; readers
+   * may run alongside. Call it on an empty tree before other threads use it.
+   *
+   * @throws std::invalid_argument if eviction is enabled.
+   */
+  void enable_rank();
+
+  /**
+   * Keeps up to `capacity` leaves that share a path in one sorted bucket
+   * instead of splitting them apart with inner nodes, which removes the
+   * lowest levels of the tree, mostly Node4s with one or two children. A
+   * bucket is split into inner nodes and smaller buckets once it overflows.
+   * Call it on an empty tree before other threads use it.
+   *
+   * @throws std::invalid_argument if `capacity` is not between 2 and
+   * `BucketNode::MAX_CAPACITY`, or eviction is enabled.
+   */
+  void enable_buckets(size_t capacity = 16);
+
+  /**
+   * Returns the number of keys less than `key`. Each node on the path adds
+   * up the counts of the entries left of it. Rank support must be enabled.
+   */
+  size_t rank(Slice key);
+
+  /**
+   * Returns an iterator at the key of 0-based rank `rank`, exhausted if the
+   * tree holds no more keys. Rank support must be enabled.
+   */
+  Iterator seek_rank(size_t rank, std::pmr::memory_resource *scratch =
+                                      std::pmr::get_default_resource());
+
+  /**
+   * Puts a learned model in front of the root, for trees whose keys are all
+   * `key_width`-byte big-endian integers (1 to 8 bytes). The model is a
+   * piecewise-linear fit of where keys fall among the subtrees on the second
+   * or third level, so a lookup computes the subtree that holds its key and
+   * starts there, skipping the nodes above it. Monotonic and clustered key
+   * spaces fit in few segments.
+   *
+   * A lookup whose key lies in no subtree of the model descends from the
+   * root. A writer that replaces one of those subtrees points the model at
+   * the replacement, or drops that subtree from it, so the other jumps stay
+   * valid. Lookups of keys the model covers that still had to descend count
+   * as misses; once they outnumber the model's subtrees, or once the writes
+   * since the last training add up to the tree's size then, the next write
+   * retrains the model from the top levels of the tree, so it follows the
+   * keys as they drift. Lookups never train. Writers and hinted operations
+   * descend as usual. Call it before other threads use the tree.
+   *
+   * @throws std::invalid_argument if `key_width` is 0 or more than 8, or if
+   * key compression is enabled.
+   */
+  void enable_learned_root(size_t key_width);
+
+  /**
+   * Retrains the learned root now, after a bulk load for instance, and
+   * returns the number of subtrees it can jump to.
+   */
+  size_t retrain_learned_root();
+
+  // Subtrees the learned root can jump to right now.
+  size_t learned_jumps();
+
+  /**
+   * Same as `insert`, but starts from `finger` and leaves the path of `key`
+   * in it.
+   */
+  void insert_hint(Finger &finger, Slice key, OwnedSlice value);
+
+  /**
+   * Same as `search`, but starts from `finger` and leaves the path of `key`
+   * in it. The span lives as long as one from `search`.
+   */
+  std::optional<std::span<uint8_t>> search_hint(Finger &finger, Slice key);
+
+  /**
+   * Searches for every key of `keys`, carrying one finger from each lookup
+   * to the next. Sorted input gets the most out of it. The result and the
+   * finger's buffers are allocated from `scratch`. Like those of `search`,
+   * the spans point into the leaves and only outlive the call under an
+   * `Epoch::Guard` if other threads overwrite, remove or evict; use
+   * `read_batch` to get copies instead.
+   *
+   * @return One result per key, in the order of `keys`.
+   */
+  std::pmr::vector<std::optional<std::span<uint8_t>>>
+  search_batch(std::span<const Slice> keys,
+               std::pmr::memory_resource *scratch =
+                   std::pmr::get_default_resource());
+
+  /**
+   * Copies the values of `keys` into `values`, consistently like `read`,
+   * carrying one finger from each lookup to the next like `search_batch`. A
+   * missing key gets an empty entry.
+   *
+   * @return Whether each key of `keys` is present, allocated from `scratch`.
+   */
+  std::pmr::vector<bool>
+  read_batch(std::span<const Slice> keys, ValueBatch &values,
+             std::pmr::memory_resource *scratch =
+                 std::pmr::get_default_resource());
+
   /**
    * Removes a key-value pair from the ART, identified by the key.
    *
@@ -157,18 +1093,196 @@ public:
    */
   void remove(Slice key);
 
+  /**
+   * Removes every pair whose key starts with `prefix` by unlinking the one
+   * subtree that holds them, a single descent however many pairs it has.
+   * The subtree is freed once no reader can still be inside it. A ranked
+   * tree reads the number of pairs off the subtree's leaf count; other trees
+   * count the leaves, without locks or descents from the root.
+   *
+   * Keys under `prefix` must not be written meanwhile: an insert racing with
+   * the removal may be dropped along with the subtree.
+   *
+   * @return The number of pairs removed.
+   * @throws std::invalid_argument if eviction or key compression is enabled.
+   */
+  size_t remove_prefix(Slice prefix);
+
+  /**
+   * Unlinks the pairs under `prefix` like `remove_prefix`, in one descent,
+   * but leaves counting and freeing them to the returned handle, so that a
+   * large subtree can be walked off the caller's thread. Same preconditions
+   * as `remove_prefix`.
+   */
+  Detached detach_prefix(Slice prefix);
+
+  /**
+   * Same as `detach_prefix(prefix)`, trusting the caller's count of the pairs
+   * under `prefix`, e.g. one kept alongside them: they leave `size` at once
+   * and releasing them does not walk them.
+   */
+  Detached detach_prefix(Slice prefix, size_t pairs);
+
+  /**
+   * Returns a copy of the pair with the smallest key, found by following the
+   * leftmost entry of every node from the root.
+   */
+  std::optional<KeyValue> min();
+
+  /**
+   * Returns a copy of the pair with the largest key.
+   */
+  std::optional<KeyValue> max();
+
+  /**
+   * Removes the pair with the smallest key and returns it. The descent that
+   * finds the leaf is the path its removal works on, so a pop costs one walk
+   * down the tree. Concurrent pops never return the same pair: a pop whose
+   * leaf was taken first retries from the root.
+   */
+  std::optional<KeyValue> pop_min();
+
+  /**
+   * Removes the pair with the largest key and returns it.
+   */
+  std::optional<KeyValue> pop_max();
+
   /**
    * Returns the tree size.
    */
   size_t size();
 
+  /**
+   * Returns an iterator positioned at the smallest key. The iterator's
+   * temporary state is allocated from `scratch`.
+   */
+  Iterator begin(std::pmr::memory_resource *scratch =
+                     std::pmr::get_default_resource());
+
+  /**
+   * Returns an iterator positioned at the smallest key not less than `key`.
+   */
+  Iterator lower_bound(Slice key, std::pmr::memory_resource *scratch =
+                                      std::pmr::get_default_resource());
+
+  /**
+   * Copies up to `limit` pairs in key order, starting at the smallest key not
+   * less than `start`. The result, its keys and values, and the traversal
+   * state are all allocated from `scratch`, so a per-request
+   * `std::pmr::monotonic_buffer_resource` releases the whole scan at once.
+   */
+  std::pmr::vector<ScanEntry> scan(Slice start, size_t limit,
+                                   std::pmr::memory_resource *scratch =
+                                       std::pmr::get_default_resource());
+
+  /**
+   * Picks up to `count` keys by random descents from the root. The sample is
+   * cheap but only roughly uniform: keys below sparse nodes are favored.
+   */
+  std::vector<ARTData> sample(size_t count);
+
+  /**
+   * Moves every pair of `other` into this tree, leaving `other` empty. Keys
+   * present in both take the value from `other`. Subtrees of `other` that do
+   * not collide with this tree are attached as they are, so merging trees
+   * that cover disjoint key ranges only walks the paths along the range
+   * boundaries.
+   *
+   * Neither tree may be used by another thread during the merge. If the two
+   * trees allocate from different resources, encode keys differently, or
+   * either deduplicates values, evicts subtrees or counts leaves, the pairs
+   * are copied instead.
+   */
+  void merge(ART &other);
+
 private:
-  NodeRef root;
-  size_t tree_size;
+  std::pmr::memory_resource *resource;
+  NodeRef root{nullptr};
+  // Guards `root` the same way an inner node's lock guards its slots.
+  WriteLock root_lock;
+  std::atomic<size_t> tree_size{0};
+  std::atomic<size_t> value_slack{0};
+  std::unique_ptr<ValueStore> store;
+  size_t dedup_min_bytes = SIZE_MAX;
+  struct Eviction;
+  std::unique_ptr<Eviction> eviction;
+  std::shared_ptr<const KeyCompressor> compressor;
+  bool ranked = false;
+  // Leaves a bucket holds at most; 0 when buckets are disabled.
+  size_t bucket_capacity = 0;
+  // Bumped whenever an inner node is replaced, which invalidates fingers.
+  std::atomic<uint64_t> structure_version{0};
+  struct LearnedRoot;
+  std::unique_ptr<LearnedRoot> learned;
+  // Bumped when a bulk change may have retired nodes the learned root jumps
+  // to, without pointing it elsewhere.
+  std::atomic<uint64_t> anchor_version{0};
 
-  void insertRecursively(NodeRef node, std::span<uint8_t> key, LeafNode leaf, int depth);
-  static void replace(NodeRef& node, Node* newNode);
+  std::optional<std::span<uint8_t>> searchFrom(Finger *finger, Slice key);
+  Iterator lowerBound(Slice key, std::pmr::memory_resource *scratch);
+  void countPath(Slice key, bool added);
+  static size_t leafCount(Node *node);
+  LeafNode *findLeaf(Finger *finger, Slice key);
+  InnerNode *jumpTarget(Slice key, size_t &depth);
+  size_t trainLearnedRoot();
+  void retrainIfDue();
+  bool tryInsert(Slice key, std::span<const uint8_t> value, Finger *finger);
+  bool tryRemove(Slice key);
+  bool tryDetachPrefix(Slice prefix, Detached &detached);
+  bool removeRoot(LeafNode *leaf);
+  std::optional<KeyValue> peek(bool largest);
+  std::optional<KeyValue> pop(bool largest);
+  static NodeRef *edgeSlot(InnerNode *node, bool largest);
+  KeyValue copyOut(LeafNode *leaf) const;
+  Slice storedKey(Slice key, ARTData &buffer) const;
+  template <typename Bytes>
+  void appendKey(const LeafNode *leaf, Bytes &out) const;
+
+  Node *faultIn(EvictedNode *stub);
+  Node *loadSubtree(EvictedNode *stub);
+  Node *buildSubtree(std::span<LeafNode *const> leaves, size_t depth);
+  bool evictUnit(NodeRef *slot, WriteLock *slot_lock, InnerNode *node,
+                 size_t depth);
+  bool locate(Slice anchor, size_t depth, InnerNode *target, NodeRef *&slot,
+              WriteLock *&slot_lock);
+  void balance();
+  size_t runReplacement(size_t units, bool aged);
+  Node *resolve(Node *node);
+  uint64_t resume(Finger *finger, Slice key, NodeRef *&slot,
+                  WriteLock *&slot_lock, size_t &depth);
+  void record(Finger *finger, Slice key, uint64_t version, bool replaced,
+              size_t keep);
+  void retireReplaced(InnerNode *node, InnerNode *successor = nullptr);
+  static void inheritAnchor(InnerNode *node, InnerNode *successor);
+  void repointAnchor(InnerNode *node, InnerNode *successor);
+  bool removeLeaf(NodeRef *node_slot, WriteLock *node_slot_lock,
+                  InnerNode *node, size_t node_depth, NodeRef *slot,
+                  LeafNode *leaf);
+  bool unlink(NodeRef *node_slot, WriteLock *node_slot_lock, InnerNode *node,
+              size_t node_depth, NodeRef *slot, Node *entry,
+              unsigned char byte);
+
+  Node *mergeNodes(Node *a, Node *b, size_t depth, bool b_wins,
+                   size_t &duplicates);
+  void attach(InnerNode *&node, Node *child, size_t depth, size_t end);
+  void addChildGrowing(InnerNode *&node, unsigned char byte, Node *child);
+  static std::pair<const uint8_t *, size_t> pathBytes(Node *node,
+                                                      size_t depth);
+  static LeafNode *minLeaf(Node *node);
+  static bool leafMatches(LeafNode *leaf, Slice key);
+  static bool prefixMatches(InnerNode *node, Slice key, size_t depth);
+  static std::optional<size_t> prefixMismatch(InnerNode *node, Slice key,
+                                              size_t depth);
+  static void placeLeaf(InnerNode *node, LeafNode *leaf, size_t depth);
+  BucketNode *newBucket(std::span<LeafNode *const> leaves);
+  bool replaceInBucket(NodeRef *slot, WriteLock *slot_lock,
+                       BucketNode *bucket, std::span<LeafNode *const> leaves);
+  InnerNode *rebuild(InnerNode *node, NodeType type);
+  LeafNode *newLeaf(Slice key, std::span<const uint8_t> value);
+  void retire(Node *node);
+  void freeSubtree(Node *node);
+  static void destroyTree(std::pmr::memory_resource *resource, Node *node);
+  static size_t countLeaves(Node *node);
 };
 
 } // namespace art
-
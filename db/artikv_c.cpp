@@ -0,0 +1,293 @@
+#include "artikv_c.h"
+#include "art.hpp"
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory_resource>
+#include <new>
+#include <numeric>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+using namespace art;
+
+struct artikv_db {
+    ART tree;
+};
+
+struct artikv_iter {
+    ART::Iterator it;
+};
+
+namespace {
+// Stack space for the temporaries of one batched call before the scratch
+// resource falls back to the heap.
+constexpr size_t SCRATCH_BYTES = 16 * 1024;
+
+thread_local std::string last_error;
+
+// Runs `fn` and turns an escaping exception into a status code.
+template <typename F> artikv_status guarded(F &&fn) {
+    try {
+        return fn();
+    } catch (const std::bad_alloc &) {
+        last_error = "out of memory";
+    } catch (const std::system_error &e) {
+        last_error = e.what();
+        return ARTIKV_IO_ERROR;
+    } catch (const std::exception &e) {
+        last_error = e.what();
+    }
+    return ARTIKV_ERROR;
+}
+
+artikv_status invalid(const char *what) {
+    last_error = what;
+    return ARTIKV_INVALID_ARGUMENT;
+}
+
+Slice packed(const uint8_t *data, const uint64_t *offsets, size_t i) {
+    return Slice(data + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+bool validOffsets(const uint64_t *offsets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (offsets[i + 1] < offsets[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T> T *allocate(size_t n) {
+    auto *p = static_cast<T *>(std::malloc(std::max<size_t>(n, 1) * sizeof(T)));
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// Copies a packed column into freshly allocated `data` and `offsets` arrays.
+void copyOut(const ART::ByteBatch &column, uint8_t *&data,
+             uint64_t *&offsets) {
+    data = allocate<uint8_t>(column.data.size());
+    offsets = allocate<uint64_t>(column.offsets.size());
+    if (!column.data.empty()) {
+        std::memcpy(data, column.data.data(), column.data.size());
+    }
+    std::memcpy(offsets, column.offsets.data(),
+                column.offsets.size() * sizeof(uint64_t));
+}
+} // namespace
+
+int artikv_abi_version(void) { return ARTIKV_ABI_VERSION; }
+
+const char *artikv_last_error(void) { return last_error.c_str(); }
+
+artikv_status artikv_open(const char *path, artikv_db **db) {
+    if (db == nullptr) {
+        return invalid("db is NULL");
+    }
+    *db = nullptr;
+    return guarded([&] {
+        auto handle = std::make_unique<artikv_db>();
+        if (path != nullptr && std::filesystem::exists(path)) {
+            loadCheckpoint(handle->tree, path);
+        }
+        *db = handle.release();
+        return ARTIKV_OK;
+    });
+}
+
+void artikv_close(artikv_db *db) { delete db; }
+
+artikv_status artikv_save(artikv_db *db, const char *path, size_t parts) {
+    if (path == nullptr) {
+        return invalid("path is NULL");
+    }
+    return guarded([&] {
+        saveCheckpoint(db->tree, path, parts);
+        return ARTIKV_OK;
+    });
+}
+
+size_t artikv_size(artikv_db *db) { return db->tree.size(); }
+
+artikv_status artikv_put(artikv_db *db, const uint8_t *key, size_t key_len,
+                         const uint8_t *value, size_t value_len) {
+    return guarded([&] {
+        db->tree.insert(Slice(key, key_len),
+                        std::vector<uint8_t>(value, value + value_len));
+        return ARTIKV_OK;
+    });
+}
+
+artikv_status artikv_delete(artikv_db *db, const uint8_t *key,
+                            size_t key_len) {
+    return guarded([&] {
+        Slice k(key, key_len);
+        if (!db->tree.search(k)) {
+            return ARTIKV_NOT_FOUND;
+        }
+        db->tree.remove(k);
+        return ARTIKV_OK;
+    });
+}
+
+artikv_status artikv_get(artikv_db *db, const uint8_t *key, size_t key_len,
+                         uint8_t *buf, size_t cap, size_t *value_len) {
+    return guarded([&] {
+        auto size = db->tree.read(Slice(key, key_len), std::span(buf, cap));
+        if (!size) {
+            return ARTIKV_NOT_FOUND;
+        }
+        if (value_len != nullptr) {
+            *value_len = *size;
+        }
+        return *size > cap ? ARTIKV_BUFFER_TOO_SMALL : ARTIKV_OK;
+    });
+}
+
+artikv_status artikv_put_batch(artikv_db *db, const uint8_t *keys,
+                               const uint64_t *key_offsets,
+                               const uint8_t *values,
+                               const uint64_t *value_offsets, size_t count) {
+    if (!validOffsets(key_offsets, count) ||
+        !validOffsets(value_offsets, count)) {
+        return invalid("offsets must not decrease");
+    }
+    return guarded([&] {
+        // Sorted order lets every insert resume from the previous one's
+        // path; the stable sort keeps the last duplicate last.
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            auto ka = packed(keys, key_offsets, a);
+            auto kb = packed(keys, key_offsets, b);
+            return std::lexicographical_compare(ka.begin(), ka.end(),
+                                                kb.begin(), kb.end());
+        });
+        ART::Finger finger;
+        for (auto i : order) {
+            auto value = packed(values, value_offsets, i);
+            db->tree.insert_hint(
+                finger, packed(keys, key_offsets, i),
+                std::vector<uint8_t>(value.begin(), value.end()));
+        }
+        return ARTIKV_OK;
+    });
+}
+
+artikv_status artikv_multi_get(artikv_db *db, const uint8_t *keys,
+                               const uint64_t *key_offsets, size_t count,
+                               artikv_batch *out) {
+    if (out == nullptr) {
+        return invalid("out is NULL");
+    }
+    *out = {};
+    if (!validOffsets(key_offsets, count)) {
+        return invalid("offsets must not decrease");
+    }
+    return guarded([&] {
+        alignas(std::max_align_t) std::byte buffer[SCRATCH_BYTES];
+        std::pmr::monotonic_buffer_resource scratch(buffer, sizeof(buffer));
+        std::pmr::vector<Slice> slices(&scratch);
+        slices.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            slices.push_back(packed(keys, key_offsets, i));
+        }
+        ART::ValueBatch values(&scratch);
+        auto found = db->tree.read_batch(slices, values, &scratch);
+        artikv_batch batch{};
+        batch.count = count;
+        batch.found = allocate<uint8_t>(count);
+        for (size_t i = 0; i < count; i++) {
+            batch.found[i] = found[i];
+        }
+        try {
+            copyOut(values, batch.data, batch.offsets);
+        } catch (...) {
+            artikv_batch_free(&batch);
+            throw;
+        }
+        *out = batch;
+        return ARTIKV_OK;
+    });
+}
+
+void artikv_batch_free(artikv_batch *batch) {
+    if (batch == nullptr) {
+        return;
+    }
+    std::free(batch->data);
+    std::free(batch->offsets);
+    std::free(batch->found);
+    std::free(batch->keys);
+    std::free(batch->key_offsets);
+    *batch = {};
+}
+
+artikv_status artikv_iter_open(artikv_db *db, const uint8_t *start,
+                               size_t start_len, artikv_iter **iter) {
+    if (iter == nullptr) {
+        return invalid("iter is NULL");
+    }
+    *iter = nullptr;
+    return guarded([&] {
+        *iter = start == nullptr
+                    ? new artikv_iter{db->tree.begin()}
+                    : new artikv_iter{db->tree.lower_bound(Slice(start, start_len))};
+        return ARTIKV_OK;
+    });
+}
+
+void artikv_iter_close(artikv_iter *iter) { delete iter; }
+
+int artikv_iter_valid(const artikv_iter *iter) { return iter->it.valid(); }
+
+void artikv_iter_next(artikv_iter *iter) { iter->it.next(); }
+
+void artikv_iter_key(const artikv_iter *iter, const uint8_t **key,
+                     size_t *key_len) {
+    auto k = iter->it.key();
+    *key = k.data();
+    *key_len = k.size();
+}
+
+void artikv_iter_value(const artikv_iter *iter, const uint8_t **value,
+                       size_t *value_len) {
+    auto v = iter->it.value();
+    *value = v.data();
+    *value_len = v.size();
+}
+
+artikv_status artikv_iter_next_batch(artikv_iter *iter, size_t max,
+                                     artikv_batch *out) {
+    if (out == nullptr) {
+        return invalid("out is NULL");
+    }
+    *out = {};
+    return guarded([&] {
+        alignas(std::max_align_t) std::byte buffer[SCRATCH_BYTES];
+        std::pmr::monotonic_buffer_resource scratch(buffer, sizeof(buffer));
+        ART::KeyBatch keys(&scratch);
+        ART::ValueBatch values(&scratch);
+        iter->it.next_batch(max, keys, values);
+        artikv_batch batch{};
+        batch.count = keys.size();
+        try {
+            copyOut(keys, batch.keys, batch.key_offsets);
+            copyOut(values, batch.data, batch.offsets);
+        } catch (...) {
+            artikv_batch_free(&batch);
+            throw;
+        }
+        *out = batch;
+        return ARTIKV_OK;
+    });
+}
@@ -0,0 +1,128 @@
+#ifndef ARTIKV_C_H
+#define ARTIKV_C_H
+
+/*
+ * C interface of the ArtiKV engine, exported from the shared library for
+ * embedding from other languages.
+ *
+ * Batched calls exchange keys and values as packed arrays: `count` strings
+ * stored back to back in one byte buffer, with `count + 1` offsets so that
+ * string i is data[offsets[i], offsets[i + 1]). One call then covers a whole
+ * batch, which keeps the per-call cost of a foreign-function boundary off
+ * every key.
+ *
+ * Functions that can fail return an artikv_status; the message of the last
+ * failure on the calling thread is available from artikv_last_error().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARTIKV_API __attribute__((visibility("default")))
+
+/* Bumped whenever a signature or struct layout below changes. */
+#define ARTIKV_ABI_VERSION 1
+
+typedef enum artikv_status {
+  ARTIKV_OK = 0,
+  ARTIKV_NOT_FOUND = 1,
+  ARTIKV_BUFFER_TOO_SMALL = 2,
+  ARTIKV_INVALID_ARGUMENT = 3,
+  ARTIKV_IO_ERROR = 4,
+  ARTIKV_ERROR = 5,
+} artikv_status;
+
+typedef struct artikv_db artikv_db;
+typedef struct artikv_iter artikv_iter;
+
+/*
+ * Packed result of a batched read, allocated by the library and released
+ * with artikv_batch_free. Entry i is data[offsets[i], offsets[i + 1]); for
+ * artikv_multi_get, found[i] is 0 for a missing key, whose entry is empty.
+ */
+typedef struct artikv_batch {
+  size_t count;
+  uint8_t *data;
+  uint64_t *offsets;
+  uint8_t *found;
+  /* Keys of the entries, for iterator batches; NULL otherwise. */
+  uint8_t *keys;
+  uint64_t *key_offsets;
+} artikv_batch;
+
+ARTIKV_API int artikv_abi_version(void);
+ARTIKV_API const char *artikv_last_error(void);
+
+/*
+ * Opens an engine, loading the checkpoint at `path` if it is not NULL and
+ * the file exists.
+ */
+ARTIKV_API artikv_status artikv_open(const char *path, artikv_db **db);
+ARTIKV_API void artikv_close(artikv_db *db);
+/* Writes a checkpoint split into `parts` range files (1 for a single file). */
+ARTIKV_API artikv_status artikv_save(artikv_db *db, const char *path,
+                                     size_t parts);
+ARTIKV_API size_t artikv_size(artikv_db *db);
+
+ARTIKV_API artikv_status artikv_put(artikv_db *db, const uint8_t *key,
+                                    size_t key_len, const uint8_t *value,
+                                    size_t value_len);
+ARTIKV_API artikv_status artikv_delete(artikv_db *db, const uint8_t *key,
+                                       size_t key_len);
+/*
+ * Copies the value of `key` into `buf`. `*value_len` receives the value's
+ * size; if it exceeds `cap`, nothing is copied and ARTIKV_BUFFER_TOO_SMALL
+ * is returned.
+ */
+ARTIKV_API artikv_status artikv_get(artikv_db *db, const uint8_t *key,
+                                    size_t key_len, uint8_t *buf, size_t cap,
+                                    size_t *value_len);
+
+/*
+ * Inserts `count` pairs; when a key repeats, the last occurrence wins. The
+ * batch is applied in key order so consecutive inserts share their path.
+ */
+ARTIKV_API artikv_status artikv_put_batch(artikv_db *db, const uint8_t *keys,
+                                          const uint64_t *key_offsets,
+                                          const uint8_t *values,
+                                          const uint64_t *value_offsets,
+                                          size_t count);
+/* Looks up `count` keys; `out` receives one entry per key, in order. */
+ARTIKV_API artikv_status artikv_multi_get(artikv_db *db, const uint8_t *keys,
+                                          const uint64_t *key_offsets,
+                                          size_t count, artikv_batch *out);
+ARTIKV_API void artikv_batch_free(artikv_batch *batch);
+
+/*
+ * Iterators walk the pairs in key order from the first key not less than
+ * `start` (the smallest key if `start` is NULL). They are weakly consistent
+ * and must be used and closed on the thread that opened them. Pointers
+ * returned by artikv_iter_key and artikv_iter_value stay valid until the
+ * iterator moves.
+ */
+ARTIKV_API artikv_status artikv_iter_open(artikv_db *db, const uint8_t *start,
+                                          size_t start_len,
+                                          artikv_iter **iter);
+ARTIKV_API void artikv_iter_close(artikv_iter *iter);
+ARTIKV_API int artikv_iter_valid(const artikv_iter *iter);
+ARTIKV_API void artikv_iter_next(artikv_iter *iter);
+ARTIKV_API void artikv_iter_key(const artikv_iter *iter, const uint8_t **key,
+                                size_t *key_len);
+ARTIKV_API void artikv_iter_value(const artikv_iter *iter,
+                                  const uint8_t **value, size_t *value_len);
+/*
+ * Copies up to `max` pairs into `out`, keys included, and advances past
+ * them. `out->count` is 0 once the iterator is exhausted.
+ */
+ARTIKV_API artikv_status artikv_iter_next_batch(artikv_iter *iter, size_t max,
+                                                artikv_batch *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARTIKV_C_H */
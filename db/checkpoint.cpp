@@ -0,0 +1,298 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace art;
+
+namespace {
+constexpr uint32_t TRAILER = 0xFFFFFFFF;
+// Tree samples taken per part when choosing the part boundaries.
+constexpr size_t SAMPLES_PER_PART = 64;
+
+using File = std::unique_ptr<FILE, decltype(&fclose)>;
+
+[[noreturn]] void fail(const std::string &what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+File open(const std::string &path, const char *mode) {
+    File file(fopen(path.c_str(), mode), &fclose);
+    if (!file) {
+        fail("open " + path);
+    }
+    return file;
+}
+
+void write(FILE *file, const void *data, size_t len, const std::string &path) {
+    if (len != 0 && fwrite(data, 1, len, file) != len) {
+        fail("write " + path);
+    }
+}
+
+void read(FILE *file, void *data, size_t len, const std::string &path) {
+    if (len != 0 && fread(data, 1, len, file) != len) {
+        if (feof(file)) {
+            throw std::runtime_error("truncated checkpoint " + path);
+        }
+        fail("read " + path);
+    }
+}
+
+// Flushes `file` to disk and moves it from `tmp` to `path`.
+void commit(File file, const std::string &tmp, const std::string &path) {
+    if (fflush(file.get()) != 0 || fsync(fileno(file.get())) != 0) {
+        fail("flush " + tmp);
+    }
+    file.reset();
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        fail("rename " + tmp);
+    }
+}
+
+// Writes the pairs with keys in [lo, hi) as one checkpoint file; a null
+// bound is open.
+size_t writeRange(ART &tree, const std::string &path, const ARTData *lo,
+                  const ARTData *hi) {
+    auto tmp = path + ".tmp";
+    auto file = open(tmp, "wb");
+    write(file.get(), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), tmp);
+    uint64_t count = 0;
+    auto it = lo == nullptr ? tree.begin()
+                            : tree.lower_bound(Slice(lo->data(), lo->size()));
+    for (; it.valid(); it.next()) {
+        auto key = it.key();
+        if (hi != nullptr && !std::lexicographical_compare(
+                                 key.begin(), key.end(), hi->begin(),
+                                 hi->end())) {
+            break;
+        }
+        auto val = it.value();
+        uint32_t lens[2] = {uint32_t(key.size()), uint32_t(val.size())};
+        write(file.get(), lens, sizeof(lens), tmp);
+        write(file.get(), key.data(), key.size(), tmp);
+        write(file.get(), val.data(), val.size(), tmp);
+        count++;
+    }
+    write(file.get(), &TRAILER, sizeof(TRAILER), tmp);
+    write(file.get(), &count, sizeof(count), tmp);
+    commit(std::move(file), tmp, path);
+    return count;
+}
+
+// Reads one checkpoint file whose magic has already been consumed. Records
+// come in key order, so each insert resumes from the previous one's path.
+size_t readRecords(ART &tree, FILE *file, const std::string &path) {
+    uint64_t count = 0;
+    ART::Finger finger;
+    std::vector<uint8_t> key;
+    while (true) {
+        uint32_t key_len;
+        read(file, &key_len, sizeof(key_len), path);
+        if (key_len == TRAILER) {
+            break;
+        }
+        uint32_t val_len;
+        read(file, &val_len, sizeof(val_len), path);
+        key.resize(key_len);
+        std::vector<uint8_t> val(val_len);
+        read(file, key.data(), key_len, path);
+        read(file, val.data(), val_len, path);
+        tree.insert_hint(finger, Slice(key.data(), key.size()), std::move(val));
+        count++;
+    }
+    uint64_t expected;
+    read(file, &expected, sizeof(expected), path);
+    if (expected != count) {
+        throw std::runtime_error("corrupt checkpoint " + path);
+    }
+    return count;
+}
+
+// Runs `work(i)` for i in [0, n) on n threads and rethrows the first error.
+template <typename F> void runParallel(size_t n, F &&work) {
+    std::vector<std::exception_ptr> errors(n);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < n; i++) {
+        threads.emplace_back([&, i] {
+            try {
+                work(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+// Reads the part names of a manifest whose magic has already been consumed,
+// as paths next to the manifest.
+std::vector<std::string> readPartNames(FILE *file, const std::string &path) {
+    uint32_t parts;
+    read(file, &parts, sizeof(parts), path);
+    auto dir = std::filesystem::path(path).parent_path();
+    std::vector<std::string> names(parts);
+    for (auto &name : names) {
+        uint32_t len;
+        read(file, &len, sizeof(len), path);
+        name.resize(len);
+        read(file, name.data(), len, path);
+        name = (dir / name).string();
+    }
+    return names;
+}
+
+// The parts of the manifest at `path`; none if there is no manifest there.
+std::vector<std::string> previousParts(const std::string &path) {
+    File file(fopen(path.c_str(), "rb"), &fclose);
+    char magic[sizeof(MANIFEST_MAGIC)];
+    if (!file || fread(magic, 1, sizeof(magic), file.get()) != sizeof(magic) ||
+        std::memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) != 0) {
+        return {};
+    }
+    try {
+        return readPartNames(file.get(), path);
+    } catch (const std::exception &) {
+        return {};
+    }
+}
+
+// The generation in a part name "<base>.<generation>.part<i>", 0 if it has
+// none.
+uint64_t generationOf(const std::string &part, const std::string &base) {
+    auto name = std::filesystem::path(part).filename().string();
+    if (!name.starts_with(base + ".")) {
+        return 0;
+    }
+    uint64_t generation = 0;
+    auto *begin = name.data() + base.size() + 1;
+    auto [end, ec] = std::from_chars(begin, name.data() + name.size(),
+                                     generation);
+    return ec == std::errc() && std::string_view(end).starts_with(".part")
+               ? generation
+               : 0;
+}
+
+// Removes the parts of a checkpoint that a newer one has replaced.
+void removeParts(const std::vector<std::string> &parts) {
+    for (auto &part : parts) {
+        std::error_code ignored;
+        std::filesystem::remove(part, ignored);
+    }
+}
+
+// Loads every part listed in a manifest into its own tree in parallel, then
+// merges them. The parts cover disjoint key ranges, so each merge only walks
+// the boundary paths.
+size_t loadParts(ART &tree, FILE *file, const std::string &path) {
+    auto names = readPartNames(file, path);
+    auto parts = names.size();
+    std::vector<std::unique_ptr<ART>> trees(parts);
+    std::vector<size_t> counts(parts);
+    runParallel(parts, [&](size_t i) {
+        trees[i] = std::make_unique<ART>();
+        counts[i] = loadCheckpoint(*trees[i], names[i]);
+    });
+    size_t count = 0;
+    for (size_t i = 0; i < parts; i++) {
+        tree.merge(*trees[i]);
+        count += counts[i];
+    }
+    return count;
+}
+} // namespace
+
+size_t art::saveCheckpoint(ART &tree, const std::string &path) {
+    auto previous = previousParts(path);
+    auto count = writeRange(tree, path, nullptr, nullptr);
+    removeParts(previous);
+    return count;
+}
+
+size_t art::saveCheckpoint(ART &tree, const std::string &path, size_t parts) {
+    if (parts <= 1) {
+        return saveCheckpoint(tree, path);
+    }
+    auto samples = tree.sample(parts * SAMPLES_PER_PART);
+    std::sort(samples.begin(), samples.end());
+    samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+    // Part i covers [bounds[i - 1], bounds[i]).
+    std::vector<ARTData> bounds;
+    for (size_t i = 1; i < parts && !samples.empty(); i++) {
+        auto &bound = samples[i * samples.size() / parts];
+        if (bounds.empty() || bounds.back() != bound) {
+            bounds.push_back(bound);
+        }
+    }
+    parts = bounds.size() + 1;
+
+    // Parts of this save get names of their own, so that until the new
+    // manifest replaces the old one, the old one names only its own parts.
+    auto base = std::filesystem::path(path).filename().string();
+    auto previous = previousParts(path);
+    uint64_t generation = 0;
+    for (auto &part : previous) {
+        generation = std::max(generation, generationOf(part, base));
+    }
+    auto prefix = base + "." + std::to_string(generation + 1) + ".part";
+    std::vector<std::string> names(parts);
+    std::vector<size_t> counts(parts);
+    for (size_t i = 0; i < parts; i++) {
+        names[i] = prefix + std::to_string(i);
+    }
+    auto dir = std::filesystem::path(path).parent_path();
+    runParallel(parts, [&](size_t i) {
+        auto *lo = i == 0 ? nullptr : &bounds[i - 1];
+        auto *hi = i + 1 == parts ? nullptr : &bounds[i];
+        counts[i] = writeRange(tree, (dir / names[i]).string(), lo, hi);
+    });
+
+    auto tmp = path + ".tmp";
+    auto file = open(tmp, "wb");
+    write(file.get(), MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC), tmp);
+    uint32_t n = parts;
+    write(file.get(), &n, sizeof(n), tmp);
+    for (auto &name : names) {
+        uint32_t len = name.size();
+        write(file.get(), &len, sizeof(len), tmp);
+        write(file.get(), name.data(), len, tmp);
+    }
+    commit(std::move(file), tmp, path);
+    removeParts(previous);
+    size_t count = 0;
+    for (auto c : counts) {
+        count += c;
+    }
+    return count;
+}
+
+size_t art::loadCheckpoint(ART &tree, const std::string &path) {
+    auto file = open(path, "rb");
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    read(file.get(), magic, sizeof(magic), path);
+    if (std::memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) == 0) {
+        return loadParts(tree, file.get(), path);
+    }
+    if (std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("not a checkpoint: " + path);
+    }
+    return readRecords(tree, file.get(), path);
+}
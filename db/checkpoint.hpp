@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "art.hpp"
+
+namespace art {
+
+/**
+ * Checkpoint file layout, all integers in host byte order:
+ *
+ *   "ARTIKV01"                          8-byte magic
+ *   { u32 key_len, u32 val_len,
+ *     key bytes, val bytes }*           one record per pair, in key order
+ *   u32 0xFFFFFFFF, u64 record_count    trailer
+ *
+ * A file without a complete trailer is rejected, so a crash mid-write never
+ * looks like a smaller but valid checkpoint.
+ *
+ * A checkpoint split into parts is a manifest instead:
+ *
+ *   "ARTIKVM1"                          8-byte magic
+ *   u32 part_count
+ *   { u32 name_len, name bytes }*       part files, relative to the manifest,
+ *                                       in key order
+ *
+ * where every part is a checkpoint file as above covering one contiguous key
+ * range.
+ */
+inline constexpr char CHECKPOINT_MAGIC[8] = {'A', 'R', 'T', 'I',
+                                             'K', 'V', '0', '1'};
+inline constexpr char MANIFEST_MAGIC[8] = {'A', 'R', 'T', 'I',
+                                           'K', 'V', 'M', '1'};
+
+/**
+ * Streams every pair of `tree` to `path` through the ordered iterator. The
+ * data is written to `path` + ".tmp" and renamed into place once complete;
+ * the parts of a manifest it replaces are removed after that.
+ *
+ * @return The number of pairs written.
+ * @throws std::system_error if the file cannot be written.
+ */
+size_t saveCheckpoint(ART &tree, const std::string &path);
+
+/**
+ * Writes `tree` as up to `parts` checkpoint files, each covering a key range
+ * of roughly equal size chosen by sampling the tree, on one thread per part.
+ * The parts are named `path` + ".<generation>.part<i>", with a generation
+ * newer than that of the manifest at `path`, so the manifest listing them
+ * replaces the old one only once all of them are complete, and a crash at
+ * any point leaves `path` naming one consistent set of parts. The previous
+ * save's parts are removed last.
+ *
+ * @return The number of pairs written.
+ * @throws std::system_error if a file cannot be written.
+ */
+size_t saveCheckpoint(ART &tree, const std::string &path, size_t parts);
+
+/**
+ * Inserts every pair stored in the checkpoint at `path` into `tree`. For a
+ * manifest, the parts are read into separate trees on one thread each and
+ * then merged into `tree`.
+ *
+ * @return The number of pairs read.
+ * @throws std::system_error if the file cannot be read, std::runtime_error
+ * if it is not a complete checkpoint.
+ */
+size_t loadCheckpoint(ART &tree, const std::string &path);
+
+} // namespace art
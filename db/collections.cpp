@@ -0,0 +1,337 @@
+#include "collections.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+using namespace art;
+
+namespace {
+constexpr uint8_t ESCAPE = 0x00;
+constexpr uint8_t ESCAPED = 0xFF;
+constexpr uint8_t TERMINATOR = 0x00;
+constexpr size_t POSITION_BYTES = sizeof(uint64_t);
+constexpr uint64_t SIGN = uint64_t(1) << 63;
+
+// The tree key prefix of collection `key`.
+ARTData prefixOf(Slice key) {
+    ARTData prefix;
+    prefix.reserve(key.size() + 3);
+    prefix.push_back(Collections::ROOT);
+    for (auto byte : key) {
+        prefix.push_back(byte);
+        if (byte == ESCAPE) {
+            prefix.push_back(ESCAPED);
+        }
+    }
+    prefix.push_back(ESCAPE);
+    prefix.push_back(TERMINATOR);
+    return prefix;
+}
+
+ARTData elementKey(const ARTData &prefix, Slice element) {
+    ARTData key(prefix);
+    key.insert(key.end(), element.begin(), element.end());
+    return key;
+}
+
+// Big-endian, with the sign bit flipped so that positions sort as numbers.
+ARTData positionKey(const ARTData &prefix, int64_t position) {
+    ARTData key(prefix);
+    auto bits = uint64_t(position) ^ SIGN;
+    for (size_t i = 0; i < POSITION_BYTES; i++) {
+        key.push_back(uint8_t(bits >> (56 - 8 * i)));
+    }
+    return key;
+}
+
+// The collection name a prefix encodes.
+ARTData nameOf(std::span<const uint8_t> prefix) {
+    ARTData name;
+    for (size_t i = 1; i + 2 < prefix.size(); i++) {
+        name.push_back(prefix[i]);
+        // Skips the byte marking an escaped 0x00.
+        i += prefix[i] == ESCAPE;
+    }
+    return name;
+}
+
+Slice slice(const ARTData &data) { return Slice(data.data(), data.size()); }
+} // namespace
+
+Collections::Collections(ART &tree) : tree(tree) {
+    // Each header comes first among the keys under its prefix.
+    uint8_t root = ROOT;
+    ARTData header;
+    for (auto it = tree.lower_bound(Slice(&root, 1)); it.valid(); it.next()) {
+        auto key = it.key();
+        used++;
+        if (header.empty() || key.size() < header.size() ||
+            !std::equal(header.begin(), header.end(), key.begin())) {
+            header.assign(key.begin(), key.end());
+            collections++;
+        }
+    }
+}
+
+// The header of the collection at `prefix`, or an empty one of `type` if
+// there is none. `Type::None` accepts any type.
+Collections::Header Collections::load(Slice prefix, Type type) {
+    Header header;
+    auto size = tree.read(
+        prefix, std::span(reinterpret_cast<uint8_t *>(&header), sizeof(header)));
+    if (!size) {
+        header.type = type;
+        return header;
+    }
+    if (type != Type::None && header.type != type) {
+        throw std::invalid_argument("key holds a collection of another type");
+    }
+    return header;
+}
+
+void Collections::store(Slice prefix, const Header &header) {
+    if (header.count == 0) {
+        tree.remove(prefix);
+        collections--;
+        used--;
+        return;
+    }
+    auto *bytes = reinterpret_cast<const uint8_t *>(&header);
+    tree.insert(prefix, ARTData(bytes, bytes + sizeof(header)));
+}
+
+Collections::Type Collections::type(Slice key) {
+    auto prefix = prefixOf(key);
+    return load(slice(prefix), Type::None).type;
+}
+
+size_t Collections::size(Slice key) {
+    auto prefix = prefixOf(key);
+    return load(slice(prefix), Type::None).count;
+}
+
+ART::Detached Collections::drop(Slice key) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), Type::None);
+    if (header.type == Type::None) {
+        return {};
+    }
+    // The header and one pair per element.
+    auto pairs = size_t(header.count) + 1;
+    collections--;
+    used -= pairs;
+    return tree.detach_prefix(slice(prefix), pairs);
+}
+
+std::vector<ARTData> Collections::names(Type type) {
+    std::vector<ARTData> found;
+    ARTData next{ROOT};
+    while (true) {
+        auto it = tree.lower_bound(slice(next));
+        if (!it.valid()) {
+            break;
+        }
+        // The first key at or after `next` is the header of a collection.
+        auto prefix = it.key();
+        auto value = it.read_value();
+        Header header;
+        std::memcpy(&header, value.data(), std::min(value.size(), sizeof(header)));
+        if (header.type == type) {
+            found.push_back(nameOf(prefix));
+        }
+        // The prefix ends with the 0x00 0x00 terminator; raising its last
+        // byte skips every key below it.
+        next.assign(prefix.begin(), prefix.end());
+        next.back()++;
+    }
+    return found;
+}
+
+bool Collections::addElement(Slice key, Type type, Slice element,
+                             Slice value) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), type);
+    auto element_key = elementKey(prefix, element);
+    bool added = !tree.search(slice(element_key));
+    tree.insert(slice(element_key), value.as_span());
+    if (added) {
+        collections += header.count == 0;
+        used += 1 + (header.count == 0);
+        header.count++;
+        store(slice(prefix), header);
+    }
+    return added;
+}
+
+bool Collections::removeElement(Slice key, Type type, Slice element) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), type);
+    auto element_key = elementKey(prefix, element);
+    if (header.count == 0 || !tree.search(slice(element_key))) {
+        return false;
+    }
+    tree.remove(slice(element_key));
+    used--;
+    header.count--;
+    store(slice(prefix), header);
+    return true;
+}
+
+bool Collections::hset(Slice key, Slice field, Slice value) {
+    return addElement(key, Type::Hash, field, value);
+}
+
+std::optional<ARTData> Collections::hget(Slice key, Slice field) {
+    auto prefix = prefixOf(key);
+    if (load(slice(prefix), Type::Hash).count == 0) {
+        return std::nullopt;
+    }
+    return tree.read(slice(elementKey(prefix, field)));
+}
+
+bool Collections::hdel(Slice key, Slice field) {
+    return removeElement(key, Type::Hash, field);
+}
+
+bool Collections::sadd(Slice key, Slice member) {
+    return addElement(key, Type::Set, member, std::string_view());
+}
+
+bool Collections::srem(Slice key, Slice member) {
+    return removeElement(key, Type::Set, member);
+}
+
+bool Collections::sismember(Slice key, Slice member) {
+    auto prefix = prefixOf(key);
+    if (load(slice(prefix), Type::Set).count == 0) {
+        return false;
+    }
+    return tree.search(slice(elementKey(prefix, member))).has_value();
+}
+
+bool Collections::zadd(Slice key, Slice member, double score) {
+    auto *bytes = reinterpret_cast<const uint8_t *>(&score);
+    ARTData value(bytes, bytes + sizeof(score));
+    return addElement(key, Type::Zset, member, slice(value));
+}
+
+bool Collections::zrem(Slice key, Slice member) {
+    return removeElement(key, Type::Zset, member);
+}
+
+std::optional<double> Collections::zscore(Slice key, Slice member) {
+    auto prefix = prefixOf(key);
+    if (load(slice(prefix), Type::Zset).count == 0) {
+        return std::nullopt;
+    }
+    double score;
+    auto size = tree.read(
+        slice(elementKey(prefix, member)),
+        std::span(reinterpret_cast<uint8_t *>(&score), sizeof(score)));
+    if (!size) {
+        return std::nullopt;
+    }
+    return score;
+}
+
+std::vector<Collections::ScoredMember>
+Collections::zmembers(Slice key, Slice from, size_t limit) {
+    std::vector<ScoredMember> members;
+    for (auto &[member, value] : elements(key, from, limit)) {
+        double score = 0;
+        std::memcpy(&score, value.data(), std::min(value.size(), sizeof(score)));
+        members.emplace_back(std::move(member), score);
+    }
+    return members;
+}
+
+std::vector<Collections::Entry> Collections::elements(Slice key, Slice from,
+                                                      size_t limit) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), Type::None);
+    if (header.type == Type::List) {
+        throw std::invalid_argument("key holds a list");
+    }
+    std::vector<Entry> entries;
+    if (header.count == 0) {
+        return entries;
+    }
+    // The header itself is the smallest key under the prefix.
+    auto start = elementKey(prefix, from);
+    for (auto it = tree.lower_bound(slice(start));
+         it.valid() && entries.size() < limit; it.next()) {
+        auto element = it.key();
+        if (element.size() < prefix.size() ||
+            !std::equal(prefix.begin(), prefix.end(), element.begin())) {
+            break;
+        }
+        if (element.size() == prefix.size()) {
+            continue;
+        }
+        entries.emplace_back(
+            ARTData(element.begin() + prefix.size(), element.end()),
+            it.read_value());
+    }
+    return entries;
+}
+
+size_t Collections::push(Slice key, Slice value, bool front) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), Type::List);
+    auto position = front ? --header.head : header.tail++;
+    tree.insert(slice(positionKey(prefix, position)), value.as_span());
+    collections += header.count == 0;
+    used += 1 + (header.count == 0);
+    header.count++;
+    store(slice(prefix), header);
+    return header.count;
+}
+
+std::optional<ARTData> Collections::pop(Slice key, bool front) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), Type::List);
+    if (header.count == 0) {
+        return std::nullopt;
+    }
+    auto position_key =
+        positionKey(prefix, front ? header.head++ : --header.tail);
+    auto value = tree.read(slice(position_key));
+    tree.remove(slice(position_key));
+    used--;
+    header.count--;
+    store(slice(prefix), header);
+    return value;
+}
+
+std::optional<ARTData> Collections::index(Slice key, int64_t index) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), Type::List);
+    auto count = int64_t(header.count);
+    if (index < 0) {
+        index += count;
+    }
+    if (index < 0 || index >= count) {
+        return std::nullopt;
+    }
+    return tree.read(slice(positionKey(prefix, header.head + index)));
+}
+
+std::vector<ARTData> Collections::range(Slice key, int64_t start,
+                                        int64_t stop) {
+    auto prefix = prefixOf(key);
+    auto header = load(slice(prefix), Type::List);
+    auto count = int64_t(header.count);
+    start = start < 0 ? std::max<int64_t>(0, start + count) : start;
+    stop = stop < 0 ? stop + count : std::min(stop, count - 1);
+    std::vector<ARTData> values;
+    if (start > stop) {
+        return values;
+    }
+    auto first = positionKey(prefix, header.head + start);
+    for (auto it = tree.lower_bound(slice(first));
+         it.valid() && int64_t(values.size()) <= stop - start; it.next()) {
+        values.push_back(it.read_value());
+    }
+    return values;
+}
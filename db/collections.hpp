@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "art.hpp"
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class Collections
+ * @brief Hashes, sets, lists and sorted sets stored together in one ART, each
+ * under a key prefix of its own.
+ *
+ * The tree may hold other pairs too, such as a server's string keys: the
+ * collections only use keys starting with the `ROOT` byte, which the other
+ * users keep clear of. A checkpoint of the tree therefore covers them, and a
+ * `Collections` created on a loaded tree picks them up again.
+ *
+ * A collection named `key` owns every tree key that starts with `ROOT` and
+ * the encoding of `key`, in which 0x00 bytes are escaped and a 0x00 0x00
+ * terminator follows, so that no collection's prefix is a prefix of
+ * another's. The prefix alone holds a header with the type and the number of
+ * elements.
+ * Below it, a hash keeps field -> value, a set keeps member -> empty, a
+ * list keeps position -> element, positions being 8 big-endian bytes that
+ * grow towards the tail, and a sorted set keeps member -> score. Ordering
+ * a sorted set by score is left to an index such as `ScoreIndex`, which can
+ * be rebuilt from the members.
+ *
+ * Element operations are single lookups, the same from three fields to
+ * millions, and so is `drop`, which takes the number of pairs it removes
+ * from the header and leaves walking and freeing them to the caller.
+ *
+ * Reads may run alongside one writer at a time. Operations on a key that
+ * holds a collection of another type throw std::invalid_argument.
+ */
+class Collections {
+public:
+  enum class Type : uint8_t { None, Hash, Set, List, Zset };
+  using Entry = std::pair<ARTData, ARTData>;
+  using ScoredMember = std::pair<ARTData, double>;
+
+  // First byte of every tree key the collections own.
+  static constexpr uint8_t ROOT = 0xFF;
+  static bool owns(Slice key) { return key.size() > 0 && key[0] == ROOT; }
+
+  // Collections kept in `tree`, counting those it already holds. The tree
+  // must outlive them.
+  explicit Collections(ART &tree);
+
+  Type type(Slice key);
+  // Number of elements, 0 if there is no such collection.
+  size_t size(Slice key);
+  // Number of collections.
+  size_t count() const { return collections; }
+  // Number of tree pairs the collections use, headers included.
+  size_t pairs() const { return used; }
+  // Unlinks the collection named `key`, in one descent, and hands back its
+  // pairs for the caller to release, e.g. off the writer's thread; an empty
+  // handle if there is no such collection.
+  ART::Detached drop(Slice key);
+  // Names of the collections of `type`, in key order.
+  std::vector<ARTData> names(Type type);
+
+  // Returns whether `field` is new.
+  bool hset(Slice key, Slice field, Slice value);
+  std::optional<ARTData> hget(Slice key, Slice field);
+  bool hdel(Slice key, Slice field);
+
+  // Returns whether `member` is new.
+  bool sadd(Slice key, Slice member);
+  bool srem(Slice key, Slice member);
+  bool sismember(Slice key, Slice member);
+
+  // Up to `limit` fields of a hash with their values, or members of a set
+  // with empty values, from the smallest not less than `from`.
+  std::vector<Entry> elements(Slice key, Slice from, size_t limit);
+
+  // Sets the score of `member` and returns whether it is new.
+  bool zadd(Slice key, Slice member, double score);
+  bool zrem(Slice key, Slice member);
+  std::optional<double> zscore(Slice key, Slice member);
+  // Up to `limit` members of a sorted set with their scores, in member
+  // order from the smallest not less than `from`.
+  std::vector<ScoredMember> zmembers(Slice key, Slice from, size_t limit);
+
+  // Adds `value` at the head or the tail of a list and returns its length.
+  size_t push(Slice key, Slice value, bool front);
+  std::optional<ARTData> pop(Slice key, bool front);
+  // Element at `index`, counted from the tail when negative.
+  std::optional<ARTData> index(Slice key, int64_t index);
+  // Elements from `start` to `stop`, both included, the way LRANGE reads
+  // them: negative indices count from the tail.
+  std::vector<ARTData> range(Slice key, int64_t start, int64_t stop);
+
+private:
+  struct Header {
+    Type type = Type::None;
+    uint64_t count = 0;
+    // Lists only: the position of the head and the one past the tail.
+    int64_t head = 0;
+    int64_t tail = 0;
+  };
+
+  ART &tree;
+  size_t collections = 0;
+  size_t used = 0;
+
+  Header load(Slice prefix, Type type);
+  void store(Slice prefix, const Header &header);
+  bool addElement(Slice key, Type type, Slice element, Slice value);
+  bool removeElement(Slice key, Type type, Slice element);
+};
+
+} // namespace art
@@ -0,0 +1,96 @@
+#include "combining.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace art;
+
+namespace {
+size_t threadSlot() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t slot =
+        next.fetch_add(1, std::memory_order_relaxed) %
+        CombiningWriter::MAX_SLOTS;
+    return slot;
+}
+
+bool keyLess(Slice a, Slice b) {
+    auto n = std::min(a.size(), b.size());
+    auto cmp = std::memcmp(a.data(), b.data(), n);
+    return cmp < 0 || (cmp == 0 && a.size() < b.size());
+}
+} // namespace
+
+CombiningWriter::CombiningWriter(ART &tree)
+    : tree(tree), shards(std::make_unique<Shard[]>(SHARDS)) {}
+
+void CombiningWriter::insert(Slice key, OwnedSlice value) {
+    Request request{key, &value};
+    submit(request);
+}
+
+void CombiningWriter::remove(Slice key) {
+    Request request{key, nullptr};
+    submit(request);
+}
+
+void CombiningWriter::submit(Request &request) {
+    auto &shard = shards[request.key.empty() ? 0 : request.key[0] % SHARDS];
+    auto &slot = shard.slots[threadSlot()];
+    Request *expected = nullptr;
+    if (!slot.compare_exchange_strong(expected, &request,
+                                      std::memory_order_release)) {
+        // Another thread shares this slot; skip combining for this write.
+        apply(request, nullptr);
+    } else {
+        while (!request.done.load(std::memory_order_acquire)) {
+            std::unique_lock combiner(shard.combiner, std::try_to_lock);
+            if (combiner.owns_lock()) {
+                combine(shard);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+    if (request.error) {
+        std::rethrow_exception(request.error);
+    }
+}
+
+void CombiningWriter::combine(Shard &shard) {
+    // Reserved up front: a request taken out of its slot must reach apply.
+    std::vector<Request *> batch;
+    batch.reserve(MAX_SLOTS);
+    for (auto &slot : shard.slots) {
+        if (slot.load(std::memory_order_relaxed) == nullptr) {
+            continue;
+        }
+        if (auto *request = slot.exchange(nullptr, std::memory_order_acquire)) {
+            batch.push_back(request);
+        }
+    }
+    // Sorted keys let each insert resume deep in the previous one's path.
+    std::stable_sort(batch.begin(), batch.end(), [](Request *a, Request *b) {
+        return keyLess(a->key, b->key);
+    });
+    for (auto *request : batch) {
+        apply(*request, &shard.finger);
+    }
+}
+
+// Never throws: a failure is handed back to the request's own thread.
+void CombiningWriter::apply(Request &request, ART::Finger *finger) {
+    try {
+        if (request.value != nullptr && finger != nullptr) {
+            tree.insert_hint(*finger, request.key, std::move(*request.value));
+        } else if (request.value != nullptr) {
+            tree.insert(request.key, std::move(*request.value));
+        } else {
+            tree.remove(request.key);
+        }
+    } catch (...) {
+        request.error = std::current_exception();
+    }
+    request.done.store(true, std::memory_order_release);
+}
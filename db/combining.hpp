@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+#include "art.hpp"
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class CombiningWriter
+ * @brief Flat-combining write path in front of an `ART`.
+ *
+ * Writers whose keys share a leading byte land in the same shard. Instead of
+ * each of them locking the same inner nodes in turn, a writer publishes its
+ * operation in a per-thread slot of the shard, and whichever writer holds the
+ * shard's combiner lock drains all published slots, sorts them by key and
+ * applies them back to back, each insert resuming from the previous one's
+ * finger. The other writers only wait for their slot to be marked done, so
+ * the contended nodes are handled by one thread whose cache already holds
+ * them.
+ *
+ * Reads go to the tree directly, and writes made straight on the tree can be
+ * mixed with combined ones.
+ *
+ * Usage example:
+ * @code
+ *     ART tree;
+ *     CombiningWriter writer(tree);
+ *     writer.insert("key1", std::string("value1"));
+ *     writer.remove("key1");
+ * @endcode
+ */
+class CombiningWriter {
+public:
+  // Threads beyond this many per shard fall back to writing directly.
+  static constexpr size_t MAX_SLOTS = 64;
+  static constexpr size_t SHARDS = 16;
+
+  explicit CombiningWriter(ART &tree);
+
+  /**
+   * Inserts or overwrites a key-value pair, possibly as part of a batch
+   * applied by another thread. Returns once the write is visible.
+   *
+   * @throws whatever `ART::insert` throws for this write, on this thread.
+   */
+  void insert(Slice key, OwnedSlice value);
+
+  /**
+   * Removes a key, possibly as part of a batch applied by another thread.
+   * Returns once the removal is visible.
+   *
+   * @throws whatever `ART::remove` throws for this removal, on this thread.
+   */
+  void remove(Slice key);
+
+private:
+  struct Request {
+    Slice key;
+    OwnedSlice *value; // nullptr for a removal
+    // Set by whichever thread applied the request if it failed.
+    std::exception_ptr error;
+    std::atomic<bool> done{false};
+  };
+
+  struct alignas(64) Shard {
+    std::mutex combiner;
+    // Path of the combiner's last write, only touched under `combiner`.
+    ART::Finger finger;
+    std::array<std::atomic<Request *>, MAX_SLOTS> slots{};
+  };
+
+  ART &tree;
+  std::unique_ptr<Shard[]> shards;
+
+  void submit(Request &request);
+  void combine(Shard &shard);
+  void apply(Request &request, ART::Finger *finger);
+};
+
+} // namespace art
@@ -0,0 +1,163 @@
+#include "epoch.hpp"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+using namespace art;
+
+namespace {
+// Number of retired objects a thread buffers before it tries to reclaim.
+constexpr size_t COLLECT_THRESHOLD = 64;
+} // namespace
+
+Epoch::Guard::Guard() { Epoch::global().enter(); }
+
+Epoch::Guard::~Guard() {
+    if (active) {
+        Epoch::global().exit();
+    }
+}
+
+Epoch &Epoch::global() {
+    static Epoch epoch;
+    return epoch;
+}
+
+Epoch::~Epoch() {
+    for (auto &r : orphans) {
+        r.reclaim(r.ptr, r.ctx);
+    }
+}
+
+Epoch::Registration::Registration(Epoch &epoch) : state(new ThreadState) {
+    std::lock_guard lock(epoch.registry_mutex);
+    epoch.threads.push_back(state);
+}
+
+Epoch::Registration::~Registration() {
+    auto &epoch = Epoch::global();
+    std::lock_guard lock(epoch.registry_mutex);
+    std::erase(epoch.threads, state);
+    // Whatever this thread could not free yet is finished by the others.
+    {
+        std::lock_guard retired_lock(state->retired_mutex);
+        epoch.orphans.insert(epoch.orphans.end(), state->retired.begin(),
+                             state->retired.end());
+    }
+    delete state;
+}
+
+Epoch::ThreadState &Epoch::local() {
+    thread_local Registration registration(*this);
+    return *registration.state;
+}
+
+void Epoch::enter() {
+    auto &state = local();
+    if (state.nesting++ == 0) {
+        state.active_epoch.store(global_epoch.load(std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+        // Publish the announcement before any tree pointer is loaded.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void Epoch::exit() {
+    auto &state = local();
+    if (--state.nesting == 0) {
+        state.active_epoch.store(0, std::memory_order_release);
+    }
+}
+
+void Epoch::retire(void *ptr, Reclaimer reclaim, void *ctx) {
+    auto &state = local();
+    size_t pending;
+    {
+        std::lock_guard lock(state.retired_mutex);
+        state.retired.push_back(
+            {ptr, reclaim, ctx, global_epoch.load(std::memory_order_seq_cst)});
+        pending = state.retired.size();
+    }
+    if (pending >= COLLECT_THRESHOLD) {
+        collect(state);
+    }
+}
+
+// Advances the global epoch when every active thread has caught up with it
+// and returns the oldest epoch a thread inside a guard may still observe.
+uint64_t Epoch::minActiveEpoch() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto current = global_epoch.load(std::memory_order_relaxed);
+    auto oldest = current;
+    for (auto *t : threads) {
+        auto e = t->active_epoch.load(std::memory_order_acquire);
+        if (e != 0) {
+            oldest = std::min(oldest, e);
+        }
+    }
+    if (oldest == current) {
+        global_epoch.store(current + 1, std::memory_order_seq_cst);
+    }
+    return oldest;
+}
+
+void Epoch::collect(ThreadState &state) {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard lock(registry_mutex);
+        auto oldest = minActiveEpoch();
+        auto split = [&](std::vector<Retired> &list) {
+            auto it = std::partition(list.begin(), list.end(), [&](auto &r) {
+                return r.epoch >= oldest;
+            });
+            ready.insert(ready.end(), it, list.end());
+            list.erase(it, list.end());
+        };
+        std::lock_guard retired_lock(state.retired_mutex);
+        split(state.retired);
+        split(orphans);
+    }
+    for (auto &r : ready) {
+        r.reclaim(r.ptr, r.ctx);
+    }
+}
+
+bool Epoch::inside() { return local().nesting != 0; }
+
+void Epoch::synchronize() {
+    assert(!inside() && "synchronize would wait for its own guard");
+    // Everything retired so far carries an epoch below `target`.
+    auto target = global_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    while (true) {
+        {
+            std::lock_guard lock(registry_mutex);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (std::all_of(threads.begin(), threads.end(), [&](auto *t) {
+                    auto e = t->active_epoch.load(std::memory_order_acquire);
+                    return e == 0 || e >= target;
+                })) {
+                break;
+            }
+        }
+        std::this_thread::yield();
+    }
+    std::vector<Retired> ready;
+    {
+        std::lock_guard lock(registry_mutex);
+        auto split = [&](std::vector<Retired> &list) {
+            auto it = std::partition(list.begin(), list.end(), [&](auto &r) {
+                return r.epoch >= target;
+            });
+            ready.insert(ready.end(), it, list.end());
+            list.erase(it, list.end());
+        };
+        for (auto *t : threads) {
+            std::lock_guard retired_lock(t->retired_mutex);
+            split(t->retired);
+        }
+        split(orphans);
+    }
+    for (auto &r : ready) {
+        r.reclaim(r.ptr, r.ctx);
+    }
+}
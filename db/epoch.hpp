@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace art {
+
+/**
+ * @class Epoch
+ * @brief Epoch-based reclamation for nodes unlinked from a lock-free tree.
+ *
+ * Readers never take locks, so a writer that unlinks a node cannot free it
+ * right away: a reader that loaded the pointer earlier may still be walking
+ * it. Every operation that dereferences tree memory runs inside a `Guard`,
+ * which announces the global epoch the thread entered in. Unlinked memory is
+ * handed to `retire` and only reclaimed once every thread that is still
+ * inside a guard entered after the memory was retired.
+ */
+class Epoch {
+public:
+  using Reclaimer = void (*)(void *ptr, void *ctx);
+
+  // Critical section in which pointers loaded from a tree stay valid.
+  // Guards nest; only the outermost one announces the epoch. A guard may be
+  // moved but stays bound to the thread that created it.
+  class Guard {
+  public:
+    Guard();
+    ~Guard();
+    Guard(Guard &&other) noexcept : active(other.active) {
+      other.active = false;
+    }
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+    Guard &operator=(Guard &&) = delete;
+
+  private:
+    bool active = true;
+  };
+
+  ~Epoch();
+
+  static Epoch &global();
+
+  /**
+   * Defers `reclaim(ptr, ctx)` until no thread can still hold `ptr`.
+   * The caller must already have made `ptr` unreachable.
+   */
+  void retire(void *ptr, Reclaimer reclaim, void *ctx = nullptr);
+
+  /**
+   * Waits until every thread inside a guard has left it or moved on, then
+   * reclaims everything retired so far by any thread. The caller must not be
+   * inside a guard itself.
+   */
+  void synchronize();
+
+  // Whether the calling thread is inside a guard.
+  bool inside();
+
+private:
+  struct Retired {
+    void *ptr;
+    Reclaimer reclaim;
+    void *ctx;
+    uint64_t epoch;
+  };
+
+  struct ThreadState {
+    // 0 while the thread is outside every guard.
+    std::atomic<uint64_t> active_epoch{0};
+    uint32_t nesting = 0;
+    // Taken by the owner to append and by `synchronize` to drain.
+    std::mutex retired_mutex;
+    std::vector<Retired> retired;
+  };
+
+  struct Registration {
+    ThreadState *state;
+    explicit Registration(Epoch &epoch);
+    ~Registration();
+  };
+
+  std::atomic<uint64_t> global_epoch{1};
+  std::mutex registry_mutex;
+  std::vector<ThreadState *> threads;
+  std::vector<Retired> orphans;
+
+  Epoch() = default;
+
+  ThreadState &local();
+  void enter();
+  void exit();
+  void collect(ThreadState &state);
+  uint64_t minActiveEpoch();
+};
+
+} // namespace art
@@ -0,0 +1,249 @@
+#include "frozen_trie.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+using namespace art;
+
+namespace {
+enum Kind : uint8_t { LEAF = 0, INNER = 1 };
+// Branches up to this many are scanned linearly, wider ones bisected.
+constexpr size_t LINEAR_BRANCHES = 16;
+
+void putVarint(std::vector<uint8_t> &out, size_t v) {
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+size_t getVarint(const uint8_t *&in) {
+    size_t v = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        auto byte = *in++;
+        v |= size_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return v;
+        }
+    }
+}
+
+void putU32(std::vector<uint8_t> &out, uint32_t v) {
+    auto *bytes = reinterpret_cast<const uint8_t *>(&v);
+    out.insert(out.end(), bytes, bytes + sizeof(v));
+}
+
+uint32_t getU32(const uint8_t *in) {
+    uint32_t v;
+    std::memcpy(&v, in, sizeof(v));
+    return v;
+}
+} // namespace
+
+FrozenTrie::FrozenTrie(std::span<const std::pair<ARTData, ARTData>> pairs) {
+    Builder builder;
+    for (auto &[key, value] : pairs) {
+        builder.add(key, value);
+    }
+    *this = builder.finish();
+}
+
+void FrozenTrie::Builder::add(std::span<const uint8_t> next,
+                              std::span<const uint8_t> next_value) {
+    if (count == 0) {
+        // Offset 0 holds no node, so 0 can stand for "none".
+        data.push_back(0);
+    } else {
+        if (!std::ranges::lexicographical_compare(key, next)) {
+            throw std::invalid_argument("frozen trie keys must increase");
+        }
+        // The last key branches off `next` right after their common bytes.
+        size_t common = 0;
+        while (common < key.size() && common < next.size() &&
+               key[common] == next[common]) {
+            common++;
+        }
+        if (open.empty() || open.back().end < common) {
+            open.push_back({common});
+        }
+        attachLeaf(open.back());
+        closeDeeperThan(common);
+    }
+    key.assign(next.begin(), next.end());
+    value.assign(next_value.begin(), next_value.end());
+    count++;
+}
+
+FrozenTrie FrozenTrie::Builder::finish() {
+    FrozenTrie trie;
+    if (count == 0) {
+        return trie;
+    }
+    if (open.empty()) {
+        trie.root = writeLeaf(0);
+    } else {
+        attachLeaf(open.back());
+        closeDeeperThan(open.front().end);
+        trie.root = writeInner(open.back(), 0);
+        open.clear();
+    }
+    data.shrink_to_fit();
+    trie.data = std::move(data);
+    trie.count = std::exchange(count, 0);
+    return trie;
+}
+
+// Writes the open nodes deeper than `depth` into their parents, which get
+// a new node at `depth` if none ends there. All of them lie on the last key.
+void FrozenTrie::Builder::closeDeeperThan(size_t depth) {
+    while (open.back().end > depth) {
+        auto node = std::move(open.back());
+        open.pop_back();
+        if (open.empty() || open.back().end < depth) {
+            open.push_back({depth});
+        }
+        auto &parent = open.back();
+        parent.children.emplace_back(key[parent.end],
+                                     writeInner(node, parent.end + 1));
+    }
+}
+
+void FrozenTrie::Builder::attachLeaf(Open &parent) {
+    if (key.size() == parent.end) {
+        parent.prefix_leaf = writeLeaf(parent.end);
+    } else {
+        parent.children.emplace_back(key[parent.end],
+                                     writeLeaf(parent.end + 1));
+    }
+}
+
+uint32_t FrozenTrie::Builder::offset() const {
+    if (data.size() > UINT32_MAX) {
+        throw std::length_error("frozen trie exceeds 4 GiB");
+    }
+    return uint32_t(data.size());
+}
+
+uint32_t FrozenTrie::Builder::writeLeaf(size_t depth) {
+    auto at = offset();
+    data.push_back(LEAF);
+    putVarint(data, key.size() - depth);
+    putVarint(data, value.size());
+    data.insert(data.end(), key.begin() + depth, key.end());
+    data.insert(data.end(), value.begin(), value.end());
+    return at;
+}
+
+// The node's compressed path runs from `start` to its `end`.
+uint32_t FrozenTrie::Builder::writeInner(const Open &node, size_t start) {
+    auto at = offset();
+    data.push_back(INNER);
+    putVarint(data, node.end - start);
+    data.insert(data.end(), key.begin() + start, key.begin() + node.end);
+    putU32(data, node.prefix_leaf);
+    putVarint(data, node.children.size());
+    for (auto &[byte, child] : node.children) {
+        data.push_back(byte);
+    }
+    for (auto &[byte, child] : node.children) {
+        putU32(data, child);
+    }
+    return at;
+}
+
+std::optional<std::span<const uint8_t>> FrozenTrie::search(Slice key) const {
+    if (root == 0) {
+        return std::nullopt;
+    }
+    auto size = size_t(key.size());
+    size_t depth = 0;
+    const uint8_t *p = data.data() + root;
+    while (true) {
+        auto kind = *p++;
+        if (kind == LEAF) {
+            auto suffix = getVarint(p);
+            auto value = getVarint(p);
+            if (size - depth != suffix ||
+                std::memcmp(p, key.data() + depth, suffix) != 0) {
+                return std::nullopt;
+            }
+            return std::span(p + suffix, value);
+        }
+        auto prefix = getVarint(p);
+        if (size - depth < prefix ||
+            std::memcmp(p, key.data() + depth, prefix) != 0) {
+            return std::nullopt;
+        }
+        depth += prefix;
+        p += prefix;
+        auto prefix_leaf = getU32(p);
+        p += sizeof(uint32_t);
+        if (depth == size) {
+            if (prefix_leaf == 0) {
+                return std::nullopt;
+            }
+            p = data.data() + prefix_leaf;
+            continue;
+        }
+        auto n = getVarint(p);
+        auto byte = key[depth++];
+        const uint8_t *branches = p;
+        size_t i;
+        if (n <= LINEAR_BRANCHES) {
+            i = 0;
+            while (i < n && branches[i] != byte) {
+                i++;
+            }
+        } else {
+            i = size_t(std::lower_bound(branches, branches + n, byte) -
+                       branches);
+            if (i < n && branches[i] != byte) {
+                i = n;
+            }
+        }
+        if (i == n) {
+            return std::nullopt;
+        }
+        p = data.data() + getU32(branches + n + i * sizeof(uint32_t));
+    }
+}
+
+void FrozenTrie::for_each(const Visitor &f) const {
+    if (root == 0) {
+        return;
+    }
+    std::vector<uint8_t> key;
+    visit(root, key, f);
+}
+
+void FrozenTrie::visit(uint32_t offset, std::vector<uint8_t> &key,
+                       const Visitor &f) const {
+    const uint8_t *p = data.data() + offset;
+    auto mark = key.size();
+    auto kind = *p++;
+    if (kind == LEAF) {
+        auto suffix = getVarint(p);
+        auto value = getVarint(p);
+        key.insert(key.end(), p, p + suffix);
+        f(key, std::span(p + suffix, value));
+        key.resize(mark);
+        return;
+    }
+    auto prefix = getVarint(p);
+    key.insert(key.end(), p, p + prefix);
+    p += prefix;
+    auto prefix_leaf = getU32(p);
+    p += sizeof(uint32_t);
+    if (prefix_leaf != 0) {
+        visit(prefix_leaf, key, f);
+    }
+    auto n = getVarint(p);
+    for (size_t i = 0; i < n; i++) {
+        key.push_back(p[i]);
+        visit(getU32(p + n + i * sizeof(uint32_t)), key, f);
+        key.pop_back();
+    }
+    key.resize(mark);
+}
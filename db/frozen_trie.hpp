@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "art.hpp"
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class FrozenTrie
+ * @brief Immutable radix trie packed into one byte array.
+ *
+ * The trie is built bottom-up from sorted pairs: every node is written after
+ * its children, and parents refer to children by their 32-bit offset in the
+ * array, so the trie holds no pointers and can be copied or written out as
+ * is. An inner node stores its whole compressed path, its prefix leaf, the
+ * sorted branch bytes and the child offsets; a leaf stores the rest of its
+ * key and the value. Lengths are varints, so small keys and values cost a
+ * byte of overhead each.
+ *
+ * Lookups walk the array directly. Nothing is ever modified in place: a new
+ * trie is built to change the contents.
+ */
+class FrozenTrie {
+public:
+  using Visitor = std::function<void(std::span<const uint8_t> key,
+                                     std::span<const uint8_t> value)>;
+
+  /**
+   * Builds a trie from pairs added in key order without holding on to them.
+   * A leaf is written once the next key shows where it branches off, and an
+   * inner node once the keys have moved past it, so the builder keeps only
+   * the last pair and the open nodes along its key.
+   */
+  class Builder {
+  public:
+    /**
+     * @throws std::invalid_argument unless `key` sorts after the previous
+     * key, std::length_error if the packed trie exceeds 4 GiB.
+     */
+    void add(std::span<const uint8_t> key, std::span<const uint8_t> value);
+    // The trie of every pair added; the builder is spent afterwards.
+    FrozenTrie finish();
+
+  private:
+    struct Open {
+      // Keys below the node share their first `end` bytes and branch on
+      // the next one.
+      size_t end;
+      uint32_t prefix_leaf = 0;
+      std::vector<std::pair<uint8_t, uint32_t>> children;
+    };
+
+    std::vector<uint8_t> data;
+    size_t count = 0;
+    // Along the last key, by increasing `end`.
+    std::vector<Open> open;
+    // The last pair, written once its parent is known.
+    ARTData key;
+    ARTData value;
+
+    void closeDeeperThan(size_t depth);
+    void attachLeaf(Open &parent);
+    uint32_t writeLeaf(size_t depth);
+    uint32_t writeInner(const Open &node, size_t start);
+    uint32_t offset() const;
+  };
+
+  FrozenTrie() = default;
+
+  /**
+   * Builds a trie holding `pairs`, which must be sorted by key without
+   * duplicates.
+   *
+   * @throws std::length_error if the packed trie exceeds 4 GiB.
+   */
+  explicit FrozenTrie(std::span<const std::pair<ARTData, ARTData>> pairs);
+
+  // The value of `key`. The span points into the trie.
+  std::optional<std::span<const uint8_t>> search(Slice key) const;
+
+  // Calls `visit` for every pair in key order.
+  void for_each(const Visitor &visit) const;
+
+  size_t size() const { return count; }
+  // Bytes of the packed array.
+  size_t bytes() const { return data.size(); }
+
+private:
+  std::vector<uint8_t> data;
+  uint32_t root = 0;
+  size_t count = 0;
+
+  void visit(uint32_t offset, std::vector<uint8_t> &key,
+             const Visitor &f) const;
+};
+
+} // namespace art
@@ -0,0 +1,189 @@
+#include "hybrid.hpp"
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace art;
+
+namespace {
+// First byte of every value in a dynamic stage.
+enum Tag : uint8_t { PUT = 0, TOMBSTONE = 1 };
+
+uint64_t hashKey(Slice key) {
+    return std::hash<std::string_view>()(std::string_view(
+        reinterpret_cast<const char *>(key.data()), key.size()));
+}
+
+bool keyLess(std::span<const uint8_t> a, std::span<const uint8_t> b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(),
+                                        b.end());
+}
+} // namespace
+
+BloomFilter::BloomFilter(size_t keys, size_t bits_per_key)
+    : bits(std::max<size_t>(64, (keys * bits_per_key + 63) / 64 * 64)),
+      // ln 2 probes per bit per key minimize false positives.
+      probes(std::max(1u, unsigned(bits_per_key * 69 / 100))),
+      words(std::make_unique<std::atomic<uint64_t>[]>(bits / 64)) {}
+
+// Probes are derived from one hash by double hashing.
+void BloomFilter::add(Slice key) {
+    auto h = hashKey(key);
+    auto delta = (h >> 17) | (h << 47);
+    for (unsigned i = 0; i < probes; i++, h += delta) {
+        auto bit = h % bits;
+        words[bit / 64].fetch_or(uint64_t(1) << (bit % 64),
+                                 std::memory_order_relaxed);
+    }
+}
+
+bool BloomFilter::may_contain(Slice key) const {
+    auto h = hashKey(key);
+    auto delta = (h >> 17) | (h << 47);
+    for (unsigned i = 0; i < probes; i++, h += delta) {
+        auto bit = h % bits;
+        if (!(words[bit / 64].load(std::memory_order_relaxed) &
+              (uint64_t(1) << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HybridIndex::Stage::Stage(const Options &options)
+    : filter(options.merge_threshold, options.bloom_bits_per_key) {}
+
+HybridIndex::HybridIndex() : HybridIndex(Options{}) {}
+
+HybridIndex::HybridIndex(const Options &options)
+    : options(options), active(std::make_shared<Stage>(options)) {}
+
+void HybridIndex::insert(Slice key, OwnedSlice value) {
+    write(key, false, value.as_span());
+}
+
+void HybridIndex::remove(Slice key) { write(key, true, {}); }
+
+void HybridIndex::write(Slice key, bool tombstone,
+                        std::span<const uint8_t> value) {
+    ARTData entry;
+    entry.reserve(value.size() + 1);
+    entry.push_back(tombstone ? TOMBSTONE : PUT);
+    entry.insert(entry.end(), value.begin(), value.end());
+    size_t size;
+    {
+        std::shared_lock lock(stages_mutex);
+        active->filter.add(key);
+        active->tree.insert(key, std::move(entry));
+        size = active->tree.size();
+    }
+    if (size >= options.merge_threshold) {
+        std::unique_lock merge_lock(merge_mutex, std::try_to_lock);
+        if (merge_lock.owns_lock()) {
+            mergeLocked();
+        }
+    }
+}
+
+std::optional<ARTData> HybridIndex::search(Slice key) {
+    std::shared_ptr<Stage> stages[2];
+    std::shared_ptr<const FrozenTrie> base;
+    {
+        std::shared_lock lock(stages_mutex);
+        stages[0] = active;
+        stages[1] = merging;
+        base = frozen;
+    }
+    for (auto &stage : stages) {
+        if (stage == nullptr || !stage->filter.may_contain(key)) {
+            continue;
+        }
+        auto entry = stage->tree.read(key);
+        if (entry) {
+            if ((*entry)[0] == TOMBSTONE) {
+                return std::nullopt;
+            }
+            entry->erase(entry->begin());
+            return entry;
+        }
+    }
+    if (base != nullptr) {
+        if (auto value = base->search(key)) {
+            return ARTData(value->begin(), value->end());
+        }
+    }
+    return std::nullopt;
+}
+
+void HybridIndex::merge() {
+    std::lock_guard merge_lock(merge_mutex);
+    mergeLocked();
+}
+
+// A stage whose merge failed stays in `merging` and is merged again by the
+// next call, before any newer one.
+void HybridIndex::mergeLocked() {
+    std::shared_ptr<Stage> full;
+    std::shared_ptr<const FrozenTrie> base;
+    {
+        std::unique_lock lock(stages_mutex);
+        if (merging == nullptr) {
+            if (active->tree.size() == 0) {
+                return;
+            }
+            merging = std::exchange(active, std::make_shared<Stage>(options));
+        }
+        full = merging;
+        base = frozen;
+    }
+
+    // Both inputs are sorted, so they stream straight into the new trie.
+    FrozenTrie::Builder builder;
+    auto it = full->tree.begin();
+    // Emits the dynamic entry under `it`; tombstones only hide older pairs.
+    auto takeDynamic = [&] {
+        auto value = it.value();
+        if (value[0] == PUT) {
+            builder.add(it.key(), value.subspan(1));
+        }
+        it.next();
+    };
+    if (base != nullptr) {
+        base->for_each([&](std::span<const uint8_t> key,
+                           std::span<const uint8_t> value) {
+            while (it.valid() && keyLess(it.key(), key)) {
+                takeDynamic();
+            }
+            if (it.valid() && std::ranges::equal(it.key(), key)) {
+                takeDynamic();
+                return;
+            }
+            builder.add(key, value);
+        });
+    }
+    while (it.valid()) {
+        takeDynamic();
+    }
+    auto next = std::make_shared<const FrozenTrie>(builder.finish());
+
+    std::unique_lock lock(stages_mutex);
+    frozen = std::move(next);
+    merging.reset();
+}
+
+size_t HybridIndex::dynamic_size() {
+    std::shared_lock lock(stages_mutex);
+    return active->tree.size() + (merging != nullptr ? merging->tree.size() : 0);
+}
+
+size_t HybridIndex::frozen_size() {
+    std::shared_lock lock(stages_mutex);
+    return frozen != nullptr ? frozen->size() : 0;
+}
+
+size_t HybridIndex::frozen_bytes() {
+    std::shared_lock lock(stages_mutex);
+    return frozen != nullptr ? frozen->bytes() : 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+
+#include "art.hpp"
+#include "frozen_trie.hpp"
+#include "slice.hpp"
+
+namespace art {
+
+// Bloom filter whose bits are set with atomic ORs, so keys can be added and
+// tested from any thread.
+class BloomFilter {
+public:
+  BloomFilter(size_t keys, size_t bits_per_key);
+
+  void add(Slice key);
+  // False means `key` was never added.
+  bool may_contain(Slice key) const;
+
+private:
+  size_t bits;
+  unsigned probes;
+  std::unique_ptr<std::atomic<uint64_t>[]> words;
+};
+
+/**
+ * @class HybridIndex
+ * @brief Two-stage index: a small dynamic `ART` in front of a `FrozenTrie`.
+ *
+ * Writes go to the dynamic stage; a removal is written there as a
+ * tombstone. Once the dynamic stage reaches `merge_threshold` entries, the
+ * writer that notices swaps in an empty one and merges the full stage into a
+ * new frozen trie, while other writers carry on in the new stage. Reads look
+ * at the dynamic stage, then at the stage being merged, then at the frozen
+ * trie; a Bloom filter per dynamic stage lets the common read of a cold key
+ * skip the tree.
+ *
+ * Cold, read-mostly data thus lives in the packed trie, and only recent
+ * writes pay for pointer nodes. A merge rebuilds the frozen trie in full, so
+ * the threshold trades write amplification against the size of the dynamic
+ * stage.
+ *
+ * All methods may be called concurrently.
+ *
+ * Usage example:
+ * @code
+ *     HybridIndex index;
+ *     index.insert("key1", std::string("value1"));
+ *     index.merge();
+ *     auto value = index.search("key1");
+ * @endcode
+ */
+class HybridIndex {
+public:
+  struct Options {
+    // Entries in the dynamic stage that trigger a merge.
+    size_t merge_threshold = size_t(1) << 16;
+    size_t bloom_bits_per_key = 10;
+  };
+
+  HybridIndex();
+  explicit HybridIndex(const Options &options);
+
+  void insert(Slice key, OwnedSlice value);
+  void remove(Slice key);
+  std::optional<ARTData> search(Slice key);
+
+  // Merges the dynamic stage into the frozen trie now.
+  void merge();
+
+  // Entries, tombstones included, in the dynamic stage.
+  size_t dynamic_size();
+  size_t frozen_size();
+  size_t frozen_bytes();
+
+private:
+  struct Stage {
+    explicit Stage(const Options &options);
+    ART tree;
+    BloomFilter filter;
+  };
+
+  Options options;
+  // Guards which stages are current, not their contents. Writers hold it
+  // shared for the whole write, so a stage swapped out for merging receives
+  // no more writes once the swap has the lock.
+  std::shared_mutex stages_mutex;
+  std::shared_ptr<Stage> active;
+  std::shared_ptr<Stage> merging;
+  std::shared_ptr<const FrozenTrie> frozen;
+  std::mutex merge_mutex;
+
+  void write(Slice key, bool tombstone, std::span<const uint8_t> value);
+  void mergeLocked();
+};
+
+} // namespace art
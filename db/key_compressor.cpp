@@ -0,0 +1,205 @@
+#include "key_compressor.hpp"
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+using namespace art;
+
+namespace {
+using Bytes = std::vector<uint8_t>;
+// Codes that share a first byte.
+constexpr size_t GROUP_SIZE = 256;
+// Substrings seen fewer times are not worth a dictionary entry.
+constexpr size_t MIN_COUNT = 2;
+
+bool less(std::span<const uint8_t> a, std::span<const uint8_t> b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(),
+                                        b.end());
+}
+
+// The smallest string above every string that starts with `s`; none when
+// `s` is all 0xff.
+std::optional<Bytes> successor(Bytes s) {
+    while (!s.empty() && s.back() == 0xff) {
+        s.pop_back();
+    }
+    if (s.empty()) {
+        return std::nullopt;
+    }
+    s.back()++;
+    return s;
+}
+
+Bytes bytesOf(std::string_view s) { return Bytes(s.begin(), s.end()); }
+} // namespace
+
+KeyCompressor::KeyCompressor(std::span<const Slice> sample)
+    : KeyCompressor(sample, Options{}) {}
+
+KeyCompressor::KeyCompressor(std::span<const Slice> sample,
+                             const Options &options) {
+    std::vector<std::string_view> keys;
+    size_t taken = 0;
+    for (auto &key : sample) {
+        if (taken >= options.sample_bytes) {
+            break;
+        }
+        keys.emplace_back(reinterpret_cast<const char *>(key.data()),
+                          key.size());
+        taken += key.size();
+    }
+
+    // Substrings are counted one length at a time, and only those whose
+    // prefix one byte shorter was frequent are counted at all.
+    std::vector<std::pair<size_t, std::string_view>> candidates;
+    std::unordered_set<std::string_view> frequent;
+    for (size_t len = 2; len <= options.max_symbol_len; len++) {
+        std::unordered_map<std::string_view, size_t> counts;
+        for (auto key : keys) {
+            for (size_t pos = 0; pos + len <= key.size(); pos++) {
+                auto sub = key.substr(pos, len);
+                if (len == 2 || frequent.contains(sub.substr(0, len - 1))) {
+                    counts[sub]++;
+                }
+            }
+        }
+        frequent.clear();
+        for (auto &[sub, count] : counts) {
+            if (count >= MIN_COUNT) {
+                frequent.insert(sub);
+                candidates.emplace_back(count * (len - 1), sub);
+            }
+        }
+        if (frequent.empty()) {
+            break;
+        }
+    }
+    auto chosen = std::min(options.symbols, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + chosen,
+                      candidates.end(), [](auto &a, auto &b) {
+                          return a.first != b.first ? a.first > b.first
+                                                    : a.second < b.second;
+                      });
+
+    // Every single byte bounds an interval, so every symbol is at least one
+    // byte long; a chosen substring and its successor bound the interval
+    // whose symbol is the substring itself.
+    for (unsigned c = 0; c < 256; c++) {
+        boundaries.push_back({uint8_t(c)});
+    }
+    for (size_t i = 0; i < chosen; i++) {
+        auto word = bytesOf(candidates[i].second);
+        if (auto next = successor(word)) {
+            boundaries.push_back(std::move(*next));
+        }
+        boundaries.push_back(std::move(word));
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()),
+                     boundaries.end());
+
+    // The symbol of [b, next) is the longest prefix of b that every string
+    // in the interval starts with.
+    for (size_t i = 0; i < boundaries.size(); i++) {
+        auto &bound = boundaries[i];
+        size_t len = bound.size();
+        for (; len > 1; len--) {
+            auto next = successor(Bytes(bound.begin(), bound.begin() + len));
+            if (!next ||
+                (i + 1 < boundaries.size() && !less(*next, boundaries[i + 1]))) {
+                break;
+            }
+        }
+        symbols.emplace_back(bound.begin(), bound.begin() + len);
+    }
+
+    std::vector<size_t> weights(boundaries.size());
+    for (auto key : keys) {
+        std::span rest(reinterpret_cast<const uint8_t *>(key.data()),
+                       key.size());
+        while (!rest.empty()) {
+            auto i = locate(rest);
+            weights[i]++;
+            rest = rest.subspan(symbols[i].size());
+        }
+    }
+    assignCodes(weights);
+}
+
+// Index of the interval holding `rest`, which is not empty.
+size_t KeyCompressor::locate(std::span<const uint8_t> rest) const {
+    auto it = std::upper_bound(
+        boundaries.begin(), boundaries.end(), rest,
+        [](std::span<const uint8_t> a, const Bytes &b) { return less(a, b); });
+    return size_t(it - boundaries.begin()) - 1;
+}
+
+// Gives one-byte codes to as many of the heaviest intervals as the 256
+// first bytes allow; the runs between them share first bytes in groups of
+// up to 256 two-byte codes.
+void KeyCompressor::assignCodes(const std::vector<size_t> &weights) {
+    auto n = boundaries.size();
+    std::vector<bool> single(n, n <= GROUP_SIZE);
+    auto groupsNeeded = [&] {
+        size_t needed = 0;
+        size_t run = 0;
+        for (size_t i = 0; i <= n; i++) {
+            if (i == n || single[i]) {
+                needed += (run + GROUP_SIZE - 1) / GROUP_SIZE + (i < n);
+                run = 0;
+            } else {
+                run++;
+            }
+        }
+        return needed;
+    };
+    if (n > GROUP_SIZE) {
+        std::vector<size_t> order(n);
+        for (size_t i = 0; i < n; i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return weights[a] > weights[b];
+        });
+        for (auto i : order) {
+            if (weights[i] == 0) {
+                break;
+            }
+            single[i] = true;
+            if (groupsNeeded() > GROUP_SIZE) {
+                single[i] = false;
+            }
+        }
+    }
+
+    codes.resize(n);
+    code_lens.resize(n);
+    size_t group = 0;
+    for (size_t i = 0; i < n;) {
+        size_t len = 1;
+        if (!single[i]) {
+            while (i + len < n && !single[i + len] && len < GROUP_SIZE) {
+                len++;
+            }
+        }
+        groups[group] = {uint32_t(i), uint32_t(len)};
+        for (size_t k = 0; k < len; k++) {
+            codes[i + k] = {uint8_t(group), uint8_t(k)};
+            code_lens[i + k] = len > 1 ? 2 : 1;
+        }
+        group++;
+        i += len;
+    }
+}
+
+void KeyCompressor::encode(Slice key, std::vector<uint8_t> &out) const {
+    std::span rest(key.data(), key.size());
+    while (!rest.empty()) {
+        auto i = locate(rest);
+        out.insert(out.end(), codes[i].begin(), codes[i].begin() + code_lens[i]);
+        rest = rest.subspan(symbols[i].size());
+    }
+}
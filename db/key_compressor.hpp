@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class KeyCompressor
+ * @brief Order-preserving key encoding with a dictionary trained on sample
+ * keys, after HOPE.
+ *
+ * The dictionary cuts the space of byte strings into sorted intervals at
+ * frequent substrings of the sample and at every single byte. All strings
+ * of an interval share a prefix, its symbol. A key is encoded by repeatedly
+ * finding the interval that holds the rest of the key, emitting the
+ * interval's code and dropping its symbol. Codes grow with their intervals
+ * and no code is a prefix of another, so encoded keys sort exactly like the
+ * keys themselves: lookups, scans and `lower_bound` work on encoded keys
+ * unchanged.
+ *
+ * Codes are one or two bytes. The most frequent intervals of the sample
+ * get the one-byte codes.
+ */
+class KeyCompressor {
+public:
+  struct Options {
+    // Substrings added to the dictionary.
+    size_t symbols = 1024;
+    size_t max_symbol_len = 16;
+    // Sample bytes looked at while counting substrings.
+    size_t sample_bytes = size_t(1) << 20;
+  };
+
+  explicit KeyCompressor(std::span<const Slice> sample);
+  KeyCompressor(std::span<const Slice> sample, const Options &options);
+
+  // Appends the encoding of `key` to `out`.
+  void encode(Slice key, std::vector<uint8_t> &out) const;
+  // Appends the key encoded as `code` to `out`.
+  template <typename Bytes>
+  void decode(std::span<const uint8_t> code, Bytes &out) const {
+    for (size_t i = 0; i < code.size();) {
+      auto &group = groups[code[i++]];
+      auto index = group.first;
+      if (group.size > 1) {
+        index += code[i++];
+      }
+      auto &symbol = symbols[index];
+      out.insert(out.end(), symbol.begin(), symbol.end());
+    }
+  }
+
+  // Intervals in the dictionary.
+  size_t intervals() const { return boundaries.size(); }
+
+private:
+  // Intervals sharing a first code byte; a group of one has one-byte codes.
+  struct Group {
+    uint32_t first = 0;
+    uint32_t size = 0;
+  };
+
+  // Sorted lower bounds of the intervals.
+  std::vector<std::vector<uint8_t>> boundaries;
+  std::vector<std::vector<uint8_t>> symbols;
+  // Code of each interval, one or two bytes.
+  std::vector<std::array<uint8_t, 2>> codes;
+  std::vector<uint8_t> code_lens;
+  std::array<Group, 256> groups{};
+
+  size_t locate(std::span<const uint8_t> rest) const;
+  void assignCodes(const std::vector<size_t> &weights);
+};
+
+} // namespace art
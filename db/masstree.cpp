@@ -0,0 +1,498 @@
+#include "masstree.hpp"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string_view>
+
+using namespace art;
+
+namespace {
+// Length classes past the byte counts 0 to SLICE: the key goes on past the
+// slice, its rest held in the record or in the next layer. The two order
+// alike, and only one of them exists per slice.
+constexpr uint8_t SUFFIX = Masstree::SLICE + 1;
+constexpr uint8_t LAYER = Masstree::SLICE + 2;
+
+uint8_t lengthClass(uint8_t length) { return std::min(length, SUFFIX); }
+
+// The key past the slice of this layer; only for keys longer than it.
+Slice rest(Slice key) {
+    return Slice(key.data() + Masstree::SLICE, key.size() - Masstree::SLICE);
+}
+
+Slice empty() { return std::string_view(); }
+
+bool equalBytes(Slice a, Slice b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+} // namespace
+
+struct Masstree::Node {
+    explicit Node(bool leaf) : leaf(leaf) {}
+    bool leaf;
+    uint8_t entries = 0;
+    uint64_t slices[WIDTH];
+    uint8_t lengths[WIDTH];
+
+    SliceKey key(size_t i) const { return {slices[i], lengths[i]}; }
+    void setKey(size_t i, SliceKey key) {
+        slices[i] = key.slice;
+        lengths[i] = key.length;
+    }
+};
+
+struct Masstree::Leaf : Node {
+    Leaf() : Node(true) {}
+    union Value {
+        Record *record;
+        // Root of the next layer, for entries of length class LAYER.
+        Node *layer;
+    };
+    Value values[WIDTH];
+};
+
+struct Masstree::Interior : Node {
+    Interior() : Node(false) {}
+    // children[i] holds the keys below key(i) and not below key(i - 1).
+    Node *children[WIDTH + 1];
+};
+
+// The rest of a key that goes on past its slice, then the value.
+struct Masstree::Record {
+    uint32_t suffix_len;
+    uint32_t value_len;
+
+    uint8_t *data() { return reinterpret_cast<uint8_t *>(this + 1); }
+    Slice suffix() { return Slice(data(), suffix_len); }
+    std::vector<uint8_t> value() {
+        return std::vector<uint8_t>(data() + suffix_len,
+                                    data() + suffix_len + value_len);
+    }
+};
+
+Masstree::Masstree(std::pmr::memory_resource *resource) : resource(resource) {}
+
+Masstree::~Masstree() { freeLayer(root); }
+
+template <typename T> T *Masstree::newNode() {
+    allocated += sizeof(T);
+    return new (resource->allocate(sizeof(T), alignof(T))) T();
+}
+
+void Masstree::freeNode(Node *node) {
+    if (node->leaf) {
+        allocated -= sizeof(Leaf);
+        resource->deallocate(node, sizeof(Leaf), alignof(Leaf));
+    } else {
+        allocated -= sizeof(Interior);
+        resource->deallocate(node, sizeof(Interior), alignof(Interior));
+    }
+}
+
+void Masstree::freeLayer(Node *node) {
+    if (node == nullptr) {
+        return;
+    }
+    if (node->leaf) {
+        auto *leaf = static_cast<Leaf *>(node);
+        for (size_t i = 0; i < leaf->entries; i++) {
+            if (leaf->lengths[i] == LAYER) {
+                freeLayer(leaf->values[i].layer);
+            } else {
+                freeRecord(leaf->values[i].record);
+            }
+        }
+    } else {
+        auto *inner = static_cast<Interior *>(node);
+        for (size_t i = 0; i <= inner->entries; i++) {
+            freeLayer(inner->children[i]);
+        }
+    }
+    freeNode(node);
+}
+
+Masstree::Record *Masstree::newRecord(Slice suffix, Slice value) {
+    size_t size = sizeof(Record) + suffix.size() + value.size();
+    allocated += size;
+    auto *record = new (resource->allocate(size, alignof(Record))) Record{
+        uint32_t(suffix.size()), uint32_t(value.size())};
+    std::copy(suffix.begin(), suffix.end(), record->data());
+    std::copy(value.begin(), value.end(), record->data() + suffix.size());
+    return record;
+}
+
+void Masstree::freeRecord(Record *record) {
+    size_t size = sizeof(Record) + record->suffix_len + record->value_len;
+    allocated -= size;
+    resource->deallocate(record, size, alignof(Record));
+}
+
+Masstree::SliceKey Masstree::sliceOf(Slice key) {
+    auto n = std::min(size_t(key.size()), SLICE);
+    uint64_t slice = 0;
+    for (size_t i = 0; i < n; i++) {
+        slice |= uint64_t(key[i]) << (56 - 8 * i);
+    }
+    return {slice, uint8_t(size_t(key.size()) > SLICE ? SUFFIX : n)};
+}
+
+int Masstree::compare(SliceKey a, SliceKey b) {
+    if (a.slice != b.slice) {
+        return a.slice < b.slice ? -1 : 1;
+    }
+    auto x = lengthClass(a.length), y = lengthClass(b.length);
+    return x < y ? -1 : x > y;
+}
+
+// The first entry of `node` not less than `at`.
+size_t Masstree::lowerBound(const Node *node, SliceKey at) {
+    size_t i = 0;
+    while (i < node->entries && compare(node->key(i), at) < 0) {
+        i++;
+    }
+    return i;
+}
+
+// The child of `node` whose range holds `at`.
+size_t Masstree::childIndex(const Interior *node, SliceKey at) {
+    size_t i = 0;
+    while (i < node->entries && compare(node->key(i), at) <= 0) {
+        i++;
+    }
+    return i;
+}
+
+Masstree::Leaf *Masstree::findLeaf(Node *node, SliceKey at) {
+    while (!node->leaf) {
+        auto *inner = static_cast<Interior *>(node);
+        node = inner->children[childIndex(inner, at)];
+    }
+    return static_cast<Leaf *>(node);
+}
+
+bool Masstree::insert(Slice key, Slice value) {
+    std::unique_lock lock(mutex);
+    bool added = insertLayer(root, key, value);
+    count += added;
+    return added;
+}
+
+bool Masstree::insertLayer(Node *&layer, Slice key, Slice value) {
+    if (layer == nullptr) {
+        layer = newNode<Leaf>();
+    }
+    bool added = false;
+    auto split = insertNode(layer, sliceOf(key), key, value, added);
+    if (split) {
+        auto *top = newNode<Interior>();
+        top->entries = 1;
+        top->setKey(0, split->separator);
+        top->children[0] = layer;
+        top->children[1] = split->right;
+        layer = top;
+    }
+    return added;
+}
+
+std::optional<Masstree::Split> Masstree::insertNode(Node *node, SliceKey at,
+                                                    Slice key, Slice value,
+                                                    bool &added) {
+    if (!node->leaf) {
+        auto *inner = static_cast<Interior *>(node);
+        auto i = childIndex(inner, at);
+        auto split = insertNode(inner->children[i], at, key, value, added);
+        if (!split) {
+            return std::nullopt;
+        }
+        return addToInterior(inner, i, *split);
+    }
+    auto *leaf = static_cast<Leaf *>(node);
+    auto i = lowerBound(leaf, at);
+    if (i < leaf->entries && compare(leaf->key(i), at) == 0) {
+        added = updateEntry(leaf, i, key, value);
+        return std::nullopt;
+    }
+    added = true;
+    auto *record = newRecord(at.length == SUFFIX ? rest(key) : empty(), value);
+    return addToLeaf(leaf, i, at, record);
+}
+
+// Stores `value` in entry `i` of `leaf`, whose slice `key` shares. Returns
+// whether `key` is new.
+bool Masstree::updateEntry(Leaf *leaf, size_t i, Slice key, Slice value) {
+    auto &entry = leaf->values[i];
+    if (leaf->lengths[i] == LAYER) {
+        return insertLayer(entry.layer, rest(key), value);
+    }
+    auto *old = entry.record;
+    if (leaf->lengths[i] == SUFFIX && !equalBytes(old->suffix(), rest(key))) {
+        // The second key to go on past this slice: both move a layer down.
+        Node *layer = nullptr;
+        auto old_value = old->value();
+        insertLayer(layer, old->suffix(),
+                    Slice(old_value.data(), old_value.size()));
+        insertLayer(layer, rest(key), value);
+        freeRecord(old);
+        leaf->lengths[i] = LAYER;
+        entry.layer = layer;
+        layer_count++;
+        return true;
+    }
+    entry.record = newRecord(old->suffix(), value);
+    freeRecord(old);
+    return false;
+}
+
+std::optional<Masstree::Split> Masstree::addToLeaf(Leaf *leaf, size_t i,
+                                                   SliceKey at,
+                                                   Record *record) {
+    SliceKey keys[WIDTH + 1];
+    Leaf::Value values[WIDTH + 1];
+    size_t n = leaf->entries;
+    for (size_t j = 0, k = 0; j <= n; j++) {
+        if (j == i) {
+            keys[j] = at;
+            values[j].record = record;
+        } else {
+            keys[j] = leaf->key(k);
+            values[j] = leaf->values[k++];
+        }
+    }
+    if (n < WIDTH) {
+        for (size_t j = 0; j <= n; j++) {
+            leaf->setKey(j, keys[j]);
+            leaf->values[j] = values[j];
+        }
+        leaf->entries++;
+        return std::nullopt;
+    }
+    auto *right = newNode<Leaf>();
+    size_t half = (WIDTH + 1) / 2;
+    for (size_t j = 0; j <= WIDTH; j++) {
+        Leaf *to = j < half ? leaf : right;
+        size_t k = j < half ? j : j - half;
+        to->setKey(k, keys[j]);
+        to->values[k] = values[j];
+    }
+    leaf->entries = uint8_t(half);
+    right->entries = uint8_t(WIDTH + 1 - half);
+    return Split{right->key(0), right};
+}
+
+// Adds the right half of child `i` of `inner` after it.
+std::optional<Masstree::Split>
+Masstree::addToInterior(Interior *inner, size_t i, Split split) {
+    SliceKey keys[WIDTH + 1];
+    Node *children[WIDTH + 2];
+    size_t n = inner->entries;
+    for (size_t j = 0, k = 0; j <= n; j++) {
+        keys[j] = j == i ? split.separator : inner->key(k++);
+    }
+    for (size_t j = 0, k = 0; j <= n + 1; j++) {
+        children[j] = j == i + 1 ? split.right : inner->children[k++];
+    }
+    if (n < WIDTH) {
+        for (size_t j = 0; j <= n; j++) {
+            inner->setKey(j, keys[j]);
+        }
+        std::copy(children, children + n + 2, inner->children);
+        inner->entries++;
+        return std::nullopt;
+    }
+    // The middle separator moves up; the halves keep the ones around it.
+    size_t mid = (WIDTH + 1) / 2;
+    auto *right = newNode<Interior>();
+    for (size_t j = 0; j < mid; j++) {
+        inner->setKey(j, keys[j]);
+    }
+    std::copy(children, children + mid + 1, inner->children);
+    inner->entries = uint8_t(mid);
+    for (size_t j = mid + 1; j <= WIDTH; j++) {
+        right->setKey(j - mid - 1, keys[j]);
+    }
+    std::copy(children + mid + 1, children + WIDTH + 2, right->children);
+    right->entries = uint8_t(WIDTH - mid);
+    return Split{keys[mid], right};
+}
+
+std::optional<std::vector<uint8_t>> Masstree::search(Slice key) {
+    std::shared_lock lock(mutex);
+    Node *layer = root;
+    while (layer != nullptr) {
+        auto at = sliceOf(key);
+        auto *leaf = findLeaf(layer, at);
+        auto i = lowerBound(leaf, at);
+        if (i == leaf->entries || compare(leaf->key(i), at) != 0) {
+            return std::nullopt;
+        }
+        if (leaf->lengths[i] == LAYER) {
+            layer = leaf->values[i].layer;
+            key = rest(key);
+            continue;
+        }
+        auto *record = leaf->values[i].record;
+        if (leaf->lengths[i] == SUFFIX &&
+            !equalBytes(record->suffix(), rest(key))) {
+            return std::nullopt;
+        }
+        return record->value();
+    }
+    return std::nullopt;
+}
+
+bool Masstree::remove(Slice key) {
+    std::unique_lock lock(mutex);
+    bool removed = removeLayer(root, key);
+    count -= removed;
+    return removed;
+}
+
+bool Masstree::removeLayer(Node *&layer, Slice key) {
+    if (layer == nullptr) {
+        return false;
+    }
+    bool removed = false;
+    if (removeNode(layer, sliceOf(key), key, removed)) {
+        freeNode(layer);
+        layer = nullptr;
+    } else {
+        layer = collapse(layer);
+    }
+    return removed;
+}
+
+// `node` itself, or its only child if it is an inner node that has one.
+Masstree::Node *Masstree::collapse(Node *node) {
+    if (node->leaf || node->entries > 0) {
+        return node;
+    }
+    auto *child = static_cast<Interior *>(node)->children[0];
+    freeNode(node);
+    return child;
+}
+
+// Removes `key` below `node` and returns whether `node` is left empty, for
+// the caller to free.
+bool Masstree::removeNode(Node *node, SliceKey at, Slice key, bool &removed) {
+    if (!node->leaf) {
+        auto *inner = static_cast<Interior *>(node);
+        auto i = childIndex(inner, at);
+        auto *child = inner->children[i];
+        if (!removeNode(child, at, key, removed)) {
+            inner->children[i] = collapse(child);
+            return false;
+        }
+        freeNode(child);
+        if (inner->entries == 0) {
+            return true;
+        }
+        // The neighbour towards the removed separator takes over the range.
+        auto k = i == 0 ? 0 : i - 1;
+        for (size_t j = k; j + 1 < inner->entries; j++) {
+            inner->setKey(j, inner->key(j + 1));
+        }
+        std::copy(inner->children + i + 1,
+                  inner->children + inner->entries + 1, inner->children + i);
+        inner->entries--;
+        return false;
+    }
+    auto *leaf = static_cast<Leaf *>(node);
+    auto i = lowerBound(leaf, at);
+    if (i == leaf->entries || compare(leaf->key(i), at) != 0) {
+        return false;
+    }
+    auto &entry = leaf->values[i];
+    if (leaf->lengths[i] == LAYER) {
+        removed = removeLayer(entry.layer, rest(key));
+        if (entry.layer != nullptr) {
+            return false;
+        }
+        layer_count--;
+    } else {
+        if (leaf->lengths[i] == SUFFIX &&
+            !equalBytes(entry.record->suffix(), rest(key))) {
+            return false;
+        }
+        freeRecord(entry.record);
+        removed = true;
+    }
+    for (size_t j = i; j + 1 < leaf->entries; j++) {
+        leaf->setKey(j, leaf->key(j + 1));
+        leaf->values[j] = leaf->values[j + 1];
+    }
+    leaf->entries--;
+    return leaf->entries == 0;
+}
+
+std::vector<Masstree::Entry> Masstree::scan(Slice start, size_t limit) {
+    std::shared_lock lock(mutex);
+    std::vector<Entry> out;
+    std::vector<uint8_t> prefix;
+    if (root != nullptr && limit > 0) {
+        collect(root, start, true, limit, prefix, out);
+    }
+    return out;
+}
+
+// Appends the pairs of the layer rooted at `node`, whose keys continue
+// `prefix`, to `out`. While `bounded`, keys below `start`, which is the rest
+// of the scan's start at this layer, are skipped.
+void Masstree::collect(const Node *node, Slice start, bool bounded, size_t limit,
+                       std::vector<uint8_t> &prefix,
+                       std::vector<Entry> &out) const {
+    SliceKey at = bounded ? sliceOf(start) : SliceKey{0, 0};
+    if (!node->leaf) {
+        auto *inner = static_cast<const Interior *>(node);
+        size_t first = bounded ? childIndex(inner, at) : 0;
+        for (size_t i = first; i <= inner->entries && out.size() < limit;
+             i++) {
+            collect(inner->children[i], start, bounded && i == first, limit,
+                    prefix, out);
+        }
+        return;
+    }
+    auto *leaf = static_cast<const Leaf *>(node);
+    for (size_t i = 0; i < leaf->entries && out.size() < limit; i++) {
+        int cmp = bounded ? compare(leaf->key(i), at) : 1;
+        if (cmp < 0) {
+            continue;
+        }
+        auto depth = prefix.size();
+        auto length = std::min<size_t>(leaf->lengths[i], SLICE);
+        for (size_t j = 0; j < length; j++) {
+            prefix.push_back(uint8_t(leaf->slices[i] >> (56 - 8 * j)));
+        }
+        if (leaf->lengths[i] == LAYER) {
+            collect(leaf->values[i].layer, cmp == 0 ? rest(start) : empty(),
+                    cmp == 0, limit, prefix, out);
+        } else {
+            auto *record = leaf->values[i].record;
+            auto suffix = record->suffix();
+            if (cmp != 0 || leaf->lengths[i] != SUFFIX ||
+                !std::lexicographical_compare(suffix.begin(), suffix.end(),
+                                              rest(start).begin(),
+                                              rest(start).end())) {
+                std::vector<uint8_t> key(prefix);
+                key.insert(key.end(), suffix.begin(), suffix.end());
+                out.emplace_back(std::move(key), record->value());
+            }
+        }
+        prefix.resize(depth);
+    }
+}
+
+size_t Masstree::size() {
+    std::shared_lock lock(mutex);
+    return count;
+}
+
+size_t Masstree::layers() {
+    std::shared_lock lock(mutex);
+    return layer_count;
+}
+
+size_t Masstree::bytes() {
+    std::shared_lock lock(mutex);
+    return allocated;
+}
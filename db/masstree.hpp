@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class Masstree
+ * @brief Trie of B+trees, one per 8-byte slice of the key, as in Masstree
+ * (Mao, Kohler and Morris, EuroSys 2012).
+ *
+ * A layer is a B+tree keyed on one slice of the key: 8 bytes read as a
+ * big-endian integer, zero-padded past the end of the key, together with
+ * how many of those bytes the key has. Every comparison inside a layer is
+ * therefore one integer compare, however long the keys are, and a key of n
+ * bytes is found in about n / 8 layers instead of up to n radix steps.
+ *
+ * A key that goes on past a slice keeps the rest of its bytes next to its
+ * value. Only when a second key shares the slice and goes on as well does a
+ * new layer hang off the entry, keyed on the next slice, so that long keys
+ * with long shared prefixes cost layers only where they actually meet.
+ *
+ * Nodes never merge: a leaf that empties is unlinked, and an inner node
+ * left with one child is replaced by it.
+ *
+ * Readers share a lock that writers take exclusively.
+ */
+class Masstree {
+public:
+  using Entry = std::pair<std::vector<uint8_t>, std::vector<uint8_t>>;
+  // Bytes of the key each layer consumes.
+  static constexpr size_t SLICE = 8;
+  // Entries per B+tree node.
+  static constexpr size_t WIDTH = 15;
+
+  explicit Masstree(std::pmr::memory_resource *resource =
+                        std::pmr::get_default_resource());
+  ~Masstree();
+  Masstree(const Masstree &) = delete;
+  Masstree &operator=(const Masstree &) = delete;
+
+  // Sets the value of `key` and returns whether `key` is new.
+  bool insert(Slice key, Slice value);
+  std::optional<std::vector<uint8_t>> search(Slice key);
+  // Returns whether `key` was there.
+  bool remove(Slice key);
+
+  // Up to `limit` pairs in key order, from the smallest key not less than
+  // `start`.
+  std::vector<Entry> scan(Slice start, size_t limit);
+
+  size_t size();
+  // Layers below the first one.
+  size_t layers();
+  // Bytes held by nodes and values, which is all the tree allocates.
+  size_t bytes();
+
+private:
+  struct Node;
+  struct Leaf;
+  struct Interior;
+  struct Record;
+  // A slice with its length class, as one layer orders keys.
+  struct SliceKey {
+    uint64_t slice;
+    uint8_t length;
+  };
+  // A node split in two: keys not less than `separator` went to `right`.
+  struct Split {
+    SliceKey separator;
+    Node *right;
+  };
+
+  std::pmr::memory_resource *resource;
+  std::shared_mutex mutex;
+  Node *root = nullptr;
+  size_t count = 0;
+  size_t layer_count = 0;
+  size_t allocated = 0;
+
+  template <typename T> T *newNode();
+  void freeNode(Node *node);
+  void freeLayer(Node *node);
+  Record *newRecord(Slice suffix, Slice value);
+  void freeRecord(Record *record);
+
+  static SliceKey sliceOf(Slice key);
+  static int compare(SliceKey a, SliceKey b);
+  static size_t lowerBound(const Node *node, SliceKey at);
+  static size_t childIndex(const Interior *node, SliceKey at);
+  static Leaf *findLeaf(Node *node, SliceKey at);
+
+  bool insertLayer(Node *&layer, Slice key, Slice value);
+  std::optional<Split> insertNode(Node *node, SliceKey at, Slice key,
+                                  Slice value, bool &added);
+  bool updateEntry(Leaf *leaf, size_t i, Slice key, Slice value);
+  std::optional<Split> addToLeaf(Leaf *leaf, size_t i, SliceKey at,
+                                 Record *record);
+  std::optional<Split> addToInterior(Interior *inner, size_t i, Split split);
+  bool removeLayer(Node *&layer, Slice key);
+  bool removeNode(Node *node, SliceKey at, Slice key, bool &removed);
+  Node *collapse(Node *node);
+
+  void collect(const Node *node, Slice start, bool bounded, size_t limit,
+               std::vector<uint8_t> &prefix, std::vector<Entry> &out) const;
+};
+
+} // namespace art
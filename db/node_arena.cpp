@@ -0,0 +1,60 @@
+#include "node_arena.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <sys/mman.h>
+#include <system_error>
+
+using namespace art;
+
+namespace {
+// Blocks up to this size are recycled by the pool.
+constexpr size_t LARGEST_POOLED_BLOCK = 1 << 20;
+
+std::byte *reserve(size_t size) {
+    void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(),
+                                "mmap node arena");
+    }
+    return static_cast<std::byte *>(p);
+}
+} // namespace
+
+NodeArena::NodeArena(size_t capacity)
+    : region(reserve(std::min(capacity, MAX_CAPACITY))),
+      size(std::min(capacity, MAX_CAPACITY)), carve(region, size),
+      pool(std::pmr::pool_options{0, LARGEST_POOLED_BLOCK}, &carve) {}
+
+NodeArena::~NodeArena() {
+    pool.release();
+    ::munmap(region, size);
+}
+
+NodeArena &NodeArena::global() {
+    static NodeArena arena;
+    return arena;
+}
+
+void *NodeArena::Region::do_allocate(size_t bytes, size_t alignment) {
+    alignment = std::max(alignment, ALIGNMENT);
+    auto offset = cursor.load(std::memory_order_relaxed);
+    size_t start;
+    do {
+        start = (offset + alignment - 1) & ~(alignment - 1);
+        if (start > size || bytes > size - start) {
+            throw std::bad_alloc();
+        }
+    } while (!cursor.compare_exchange_weak(offset, start + bytes,
+                                           std::memory_order_relaxed));
+    return begin + start;
+}
+
+void *NodeArena::do_allocate(size_t bytes, size_t alignment) {
+    return pool.allocate(bytes, std::max(alignment, ALIGNMENT));
+}
+
+void NodeArena::do_deallocate(void *ptr, size_t bytes, size_t alignment) {
+    pool.deallocate(ptr, bytes, std::max(alignment, ALIGNMENT));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace art {
+
+/**
+ * @class NodeArena
+ * @brief Memory resource carved out of one reserved address range.
+ *
+ * The range is reserved up front and only backed by memory as it is used,
+ * so every block the arena hands out lies at a bounded offset from `base()`.
+ * Trees built with `ARTIKV_COMPRESSED_REFS` rely on this to store child
+ * references as 32-bit offsets in units of `ALIGNMENT`.
+ *
+ * Blocks are recycled by a synchronized pool on top of the range. Blocks
+ * larger than the pool's biggest size class are taken from the range
+ * directly and not reused once freed.
+ */
+class NodeArena : public std::pmr::memory_resource {
+public:
+  // Every block starts at a multiple of this from `base()`.
+  static constexpr size_t ALIGNMENT = 8;
+  // The range a 32-bit count of `ALIGNMENT` units can address.
+  static constexpr size_t MAX_CAPACITY = (size_t(1) << 32) * ALIGNMENT;
+
+  // Throws std::system_error if the range cannot be reserved.
+  explicit NodeArena(size_t capacity = MAX_CAPACITY);
+  ~NodeArena() override;
+  NodeArena(const NodeArena &) = delete;
+  NodeArena &operator=(const NodeArena &) = delete;
+
+  // The arena compressed references are relative to.
+  static NodeArena &global();
+
+  const std::byte *base() const { return region; }
+  size_t capacity() const { return size; }
+  // Bytes of the range handed to the pool so far.
+  size_t reserved() const { return carve.used(); }
+  bool contains(const void *ptr) const {
+    auto *p = static_cast<const std::byte *>(ptr);
+    return p >= region && p < region + size;
+  }
+
+private:
+  // Hands out the range front to back. Freed blocks are left to the pool.
+  class Region : public std::pmr::memory_resource {
+  public:
+    Region(std::byte *begin, size_t size) : begin(begin), size(size) {}
+    size_t used() const { return cursor.load(std::memory_order_relaxed); }
+
+  private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+
+    std::byte *begin;
+    size_t size;
+    // Offset 0 stays unused so that it can encode a null reference.
+    std::atomic<size_t> cursor{ALIGNMENT};
+  };
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *ptr, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+  std::byte *region;
+  size_t size;
+  Region carve;
+  std::pmr::synchronized_pool_resource pool;
+};
+
+} // namespace art
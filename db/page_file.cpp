@@ -0,0 +1,95 @@
+#include "page_file.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace art;
+
+namespace {
+[[noreturn]] void fail(const std::string &what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+PageFile::PageFile(const std::string &path) : path(path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fail("open " + path);
+    }
+}
+
+PageFile::~PageFile() {
+    ::close(fd);
+    ::unlink(path.c_str());
+}
+
+PageFile::Extent PageFile::write(std::span<const uint8_t> bytes) {
+    Extent extent{0, bytes.size()};
+    {
+        std::lock_guard lock(mutex);
+        auto it = free_extents.lower_bound(bytes.size());
+        if (it != free_extents.end()) {
+            extent.offset = it->second;
+            if (it->first > bytes.size()) {
+                free_extents.emplace(it->first - bytes.size(),
+                                     it->second + bytes.size());
+            }
+            free_extents.erase(it);
+        } else {
+            extent.offset = end;
+            end += bytes.size();
+        }
+        in_use += bytes.size();
+    }
+    size_t done = 0;
+    while (done < bytes.size()) {
+        auto n = ::pwrite(fd, bytes.data() + done, bytes.size() - done,
+                          off_t(extent.offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            auto saved = errno;
+            release(extent);
+            errno = saved;
+            fail("write " + path);
+        }
+        done += size_t(n);
+    }
+    return extent;
+}
+
+std::vector<uint8_t> PageFile::read(Extent extent) const {
+    std::vector<uint8_t> bytes(extent.length);
+    size_t done = 0;
+    while (done < bytes.size()) {
+        auto n = ::pread(fd, bytes.data() + done, bytes.size() - done,
+                         off_t(extent.offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            fail("read " + path);
+        }
+        done += size_t(n);
+    }
+    return bytes;
+}
+
+void PageFile::release(Extent extent) {
+    if (extent.length == 0) {
+        return;
+    }
+    std::lock_guard lock(mutex);
+    free_extents.emplace(extent.length, extent.offset);
+    in_use -= extent.length;
+}
+
+uint64_t PageFile::used() const {
+    std::lock_guard lock(mutex);
+    return in_use;
+}
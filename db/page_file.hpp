@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace art {
+
+/**
+ * @class PageFile
+ * @brief Local file holding variable-sized pages written by the tree.
+ *
+ * Each page is one extent of the file. Released extents are kept by length
+ * and reused best-fit by later writes; they are not coalesced. The file is
+ * created empty and removed again when the `PageFile` is destroyed, so it
+ * only ever holds data of the running process.
+ */
+class PageFile {
+public:
+  struct Extent {
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  // Creates or truncates `path`. Throws std::system_error on failure.
+  explicit PageFile(const std::string &path);
+  ~PageFile();
+  PageFile(const PageFile &) = delete;
+  PageFile &operator=(const PageFile &) = delete;
+
+  // Throws std::system_error if the write fails.
+  Extent write(std::span<const uint8_t> bytes);
+  // Throws std::system_error if the read fails or comes up short.
+  std::vector<uint8_t> read(Extent extent) const;
+  void release(Extent extent);
+
+  // Bytes in extents that have not been released.
+  uint64_t used() const;
+
+private:
+  int fd;
+  std::string path;
+  mutable std::mutex mutex;
+  uint64_t end = 0;
+  uint64_t in_use = 0;
+  // Released extents: length -> offset.
+  std::multimap<uint64_t, uint64_t> free_extents;
+};
+
+} // namespace art
@@ -0,0 +1,783 @@
+#include "shared_art.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace art;
+
+namespace {
+constexpr char SEGMENT_MAGIC[8] = {'A', 'R', 'T', 'I', 'K', 'V', 'S', '1'};
+// Blocks are powers of two from 32 bytes up to 2^(5 + SIZE_CLASSES - 1).
+constexpr size_t MIN_BLOCK_SHIFT = 5;
+constexpr size_t SIZE_CLASSES = 40;
+// Number of blocks the writer retires before it advances the epoch and tries
+// to reclaim.
+constexpr size_t COLLECT_THRESHOLD = 64;
+constexpr uint8_t EMPTY = 0xFF;
+// Smallest segment `create` accepts beyond the header.
+constexpr size_t MIN_DATA_BYTES = 64 * 1024;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<pid_t>::is_always_lock_free &&
+                  std::atomic<uint16_t>::is_always_lock_free &&
+                  std::atomic<uint8_t>::is_always_lock_free,
+              "atomics in shared memory must be address-free");
+static_assert(sizeof(std::atomic<uint8_t>) == 1);
+
+[[noreturn]] void fail(const char *what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+size_t classFor(size_t bytes) {
+    size_t cls = 0;
+    while ((size_t(1) << (cls + MIN_BLOCK_SHIFT)) < bytes) {
+        cls++;
+    }
+    if (cls >= SIZE_CLASSES) {
+        throw std::bad_alloc();
+    }
+    return cls;
+}
+
+size_t classBytes(size_t cls) { return size_t(1) << (cls + MIN_BLOCK_SHIFT); }
+
+bool isInner(uint8_t type) { return type != uint8_t(NodeType::Leaf); }
+} // namespace
+
+struct SharedART::Header {
+    char magic[8];
+    uint64_t capacity;
+    Ref root;
+    std::atomic<uint64_t> size;
+    std::atomic<uint64_t> epoch;
+    std::atomic<pid_t> writer;
+    // Allocator state. Only the writer changes it.
+    std::atomic<uint64_t> bump;
+    Offset free_lists[SIZE_CLASSES];
+    struct ReaderSlot {
+        std::atomic<pid_t> pid;
+        // 0 while the reader is outside every operation.
+        std::atomic<uint64_t> epoch;
+    } readers[MAX_READERS];
+};
+
+namespace {
+// Fields shared by all inner nodes. The per-type body follows, then the
+// full compressed prefix.
+struct Inner {
+    uint8_t type;
+    // Slots used so far in a Node4/16/48; slots are never reused.
+    std::atomic<uint16_t> count;
+    uint32_t prefix_len;
+    std::atomic<uint64_t> prefix_leaf;
+};
+
+template <size_t N> struct Sparse : Inner {
+    uint8_t keys[N];
+    std::atomic<uint64_t> children[N];
+};
+using Sparse4 = Sparse<4>;
+using Sparse16 = Sparse<16>;
+
+struct Indexed48 : Inner {
+    std::atomic<uint8_t> index[256];
+    std::atomic<uint64_t> children[48];
+};
+
+struct Direct256 : Inner {
+    std::atomic<uint64_t> children[256];
+};
+
+// A key-value pair; the key bytes follow, then the value bytes.
+struct Leaf {
+    uint8_t type;
+    uint32_t key_len;
+    uint32_t val_len;
+
+    const uint8_t *key() const {
+        return reinterpret_cast<const uint8_t *>(this + 1);
+    }
+    const uint8_t *val() const { return key() + key_len; }
+};
+
+size_t bodySize(uint8_t type) {
+    switch (NodeType(type)) {
+    case NodeType::Node4:
+        return sizeof(Sparse4);
+    case NodeType::Node16:
+        return sizeof(Sparse16);
+    case NodeType::Node48:
+        return sizeof(Indexed48);
+    default:
+        return sizeof(Direct256);
+    }
+}
+
+size_t capacity(uint8_t type) {
+    switch (NodeType(type)) {
+    case NodeType::Node4:
+        return 4;
+    case NodeType::Node16:
+        return 16;
+    case NodeType::Node48:
+        return 48;
+    default:
+        return 256;
+    }
+}
+
+uint8_t typeFor(size_t children) {
+    for (auto type : {NodeType::Node4, NodeType::Node16, NodeType::Node48}) {
+        if (children <= capacity(uint8_t(type))) {
+            return uint8_t(type);
+        }
+    }
+    return uint8_t(NodeType::Node256);
+}
+
+size_t shrinkThreshold(uint8_t type) {
+    switch (NodeType(type)) {
+    case NodeType::Node16:
+        return 3;
+    case NodeType::Node48:
+        return 12;
+    case NodeType::Node256:
+        return 37;
+    default:
+        return 0;
+    }
+}
+} // namespace
+
+int SharedART::create(size_t capacity, const std::string &name) {
+    if (capacity < sizeof(Header) + MIN_DATA_BYTES) {
+        throw std::invalid_argument("shared segment too small");
+    }
+    int fd = name.empty() ? memfd_create("artikv", MFD_CLOEXEC)
+                          : shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR,
+                                     0600);
+    if (fd < 0) {
+        fail("create shared segment");
+    }
+    if (ftruncate(fd, capacity) != 0) {
+        ::close(fd);
+        fail("size shared segment");
+    }
+    auto *mem = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        ::close(fd);
+        fail("map shared segment");
+    }
+    // The file starts zeroed, which is a valid state for every atomic.
+    auto *header = static_cast<Header *>(mem);
+    header->capacity = capacity;
+    header->epoch.store(1, std::memory_order_relaxed);
+    header->bump.store((sizeof(Header) + 63) & ~size_t(63),
+                       std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    munmap(mem, sizeof(Header));
+    return fd;
+}
+
+SharedART::SharedART(int fd, Role role) : role(role) {
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        fail("stat shared segment");
+    }
+    if (size_t(st.st_size) < sizeof(Header)) {
+        throw std::runtime_error("not a shared tree segment");
+    }
+    auto *mem = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    if (mem == MAP_FAILED) {
+        fail("map shared segment");
+    }
+    base = static_cast<uint8_t *>(mem);
+    mapped = st.st_size;
+
+    auto &h = header();
+    auto pid = getpid();
+    try {
+        if (std::memcmp(h.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+            h.capacity != mapped) {
+            throw std::runtime_error("not a shared tree segment");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (role == Role::Writer) {
+            pid_t owner = 0;
+            while (!h.writer.compare_exchange_strong(owner, pid)) {
+                if (alive(owner)) {
+                    throw std::runtime_error("shared tree already has a writer");
+                }
+            }
+            return;
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t i = 0; i < MAX_READERS; i++) {
+                auto &slot = h.readers[i];
+                pid_t owner = slot.pid.load();
+                // On the second pass, take over slots of dead processes.
+                if ((owner == 0 || (pass == 1 && !alive(owner))) &&
+                    slot.pid.compare_exchange_strong(owner, pid)) {
+                    slot.epoch.store(0);
+                    reader_slot = i;
+                    return;
+                }
+            }
+        }
+        throw std::runtime_error("no free reader slot in shared tree");
+    } catch (...) {
+        munmap(base, mapped);
+        throw;
+    }
+}
+
+SharedART::~SharedART() {
+    auto &h = header();
+    if (role == Role::Writer) {
+        h.epoch.fetch_add(1);
+        collect();
+        h.writer.store(0);
+    } else {
+        h.readers[reader_slot].epoch.store(0);
+        h.readers[reader_slot].pid.store(0);
+    }
+    munmap(base, mapped);
+}
+
+SharedART::Guard::Guard(SharedART &tree) : tree(tree) {
+    if (tree.role == Role::Reader) {
+        auto &h = tree.header();
+        h.readers[tree.reader_slot].epoch.store(h.epoch.load());
+    }
+}
+
+SharedART::Guard::~Guard() {
+    if (tree.role == Role::Reader) {
+        tree.header().readers[tree.reader_slot].epoch.store(
+            0, std::memory_order_release);
+    }
+}
+
+SharedART::Header &SharedART::header() const {
+    return *reinterpret_cast<Header *>(base);
+}
+
+size_t SharedART::size() const {
+    return header().size.load(std::memory_order_relaxed);
+}
+
+size_t SharedART::used() const {
+    return header().bump.load(std::memory_order_relaxed);
+}
+
+void SharedART::requireWriter() const {
+    if (role != Role::Writer) {
+        throw std::logic_error("shared tree handle is read-only");
+    }
+}
+
+std::optional<ARTData> SharedART::search(Slice key) {
+    Guard guard(*this);
+    auto off = header().root.load(std::memory_order_acquire);
+    size_t depth = 0;
+    while (off != 0) {
+        auto type = *at<uint8_t>(off);
+        if (!isInner(type)) {
+            auto *leaf = at<Leaf>(off);
+            if (leaf->key_len != size_t(key.size()) ||
+                std::memcmp(leaf->key(), key.data(), key.size()) != 0) {
+                return std::nullopt;
+            }
+            return ARTData(leaf->val(), leaf->val() + leaf->val_len);
+        }
+        auto *node = at<Inner>(off);
+        auto *prefix = at<uint8_t>(off + bodySize(type));
+        if (depth + node->prefix_len > size_t(key.size()) ||
+            std::memcmp(prefix, key.data() + depth, node->prefix_len) != 0) {
+            return std::nullopt;
+        }
+        depth += node->prefix_len;
+        if (depth == size_t(key.size())) {
+            off = node->prefix_leaf.load(std::memory_order_acquire);
+            continue;
+        }
+        off = findChild(off, key[depth++]);
+    }
+    return std::nullopt;
+}
+
+void SharedART::insert(Slice key, std::span<const uint8_t> value) {
+    requireWriter();
+    auto &h = header();
+    auto leaf = newLeaf(key, value);
+    auto *slot = &h.root;
+    size_t depth = 0;
+    while (true) {
+        auto off = slot->load(std::memory_order_relaxed);
+        if (off == 0) {
+            slot->store(leaf, std::memory_order_release);
+            h.size.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto type = *at<uint8_t>(off);
+        if (!isInner(type)) {
+            auto *old = at<Leaf>(off);
+            if (old->key_len == size_t(key.size()) &&
+                std::memcmp(old->key(), key.data(), key.size()) == 0) {
+                slot->store(leaf, std::memory_order_release);
+                retire(off);
+                return;
+            }
+            // Both keys continue past `depth`; they share `common` more
+            // bytes before they diverge or one of them ends.
+            size_t limit = std::min<size_t>(old->key_len, key.size());
+            size_t common = 0;
+            while (depth + common < limit &&
+                   old->key()[depth + common] == key[depth + common]) {
+                common++;
+            }
+            auto node = newInner(uint8_t(NodeType::Node4), key.data() + depth,
+                                 common);
+            placeLeaf(node, off, depth + common);
+            placeLeaf(node, leaf, depth + common);
+            slot->store(node, std::memory_order_release);
+            h.size.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto *node = at<Inner>(off);
+        auto *prefix = at<uint8_t>(off + bodySize(type));
+        size_t mismatch = 0;
+        while (mismatch < node->prefix_len &&
+               depth + mismatch < size_t(key.size()) &&
+               prefix[mismatch] == key[depth + mismatch]) {
+            mismatch++;
+        }
+        if (mismatch < node->prefix_len) {
+            // Split the prefix: a new Node4 takes the common part, and a copy
+            // of the node keeps what follows the diverging byte.
+            auto split = newInner(uint8_t(NodeType::Node4), prefix, mismatch);
+            auto moved = rebuild(off, 0, prefix + mismatch + 1,
+                                 node->prefix_len - mismatch - 1);
+            addChild(split, prefix[mismatch], moved);
+            placeLeaf(split, leaf, depth + mismatch);
+            slot->store(split, std::memory_order_release);
+            retire(off);
+            h.size.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        depth += node->prefix_len;
+        if (depth == size_t(key.size())) {
+            auto old = node->prefix_leaf.load(std::memory_order_relaxed);
+            node->prefix_leaf.store(leaf, std::memory_order_release);
+            if (old != 0) {
+                retire(old);
+            } else {
+                h.size.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+        if (auto *child = childSlot(off, key[depth])) {
+            slot = child;
+            depth++;
+            continue;
+        }
+        if (!addChild(off, key[depth], leaf)) {
+            auto grown = rebuild(off, 1, prefix, node->prefix_len);
+            addChild(grown, key[depth], leaf);
+            slot->store(grown, std::memory_order_release);
+            retire(off);
+        }
+        h.size.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+void SharedART::remove(Slice key) {
+    requireWriter();
+    auto &h = header();
+    // The inner node being walked and the slot that holds it.
+    Ref *node_slot = nullptr;
+    Offset node = 0;
+    auto *slot = &h.root;
+    size_t depth = 0;
+    while (true) {
+        auto off = slot->load(std::memory_order_relaxed);
+        if (off == 0) {
+            return;
+        }
+        auto type = *at<uint8_t>(off);
+        if (!isInner(type)) {
+            auto *leaf = at<Leaf>(off);
+            if (leaf->key_len != size_t(key.size()) ||
+                std::memcmp(leaf->key(), key.data(), key.size()) != 0) {
+                return;
+            }
+            slot->store(0, std::memory_order_release);
+            retire(off);
+            h.size.fetch_sub(1, std::memory_order_relaxed);
+            if (node != 0) {
+                fixUp(*node_slot, node);
+            }
+            return;
+        }
+        auto *inner = at<Inner>(off);
+        auto *prefix = at<uint8_t>(off + bodySize(type));
+        if (depth + inner->prefix_len > size_t(key.size()) ||
+            std::memcmp(prefix, key.data() + depth, inner->prefix_len) != 0) {
+            return;
+        }
+        depth += inner->prefix_len;
+        node_slot = slot;
+        node = off;
+        if (depth == size_t(key.size())) {
+            slot = &inner->prefix_leaf;
+            continue;
+        }
+        slot = childSlot(off, key[depth++]);
+        if (slot == nullptr) {
+            return;
+        }
+    }
+}
+
+// Restores the node invariants after a child or the prefix leaf of `node`
+// was cleared: empty nodes disappear, nodes left with a single entry are
+// merged into it, and sparse wide nodes are rebuilt narrower.
+void SharedART::fixUp(Ref &slot, Offset node) {
+    auto *inner = at<Inner>(node);
+    auto live = liveChildren(node);
+    auto prefix_leaf = inner->prefix_leaf.load(std::memory_order_relaxed);
+    if (live == 0) {
+        slot.store(prefix_leaf, std::memory_order_release);
+        retire(node);
+        return;
+    }
+    if (live == 1 && prefix_leaf == 0) {
+        uint8_t byte = 0;
+        Offset child = 0;
+        forEachChild(node, [&](uint8_t b, Offset c) {
+            byte = b;
+            child = c;
+        });
+        if (!isInner(*at<uint8_t>(child))) {
+            slot.store(child, std::memory_order_release);
+            retire(node);
+            return;
+        }
+        // Path compression: the child absorbs this node's prefix and byte.
+        auto *c = at<Inner>(child);
+        std::vector<uint8_t> merged(at<uint8_t>(node + bodySize(inner->type)),
+                                    at<uint8_t>(node + bodySize(inner->type)) +
+                                        inner->prefix_len);
+        merged.push_back(byte);
+        auto *child_prefix = at<uint8_t>(child + bodySize(c->type));
+        merged.insert(merged.end(), child_prefix, child_prefix + c->prefix_len);
+        auto collapsed = rebuild(child, 0, merged.data(), merged.size());
+        slot.store(collapsed, std::memory_order_release);
+        retire(node);
+        retire(child);
+        return;
+    }
+    if (live <= shrinkThreshold(inner->type)) {
+        auto shrunk = rebuild(node, 0, at<uint8_t>(node + bodySize(inner->type)),
+                              inner->prefix_len);
+        slot.store(shrunk, std::memory_order_release);
+        retire(node);
+    }
+}
+
+SharedART::Offset SharedART::findChild(Offset node, uint8_t byte) const {
+    auto type = NodeType(*at<uint8_t>(node));
+    auto sparse = [&](auto *n) -> Offset {
+        auto count = n->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            if (n->keys[i] == byte) {
+                // A removed entry leaves a null child behind; the byte may
+                // have been added again further on.
+                if (auto child = n->children[i].load(std::memory_order_acquire)) {
+                    return child;
+                }
+            }
+        }
+        return 0;
+    };
+    switch (type) {
+    case NodeType::Node4:
+        return sparse(at<Sparse4>(node));
+    case NodeType::Node16:
+        return sparse(at<Sparse16>(node));
+    case NodeType::Node48: {
+        auto *n = at<Indexed48>(node);
+        auto index = n->index[byte].load(std::memory_order_acquire);
+        return index == EMPTY
+                   ? 0
+                   : n->children[index].load(std::memory_order_acquire);
+    }
+    default:
+        return at<Direct256>(node)->children[byte].load(std::memory_order_acquire);
+    }
+}
+
+SharedART::Ref *SharedART::childSlot(Offset node, uint8_t byte) const {
+    auto type = NodeType(*at<uint8_t>(node));
+    auto sparse = [&](auto *n) -> Ref * {
+        auto count = n->count.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; i++) {
+            if (n->keys[i] == byte && n->children[i].load() != 0) {
+                return &n->children[i];
+            }
+        }
+        return nullptr;
+    };
+    Ref *slot = nullptr;
+    switch (type) {
+    case NodeType::Node4:
+        return sparse(at<Sparse4>(node));
+    case NodeType::Node16:
+        return sparse(at<Sparse16>(node));
+    case NodeType::Node48: {
+        auto *n = at<Indexed48>(node);
+        auto index = n->index[byte].load(std::memory_order_relaxed);
+        if (index == EMPTY) {
+            return nullptr;
+        }
+        slot = &n->children[index];
+        break;
+    }
+    default:
+        slot = &at<Direct256>(node)->children[byte];
+    }
+    return slot->load(std::memory_order_relaxed) != 0 ? slot : nullptr;
+}
+
+// Makes `child` reachable under `byte`, or returns false if the node has no
+// unused slot left.
+bool SharedART::addChild(Offset node, uint8_t byte, Offset child) {
+    auto type = NodeType(*at<uint8_t>(node));
+    auto sparse = [&](auto *n, size_t cap) {
+        auto count = n->count.load(std::memory_order_relaxed);
+        if (count == cap) {
+            return false;
+        }
+        n->keys[count] = byte;
+        n->children[count].store(child, std::memory_order_relaxed);
+        n->count.store(count + 1, std::memory_order_release);
+        return true;
+    };
+    switch (type) {
+    case NodeType::Node4:
+        return sparse(at<Sparse4>(node), 4);
+    case NodeType::Node16:
+        return sparse(at<Sparse16>(node), 16);
+    case NodeType::Node48: {
+        auto *n = at<Indexed48>(node);
+        auto count = n->count.load(std::memory_order_relaxed);
+        if (count == 48) {
+            return false;
+        }
+        n->children[count].store(child, std::memory_order_relaxed);
+        n->index[byte].store(count, std::memory_order_release);
+        n->count.store(count + 1, std::memory_order_relaxed);
+        return true;
+    }
+    default:
+        at<Direct256>(node)->children[byte].store(child, std::memory_order_release);
+        return true;
+    }
+}
+
+template <typename F> void SharedART::forEachChild(Offset node, F &&fn) const {
+    auto type = NodeType(*at<uint8_t>(node));
+    auto sparse = [&](auto *n) {
+        auto count = n->count.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; i++) {
+            if (auto child = n->children[i].load(std::memory_order_relaxed)) {
+                fn(n->keys[i], child);
+            }
+        }
+    };
+    switch (type) {
+    case NodeType::Node4:
+        return sparse(at<Sparse4>(node));
+    case NodeType::Node16:
+        return sparse(at<Sparse16>(node));
+    case NodeType::Node48: {
+        auto *n = at<Indexed48>(node);
+        for (size_t b = 0; b < 256; b++) {
+            auto index = n->index[b].load(std::memory_order_relaxed);
+            if (index == EMPTY) {
+                continue;
+            }
+            if (auto child = n->children[index].load(std::memory_order_relaxed)) {
+                fn(uint8_t(b), child);
+            }
+        }
+        return;
+    }
+    default:
+        for (size_t b = 0; b < 256; b++) {
+            auto child = at<Direct256>(node)->children[b].load(
+                std::memory_order_relaxed);
+            if (child != 0) {
+                fn(uint8_t(b), child);
+            }
+        }
+    }
+}
+
+size_t SharedART::liveChildren(Offset node) const {
+    size_t live = 0;
+    forEachChild(node, [&](uint8_t, Offset) { live++; });
+    return live;
+}
+
+SharedART::Offset SharedART::newLeaf(Slice key,
+                                     std::span<const uint8_t> value) {
+    size_t cls;
+    auto off = allocate(sizeof(Leaf) + key.size() + value.size(), cls);
+    auto *leaf = at<Leaf>(off);
+    leaf->type = uint8_t(NodeType::Leaf);
+    leaf->key_len = key.size();
+    leaf->val_len = value.size();
+    auto *bytes = at<uint8_t>(off + sizeof(Leaf));
+    std::memcpy(bytes, key.data(), key.size());
+    std::memcpy(bytes + key.size(), value.data(), value.size());
+    return off;
+}
+
+SharedART::Offset SharedART::newInner(uint8_t type, const uint8_t *prefix,
+                                      size_t prefix_len) {
+    size_t cls;
+    auto off = allocate(bodySize(type) + prefix_len, cls);
+    std::memset(at<uint8_t>(off), 0, bodySize(type));
+    auto *node = at<Inner>(off);
+    node->type = type;
+    node->prefix_len = prefix_len;
+    if (NodeType(type) == NodeType::Node48) {
+        for (auto &index : at<Indexed48>(off)->index) {
+            index.store(EMPTY, std::memory_order_relaxed);
+        }
+    }
+    std::memmove(at<uint8_t>(off + bodySize(type)), prefix, prefix_len);
+    return off;
+}
+
+// Copies the live entries of `node` into the smallest node type that also
+// has room for `extra` more children, giving the copy a new prefix.
+SharedART::Offset SharedART::rebuild(Offset node, size_t extra,
+                                     const uint8_t *prefix,
+                                     size_t prefix_len) {
+    auto copy = newInner(typeFor(liveChildren(node) + extra), prefix,
+                         prefix_len);
+    at<Inner>(copy)->prefix_leaf.store(
+        at<Inner>(node)->prefix_leaf.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    forEachChild(node, [&](uint8_t byte, Offset child) {
+        addChild(copy, byte, child);
+    });
+    return copy;
+}
+
+// Places `leaf` into a node whose path ends at `depth`.
+void SharedART::placeLeaf(Offset inner, Offset leaf, size_t depth) {
+    auto *l = at<Leaf>(leaf);
+    if (l->key_len == depth) {
+        at<Inner>(inner)->prefix_leaf.store(leaf, std::memory_order_release);
+    } else {
+        addChild(inner, l->key()[depth], leaf);
+    }
+}
+
+SharedART::Offset SharedART::allocate(size_t bytes, size_t &size_class) {
+    auto &h = header();
+    size_class = classFor(bytes);
+    if (auto block = h.free_lists[size_class]) {
+        h.free_lists[size_class] = *at<Offset>(block);
+        return block;
+    }
+    auto block = h.bump.load(std::memory_order_relaxed);
+    if (block + classBytes(size_class) > h.capacity) {
+        throw std::bad_alloc();
+    }
+    h.bump.store(block + classBytes(size_class), std::memory_order_relaxed);
+    return block;
+}
+
+void SharedART::release(Offset block, size_t size_class) {
+    auto &h = header();
+    *at<Offset>(block) = h.free_lists[size_class];
+    h.free_lists[size_class] = block;
+}
+
+size_t SharedART::blockClass(Offset block) const {
+    auto type = *at<uint8_t>(block);
+    if (!isInner(type)) {
+        auto *leaf = at<Leaf>(block);
+        return classFor(sizeof(Leaf) + leaf->key_len + leaf->val_len);
+    }
+    return classFor(bodySize(type) + at<Inner>(block)->prefix_len);
+}
+
+void SharedART::retire(Offset block) {
+    auto &h = header();
+    retired.push_back(
+        {block, blockClass(block), h.epoch.load(std::memory_order_relaxed)});
+    if (retired.size() >= COLLECT_THRESHOLD) {
+        h.epoch.fetch_add(1);
+        collect();
+    }
+}
+
+void SharedART::collect() {
+    auto &h = header();
+    // Pairs with the reader's store of its epoch: a reader this scan misses
+    // entered after the unlinks above and cannot reach the blocks.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t min_active = UINT64_MAX;
+    for (auto &slot : h.readers) {
+        auto pid = slot.pid.load();
+        auto epoch = slot.epoch.load();
+        if (pid == 0 || epoch == 0) {
+            continue;
+        }
+        if (!alive(pid)) {
+            // The reader died mid-operation; its slot would pin the epoch
+            // forever. The slot is held under this process's pid while it is
+            // cleared, so that a reader taking it over meanwhile cannot have
+            // its epoch wiped.
+            if (slot.pid.compare_exchange_strong(pid, getpid())) {
+                slot.epoch.store(0);
+                slot.pid.store(0);
+                continue;
+            }
+            epoch = slot.epoch.load();
+            if (epoch == 0) {
+                continue;
+            }
+        }
+        min_active = std::min(min_active, epoch);
+    }
+    std::erase_if(retired, [&](const Retired &r) {
+        if (r.epoch >= min_active) {
+            return false;
+        }
+        release(r.block, r.size_class);
+        return true;
+    });
+}
+
+bool SharedART::alive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
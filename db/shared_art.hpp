@@ -0,0 +1,160 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "art.hpp"
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class SharedART
+ * @brief Adaptive radix tree stored in a shared-memory segment.
+ *
+ * The segment is a `memfd` or POSIX shared-memory object holding a header and
+ * every node of the tree. Nodes refer to each other by their offset into the
+ * segment, so each process can map it at a different address. Memory comes
+ * from a size-class allocator whose free lists live in the header.
+ *
+ * One process at a time attaches as the writer; any number of processes
+ * attach as readers. The writer never modifies anything a reader may be
+ * looking at except through single atomic stores: Node4/16/48 are
+ * append-only, so a new child is written before the count that makes it
+ * visible, and every other change builds a replacement node that is swapped
+ * into its parent's slot. Readers therefore take no locks.
+ *
+ * Replaced memory is reclaimed with epochs kept in the header: each reader
+ * handle owns a slot that announces the epoch it entered in, and the writer
+ * only frees a retired block once every active slot entered after it was
+ * retired. Slots and the writer role are tagged with the owner's pid, so a
+ * process that dies without detaching is noticed and its slot released.
+ *
+ * A handle is used by one thread at a time; threads that read concurrently
+ * each attach their own handle.
+ *
+ * Usage example:
+ * @code
+ *     int fd = SharedART::create(64 << 20);
+ *     SharedART writer(fd, SharedART::Role::Writer);
+ *     writer.insert("key1", std::string_view("value1"));
+ *     // In another process that received `fd`:
+ *     SharedART reader(fd, SharedART::Role::Reader);
+ *     auto value = reader.search("key1");
+ * @endcode
+ */
+class SharedART {
+public:
+  enum class Role { Writer, Reader };
+  // Reader handles that can be attached to one segment at the same time.
+  static constexpr size_t MAX_READERS = 128;
+
+  /**
+   * Creates and formats a segment of `capacity` bytes. Without a name the
+   * segment is an anonymous `memfd` that other processes receive by
+   * inheriting or being passed the descriptor; with one it is the POSIX
+   * shared-memory object `name`, which other processes open with
+   * `shm_open`.
+   *
+   * @return A descriptor the caller owns.
+   * @throws std::system_error if the segment cannot be created,
+   * std::invalid_argument if `capacity` leaves no room for nodes.
+   */
+  static int create(size_t capacity, const std::string &name = "");
+
+  /**
+   * Maps the segment behind `fd` and registers as its writer or as one of
+   * its readers. The descriptor may be closed afterwards.
+   *
+   * @throws std::system_error if the segment cannot be mapped,
+   * std::runtime_error if it is not formatted, another live process is its
+   * writer, or all reader slots are taken.
+   */
+  SharedART(int fd, Role role);
+  ~SharedART();
+  SharedART(const SharedART &) = delete;
+  SharedART &operator=(const SharedART &) = delete;
+
+  /**
+   * Inserts or overwrites a key-value pair. Writer only.
+   *
+   * @throws std::bad_alloc if the segment is full.
+   */
+  void insert(Slice key, std::span<const uint8_t> value);
+  void insert(Slice key, std::string_view value) {
+    insert(key, std::span(reinterpret_cast<const uint8_t *>(value.data()),
+                          value.size()));
+  }
+
+  // Removes a key if present. Writer only.
+  void remove(Slice key);
+
+  // Copies out the value stored under `key`.
+  std::optional<ARTData> search(Slice key);
+
+  size_t size() const;
+  // High-water mark of the segment's allocator, in bytes.
+  size_t used() const;
+
+private:
+  struct Header;
+  using Offset = uint64_t;
+  using Ref = std::atomic<Offset>;
+
+  struct Retired {
+    Offset block;
+    size_t size_class;
+    uint64_t epoch;
+  };
+
+  // Announces this handle's epoch in its reader slot for one operation.
+  class Guard {
+  public:
+    explicit Guard(SharedART &tree);
+    ~Guard();
+
+  private:
+    SharedART &tree;
+  };
+
+  uint8_t *base = nullptr;
+  size_t mapped = 0;
+  Role role;
+  size_t reader_slot = 0;
+  // Blocks unlinked by this writer that readers may still be walking. They
+  // leak if the writer dies before its readers move on.
+  std::vector<Retired> retired;
+
+  Header &header() const;
+  template <typename T> T *at(Offset off) const {
+    return reinterpret_cast<T *>(base + off);
+  }
+
+  void requireWriter() const;
+  Offset findChild(Offset node, uint8_t byte) const;
+  Ref *childSlot(Offset node, uint8_t byte) const;
+  bool addChild(Offset node, uint8_t byte, Offset child);
+  size_t liveChildren(Offset node) const;
+  template <typename F> void forEachChild(Offset node, F &&fn) const;
+
+  Offset newLeaf(Slice key, std::span<const uint8_t> value);
+  Offset newInner(uint8_t type, const uint8_t *prefix, size_t prefix_len);
+  Offset rebuild(Offset node, size_t extra, const uint8_t *prefix,
+                 size_t prefix_len);
+  void placeLeaf(Offset inner, Offset leaf, size_t depth);
+  void fixUp(Ref &slot, Offset node);
+
+  Offset allocate(size_t bytes, size_t &size_class);
+  void release(Offset block, size_t size_class);
+  size_t blockClass(Offset block) const;
+  void retire(Offset block);
+  void collect();
+  static bool alive(pid_t pid);
+};
+
+} // namespace art
@@ -0,0 +1,144 @@
+#include "sorted_set.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+using namespace art;
+
+namespace {
+constexpr size_t SCORE_BYTES = sizeof(uint64_t);
+constexpr uint64_t SIGN = uint64_t(1) << 63;
+
+// Big-endian bytes that compare like the scores: non-negative scores get the
+// sign bit set, negative ones have every bit flipped.
+void encodeScore(double score, uint8_t *out) {
+    if (score == 0) {
+        // -0.0 sorts with 0.0.
+        score = 0;
+    }
+    auto bits = std::bit_cast<uint64_t>(score);
+    bits = (bits & SIGN) ? ~bits : bits | SIGN;
+    for (size_t i = 0; i < SCORE_BYTES; i++) {
+        out[i] = uint8_t(bits >> (56 - 8 * i));
+    }
+}
+
+double decodeScore(const uint8_t *in) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < SCORE_BYTES; i++) {
+        bits = bits << 8 | in[i];
+    }
+    bits = (bits & SIGN) ? bits & ~SIGN : ~bits;
+    return std::bit_cast<double>(bits);
+}
+
+Slice slice(const ARTData &data) { return Slice(data.data(), data.size()); }
+} // namespace
+
+ScoreIndex::ScoreIndex() { by_score.enable_rank(); }
+
+ARTData ScoreIndex::scoreKey(double score, Slice member) {
+    ARTData key(SCORE_BYTES + member.size());
+    encodeScore(score, key.data());
+    std::copy(member.begin(), member.end(), key.begin() + SCORE_BYTES);
+    return key;
+}
+
+ScoreIndex::Entry ScoreIndex::decodeKey(std::span<const uint8_t> key) {
+    return {ARTData(key.begin() + SCORE_BYTES, key.end()),
+            decodeScore(key.data())};
+}
+
+void ScoreIndex::add(Slice member, double score) {
+    by_score.insert(slice(scoreKey(score, member)), ARTData());
+}
+
+void ScoreIndex::remove(Slice member, double score) {
+    by_score.remove(slice(scoreKey(score, member)));
+}
+
+size_t ScoreIndex::rank(Slice member, double score) {
+    return by_score.rank(slice(scoreKey(score, member)));
+}
+
+size_t ScoreIndex::size() { return by_score.size(); }
+
+std::vector<ScoreIndex::Entry> ScoreIndex::range(size_t start, size_t stop) {
+    std::vector<Entry> entries;
+    if (start > stop) {
+        return entries;
+    }
+    for (auto it = by_score.seek_rank(start);
+         it.valid() && entries.size() <= stop - start; it.next()) {
+        entries.push_back(decodeKey(it.key()));
+    }
+    return entries;
+}
+
+// The offset is skipped by rank, not by walking past the entries.
+std::vector<ScoreIndex::Entry>
+ScoreIndex::range_by_score(double min, double max, size_t offset,
+                           size_t count) {
+    std::vector<Entry> entries;
+    auto first = by_score.rank(slice(scoreKey(min, std::string_view())));
+    for (auto it = by_score.seek_rank(first + offset);
+         it.valid() && entries.size() < count; it.next()) {
+        auto entry = decodeKey(it.key());
+        if (entry.second > max) {
+            break;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+bool SortedSet::add(Slice member, double score) {
+    if (std::isnan(score)) {
+        throw std::invalid_argument("score is NaN");
+    }
+    auto old = this->score(member);
+    if (old) {
+        if (*old == score) {
+            return false;
+        }
+        index.remove(member, *old);
+    }
+    index.add(member, score);
+    ARTData value(sizeof(score));
+    std::memcpy(value.data(), &score, sizeof(score));
+    members.insert(member, std::move(value));
+    return !old;
+}
+
+bool SortedSet::remove(Slice member) {
+    auto old = score(member);
+    if (!old) {
+        return false;
+    }
+    index.remove(member, *old);
+    members.remove(member);
+    return true;
+}
+
+std::optional<double> SortedSet::score(Slice member) {
+    double score;
+    auto size = members.read(
+        member, std::span(reinterpret_cast<uint8_t *>(&score), sizeof(score)));
+    if (!size) {
+        return std::nullopt;
+    }
+    return score;
+}
+
+std::optional<size_t> SortedSet::rank(Slice member) {
+    auto old = score(member);
+    if (!old) {
+        return std::nullopt;
+    }
+    return index.rank(member, *old);
+}
+
+size_t SortedSet::size() { return members.size(); }
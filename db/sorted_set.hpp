@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "art.hpp"
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class ScoreIndex
+ * @brief Members ordered by a floating-point score, without a way to look
+ * a score up by member: the caller keeps the scores and passes them in.
+ *
+ * The index holds the key (encoded score, member) with an empty value,
+ * where the score is encoded into 8 bytes that sort like the numbers they
+ * stand for. Pairs with equal scores therefore order by member, and score
+ * ranges are `lower_bound` scans. The tree counts its leaves, which turns
+ * ranks and rank ranges into one descent each.
+ *
+ * Reads may run alongside one writer at a time.
+ */
+class ScoreIndex {
+public:
+  using Entry = std::pair<ARTData, double>;
+
+  ScoreIndex();
+
+  // `member` must not be in the index; remove its old score first.
+  void add(Slice member, double score);
+  void remove(Slice member, double score);
+  // 0-based position by ascending score of `member`, which has `score`.
+  size_t rank(Slice member, double score);
+  size_t size();
+
+  // Entries of ranks `start` to `stop`, both included.
+  std::vector<Entry> range(size_t start, size_t stop);
+  // Entries with `min` <= score <= `max`, skipping `offset` and returning
+  // at most `count`.
+  std::vector<Entry> range_by_score(double min, double max, size_t offset = 0,
+                                    size_t count = SIZE_MAX);
+
+private:
+  ART by_score;
+
+  static ARTData scoreKey(double score, Slice member);
+  static Entry decodeKey(std::span<const uint8_t> key);
+};
+
+/**
+ * @class SortedSet
+ * @brief Members ordered by a floating-point score, as in a Redis sorted
+ * set, kept in two trees.
+ *
+ * `members` maps each member to its score, and a `ScoreIndex` orders them
+ * by score.
+ *
+ * Reads may run alongside one writer at a time.
+ */
+class SortedSet {
+public:
+  using Entry = ScoreIndex::Entry;
+
+  /**
+   * Sets the score of `member`.
+   *
+   * @return Whether `member` is new.
+   * @throws std::invalid_argument if `score` is NaN.
+   */
+  bool add(Slice member, double score);
+  // Returns whether `member` was there.
+  bool remove(Slice member);
+
+  std::optional<double> score(Slice member);
+  // 0-based position of `member` by ascending score.
+  std::optional<size_t> rank(Slice member);
+  size_t size();
+
+  // Entries of ranks `start` to `stop`, both included.
+  std::vector<Entry> range(size_t start, size_t stop) {
+    return index.range(start, stop);
+  }
+  // Entries with `min` <= score <= `max`, skipping `offset` and returning
+  // at most `count`.
+  std::vector<Entry> range_by_score(double min, double max, size_t offset = 0,
+                                    size_t count = SIZE_MAX) {
+    return index.range_by_score(min, max, offset, count);
+  }
+
+private:
+  ART members;
+  ScoreIndex index;
+};
+
+} // namespace art
@@ -0,0 +1,602 @@
+#include "tid_index.hpp"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+using namespace art;
+
+namespace {
+enum Kind : uint8_t { N4, N16, N48, N256 };
+constexpr size_t CAPACITY[] = {4, 16, 48, 256};
+
+bool isLeaf(uint64_t ref) { return ref & 1; }
+uint64_t leafRef(uint64_t tid) { return tid << 1 | 1; }
+uint64_t tidOf(uint64_t ref) { return ref >> 1; }
+
+bool equalKey(const std::vector<uint8_t> &a, Slice b) {
+    return a.size() == size_t(b.size()) &&
+           std::equal(a.begin(), a.end(), b.begin());
+}
+} // namespace
+
+struct TidIndex::Node {
+    explicit Node(uint8_t kind) : kind(kind) {}
+    uint8_t kind;
+    uint16_t entries = 0;
+    // Full length of the compressed path; only its first MAX_PREFIX bytes
+    // are kept.
+    uint32_t prefix_len = 0;
+    uint8_t prefix[MAX_PREFIX] = {};
+    // Leaf of the key that ends at this node.
+    Ref prefix_leaf = 0;
+};
+
+struct TidIndex::Node4 : Node {
+    Node4() : Node(N4) {}
+    uint8_t keys[4];
+    Ref children[4];
+};
+
+struct TidIndex::Node16 : Node {
+    Node16() : Node(N16) {}
+    uint8_t keys[16];
+    Ref children[16];
+};
+
+struct TidIndex::Node48 : Node {
+    Node48() : Node(N48) {}
+    // Slot of each byte plus one, 0 for none. Slots [0, entries) are used.
+    uint8_t index[256] = {};
+    Ref children[48];
+};
+
+struct TidIndex::Node256 : Node {
+    Node256() : Node(N256) {}
+    Ref children[256] = {};
+};
+
+TidIndex::TidIndex(KeyLoader load_key, std::pmr::memory_resource *resource)
+    : load_key(std::move(load_key)), resource(resource) {}
+
+TidIndex::~TidIndex() { freeTree(root); }
+
+template <typename T> T *TidIndex::newNode(const Node *header) {
+    auto *node = new (resource->allocate(sizeof(T), alignof(T))) T();
+    allocated += sizeof(T);
+    if (header != nullptr) {
+        node->prefix_len = header->prefix_len;
+        std::memcpy(node->prefix, header->prefix, MAX_PREFIX);
+        node->prefix_leaf = header->prefix_leaf;
+    }
+    return node;
+}
+
+void TidIndex::freeNode(Node *node) {
+    size_t bytes = 0;
+    size_t align = alignof(Node);
+    switch (node->kind) {
+    case N4:
+        bytes = sizeof(Node4);
+        align = alignof(Node4);
+        break;
+    case N16:
+        bytes = sizeof(Node16);
+        align = alignof(Node16);
+        break;
+    case N48:
+        bytes = sizeof(Node48);
+        align = alignof(Node48);
+        break;
+    case N256:
+        bytes = sizeof(Node256);
+        align = alignof(Node256);
+        break;
+    }
+    resource->deallocate(node, bytes, align);
+    allocated -= bytes;
+}
+
+void TidIndex::freeTree(Ref ref) {
+    if (ref == 0 || isLeaf(ref)) {
+        return;
+    }
+    auto *node = reinterpret_cast<Node *>(ref);
+    forEachChild(node, [&](uint8_t, Ref child) { freeTree(child); });
+    freeNode(node);
+}
+
+TidIndex::Ref *TidIndex::findChild(Node *node, uint8_t byte) {
+    switch (node->kind) {
+    case N4: {
+        auto *n = static_cast<Node4 *>(node);
+        for (size_t i = 0; i < n->entries; i++) {
+            if (n->keys[i] == byte) {
+                return &n->children[i];
+            }
+        }
+        return nullptr;
+    }
+    case N16: {
+        auto *n = static_cast<Node16 *>(node);
+        auto *end = n->keys + n->entries;
+        auto *it = std::lower_bound(n->keys, end, byte);
+        return it != end && *it == byte ? &n->children[it - n->keys] : nullptr;
+    }
+    case N48: {
+        auto *n = static_cast<Node48 *>(node);
+        return n->index[byte] != 0 ? &n->children[n->index[byte] - 1] : nullptr;
+    }
+    default: {
+        auto *n = static_cast<Node256 *>(node);
+        return n->children[byte] != 0 ? &n->children[byte] : nullptr;
+    }
+    }
+}
+
+// Visits the children of `node` in byte order.
+template <typename F> void TidIndex::forEachChild(const Node *node, F &&fn) {
+    switch (node->kind) {
+    case N4: {
+        auto *n = static_cast<const Node4 *>(node);
+        for (size_t i = 0; i < n->entries; i++) {
+            fn(n->keys[i], n->children[i]);
+        }
+        break;
+    }
+    case N16: {
+        auto *n = static_cast<const Node16 *>(node);
+        for (size_t i = 0; i < n->entries; i++) {
+            fn(n->keys[i], n->children[i]);
+        }
+        break;
+    }
+    case N48: {
+        auto *n = static_cast<const Node48 *>(node);
+        for (unsigned byte = 0; byte < 256; byte++) {
+            if (n->index[byte] != 0) {
+                fn(uint8_t(byte), n->children[n->index[byte] - 1]);
+            }
+        }
+        break;
+    }
+    default: {
+        auto *n = static_cast<const Node256 *>(node);
+        for (unsigned byte = 0; byte < 256; byte++) {
+            if (n->children[byte] != 0) {
+                fn(uint8_t(byte), n->children[byte]);
+            }
+        }
+        break;
+    }
+    }
+}
+
+// Adds a child to a node that has room for it.
+void TidIndex::insertChild(Node *node, uint8_t byte, Ref child) {
+    auto sortedInsert = [&](uint8_t *keys, Ref *children) {
+        size_t i = std::upper_bound(keys, keys + node->entries, byte) - keys;
+        std::memmove(keys + i + 1, keys + i, node->entries - i);
+        std::memmove(children + i + 1, children + i,
+                     (node->entries - i) * sizeof(Ref));
+        keys[i] = byte;
+        children[i] = child;
+    };
+    switch (node->kind) {
+    case N4: {
+        auto *n = static_cast<Node4 *>(node);
+        sortedInsert(n->keys, n->children);
+        break;
+    }
+    case N16: {
+        auto *n = static_cast<Node16 *>(node);
+        sortedInsert(n->keys, n->children);
+        break;
+    }
+    case N48: {
+        auto *n = static_cast<Node48 *>(node);
+        n->children[n->entries] = child;
+        n->index[byte] = uint8_t(n->entries + 1);
+        break;
+    }
+    default:
+        static_cast<Node256 *>(node)->children[byte] = child;
+        break;
+    }
+    node->entries++;
+}
+
+void TidIndex::removeChild(Node *node, uint8_t byte) {
+    auto sortedErase = [&](uint8_t *keys, Ref *children) {
+        size_t i = std::find(keys, keys + node->entries, byte) - keys;
+        std::memmove(keys + i, keys + i + 1, node->entries - i - 1);
+        std::memmove(children + i, children + i + 1,
+                     (node->entries - i - 1) * sizeof(Ref));
+    };
+    switch (node->kind) {
+    case N4: {
+        auto *n = static_cast<Node4 *>(node);
+        sortedErase(n->keys, n->children);
+        break;
+    }
+    case N16: {
+        auto *n = static_cast<Node16 *>(node);
+        sortedErase(n->keys, n->children);
+        break;
+    }
+    case N48: {
+        // The last used slot moves into the freed one.
+        auto *n = static_cast<Node48 *>(node);
+        auto slot = n->index[byte] - 1;
+        auto last = n->entries - 1;
+        if (slot != last) {
+            n->children[slot] = n->children[last];
+            for (auto &index : n->index) {
+                if (index == last + 1) {
+                    index = uint8_t(slot + 1);
+                    break;
+                }
+            }
+        }
+        n->index[byte] = 0;
+        break;
+    }
+    default:
+        static_cast<Node256 *>(node)->children[byte] = 0;
+        break;
+    }
+    node->entries--;
+}
+
+// Moves the header and children of `node` into a new node of `kind`, which
+// must have room for them, and frees `node`.
+TidIndex::Node *TidIndex::rebuild(Node *node, uint8_t kind) {
+    Node *fresh;
+    switch (kind) {
+    case N4:
+        fresh = newNode<Node4>(node);
+        break;
+    case N16:
+        fresh = newNode<Node16>(node);
+        break;
+    case N48:
+        fresh = newNode<Node48>(node);
+        break;
+    default:
+        fresh = newNode<Node256>(node);
+        break;
+    }
+    forEachChild(node, [&](uint8_t byte, Ref child) {
+        insertChild(fresh, byte, child);
+    });
+    freeNode(node);
+    return fresh;
+}
+
+// Adds a child to `node`, which hangs from `slot`, growing it if full.
+void TidIndex::addChild(Ref &slot, Node *node, uint8_t byte, Ref child) {
+    if (node->entries == CAPACITY[node->kind]) {
+        node = rebuild(node, node->kind + 1);
+        slot = Ref(node);
+    }
+    insertChild(node, byte, child);
+}
+
+// Restores the shape of `node`, which hangs from `slot`, after a removal:
+// a node left with one entry is replaced by it, and an underfull node by
+// the next smaller kind.
+void TidIndex::compact(Ref &slot, Node *node) {
+    if (node->entries == 0) {
+        slot = node->prefix_leaf;
+        freeNode(node);
+        return;
+    }
+    if (node->entries == 1 && node->prefix_leaf == 0) {
+        uint8_t byte = 0;
+        Ref child = 0;
+        forEachChild(node, [&](uint8_t b, Ref c) {
+            byte = b;
+            child = c;
+        });
+        if (!isLeaf(child)) {
+            // The child's path grows by this node's path and the byte.
+            auto *inner = reinterpret_cast<Node *>(child);
+            uint8_t prefix[MAX_PREFIX] = {};
+            size_t n = std::min<size_t>(node->prefix_len, MAX_PREFIX);
+            std::memcpy(prefix, node->prefix, n);
+            if (n < MAX_PREFIX) {
+                prefix[n++] = byte;
+            }
+            std::memcpy(prefix + n, inner->prefix,
+                        std::min<size_t>(inner->prefix_len, MAX_PREFIX - n));
+            inner->prefix_len += node->prefix_len + 1;
+            std::memcpy(inner->prefix, prefix, MAX_PREFIX);
+        }
+        slot = child;
+        freeNode(node);
+        return;
+    }
+    if (node->kind != N4 &&
+        node->entries <= CAPACITY[node->kind - 1] * 3 / 4) {
+        slot = Ref(rebuild(node, node->kind - 1));
+    }
+}
+
+TidIndex::Ref TidIndex::minLeaf(Ref ref) {
+    while (!isLeaf(ref)) {
+        auto *node = reinterpret_cast<Node *>(ref);
+        if (node->prefix_leaf != 0) {
+            return node->prefix_leaf;
+        }
+        bool first = true;
+        forEachChild(node, [&](uint8_t, Ref child) {
+            if (first) {
+                ref = child;
+                first = false;
+            }
+        });
+    }
+    return ref;
+}
+
+void TidIndex::setPrefix(Node *node, const uint8_t *bytes, size_t len) {
+    node->prefix_len = uint32_t(len);
+    std::memmove(node->prefix, bytes, std::min(len, MAX_PREFIX));
+}
+
+void TidIndex::loadKey(Ref leaf, std::vector<uint8_t> &key) const {
+    key.clear();
+    load_key(tidOf(leaf), key);
+}
+
+// The whole path of `node`, which hangs at `depth`. Paths longer than the
+// node keeps are read from the key of a leaf below it, loaded into `buffer`.
+const uint8_t *TidIndex::fullPrefix(const Node *node, size_t depth,
+                                    std::vector<uint8_t> &buffer) const {
+    if (node->prefix_len <= MAX_PREFIX) {
+        return node->prefix;
+    }
+    loadKey(minLeaf(Ref(node)), buffer);
+    return buffer.data() + depth;
+}
+
+std::optional<uint64_t> TidIndex::insert(Slice key, uint64_t tid) {
+    if (tid > MAX_TID) {
+        throw std::invalid_argument("tuple ID exceeds 63 bits");
+    }
+    auto leaf = leafRef(tid);
+    auto size = size_t(key.size());
+    std::vector<uint8_t> buffer;
+    std::unique_lock lock(mutex);
+    Ref *slot = &root;
+    size_t depth = 0;
+    while (true) {
+        auto ref = *slot;
+        if (ref == 0) {
+            *slot = leaf;
+            count++;
+            return std::nullopt;
+        }
+        if (isLeaf(ref)) {
+            loadKey(ref, buffer);
+            if (equalKey(buffer, key)) {
+                *slot = leaf;
+                return tidOf(ref);
+            }
+            // Both keys go below a new node at the end of their common path.
+            size_t common = 0;
+            while (depth + common < size && depth + common < buffer.size() &&
+                   buffer[depth + common] == key[depth + common]) {
+                common++;
+            }
+            auto *node = newNode<Node4>(nullptr);
+            setPrefix(node, key.data() + depth, common);
+            auto end = depth + common;
+            if (buffer.size() == end) {
+                node->prefix_leaf = ref;
+            } else {
+                insertChild(node, buffer[end], ref);
+            }
+            if (size == end) {
+                node->prefix_leaf = leaf;
+            } else {
+                insertChild(node, key[end], leaf);
+            }
+            *slot = Ref(node);
+            count++;
+            return std::nullopt;
+        }
+        auto *node = reinterpret_cast<Node *>(ref);
+        if (node->prefix_len > 0) {
+            auto *prefix = fullPrefix(node, depth, buffer);
+            size_t match = 0;
+            while (match < node->prefix_len && depth + match < size &&
+                   prefix[match] == key[depth + match]) {
+                match++;
+            }
+            if (match < node->prefix_len) {
+                // The key leaves the path inside it: split the path there.
+                auto *parent = newNode<Node4>(nullptr);
+                setPrefix(parent, prefix, match);
+                auto byte = prefix[match];
+                setPrefix(node, prefix + match + 1,
+                          node->prefix_len - match - 1);
+                insertChild(parent, byte, ref);
+                if (depth + match == size) {
+                    parent->prefix_leaf = leaf;
+                } else {
+                    insertChild(parent, key[depth + match], leaf);
+                }
+                *slot = Ref(parent);
+                count++;
+                return std::nullopt;
+            }
+            depth += node->prefix_len;
+        }
+        if (depth == size) {
+            auto old = std::exchange(node->prefix_leaf, leaf);
+            if (old == 0) {
+                count++;
+                return std::nullopt;
+            }
+            return tidOf(old);
+        }
+        auto *child = findChild(node, key[depth]);
+        if (child == nullptr) {
+            addChild(*slot, node, key[depth], leaf);
+            count++;
+            return std::nullopt;
+        }
+        slot = child;
+        depth++;
+    }
+}
+
+// Paths are compared only as far as nodes keep them; the key loaded for the
+// leaf settles the rest.
+std::optional<uint64_t> TidIndex::search(Slice key) {
+    auto size = size_t(key.size());
+    std::shared_lock lock(mutex);
+    Ref ref = root;
+    size_t depth = 0;
+    while (ref != 0 && !isLeaf(ref)) {
+        auto *node = reinterpret_cast<Node *>(ref);
+        auto kept = std::min<size_t>(node->prefix_len, MAX_PREFIX);
+        if (depth + node->prefix_len > size ||
+            std::memcmp(node->prefix, key.data() + depth, kept) != 0) {
+            return std::nullopt;
+        }
+        depth += node->prefix_len;
+        if (depth == size) {
+            ref = node->prefix_leaf;
+            break;
+        }
+        auto *child = findChild(node, key[depth++]);
+        ref = child != nullptr ? *child : 0;
+    }
+    if (ref == 0) {
+        return std::nullopt;
+    }
+    std::vector<uint8_t> buffer;
+    loadKey(ref, buffer);
+    if (!equalKey(buffer, key)) {
+        return std::nullopt;
+    }
+    return tidOf(ref);
+}
+
+std::optional<uint64_t> TidIndex::remove(Slice key) {
+    auto size = size_t(key.size());
+    std::vector<uint8_t> buffer;
+    std::unique_lock lock(mutex);
+    Ref *node_slot = nullptr;
+    Node *node = nullptr;
+    Ref *slot = &root;
+    size_t depth = 0;
+    while (*slot != 0 && !isLeaf(*slot)) {
+        node_slot = slot;
+        node = reinterpret_cast<Node *>(*slot);
+        auto kept = std::min<size_t>(node->prefix_len, MAX_PREFIX);
+        if (depth + node->prefix_len > size ||
+            std::memcmp(node->prefix, key.data() + depth, kept) != 0) {
+            return std::nullopt;
+        }
+        depth += node->prefix_len;
+        if (depth == size) {
+            slot = &node->prefix_leaf;
+            break;
+        }
+        slot = findChild(node, key[depth++]);
+        if (slot == nullptr) {
+            return std::nullopt;
+        }
+    }
+    auto ref = *slot;
+    if (ref == 0) {
+        return std::nullopt;
+    }
+    loadKey(ref, buffer);
+    if (!equalKey(buffer, key)) {
+        return std::nullopt;
+    }
+    if (node == nullptr) {
+        root = 0;
+    } else {
+        if (slot == &node->prefix_leaf) {
+            node->prefix_leaf = 0;
+        } else {
+            removeChild(node, key[depth - 1]);
+        }
+        compact(*node_slot, node);
+    }
+    count--;
+    return tidOf(ref);
+}
+
+std::vector<uint64_t> TidIndex::scan(Slice start, size_t limit) {
+    std::vector<uint64_t> out;
+    std::shared_lock lock(mutex);
+    if (root != 0 && limit > 0) {
+        collect(root, start, 0, true, limit, out);
+    }
+    return out;
+}
+
+// Appends the tuple IDs below `ref`, which hangs at `depth`, in key order.
+// While `bounded`, the subtree's path equals `start` so far and keys below
+// `start` are skipped.
+void TidIndex::collect(Ref ref, Slice start, size_t depth, bool bounded,
+                       size_t limit, std::vector<uint64_t> &out) const {
+    if (out.size() >= limit) {
+        return;
+    }
+    if (isLeaf(ref)) {
+        if (bounded) {
+            std::vector<uint8_t> key;
+            loadKey(ref, key);
+            if (std::lexicographical_compare(key.begin(), key.end(),
+                                             start.begin(), start.end())) {
+                return;
+            }
+        }
+        out.push_back(tidOf(ref));
+        return;
+    }
+    auto *node = reinterpret_cast<const Node *>(ref);
+    if (bounded) {
+        std::vector<uint8_t> buffer;
+        auto *prefix = fullPrefix(node, depth, buffer);
+        auto size = size_t(start.size());
+        auto n = std::min<size_t>(node->prefix_len, size - depth);
+        auto cmp = n == 0 ? 0 : std::memcmp(prefix, start.data() + depth, n);
+        if (cmp < 0) {
+            return;
+        }
+        // A path above `start`, or one that reaches its end, puts every key
+        // below it in range.
+        bounded = cmp == 0 && n == node->prefix_len && depth + n < size;
+        depth += node->prefix_len;
+    }
+    if (!bounded && node->prefix_leaf != 0) {
+        collect(node->prefix_leaf, start, depth, false, limit, out);
+    }
+    auto next = bounded ? start[depth] : 0;
+    forEachChild(node, [&](uint8_t byte, Ref child) {
+        if (!bounded || byte >= next) {
+            collect(child, start, depth + 1, bounded && byte == next, limit,
+                    out);
+        }
+    });
+}
+
+size_t TidIndex::size() {
+    std::shared_lock lock(mutex);
+    return count;
+}
+
+size_t TidIndex::bytes() {
+    std::shared_lock lock(mutex);
+    return allocated;
+}
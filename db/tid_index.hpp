@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include "slice.hpp"
+
+namespace art {
+
+/**
+ * @class TidIndex
+ * @brief Radix tree over keys held by an external record store: a leaf is a
+ * tuple ID packed into its parent's child slot, and the tree stores no keys.
+ *
+ * This is the configuration of the original ART paper for secondary
+ * indexes. A child slot holds either a node pointer or `tid << 1 | 1`, so
+ * tuple IDs have 63 bits and leaves take no memory of their own. Whenever
+ * the tree needs the key of a leaf, to verify a lookup or to split a path,
+ * it asks `load_key`, which appends the key of a tuple ID to a buffer.
+ *
+ * Inner nodes keep the first `MAX_PREFIX` bytes of their compressed path.
+ * Lookups skip the rest optimistically and verify the key at the leaf;
+ * inserts, removals and scans that need the rest load it from a leaf below.
+ *
+ * As in `ART`, a key may be a prefix of another. Keys are unique; a
+ * non-unique secondary index appends the tuple ID to the key.
+ *
+ * Readers share a lock that writers take exclusively. `load_key` is called
+ * under that lock, from several reader threads at once.
+ */
+class TidIndex {
+public:
+  // Appends the key of the tuple `tid` to `key`.
+  using KeyLoader = std::function<void(uint64_t tid, std::vector<uint8_t> &key)>;
+  static constexpr uint64_t MAX_TID = (uint64_t(1) << 63) - 1;
+  // Path bytes kept in an inner node.
+  static constexpr size_t MAX_PREFIX = 8;
+
+  explicit TidIndex(KeyLoader load_key,
+                    std::pmr::memory_resource *resource =
+                        std::pmr::get_default_resource());
+  ~TidIndex();
+  TidIndex(const TidIndex &) = delete;
+  TidIndex &operator=(const TidIndex &) = delete;
+
+  /**
+   * Points `key` at `tid`, which `load_key` must map back to `key`.
+   *
+   * @return The tuple ID `key` pointed at before, if any.
+   * @throws std::invalid_argument if `tid` exceeds `MAX_TID`.
+   */
+  std::optional<uint64_t> insert(Slice key, uint64_t tid);
+  std::optional<uint64_t> search(Slice key);
+  // Returns the tuple ID `key` pointed at, if any.
+  std::optional<uint64_t> remove(Slice key);
+
+  // Up to `limit` tuple IDs in key order, from the smallest key not less
+  // than `start`.
+  std::vector<uint64_t> scan(Slice start, size_t limit);
+
+  size_t size();
+  // Bytes held by inner nodes, which is all the tree allocates.
+  size_t bytes();
+
+private:
+  using Ref = uint64_t;
+  struct Node;
+  struct Node4;
+  struct Node16;
+  struct Node48;
+  struct Node256;
+
+  KeyLoader load_key;
+  std::pmr::memory_resource *resource;
+  std::shared_mutex mutex;
+  Ref root = 0;
+  size_t count = 0;
+  size_t allocated = 0;
+
+  template <typename T> T *newNode(const Node *header);
+  void freeNode(Node *node);
+  void freeTree(Ref ref);
+  Node *rebuild(Node *node, uint8_t kind);
+  void addChild(Ref &slot, Node *node, uint8_t byte, Ref child);
+  void compact(Ref &slot, Node *node);
+  static Ref *findChild(Node *node, uint8_t byte);
+  static void insertChild(Node *node, uint8_t byte, Ref child);
+  static void removeChild(Node *node, uint8_t byte);
+  template <typename F> static void forEachChild(const Node *node, F &&fn);
+  static Ref minLeaf(Ref ref);
+  static void setPrefix(Node *node, const uint8_t *bytes, size_t len);
+
+  void loadKey(Ref leaf, std::vector<uint8_t> &key) const;
+  const uint8_t *fullPrefix(const Node *node, size_t depth,
+                            std::vector<uint8_t> &buffer) const;
+  void collect(Ref ref, Slice start, size_t depth, bool bounded, size_t limit,
+               std::vector<uint64_t> &out) const;
+};
+
+} // namespace art
@@ -0,0 +1,92 @@
+#include "value_store.hpp"
+#include <cstring>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+
+using namespace art;
+
+ValueStore::ValueStore(std::pmr::memory_resource *resource, Hasher hasher)
+    : resource(resource), hasher(hasher) {}
+
+ValueStore::~ValueStore() {
+    for (auto &[hash, value] : values) {
+        resource->deallocate(value, sizeof(SharedValue) + value->size,
+                             alignof(SharedValue));
+    }
+}
+
+uint64_t ValueStore::hash(std::span<const uint8_t> bytes) {
+    return std::hash<std::string_view>()(std::string_view(
+        reinterpret_cast<const char *>(bytes.data()), bytes.size()));
+}
+
+SharedValue *ValueStore::acquire(std::span<const uint8_t> bytes) {
+    if (bytes.size() > UINT32_MAX) {
+        throw std::length_error("value exceeds 4 GiB");
+    }
+    auto h = hasher(bytes);
+    std::lock_guard lock(mutex);
+    auto [first, last] = values.equal_range(h);
+    for (auto it = first; it != last; ++it) {
+        auto *value = it->second;
+        if (value->size == bytes.size() &&
+            std::memcmp(value->data(), bytes.data(), bytes.size()) == 0) {
+            value->refs++;
+            refs++;
+            return value;
+        }
+    }
+    auto *memory = resource->allocate(sizeof(SharedValue) + bytes.size(),
+                                      alignof(SharedValue));
+    auto *value = new (memory)
+        SharedValue{this, h, uint32_t(bytes.size()), 1};
+    if (!bytes.empty()) {
+        std::memcpy(const_cast<uint8_t *>(value->data()), bytes.data(),
+                    bytes.size());
+    }
+    try {
+        values.emplace(h, value);
+    } catch (...) {
+        resource->deallocate(memory, sizeof(SharedValue) + bytes.size(),
+                             alignof(SharedValue));
+        throw;
+    }
+    stored_bytes += bytes.size();
+    refs++;
+    return value;
+}
+
+void ValueStore::release(SharedValue *value) {
+    std::lock_guard lock(mutex);
+    refs--;
+    if (--value->refs > 0) {
+        return;
+    }
+    auto [first, last] = values.equal_range(value->hash);
+    for (auto it = first; it != last; ++it) {
+        if (it->second == value) {
+            values.erase(it);
+            break;
+        }
+    }
+    stored_bytes -= value->size;
+    resource->deallocate(value, sizeof(SharedValue) + value->size,
+                         alignof(SharedValue));
+}
+
+size_t ValueStore::size() const {
+    std::lock_guard lock(mutex);
+    return values.size();
+}
+
+size_t ValueStore::bytes() const {
+    std::lock_guard lock(mutex);
+    return stored_bytes;
+}
+
+size_t ValueStore::references() const {
+    std::lock_guard lock(mutex);
+    return refs;
+}
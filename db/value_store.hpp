@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+namespace art {
+
+class ValueStore;
+
+// One stored value and the number of leaves that refer to it. The bytes
+// follow the header and never change.
+struct SharedValue {
+  ValueStore *store;
+  uint64_t hash;
+  uint32_t size;
+  uint32_t refs;
+
+  const uint8_t *data() const {
+    return reinterpret_cast<const uint8_t *>(this + 1);
+  }
+  std::span<const uint8_t> bytes() const { return {data(), size}; }
+};
+
+/**
+ * @class ValueStore
+ * @brief Content-addressed, reference-counted store for large values.
+ *
+ * `acquire` hashes a value and returns the stored copy with equal bytes,
+ * adding a reference, or stores a new copy. Values with equal hashes are
+ * compared byte for byte, so a collision only costs a comparison. `release`
+ * drops a reference and frees the copy with the last one.
+ *
+ * A tree with deduplication enabled (`ART::enable_dedup`) keeps one store;
+ * its leaves take a reference when they are created and give it back when
+ * they are reclaimed, so readers never see a value freed under them.
+ */
+class ValueStore {
+public:
+  using Hasher = uint64_t (*)(std::span<const uint8_t> bytes);
+
+  explicit ValueStore(std::pmr::memory_resource *resource =
+                          std::pmr::get_default_resource(),
+                      Hasher hasher = hash);
+  ~ValueStore();
+  ValueStore(const ValueStore &) = delete;
+  ValueStore &operator=(const ValueStore &) = delete;
+
+  SharedValue *acquire(std::span<const uint8_t> bytes);
+  void release(SharedValue *value);
+
+  // Distinct values stored.
+  size_t size() const;
+  // Bytes of all distinct values stored.
+  size_t bytes() const;
+  // References held by leaves, one per leaf that points into the store.
+  size_t references() const;
+
+  static uint64_t hash(std::span<const uint8_t> bytes);
+
+private:
+  std::pmr::memory_resource *resource;
+  Hasher hasher;
+  mutable std::mutex mutex;
+  std::unordered_multimap<uint64_t, SharedValue *> values;
+  size_t stored_bytes = 0;
+  size_t refs = 0;
+};
+
+} // namespace art
@@ -0,0 +1,115 @@
+#include "executor.hpp"
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace artikv;
+
+namespace {
+// Nice value workers add to their own, so they yield to the event loop.
+constexpr int WORKER_NICENESS = 10;
+} // namespace
+
+Executor::Executor(size_t threads) {
+    for (size_t i = 0; i < threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        this->threads.emplace_back([this, i] { work(i); });
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void Executor::submit(Job job) {
+    size_t worker;
+    {
+        std::lock_guard lock(mutex);
+        worker = next_worker++ % workers.size();
+    }
+    push(worker, std::move(job));
+}
+
+void Executor::push(size_t worker, Job job) {
+    {
+        std::lock_guard lock(workers[worker]->mutex);
+        workers[worker]->jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard lock(mutex);
+        queued++;
+    }
+    wakeup.notify_one();
+}
+
+void Executor::pause() {
+    std::unique_lock lock(mutex);
+    paused = true;
+    drained.wait(lock, [&] { return running == 0; });
+}
+
+void Executor::resume() {
+    {
+        std::lock_guard lock(mutex);
+        paused = false;
+    }
+    wakeup.notify_all();
+}
+
+// Takes the next job of worker `self`, or steals the newest job of another.
+bool Executor::take(size_t self, Job &job) {
+    for (size_t i = 0; i < workers.size(); i++) {
+        auto &worker = *workers[(self + i) % workers.size()];
+        std::lock_guard lock(worker.mutex);
+        if (worker.jobs.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            job = std::move(worker.jobs.front());
+            worker.jobs.pop_front();
+        } else {
+            job = std::move(worker.jobs.back());
+            worker.jobs.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void Executor::work(size_t self) {
+    setpriority(PRIO_PROCESS, gettid(),
+                getpriority(PRIO_PROCESS, gettid()) + WORKER_NICENESS);
+    Job job;
+    while (true) {
+        {
+            std::unique_lock lock(mutex);
+            wakeup.wait(lock, [&] { return stopping || (!paused && queued > 0); });
+            if (stopping) {
+                return;
+            }
+            running++;
+        }
+        bool took = take(self, job);
+        if (took) {
+            std::lock_guard lock(mutex);
+            queued--;
+        }
+        if (took && job()) {
+            push(self, std::move(job));
+        }
+        {
+            std::lock_guard lock(mutex);
+            running--;
+        }
+        drained.notify_all();
+        job = nullptr;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace artikv {
+
+/**
+ * @class Executor
+ * @brief Work-stealing thread pool for commands too long for the event loop.
+ *
+ * A job does one bounded chunk of work per call and returns whether it has
+ * more. Each worker owns a deque: it runs jobs from the front and puts an
+ * unfinished job back at the end, so long jobs take turns chunk by chunk. An
+ * idle worker steals from the end of another worker's deque. Workers run at
+ * a lower scheduling priority than the thread that created the pool, so the
+ * event loop keeps the CPU for point requests under load.
+ *
+ * `pause` waits for the chunks in flight and holds the workers between
+ * chunks until `resume`, e.g. around a `fork`.
+ */
+class Executor {
+public:
+  using Job = std::function<bool()>;
+
+  explicit Executor(size_t threads);
+  // Stops the workers after their current chunk; queued jobs are dropped.
+  ~Executor();
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  void submit(Job job);
+  void pause();
+  void resume();
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::condition_variable drained;
+  // Guarded by `mutex`. Jobs pushed and not yet taken; briefly negative
+  // when a job is taken before its submitter counts it.
+  std::ptrdiff_t queued = 0;
+  size_t running = 0;
+  bool paused = false;
+  bool stopping = false;
+  size_t next_worker = 0;
+  std::vector<std::thread> threads;
+
+  void work(size_t self);
+  bool take(size_t self, Job &job);
+  void push(size_t worker, Job job);
+};
+
+} // namespace artikv
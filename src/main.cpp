@@ -1,13 +1,68 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
 #include <iostream>
-#include <format>
-#include "slice.hpp"
+#include <string_view>
+
+#include "art.hpp"
+#include "checkpoint.hpp"
+#include "server.hpp"
 
 using namespace art;
 
+static void usage(const char *argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--port N] [--dir PATH] [--dbfilename NAME] [--save-parts N]"
+                 " [--shm-socket PATH] [--shm-busy-poll-us N]"
+                 " [--dedup-min-bytes N] [--scan-threads N]\n";
+    std::exit(1);
+}
+
+int main(int argc, char **argv) {
+    artikv::Config config;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        if (arg == "--port") {
+            config.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "--dir") {
+            config.dir = argv[++i];
+        } else if (arg == "--dbfilename") {
+            config.dbfilename = argv[++i];
+        } else if (arg == "--save-parts") {
+            config.save_parts = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--shm-socket") {
+            config.shm_socket = argv[++i];
+        } else if (arg == "--shm-busy-poll-us") {
+            config.shm_busy_poll_us = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--dedup-min-bytes") {
+            config.dedup_min_bytes = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--scan-threads") {
+            config.scan_threads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            usage(argv[0]);
+        }
+    }
 
-int main() {
-    std::cout << "Hello, world!\n";
-    auto value_left_value = std::string("abc");
-    auto slice = OwnedSlice(std::move(value_left_value));
+    ART tree;
+    if (config.dedup_min_bytes > 0) {
+        tree.enable_dedup(config.dedup_min_bytes);
+    }
+    try {
+        auto path = config.checkpointPath();
+        if (std::filesystem::exists(path)) {
+            auto keys = loadCheckpoint(tree, path);
+            std::cerr << "loaded " << keys << " keys from " << path << "\n";
+        }
+        artikv::Server server(tree, config);
+        server.run();
+    } catch (const std::exception &e) {
+        std::cerr << "fatal: " << e.what() << "\n";
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,155 @@
+#include "resp.hpp"
+#include <charconv>
+
+using namespace artikv;
+
+namespace {
+// Largest bulk string a client may send, same as the Redis default.
+constexpr int64_t MAX_BULK_LEN = 512 * 1024 * 1024;
+constexpr int64_t MAX_ARGS = 1024 * 1024;
+
+// Reads "<prefix><integer>\r\n" at `pos`, advancing `pos` past it.
+ParseStatus parseLength(std::string_view input, size_t &pos, char prefix,
+                        int64_t &value) {
+    auto end = input.find("\r\n", pos);
+    if (end == std::string_view::npos) {
+        return ParseStatus::Incomplete;
+    }
+    if (input[pos] != prefix) {
+        return ParseStatus::Error;
+    }
+    auto [ptr, ec] =
+        std::from_chars(input.data() + pos + 1, input.data() + end, value);
+    if (ec != std::errc() || ptr != input.data() + end) {
+        return ParseStatus::Error;
+    }
+    pos = end + 2;
+    return ParseStatus::Ok;
+}
+
+ParseStatus parseInline(std::string_view input, size_t &consumed,
+                        std::vector<std::string> &argv) {
+    auto end = input.find('\n');
+    if (end == std::string_view::npos) {
+        return ParseStatus::Incomplete;
+    }
+    auto line = input.substr(0, end);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    size_t pos = 0;
+    while (pos < line.size()) {
+        auto start = line.find_first_not_of(' ', pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        auto stop = line.find(' ', start);
+        if (stop == std::string_view::npos) {
+            stop = line.size();
+        }
+        argv.emplace_back(line.substr(start, stop - start));
+        pos = stop;
+    }
+    consumed = end + 1;
+    return ParseStatus::Ok;
+}
+} // namespace
+
+ParseStatus artikv::parseCommand(std::string_view input, size_t &consumed,
+                                 std::vector<std::string> &argv) {
+    argv.clear();
+    if (input.empty()) {
+        return ParseStatus::Incomplete;
+    }
+    if (input[0] != '*') {
+        return parseInline(input, consumed, argv);
+    }
+    size_t pos = 0;
+    int64_t count;
+    if (auto s = parseLength(input, pos, '*', count); s != ParseStatus::Ok) {
+        return s;
+    }
+    if (count < 0 || count > MAX_ARGS) {
+        return ParseStatus::Error;
+    }
+    for (int64_t i = 0; i < count; i++) {
+        if (pos >= input.size()) {
+            return ParseStatus::Incomplete;
+        }
+        int64_t len;
+        if (auto s = parseLength(input, pos, '$', len); s != ParseStatus::Ok) {
+            return s;
+        }
+        if (len < 0 || len > MAX_BULK_LEN) {
+            return ParseStatus::Error;
+        }
+        if (input.size() < pos + len + 2) {
+            return ParseStatus::Incomplete;
+        }
+        if (input[pos + len] != '\r' || input[pos + len + 1] != '\n') {
+            return ParseStatus::Error;
+        }
+        argv.emplace_back(input.substr(pos, len));
+        pos += len + 2;
+    }
+    consumed = pos;
+    return ParseStatus::Ok;
+}
+
+void artikv::replySimple(std::string &out, std::string_view s) {
+    out += '+';
+    out += s;
+    out += "\r\n";
+}
+
+void artikv::replyError(std::string &out, std::string_view message) {
+    out += "-ERR ";
+    out += message;
+    out += "\r\n";
+}
+
+void artikv::replyError(std::string &out, std::string_view code,
+                        std::string_view message) {
+    out += '-';
+    out += code;
+    out += ' ';
+    out += message;
+    out += "\r\n";
+}
+
+void artikv::replyInteger(std::string &out, int64_t n) {
+    out += ':';
+    out += std::to_string(n);
+    out += "\r\n";
+}
+
+void artikv::replyBulk(std::string &out, std::span<const uint8_t> data) {
+    replyBulk(out, std::string_view(reinterpret_cast<const char *>(data.data()),
+                                    data.size()));
+}
+
+void artikv::replyBulk(std::string &out, std::string_view data) {
+    out += '$';
+    out += std::to_string(data.size());
+    out += "\r\n";
+    out += data;
+    out += "\r\n";
+}
+
+void artikv::replyNull(std::string &out) { out += "$-1\r\n"; }
+
+void artikv::replyArray(std::string &out, size_t len) {
+    out += '*';
+    out += std::to_string(len);
+    out += "\r\n";
+}
+
+void artikv::replyMap(std::string &out, size_t pairs) {
+    out += '%';
+    out += std::to_string(pairs);
+    out += "\r\n";
+}
+
+void artikv::replyStreamStart(std::string &out) { out += "*?\r\n"; }
+
+void artikv::replyStreamEnd(std::string &out) { out += ".\r\n"; }
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace artikv {
+
+// Result of trying to read one command out of a connection's input buffer.
+enum class ParseStatus { Ok, Incomplete, Error };
+
+/**
+ * Parses one command from `input`, either as a RESP array of bulk strings or
+ * as an inline command line ("SET key value\r\n").
+ *
+ * @param consumed set to the number of bytes the command took on success.
+ * @param argv receives the command name and its arguments on success.
+ */
+ParseStatus parseCommand(std::string_view input, size_t &consumed,
+                         std::vector<std::string> &argv);
+
+// Helpers that append one RESP reply to a connection's output buffer.
+void replySimple(std::string &out, std::string_view s);
+void replyError(std::string &out, std::string_view message);
+// An error whose code is not ERR, e.g. WRONGTYPE.
+void replyError(std::string &out, std::string_view code,
+                std::string_view message);
+void replyInteger(std::string &out, int64_t n);
+void replyBulk(std::string &out, std::span<const uint8_t> data);
+void replyBulk(std::string &out, std::string_view data);
+void replyNull(std::string &out);
+void replyArray(std::string &out, size_t len);
+// RESP3 map of `pairs` key-value pairs, which follow.
+void replyMap(std::string &out, size_t pairs);
+// RESP3 streamed array: the header, then elements as they come, then the
+// end marker.
+void replyStreamStart(std::string &out);
+void replyStreamEnd(std::string &out);
+
+} // namespace artikv
@@ -0,0 +1,1396 @@
+#include "server.hpp"
+#include "checkpoint.hpp"
+#include "resp.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <utility>
+#include <unistd.h>
+
+using namespace artikv;
+
+namespace {
+constexpr int MAX_EVENTS = 128;
+// Upper bound on how long the loop sleeps, so a finished background save is
+// reaped promptly even when no client is active.
+constexpr int POLL_TIMEOUT_MS = 100;
+constexpr size_t READ_CHUNK = 16 * 1024;
+// Keys one chunk of an offloaded command visits at most.
+constexpr size_t CHUNK_KEYS = 512;
+// SCANs of up to this many pairs run on the loop.
+constexpr size_t INLINE_SCAN_LIMIT = 1024;
+// Unsent reply bytes beyond which an offloaded command waits for its client.
+constexpr size_t MAX_UNSENT = 4 << 20;
+
+[[noreturn]] void fail(const char *what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+art::Slice slice(const std::string &s) { return std::string_view(s); }
+art::Slice slice(const art::ARTData &s) { return art::Slice(s.data(), s.size()); }
+
+void watch(int epoll_fd, int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+bool parseCount(const std::string &s, size_t &count) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), count);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+bool parseIndex(const std::string &s, int64_t &index) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), index);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+// Accepts what Redis does for a score: decimals, exponents, `inf` and
+// `-inf` with an optional `+`, but no NaN.
+bool parseScore(std::string_view s, double &score) {
+    if (s.size() > 1 && s[0] == '+' && s[1] != '-') {
+        s.remove_prefix(1);
+    }
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), score);
+    return ec == std::errc() && end == s.data() + s.size() && !std::isnan(score);
+}
+
+// A ZRANGEBYSCORE bound; a leading `(` excludes the score itself, which
+// becomes the next double towards the other bound.
+bool parseBound(std::string_view s, double &bound, double towards) {
+    bool exclusive = !s.empty() && s[0] == '(';
+    if (exclusive) {
+        s.remove_prefix(1);
+    }
+    if (!parseScore(s, bound)) {
+        return false;
+    }
+    if (exclusive) {
+        bound = std::nextafter(bound, towards);
+    }
+    return true;
+}
+
+void replyWrongType(std::string &out) {
+    replyError(out, "WRONGTYPE",
+               "Operation against a key holding the wrong kind of value");
+}
+
+void replyScore(std::string &out, double score) {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), score);
+    replyBulk(out, std::string_view(buf, end - buf));
+}
+
+void replyEntries(std::string &out,
+                  const std::vector<art::ScoreIndex::Entry> &entries,
+                  bool with_scores) {
+    replyArray(out, entries.size() * (with_scores ? 2 : 1));
+    for (auto &[member, score] : entries) {
+        replyBulk(out, member);
+        if (with_scores) {
+            replyScore(out, score);
+        }
+    }
+}
+
+// Up to `limit` keys starting with `prefix`, from the smallest key not less
+// than `from`.
+std::vector<std::string> prefixKeys(art::ART &tree, const std::string &from,
+                                    const std::string &prefix, size_t limit) {
+    std::vector<std::string> keys;
+    for (auto it = tree.lower_bound(slice(from));
+         it.valid() && keys.size() < limit; it.next()) {
+        auto key = it.key();
+        if (key.size() < prefix.size() ||
+            !std::equal(prefix.begin(), prefix.end(), key.begin()) ||
+            art::Collections::owns(art::Slice(key.data(), key.size()))) {
+            break;
+        }
+        keys.emplace_back(key.begin(), key.end());
+    }
+    return keys;
+}
+
+// Drops the pairs of collections, which sort after every string key.
+void stringsOnly(std::pmr::vector<art::ART::ScanEntry> &entries) {
+    auto first = std::find_if(entries.begin(), entries.end(), [](auto &entry) {
+        return art::Collections::owns(
+            art::Slice(entry.first.data(), entry.first.size()));
+    });
+    entries.erase(first, entries.end());
+}
+} // namespace
+
+Server::Server(art::ART &tree, Config config)
+    : tree(tree), config(std::move(config)), collections(tree),
+      executor(std::max<size_t>(1, this->config.scan_threads)) {
+    commands = {
+        {"PING", &Server::cmdPing},     {"HELLO", &Server::cmdHello},
+        {"GET", &Server::cmdGet},
+        {"SET", &Server::cmdSet},       {"DEL", &Server::cmdDel},
+        {"DBSIZE", &Server::cmdDbsize}, {"SAVE", &Server::cmdSave},
+        {"BGSAVE", &Server::cmdBgsave}, {"INFO", &Server::cmdInfo},
+        {"SCAN", &Server::cmdScan},     {"DELPREFIX", &Server::cmdDelprefix},
+        {"COUNTPREFIX", &Server::cmdCountprefix},
+        {"ZADD", &Server::cmdZadd},     {"ZREM", &Server::cmdZrem},
+        {"ZSCORE", &Server::cmdZscore}, {"ZCARD", &Server::cmdZcard},
+        {"ZRANK", &Server::cmdZrank},   {"ZRANGE", &Server::cmdZrange},
+        {"ZRANGEBYSCORE", &Server::cmdZrangebyscore},
+        {"TYPE", &Server::cmdType},     {"HSET", &Server::cmdHset},
+        {"HGET", &Server::cmdHget},     {"HDEL", &Server::cmdHdel},
+        {"HLEN", &Server::cmdHlen},     {"HGETALL", &Server::cmdHgetall},
+        {"SADD", &Server::cmdSadd},     {"SREM", &Server::cmdSrem},
+        {"SISMEMBER", &Server::cmdSismember},
+        {"SCARD", &Server::cmdScard},   {"SMEMBERS", &Server::cmdSmembers},
+        {"LPUSH", &Server::cmdLpush},   {"RPUSH", &Server::cmdRpush},
+        {"LPOP", &Server::cmdLpop},     {"RPOP", &Server::cmdRpop},
+        {"LLEN", &Server::cmdLlen},     {"LINDEX", &Server::cmdLindex},
+        {"LRANGE", &Server::cmdLrange},
+    };
+    // Sorted sets loaded with the tree get their score index back.
+    for (auto &name : collections.names(art::Collections::Type::Zset)) {
+        auto index = std::make_unique<art::ScoreIndex>();
+        for (auto &[member, score] :
+             collections.zmembers(slice(name), std::string_view(), SIZE_MAX)) {
+            index->add(slice(member), score);
+        }
+        zsets.emplace(std::string(name.begin(), name.end()), std::move(index));
+    }
+}
+
+Server::~Server() {
+    // No chunk may post to the completion eventfd once it is closed.
+    executor.pause();
+    for (auto &[fd, conn] : connections) {
+        ::close(fd);
+    }
+    if (listen_fd != -1) {
+        ::close(listen_fd);
+    }
+    shm_channels.clear();
+    if (shm_listen_fd != -1) {
+        ::close(shm_listen_fd);
+        unlink(config.shm_socket.c_str());
+    }
+    if (completion_fd != -1) {
+        ::close(completion_fd);
+    }
+    if (epoll_fd != -1) {
+        ::close(epoll_fd);
+    }
+}
+
+void Server::run() {
+    listen();
+    if (!config.shm_socket.empty()) {
+        listenShm();
+    }
+    epoll_event events[MAX_EVENTS];
+    while (true) {
+        // Channels are only signalled once they announced they are asleep.
+        int timeout = sleepShm() ? POLL_TIMEOUT_MS : 0;
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (n < 0 && errno != EINTR) {
+            fail("epoll_wait");
+        }
+        for (int i = 0; i < n; i++) {
+            auto fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                acceptClients();
+                continue;
+            }
+            if (fd == shm_listen_fd) {
+                acceptShmClients();
+                continue;
+            }
+            if (fd == completion_fd) {
+                drainCompletions();
+                continue;
+            }
+            if (auto wakeup = shm_wakeups.find(fd); wakeup != shm_wakeups.end()) {
+                wakeup->second->drainWakeups();
+                continue;
+            }
+            if (auto channel = shm_channels.find(fd);
+                channel != shm_channels.end()) {
+                // The client never writes to its socket; any event is a hangup.
+                closeShm(*channel->second);
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;
+            }
+            auto &conn = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                close(conn);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                onReadable(conn);
+            }
+            if (connections.contains(fd) && (events[i].events & EPOLLOUT)) {
+                flush(conn);
+            }
+        }
+        for (auto &[fd, channel] : shm_channels) {
+            serveShm(*channel);
+        }
+        busyPollShm();
+        bgsave.poll();
+    }
+}
+
+void Server::listen() {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fail("socket");
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(config.port);
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) <
+            0 ||
+        ::listen(listen_fd, SOMAXCONN) < 0) {
+        fail("bind");
+    }
+    setNonBlocking(listen_fd);
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        fail("epoll_create1");
+    }
+    watch(epoll_fd, listen_fd, EPOLLIN);
+    completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (completion_fd < 0) {
+        fail("eventfd");
+    }
+    watch(epoll_fd, completion_fd, EPOLLIN);
+    std::fprintf(stderr, "ArtiKV listening on port %u\n", config.port);
+}
+
+void Server::acceptClients() {
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        setNonBlocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        watch(epoll_fd, fd, EPOLLIN | EPOLLOUT | EPOLLET);
+        connections.emplace(fd, std::make_unique<Connection>(fd));
+    }
+}
+
+void Server::onReadable(Connection &conn) {
+    char buf[READ_CHUNK];
+    while (true) {
+        auto n = read(conn.fd, buf, sizeof(buf));
+        if (n > 0) {
+            conn.in.append(buf, n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            conn.closing = true;
+        }
+        if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    process(conn);
+}
+
+// Runs the complete commands buffered for `conn` and flushes their replies.
+// A command handed to the executor holds back the ones behind it until it
+// is done.
+void Server::process(Connection &conn) {
+    Args argv;
+    size_t offset = 0;
+    while (offset < conn.in.size() && conn.offload == nullptr) {
+        size_t consumed = 0;
+        auto status = parseCommand(std::string_view(conn.in).substr(offset),
+                                   consumed, argv);
+        if (status == ParseStatus::Incomplete) {
+            break;
+        }
+        if (status == ParseStatus::Error) {
+            replyError(conn.out, "Protocol error");
+            conn.closing = true;
+            break;
+        }
+        offset += consumed;
+        if (!argv.empty()) {
+            dispatch(conn, argv);
+        }
+    }
+    conn.in.erase(0, offset);
+    flush(conn);
+}
+
+void Server::flush(Connection &conn) {
+    while (!conn.out.empty()) {
+        auto n = write(conn.fd, conn.out.data(), conn.out.size());
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            close(conn);
+            return;
+        }
+        conn.out.erase(0, n);
+    }
+    if (conn.offload != nullptr) {
+        conn.offload->unsent.store(conn.out.size(), std::memory_order_relaxed);
+        if (conn.parked != nullptr && conn.out.size() <= MAX_UNSENT) {
+            schedule(conn.offload, std::exchange(conn.parked, nullptr));
+        }
+    } else if (conn.closing && conn.out.empty()) {
+        close(conn);
+    }
+}
+
+void Server::close(Connection &conn) {
+    if (conn.offload != nullptr) {
+        conn.offload->cancelled.store(true, std::memory_order_relaxed);
+    }
+    auto fd = conn.fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(fd);
+}
+
+void Server::dispatch(Connection &conn, Args &argv) {
+    auto &name = argv[0];
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::toupper(c); });
+    auto it = commands.find(name);
+    if (it == commands.end()) {
+        replyError(conn.out, "unknown command '" + name + "'");
+        return;
+    }
+    (this->*it->second)(conn, argv);
+}
+
+// Runs `chunk` on the executor until it has no more work. The reply bytes of
+// every chunk are sent as soon as the loop picks them up.
+void Server::offload(Connection &conn, Chunk chunk) {
+    conn.offload = std::make_shared<Offload>(conn.fd);
+    schedule(conn.offload, std::move(chunk));
+}
+
+// Runs `chunk` on the executor for a command that replies with an array of
+// the elements the chunks append. RESP3 clients get a streamed array; for
+// RESP2 ones the elements are gathered until the length is known.
+void Server::offloadArray(Connection &conn, ArrayChunk chunk) {
+    if (conn.protocol >= 3) {
+        replyStreamStart(conn.out);
+        return offload(conn, [chunk = std::move(chunk)](std::string &out) {
+            size_t count = 0;
+            if (chunk(out, count)) {
+                return true;
+            }
+            replyStreamEnd(out);
+            return false;
+        });
+    }
+    offload(conn, [chunk = std::move(chunk), elements = std::string(),
+                   count = size_t(0)](std::string &out) mutable {
+        if (chunk(elements, count)) {
+            return true;
+        }
+        replyArray(out, count);
+        out += elements;
+        return false;
+    });
+}
+
+void Server::schedule(std::shared_ptr<Offload> offload, Chunk chunk) {
+    executor.submit([this, offload = std::move(offload),
+                     chunk = std::move(chunk)]() mutable {
+        if (offload->cancelled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (offload->unsent.load(std::memory_order_relaxed) > MAX_UNSENT) {
+            // The client is not keeping up. The loop runs the rest once it
+            // has sent enough; the worker moves on to other jobs.
+            post(offload, std::string(), false, std::move(chunk));
+            return false;
+        }
+        std::string out;
+        bool more = chunk(out);
+        post(offload, std::move(out), !more);
+        return more;
+    });
+}
+
+// Hands reply bytes of an offloaded command to the loop, or the command
+// itself when it is `parked`. Called on workers.
+void Server::post(const std::shared_ptr<Offload> &offload, std::string out,
+                  bool done, Chunk parked) {
+    {
+        std::lock_guard lock(completions_mutex);
+        completions.push_back(
+            {offload, std::move(out), done, std::move(parked)});
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = write(completion_fd, &one, sizeof(one));
+}
+
+void Server::drainCompletions() {
+    uint64_t count;
+    [[maybe_unused]] auto n = read(completion_fd, &count, sizeof(count));
+    std::vector<Completion> ready;
+    {
+        std::lock_guard lock(completions_mutex);
+        ready.swap(completions);
+    }
+    for (auto &completion : ready) {
+        // The connection may have closed, and its descriptor been reused.
+        auto it = connections.find(completion.offload->fd);
+        if (it == connections.end() ||
+            it->second->offload != completion.offload) {
+            continue;
+        }
+        auto &conn = *it->second;
+        conn.out += completion.out;
+        conn.parked = std::move(completion.parked);
+        if (completion.done) {
+            conn.offload.reset();
+            process(conn);
+        } else {
+            flush(conn);
+        }
+    }
+}
+
+void Server::listenShm() {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (config.shm_socket.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("socket path too long: " + config.shm_socket);
+    }
+    std::memcpy(addr.sun_path, config.shm_socket.c_str(),
+                config.shm_socket.size() + 1);
+    shm_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (shm_listen_fd < 0) {
+        fail("socket");
+    }
+    unlink(config.shm_socket.c_str());
+    if (bind(shm_listen_fd, reinterpret_cast<sockaddr *>(&addr),
+             sizeof(addr)) < 0 ||
+        ::listen(shm_listen_fd, SOMAXCONN) < 0) {
+        fail("bind");
+    }
+    setNonBlocking(shm_listen_fd);
+    watch(epoll_fd, shm_listen_fd, EPOLLIN);
+    std::fprintf(stderr, "ArtiKV shared-memory channels on %s\n",
+                 config.shm_socket.c_str());
+}
+
+void Server::acceptShmClients() {
+    while (true) {
+        int fd = accept4(shm_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        std::unique_ptr<ShmChannel> channel;
+        try {
+            channel = std::make_unique<ShmChannel>(fd);
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "shared-memory channel failed: %s\n",
+                         e.what());
+            ::close(fd);
+            continue;
+        }
+        watch(epoll_fd, fd, EPOLLIN | EPOLLRDHUP);
+        watch(epoll_fd, channel->requestFd(), EPOLLIN);
+        shm_wakeups.emplace(channel->requestFd(), channel.get());
+        shm_channels.emplace(fd, std::move(channel));
+    }
+}
+
+void Server::closeShm(ShmChannel &channel) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, channel.socketFd(), nullptr);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, channel.requestFd(), nullptr);
+    shm_wakeups.erase(channel.requestFd());
+    shm_channels.erase(channel.socketFd());
+}
+
+size_t Server::serveShm(ShmChannel &channel) {
+    channel.wake();
+    size_t served = 0;
+    for (auto request = channel.nextRequest(); !request.empty();
+         request = channel.nextRequest()) {
+        if (!serveShmRequest(channel, request)) {
+            // No room to answer until the client releases its last value.
+            break;
+        }
+        served++;
+    }
+    channel.notify();
+    return served;
+}
+
+bool Server::serveShmRequest(ShmChannel &channel,
+                             std::span<const uint8_t> request) {
+    ShmRequest header;
+    if (request.size() < sizeof(header)) {
+        return channel.respond(ShmStatus::BadRequest);
+    }
+    std::memcpy(&header, request.data(), sizeof(header));
+    if (request.size() != sizeof(header) + header.key_len + header.val_len) {
+        return channel.respond(ShmStatus::BadRequest);
+    }
+    art::Slice key(request.data() + sizeof(header), header.key_len);
+    auto *value = request.data() + sizeof(header) + header.key_len;
+    switch (header.op) {
+    case ShmOp::Get:
+        // Copied: an offloaded command may remove the key meanwhile.
+        if (auto found = art::Collections::owns(key) ? std::nullopt
+                                                     : tree.read(key)) {
+            return channel.respond(ShmStatus::Ok, *found);
+        }
+        return channel.respond(exists(key) ? ShmStatus::WrongType
+                                           : ShmStatus::NotFound);
+    case ShmOp::Set:
+        if (art::Collections::owns(key)) {
+            return channel.respond(ShmStatus::BadRequest);
+        }
+        setString(key, std::vector<uint8_t>(value, value + header.val_len));
+        return channel.respond(ShmStatus::Ok);
+    case ShmOp::Del:
+        return channel.respond(removeKey(key) ? ShmStatus::Ok
+                                              : ShmStatus::NotFound);
+    }
+    return channel.respond(ShmStatus::BadRequest);
+}
+
+// Announces to every channel that the loop is about to block. Returns false
+// if one of them already has requests waiting.
+bool Server::sleepShm() {
+    bool idle = true;
+    for (auto &[fd, channel] : shm_channels) {
+        idle = channel->sleep() && idle;
+    }
+    return idle;
+}
+
+void Server::busyPollShm() {
+    if (config.shm_busy_poll_us == 0 || shm_channels.empty()) {
+        return;
+    }
+    // Fixed on entry: under steady shared-memory traffic the loop still gets
+    // back to sockets, completions and the background save.
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(config.shm_busy_poll_us);
+    while (std::chrono::steady_clock::now() < deadline) {
+        for (auto &[fd, channel] : shm_channels) {
+            serveShm(*channel);
+        }
+    }
+}
+
+void Server::cmdPing(Connection &conn, const Args &argv) {
+    if (argv.size() > 1) {
+        replyBulk(conn.out, argv[1]);
+    } else {
+        replySimple(conn.out, "PONG");
+    }
+}
+
+// HELLO [protover]: switches the connection to RESP2 or RESP3 and replies
+// with a map describing the server.
+void Server::cmdHello(Connection &conn, const Args &argv) {
+    if (argv.size() > 2) {
+        return replyError(conn.out, "wrong number of arguments for 'HELLO'");
+    }
+    if (argv.size() == 2) {
+        if (argv[1] != "2" && argv[1] != "3") {
+            return replyError(conn.out, "NOPROTO",
+                              "unsupported protocol version");
+        }
+        conn.protocol = argv[1][0] - '0';
+    }
+    if (conn.protocol >= 3) {
+        replyMap(conn.out, 2);
+    } else {
+        replyArray(conn.out, 4);
+    }
+    replyBulk(conn.out, "server");
+    replyBulk(conn.out, "artikv");
+    replyBulk(conn.out, "proto");
+    replyInteger(conn.out, conn.protocol);
+}
+
+// Whether `key` holds a string. Tree keys of collections are not strings.
+bool Server::isString(art::Slice key) {
+    return !art::Collections::owns(key) && tree.search(key);
+}
+
+// Whether `key` holds a value of any type.
+bool Server::exists(art::Slice key) {
+    return isString(key) ||
+           collections.type(key) != art::Collections::Type::None;
+}
+
+// Stores a string at `key`, replacing a value of another type.
+void Server::setString(art::Slice key, art::OwnedSlice value) {
+    if (!tree.search(key)) {
+        removeKey(key);
+    }
+    tree.insert(key, std::move(value));
+}
+
+// Removes whatever `key` holds; a key holds one type at most.
+bool Server::removeKey(art::Slice key) {
+    if (isString(key)) {
+        tree.remove(key);
+        return true;
+    }
+    // One descent on the loop, however many elements the collection has;
+    // a worker frees them.
+    auto detached = collections.drop(key);
+    if (!detached) {
+        return false;
+    }
+    zsets.erase(std::string(key.begin(), key.end()));
+    executor.submit([detached = std::make_shared<art::ART::Detached>(
+                         std::move(detached))] {
+        detached->release();
+        return false;
+    });
+    return true;
+}
+
+void Server::cmdGet(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'GET'");
+    }
+    // Copied: an offloaded command may remove the key meanwhile.
+    auto value = art::Collections::owns(slice(argv[1]))
+                     ? std::nullopt
+                     : tree.read(slice(argv[1]));
+    if (value) {
+        replyBulk(conn.out, *value);
+    } else if (exists(slice(argv[1]))) {
+        replyWrongType(conn.out);
+    } else {
+        replyNull(conn.out);
+    }
+}
+
+// SET key value: replaces whatever `key` held before, as in Redis.
+void Server::cmdSet(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out, "wrong number of arguments for 'SET'");
+    }
+    if (art::Collections::owns(slice(argv[1]))) {
+        return replyError(conn.out, "keys starting with 0xFF are reserved");
+    }
+    setString(slice(argv[1]), std::string(argv[2]));
+    replySimple(conn.out, "OK");
+}
+
+void Server::cmdDel(Connection &conn, const Args &argv) {
+    if (argv.size() < 2) {
+        return replyError(conn.out, "wrong number of arguments for 'DEL'");
+    }
+    int64_t removed = 0;
+    for (size_t i = 1; i < argv.size(); i++) {
+        removed += removeKey(slice(argv[i]));
+    }
+    replyInteger(conn.out, removed);
+}
+
+// Keys as clients see them: each collection is one, whatever number of tree
+// pairs it uses.
+size_t Server::keyCount() {
+    return tree.size() - collections.pairs() + collections.count();
+}
+
+void Server::cmdDbsize(Connection &conn, const Args &) {
+    replyInteger(conn.out, int64_t(keyCount()));
+}
+
+void Server::cmdSave(Connection &conn, const Args &) {
+    if (bgsave.running()) {
+        return replyError(conn.out, "Background save already in progress");
+    }
+    // Offloaded commands wait, so the checkpoint is a point in time.
+    executor.pause();
+    try {
+        art::saveCheckpoint(tree, config.checkpointPath(), config.save_parts);
+        replySimple(conn.out, "OK");
+    } catch (const std::exception &e) {
+        replyError(conn.out, e.what());
+    }
+    executor.resume();
+}
+
+void Server::cmdBgsave(Connection &conn, const Args &) {
+    if (bgsave.running()) {
+        return replyError(conn.out, "Background save already in progress");
+    }
+    // Workers are parked between chunks, holding no locks, across the fork.
+    executor.pause();
+    bool started =
+        bgsave.start(tree, config.checkpointPath(), config.save_parts);
+    executor.resume();
+    if (!started) {
+        return replyError(conn.out, "fork failed");
+    }
+    replySimple(conn.out, "Background saving started");
+}
+
+void Server::cmdInfo(Connection &conn, const Args &) {
+    auto &last = bgsave.last();
+    std::string info;
+    info += "# Keyspace\r\nkeys:" + std::to_string(keyCount()) + "\r\n";
+    if (auto *store = tree.value_store()) {
+        info += "# Dedup\r\n";
+        info += "dedup_values:" + std::to_string(store->size()) + "\r\n";
+        info += "dedup_bytes:" + std::to_string(store->bytes()) + "\r\n";
+        info += "dedup_references:" + std::to_string(store->references()) +
+                "\r\n";
+    }
+    info += "# Persistence\r\n";
+    info += "bgsave_in_progress:" + std::to_string(bgsave.running()) + "\r\n";
+    info += "last_bgsave_status:" + std::string(last.ok ? "ok" : "err") +
+            "\r\n";
+    info += "last_bgsave_keys:" + std::to_string(last.keys) + "\r\n";
+    info += "last_bgsave_duration_ms:" +
+            std::to_string(last.duration.count()) + "\r\n";
+    info += "last_bgsave_cow_bytes:" + std::to_string(last.cow_bytes) + "\r\n";
+    info += "last_bgsave_parent_minor_faults:" +
+            std::to_string(last.parent_minor_faults) + "\r\n";
+    replyBulk(conn.out, info);
+}
+
+// SCAN start count: up to `count` pairs from the smallest key not less than
+// `start`, as one flat array of keys and values. Larger scans run on the
+// executor, streamed to RESP3 clients.
+void Server::cmdScan(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out, "wrong number of arguments for 'SCAN'");
+    }
+    size_t count;
+    if (!parseCount(argv[2], count)) {
+        return replyError(conn.out, "value is not an integer or out of range");
+    }
+    if (count <= INLINE_SCAN_LIMIT) {
+        auto entries = tree.scan(slice(argv[1]), count);
+        stringsOnly(entries);
+        replyArray(conn.out, entries.size() * 2);
+        for (auto &[key, value] : entries) {
+            replyBulk(conn.out, key);
+            replyBulk(conn.out, value);
+        }
+        return;
+    }
+    offloadArray(conn, [this, next = argv[1], left = count](
+                           std::string &out, size_t &elements) mutable {
+        auto want = std::min(left, CHUNK_KEYS);
+        auto entries = tree.scan(slice(next), want);
+        stringsOnly(entries);
+        for (auto &[key, value] : entries) {
+            replyBulk(out, key);
+            replyBulk(out, value);
+        }
+        elements += entries.size() * 2;
+        left -= entries.size();
+        if (entries.size() < want || left == 0) {
+            return false;
+        }
+        auto &last = entries.back().first;
+        next.assign(last.begin(), last.end());
+        next.push_back('\0');
+        return true;
+    });
+}
+
+// DELPREFIX prefix: removes every string key starting with `prefix` and
+// replies with their number. The loop, which no other writer races with,
+// only unlinks the subtrees holding them; counting and freeing their keys is
+// offloaded, one subtree per chunk, and DBSIZE still counts them until then.
+void Server::cmdDelprefix(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out,
+                          "wrong number of arguments for 'DELPREFIX'");
+    }
+    auto &prefix = argv[1];
+    if (art::Collections::owns(slice(prefix))) {
+        return replyInteger(conn.out, 0);
+    }
+    auto detached = std::make_shared<std::vector<art::ART::Detached>>();
+    int64_t removed = 0;
+    if (!prefix.empty()) {
+        detached->push_back(tree.detach_prefix(slice(prefix)));
+    } else {
+        // Every string: one subtree per first byte, leaving the collections'.
+        if (isString(std::string_view())) {
+            tree.remove(std::string_view());
+            removed++;
+        }
+        for (unsigned byte = 0; byte < art::Collections::ROOT; byte++) {
+            auto first = uint8_t(byte);
+            if (auto subtree = tree.detach_prefix(art::Slice(&first, 1))) {
+                detached->push_back(std::move(subtree));
+            }
+        }
+    }
+    if (detached->empty() || !detached->front()) {
+        return replyInteger(conn.out, removed);
+    }
+    offload(conn, [detached, removed, next = size_t(0)](
+                      std::string &out) mutable {
+        removed += int64_t((*detached)[next++].release());
+        if (next < detached->size()) {
+            return true;
+        }
+        replyInteger(out, removed);
+        return false;
+    });
+}
+
+// COUNTPREFIX prefix: the number of keys starting with `prefix`.
+void Server::cmdCountprefix(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out,
+                          "wrong number of arguments for 'COUNTPREFIX'");
+    }
+    offload(conn, [this, prefix = argv[1], next = argv[1],
+                   counted = int64_t(0)](std::string &out) mutable {
+        auto keys = prefixKeys(tree, next, prefix, CHUNK_KEYS);
+        counted += keys.size();
+        if (keys.size() < CHUNK_KEYS) {
+            replyInteger(out, counted);
+            return false;
+        }
+        next = keys.back() + '\0';
+        return true;
+    });
+}
+
+art::ScoreIndex *Server::findZset(const std::string &key) {
+    auto it = zsets.find(key);
+    return it == zsets.end() ? nullptr : it->second.get();
+}
+
+// ZADD key score member [score member ...]: replies with the number of
+// members added, not counting updated scores.
+void Server::cmdZadd(Connection &conn, const Args &argv) {
+    if (argv.size() < 4 || argv.size() % 2 != 0) {
+        return replyError(conn.out, "wrong number of arguments for 'ZADD'");
+    }
+    std::vector<double> scores;
+    for (size_t i = 2; i < argv.size(); i += 2) {
+        if (!parseScore(argv[i], scores.emplace_back())) {
+            return replyError(conn.out, "value is not a valid float");
+        }
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    auto &index = zsets[argv[1]];
+    if (!index) {
+        index = std::make_unique<art::ScoreIndex>();
+    }
+    int64_t added = 0;
+    for (size_t i = 2; i < argv.size(); i += 2) {
+        auto score = scores[(i - 2) / 2];
+        auto member = slice(argv[i + 1]);
+        auto old = collections.zscore(slice(argv[1]), member);
+        if (old && *old == score) {
+            continue;
+        }
+        collections.zadd(slice(argv[1]), member, score);
+        if (old) {
+            index->remove(member, *old);
+        } else {
+            added++;
+        }
+        index->add(member, score);
+    }
+    replyInteger(conn.out, added);
+}
+
+// ZREM key member [member ...]: drops the set once it is empty.
+void Server::cmdZrem(Connection &conn, const Args &argv) {
+    if (argv.size() < 3) {
+        return replyError(conn.out, "wrong number of arguments for 'ZREM'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    auto *index = findZset(argv[1]);
+    int64_t removed = 0;
+    for (size_t i = 2; index && i < argv.size(); i++) {
+        auto old = collections.zscore(slice(argv[1]), slice(argv[i]));
+        if (!old) {
+            continue;
+        }
+        collections.zrem(slice(argv[1]), slice(argv[i]));
+        index->remove(slice(argv[i]), *old);
+        removed++;
+    }
+    if (index && index->size() == 0) {
+        zsets.erase(argv[1]);
+    }
+    replyInteger(conn.out, removed);
+}
+
+void Server::cmdZscore(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out, "wrong number of arguments for 'ZSCORE'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    auto score = collections.zscore(slice(argv[1]), slice(argv[2]));
+    if (score) {
+        replyScore(conn.out, *score);
+    } else {
+        replyNull(conn.out);
+    }
+}
+
+void Server::cmdZcard(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'ZCARD'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    replyInteger(conn.out, int64_t(collections.size(slice(argv[1]))));
+}
+
+void Server::cmdZrank(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out, "wrong number of arguments for 'ZRANK'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    auto *index = findZset(argv[1]);
+    auto score = collections.zscore(slice(argv[1]), slice(argv[2]));
+    if (index && score) {
+        replyInteger(conn.out, int64_t(index->rank(slice(argv[2]), *score)));
+    } else {
+        replyNull(conn.out);
+    }
+}
+
+// ZRANGE key start stop [WITHSCORES]: ranks count from the end when
+// negative, as in Redis.
+void Server::cmdZrange(Connection &conn, const Args &argv) {
+    bool with_scores = argv.size() == 5 && strcasecmp(argv[4].c_str(),
+                                                      "WITHSCORES") == 0;
+    if (argv.size() != 4 && !with_scores) {
+        return replyError(conn.out, "wrong number of arguments for 'ZRANGE'");
+    }
+    int64_t start, stop;
+    if (!parseIndex(argv[2], start) || !parseIndex(argv[3], stop)) {
+        return replyError(conn.out, "value is not an integer or out of range");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    auto *index = findZset(argv[1]);
+    int64_t size = index ? index->size() : 0;
+    start = start < 0 ? std::max<int64_t>(0, start + size) : start;
+    stop = stop < 0 ? stop + size : std::min(stop, size - 1);
+    if (!index || start > stop) {
+        return replyArray(conn.out, 0);
+    }
+    replyEntries(conn.out, index->range(start, stop), with_scores);
+}
+
+// ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]: a negative
+// count means no limit.
+void Server::cmdZrangebyscore(Connection &conn, const Args &argv) {
+    if (argv.size() < 4) {
+        return replyError(conn.out,
+                          "wrong number of arguments for 'ZRANGEBYSCORE'");
+    }
+    double min, max;
+    if (!parseBound(argv[2], min, INFINITY) ||
+        !parseBound(argv[3], max, -INFINITY)) {
+        return replyError(conn.out, "min or max is not a float");
+    }
+    bool with_scores = false;
+    int64_t offset = 0, count = -1;
+    for (size_t i = 4; i < argv.size(); i++) {
+        if (strcasecmp(argv[i].c_str(), "WITHSCORES") == 0) {
+            with_scores = true;
+        } else if (strcasecmp(argv[i].c_str(), "LIMIT") == 0 &&
+                   i + 2 < argv.size()) {
+            if (!parseIndex(argv[i + 1], offset) ||
+                !parseIndex(argv[i + 2], count)) {
+                return replyError(conn.out,
+                                  "value is not an integer or out of range");
+            }
+            i += 2;
+        } else {
+            return replyError(conn.out, "syntax error");
+        }
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Zset)) {
+        return;
+    }
+    auto *index = findZset(argv[1]);
+    if (!index || offset < 0 || min > max) {
+        return replyArray(conn.out, 0);
+    }
+    replyEntries(conn.out,
+                 index->range_by_score(min, max, offset,
+                                     count < 0 ? SIZE_MAX : size_t(count)),
+                 with_scores);
+}
+
+void Server::cmdType(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'TYPE'");
+    }
+    using Type = art::Collections::Type;
+    auto type = collections.type(slice(argv[1]));
+    if (type == Type::Hash) {
+        replySimple(conn.out, "hash");
+    } else if (type == Type::Set) {
+        replySimple(conn.out, "set");
+    } else if (type == Type::List) {
+        replySimple(conn.out, "list");
+    } else if (type == Type::Zset) {
+        replySimple(conn.out, "zset");
+    } else if (isString(slice(argv[1]))) {
+        replySimple(conn.out, "string");
+    } else {
+        replySimple(conn.out, "none");
+    }
+}
+
+// Replies with WRONGTYPE unless `key` holds a collection of `type` or
+// nothing at all.
+bool Server::checkType(Connection &conn, const std::string &key,
+                       art::Collections::Type type) {
+    auto held = collections.type(slice(key));
+    if ((held != art::Collections::Type::None && held != type) ||
+        (held == art::Collections::Type::None && isString(slice(key)))) {
+        replyWrongType(conn.out);
+        return false;
+    }
+    return true;
+}
+
+// HGETALL and SMEMBERS: the fields with their values, or the members, of
+// `key`. Large collections run on the executor and stream their reply.
+void Server::replyElements(Connection &conn, const std::string &key,
+                           bool values) {
+    auto size = collections.size(slice(key));
+    if (size <= INLINE_SCAN_LIMIT) {
+        auto entries =
+            collections.elements(slice(key), std::string_view(), SIZE_MAX);
+        replyArray(conn.out, entries.size() * (values ? 2 : 1));
+        for (auto &[element, value] : entries) {
+            replyBulk(conn.out, element);
+            if (values) {
+                replyBulk(conn.out, value);
+            }
+        }
+        return;
+    }
+    offloadArray(conn, [this, key, values, next = std::string()](
+                           std::string &out, size_t &elements) mutable {
+        auto entries =
+            collections.elements(slice(key), slice(next), CHUNK_KEYS);
+        for (auto &[element, value] : entries) {
+            replyBulk(out, element);
+            if (values) {
+                replyBulk(out, value);
+            }
+        }
+        elements += entries.size() * (values ? 2 : 1);
+        if (entries.size() < CHUNK_KEYS) {
+            return false;
+        }
+        auto &last = entries.back().first;
+        next.assign(last.begin(), last.end());
+        next.push_back('\0');
+        return true;
+    });
+}
+
+// HSET key field value [field value ...]: replies with the number of new
+// fields.
+void Server::cmdHset(Connection &conn, const Args &argv) {
+    if (argv.size() < 4 || argv.size() % 2 != 0) {
+        return replyError(conn.out, "wrong number of arguments for 'HSET'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Hash)) {
+        return;
+    }
+    int64_t added = 0;
+    for (size_t i = 2; i < argv.size(); i += 2) {
+        added += collections.hset(slice(argv[1]), slice(argv[i]),
+                                  slice(argv[i + 1]));
+    }
+    replyInteger(conn.out, added);
+}
+
+void Server::cmdHget(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out, "wrong number of arguments for 'HGET'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Hash)) {
+        return;
+    }
+    auto value = collections.hget(slice(argv[1]), slice(argv[2]));
+    if (value) {
+        replyBulk(conn.out, *value);
+    } else {
+        replyNull(conn.out);
+    }
+}
+
+void Server::cmdHdel(Connection &conn, const Args &argv) {
+    if (argv.size() < 3) {
+        return replyError(conn.out, "wrong number of arguments for 'HDEL'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Hash)) {
+        return;
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < argv.size(); i++) {
+        removed += collections.hdel(slice(argv[1]), slice(argv[i]));
+    }
+    replyInteger(conn.out, removed);
+}
+
+void Server::cmdHlen(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'HLEN'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Hash)) {
+        return;
+    }
+    replyInteger(conn.out, collections.size(slice(argv[1])));
+}
+
+void Server::cmdHgetall(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'HGETALL'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Hash)) {
+        return;
+    }
+    replyElements(conn, argv[1], true);
+}
+
+void Server::cmdSadd(Connection &conn, const Args &argv) {
+    if (argv.size() < 3) {
+        return replyError(conn.out, "wrong number of arguments for 'SADD'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Set)) {
+        return;
+    }
+    int64_t added = 0;
+    for (size_t i = 2; i < argv.size(); i++) {
+        added += collections.sadd(slice(argv[1]), slice(argv[i]));
+    }
+    replyInteger(conn.out, added);
+}
+
+void Server::cmdSrem(Connection &conn, const Args &argv) {
+    if (argv.size() < 3) {
+        return replyError(conn.out, "wrong number of arguments for 'SREM'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Set)) {
+        return;
+    }
+    int64_t removed = 0;
+    for (size_t i = 2; i < argv.size(); i++) {
+        removed += collections.srem(slice(argv[1]), slice(argv[i]));
+    }
+    replyInteger(conn.out, removed);
+}
+
+void Server::cmdSismember(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out,
+                          "wrong number of arguments for 'SISMEMBER'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Set)) {
+        return;
+    }
+    replyInteger(conn.out,
+                 collections.sismember(slice(argv[1]), slice(argv[2])));
+}
+
+void Server::cmdScard(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'SCARD'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Set)) {
+        return;
+    }
+    replyInteger(conn.out, collections.size(slice(argv[1])));
+}
+
+void Server::cmdSmembers(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out,
+                          "wrong number of arguments for 'SMEMBERS'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::Set)) {
+        return;
+    }
+    replyElements(conn, argv[1], false);
+}
+
+// LPUSH and RPUSH key element [element ...]: replies with the new length.
+void Server::push(Connection &conn, const Args &argv, bool front) {
+    if (argv.size() < 3) {
+        return replyError(conn.out, "wrong number of arguments for '" +
+                                        argv[0] + "'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::List)) {
+        return;
+    }
+    size_t length = 0;
+    for (size_t i = 2; i < argv.size(); i++) {
+        length = collections.push(slice(argv[1]), slice(argv[i]), front);
+    }
+    replyInteger(conn.out, length);
+}
+
+void Server::pop(Connection &conn, const Args &argv, bool front) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for '" +
+                                        argv[0] + "'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::List)) {
+        return;
+    }
+    auto value = collections.pop(slice(argv[1]), front);
+    if (value) {
+        replyBulk(conn.out, *value);
+    } else {
+        replyNull(conn.out);
+    }
+}
+
+void Server::cmdLpush(Connection &conn, const Args &argv) {
+    push(conn, argv, true);
+}
+
+void Server::cmdRpush(Connection &conn, const Args &argv) {
+    push(conn, argv, false);
+}
+
+void Server::cmdLpop(Connection &conn, const Args &argv) {
+    pop(conn, argv, true);
+}
+
+void Server::cmdRpop(Connection &conn, const Args &argv) {
+    pop(conn, argv, false);
+}
+
+void Server::cmdLlen(Connection &conn, const Args &argv) {
+    if (argv.size() != 2) {
+        return replyError(conn.out, "wrong number of arguments for 'LLEN'");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::List)) {
+        return;
+    }
+    replyInteger(conn.out, collections.size(slice(argv[1])));
+}
+
+void Server::cmdLindex(Connection &conn, const Args &argv) {
+    if (argv.size() != 3) {
+        return replyError(conn.out, "wrong number of arguments for 'LINDEX'");
+    }
+    int64_t index;
+    if (!parseIndex(argv[2], index)) {
+        return replyError(conn.out, "value is not an integer or out of range");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::List)) {
+        return;
+    }
+    auto value = collections.index(slice(argv[1]), index);
+    if (value) {
+        replyBulk(conn.out, *value);
+    } else {
+        replyNull(conn.out);
+    }
+}
+
+// LRANGE key start stop: long ranges run on the executor and stream, each
+// chunk reading its positions relative to the head at that moment.
+void Server::cmdLrange(Connection &conn, const Args &argv) {
+    if (argv.size() != 4) {
+        return replyError(conn.out, "wrong number of arguments for 'LRANGE'");
+    }
+    int64_t start, stop;
+    if (!parseIndex(argv[2], start) || !parseIndex(argv[3], stop)) {
+        return replyError(conn.out, "value is not an integer or out of range");
+    }
+    if (!checkType(conn, argv[1], art::Collections::Type::List)) {
+        return;
+    }
+    int64_t size = collections.size(slice(argv[1]));
+    start = start < 0 ? std::max<int64_t>(0, start + size) : start;
+    stop = stop < 0 ? stop + size : std::min(stop, size - 1);
+    if (start > stop) {
+        return replyArray(conn.out, 0);
+    }
+    if (stop - start < int64_t(INLINE_SCAN_LIMIT)) {
+        auto values = collections.range(slice(argv[1]), start, stop);
+        replyArray(conn.out, values.size());
+        for (auto &value : values) {
+            replyBulk(conn.out, value);
+        }
+        return;
+    }
+    offloadArray(conn, [this, key = argv[1], start, stop](
+                           std::string &out, size_t &elements) mutable {
+        auto last = std::min<int64_t>(stop, start + CHUNK_KEYS - 1);
+        auto values = collections.range(slice(key), start, last);
+        for (auto &value : values) {
+            replyBulk(out, value);
+        }
+        elements += values.size();
+        bool shrunk = int64_t(values.size()) < last - start + 1;
+        start = last + 1;
+        if (shrunk || start > stop) {
+            return false;
+        }
+        return true;
+    });
+}
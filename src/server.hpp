@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "art.hpp"
+#include "collections.hpp"
+#include "executor.hpp"
+#include "shm_transport.hpp"
+#include "snapshot.hpp"
+#include "sorted_set.hpp"
+
+namespace artikv {
+
+struct Config {
+  uint16_t port = 6380;
+  std::string dir = ".";
+  std::string dbfilename = "dump.akv";
+  // Number of range files SAVE and BGSAVE split the checkpoint into.
+  size_t save_parts = 1;
+  // Unix socket co-located clients connect to for a shared-memory channel;
+  // empty to disable the transport.
+  std::string shm_socket;
+  // How long each pass of the loop polls shared-memory channels before it
+  // turns to sockets and may block again; 0 to always block.
+  unsigned shm_busy_poll_us = 0;
+  // Values of at least this many bytes are stored once per distinct
+  // content; 0 to disable deduplication.
+  size_t dedup_min_bytes = 0;
+  // Workers that run long commands (large SCANs, COUNTPREFIX).
+  size_t scan_threads = 2;
+
+  std::string checkpointPath() const { return dir + "/" + dbfilename; }
+};
+
+/**
+ * @class Server
+ * @brief Single-threaded epoll server speaking RESP over TCP.
+ *
+ * Point commands run to completion on the event loop thread against the
+ * shared `ART`; replies are buffered per connection and flushed when the
+ * socket becomes writable. Clients on the same host may instead ask for a
+ * shared-memory channel (see shm_transport.hpp), served by the same loop.
+ *
+ * Commands that may touch many keys are offloaded to an `Executor` and run
+ * there in chunks of a bounded number of keys. Each chunk's reply bytes are
+ * handed back to the loop through an eventfd and sent right away, so a large
+ * SCAN streams to clients that switched to RESP3 with HELLO; RESP2 needs an
+ * array's length up front, so its elements are gathered on the worker and
+ * sent once complete. A job whose client is far behind is parked on its
+ * connection until the loop has drained it, leaving its worker to others.
+ * The connection that issued the command reads no further commands until it
+ * is done, which keeps its replies in order; other connections are not held
+ * up.
+ */
+class Server {
+public:
+  Server(art::ART &tree, Config config);
+  ~Server();
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  // Serves until the process is terminated. Throws std::system_error if the
+  // listening socket cannot be set up.
+  void run();
+
+private:
+  // A command of one connection running on the executor.
+  struct Offload {
+    explicit Offload(int fd) : fd(fd) {}
+    int fd;
+    // Set once the connection is gone; the job stops at its next chunk.
+    std::atomic<bool> cancelled{false};
+    // Reply bytes the connection has not sent yet, as of the last flush.
+    std::atomic<size_t> unsent{0};
+  };
+  using Args = std::vector<std::string>;
+  // Does one chunk of an offloaded command, appending its reply bytes to
+  // the argument. Returns whether there is more.
+  using Chunk = std::function<bool(std::string &)>;
+  // Same for a command replying with an array: appends elements and adds
+  // their number to the second argument.
+  using ArrayChunk = std::function<bool(std::string &, size_t &)>;
+  struct Completion {
+    std::shared_ptr<Offload> offload;
+    std::string out;
+    bool done;
+    // The rest of the job when it stopped to let its client catch up.
+    Chunk parked;
+  };
+  struct Connection {
+    int fd;
+    std::string in;
+    std::string out;
+    bool closing = false;
+    // RESP version chosen with HELLO.
+    int protocol = 2;
+    std::shared_ptr<Offload> offload;
+    // The offloaded job, while it waits for `out` to drain.
+    Chunk parked;
+  };
+  using Handler = void (Server::*)(Connection &, const Args &);
+
+  art::ART &tree;
+  Config config;
+  int listen_fd = -1;
+  int epoll_fd = -1;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections;
+  std::unordered_map<std::string, Handler> commands;
+  // Hashes, sets, lists and sorted sets, stored in `tree` under a reserved
+  // first byte so that checkpoints include them. String commands keep clear
+  // of those keys, and a key holds a value of one type at most. The event
+  // loop is their only writer; offloaded commands may read them.
+  art::Collections collections;
+  // Score index of every sorted set in `collections`, which ranks and score
+  // ranges are answered from; scores and members are looked up in
+  // `collections` itself. It is rebuilt from the members on start. Only the
+  // event loop touches it.
+  std::unordered_map<std::string, std::unique_ptr<art::ScoreIndex>> zsets;
+  BackgroundSave bgsave;
+  int shm_listen_fd = -1;
+  // Channels by their socket, and the same channels by their request eventfd.
+  std::unordered_map<int, std::unique_ptr<ShmChannel>> shm_channels;
+  std::unordered_map<int, ShmChannel *> shm_wakeups;
+  int completion_fd = -1;
+  std::mutex completions_mutex;
+  std::vector<Completion> completions;
+  // Declared last so that its workers stop before the rest goes away.
+  Executor executor;
+
+  void listen();
+  void acceptClients();
+  void onReadable(Connection &conn);
+  void flush(Connection &conn);
+  void close(Connection &conn);
+  void dispatch(Connection &conn, Args &argv);
+  void process(Connection &conn);
+
+  void offload(Connection &conn, Chunk chunk);
+  void offloadArray(Connection &conn, ArrayChunk chunk);
+  void schedule(std::shared_ptr<Offload> offload, Chunk chunk);
+  void post(const std::shared_ptr<Offload> &offload, std::string out,
+            bool done, Chunk parked = nullptr);
+  void drainCompletions();
+
+  void listenShm();
+  void acceptShmClients();
+  void closeShm(ShmChannel &channel);
+  size_t serveShm(ShmChannel &channel);
+  bool serveShmRequest(ShmChannel &channel, std::span<const uint8_t> request);
+  bool sleepShm();
+  void busyPollShm();
+
+  void cmdPing(Connection &conn, const Args &argv);
+  void cmdHello(Connection &conn, const Args &argv);
+  void cmdGet(Connection &conn, const Args &argv);
+  void cmdSet(Connection &conn, const Args &argv);
+  void cmdDel(Connection &conn, const Args &argv);
+  void cmdDbsize(Connection &conn, const Args &argv);
+  void cmdSave(Connection &conn, const Args &argv);
+  void cmdBgsave(Connection &conn, const Args &argv);
+  void cmdInfo(Connection &conn, const Args &argv);
+  void cmdScan(Connection &conn, const Args &argv);
+  void cmdDelprefix(Connection &conn, const Args &argv);
+  void cmdCountprefix(Connection &conn, const Args &argv);
+  void cmdZadd(Connection &conn, const Args &argv);
+  void cmdZrem(Connection &conn, const Args &argv);
+  void cmdZscore(Connection &conn, const Args &argv);
+  void cmdZcard(Connection &conn, const Args &argv);
+  void cmdZrank(Connection &conn, const Args &argv);
+  void cmdZrange(Connection &conn, const Args &argv);
+  void cmdZrangebyscore(Connection &conn, const Args &argv);
+
+  art::ScoreIndex *findZset(const std::string &key);
+
+  void cmdType(Connection &conn, const Args &argv);
+  void cmdHset(Connection &conn, const Args &argv);
+  void cmdHget(Connection &conn, const Args &argv);
+  void cmdHdel(Connection &conn, const Args &argv);
+  void cmdHlen(Connection &conn, const Args &argv);
+  void cmdHgetall(Connection &conn, const Args &argv);
+  void cmdSadd(Connection &conn, const Args &argv);
+  void cmdSrem(Connection &conn, const Args &argv);
+  void cmdSismember(Connection &conn, const Args &argv);
+  void cmdScard(Connection &conn, const Args &argv);
+  void cmdSmembers(Connection &conn, const Args &argv);
+  void cmdLpush(Connection &conn, const Args &argv);
+  void cmdRpush(Connection &conn, const Args &argv);
+  void cmdLpop(Connection &conn, const Args &argv);
+  void cmdRpop(Connection &conn, const Args &argv);
+  void cmdLlen(Connection &conn, const Args &argv);
+  void cmdLindex(Connection &conn, const Args &argv);
+  void cmdLrange(Connection &conn, const Args &argv);
+
+  bool isString(art::Slice key);
+  bool exists(art::Slice key);
+  size_t keyCount();
+  void setString(art::Slice key, art::OwnedSlice value);
+  bool removeKey(art::Slice key);
+  bool checkType(Connection &conn, const std::string &key,
+                 art::Collections::Type type);
+  void push(Connection &conn, const Args &argv, bool front);
+  void pop(Connection &conn, const Args &argv, bool front);
+  void replyElements(Connection &conn, const std::string &key, bool values);
+};
+
+} // namespace artikv
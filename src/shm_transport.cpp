@@ -0,0 +1,378 @@
+#include "shm_transport.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace artikv;
+
+namespace {
+// Length word of the filler record that skips to the start of the buffer.
+constexpr uint32_t PAD = 0xFFFFFFFF;
+// Record header: the u32 length, padded so payloads stay 8-byte aligned.
+constexpr size_t RECORD_HEADER = 8;
+constexpr int CHANNEL_FDS = 3;
+
+[[noreturn]] void fail(const char *what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+std::span<const uint8_t> bytes(std::string_view s) {
+    return {reinterpret_cast<const uint8_t *>(s.data()), s.size()};
+}
+
+template <typename T> std::span<const uint8_t> bytes(const T &value) {
+    return {reinterpret_cast<const uint8_t *>(&value), sizeof(value)};
+}
+
+void signal(int fd) {
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = write(fd, &one, sizeof(one));
+}
+
+ShmChannelLayout *mapChannel(int memfd) {
+    auto *mem = mmap(nullptr, sizeof(ShmChannelLayout), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, memfd, 0);
+    if (mem == MAP_FAILED) {
+        fail("map channel");
+    }
+    return static_cast<ShmChannelLayout *>(mem);
+}
+} // namespace
+
+bool ShmRing::push(std::initializer_list<std::span<const uint8_t>> parts) {
+    size_t len = 0;
+    for (auto &part : parts) {
+        len += part.size();
+    }
+    auto record = RECORD_HEADER + align8(len);
+    auto head = state->head.load(std::memory_order_relaxed);
+    auto tail = state->tail.load(std::memory_order_acquire);
+    auto pos = head % capacity;
+    size_t pad = pos + record > capacity ? capacity - pos : 0;
+    if (len > maxRecord() || head + pad + record - tail > capacity) {
+        return false;
+    }
+    if (pad != 0) {
+        std::memcpy(data + pos, &PAD, sizeof(PAD));
+        head += pad;
+        pos = 0;
+    }
+    auto n = uint32_t(len);
+    std::memcpy(data + pos, &n, sizeof(n));
+    auto *out = data + pos + RECORD_HEADER;
+    for (auto &part : parts) {
+        std::memcpy(out, part.data(), part.size());
+        out += part.size();
+    }
+    state->head.store(head + record, std::memory_order_release);
+    return true;
+}
+
+bool ShmRing::consumerSleeping() const {
+    // Pairs with the fence in `sleep`: either the consumer sees the record
+    // just pushed, or the producer sees the flag.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return state->consumer_sleeping.load(std::memory_order_relaxed);
+}
+
+std::span<const uint8_t> ShmRing::front() {
+    auto tail = state->tail.load(std::memory_order_relaxed);
+    auto head = state->head.load(std::memory_order_acquire);
+    while (tail != head) {
+        auto pos = tail % capacity;
+        uint32_t len;
+        std::memcpy(&len, data + pos, sizeof(len));
+        if (len != PAD) {
+            return {data + pos + RECORD_HEADER, len};
+        }
+        tail += capacity - pos;
+        state->tail.store(tail, std::memory_order_release);
+    }
+    return {};
+}
+
+void ShmRing::pop() {
+    auto tail = state->tail.load(std::memory_order_relaxed);
+    uint32_t len;
+    std::memcpy(&len, data + tail % capacity, sizeof(len));
+    state->tail.store(tail + RECORD_HEADER + align8(len),
+                      std::memory_order_release);
+}
+
+bool ShmRing::sleep() {
+    state->consumer_sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (state->head.load(std::memory_order_relaxed) !=
+        state->tail.load(std::memory_order_relaxed)) {
+        wake();
+        return false;
+    }
+    return true;
+}
+
+void ShmRing::wake() {
+    state->consumer_sleeping.store(0, std::memory_order_relaxed);
+}
+
+ShmChannel::ShmChannel(int socket_fd) : socket_fd(socket_fd) {
+    int memfd = memfd_create("artikv-channel", MFD_CLOEXEC);
+    if (memfd < 0) {
+        fail("memfd_create");
+    }
+    try {
+        if (ftruncate(memfd, sizeof(ShmChannelLayout)) != 0) {
+            fail("size channel");
+        }
+        // The server only reads the request eventfd once epoll reported it
+        // readable; the response eventfd stays blocking for the client.
+        request_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        response_fd = eventfd(0, EFD_CLOEXEC);
+        if (request_fd < 0 || response_fd < 0) {
+            fail("eventfd");
+        }
+        layout = mapChannel(memfd);
+        std::memcpy(layout->magic, SHM_CHANNEL_MAGIC, sizeof(SHM_CHANNEL_MAGIC));
+        requests = ShmRing(&layout->requests, layout->request_data,
+                           ShmChannelLayout::REQUEST_BYTES);
+        responses = ShmRing(&layout->responses, layout->response_data,
+                            ShmChannelLayout::RESPONSE_BYTES);
+
+        int fds[CHANNEL_FDS] = {memfd, request_fd, response_fd};
+        char byte = 0;
+        iovec iov{&byte, 1};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        if (sendmsg(socket_fd, &msg, MSG_NOSIGNAL) != 1) {
+            fail("send channel");
+        }
+    } catch (...) {
+        ::close(memfd);
+        unmap();
+        throw;
+    }
+    ::close(memfd);
+}
+
+ShmChannel::~ShmChannel() {
+    unmap();
+    ::close(socket_fd);
+}
+
+void ShmChannel::unmap() {
+    if (layout != nullptr) {
+        munmap(layout, sizeof(ShmChannelLayout));
+        layout = nullptr;
+    }
+    for (int *fd : {&request_fd, &response_fd}) {
+        if (*fd != -1) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+bool ShmChannel::respond(ShmStatus status, std::span<const uint8_t> value) {
+    if (value.size() > ShmChannelLayout::MAX_VALUE) {
+        status = ShmStatus::TooLarge;
+        value = {};
+    }
+    auto head = layout->values_head.load(std::memory_order_relaxed);
+    ShmResponse response{status, uint32_t(value.size()), 0, head};
+    if (!value.empty()) {
+        auto start = head % ShmChannelLayout::VALUE_BYTES;
+        if (start + value.size() > ShmChannelLayout::VALUE_BYTES) {
+            head += ShmChannelLayout::VALUE_BYTES - start;
+            start = 0;
+        }
+        auto tail = layout->values_tail.load(std::memory_order_acquire);
+        if (head + value.size() - tail > ShmChannelLayout::VALUE_BYTES) {
+            return false;
+        }
+        std::memcpy(layout->values + start, value.data(), value.size());
+        response.value_offset = start;
+        response.value_end = head + value.size();
+    }
+    if (!responses.push({bytes(response)})) {
+        return false;
+    }
+    layout->values_head.store(response.value_end, std::memory_order_relaxed);
+    requests.pop();
+    notify_pending = true;
+    return true;
+}
+
+void ShmChannel::notify() {
+    if (notify_pending && responses.consumerSleeping()) {
+        signal(response_fd);
+    }
+    notify_pending = false;
+}
+
+void ShmChannel::drainWakeups() {
+    uint64_t count;
+    [[maybe_unused]] auto n = read(request_fd, &count, sizeof(count));
+}
+
+ShmClient::ShmClient(const std::string &socket_path, unsigned busy_poll_spins)
+    : busy_poll_spins(busy_poll_spins) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("socket path too long: " + socket_path);
+    }
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0) {
+        fail("socket");
+    }
+
+    int fds[CHANNEL_FDS];
+    try {
+        if (connect(socket_fd, reinterpret_cast<sockaddr *>(&addr),
+                    sizeof(addr)) != 0) {
+            fail("connect");
+        }
+        char byte;
+        iovec iov{&byte, 1};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC) != 1) {
+            fail("receive channel");
+        }
+        auto *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+            throw std::runtime_error("server sent no channel");
+        }
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    } catch (...) {
+        ::close(socket_fd);
+        throw;
+    }
+    request_fd = fds[1];
+    response_fd = fds[2];
+    try {
+        layout = mapChannel(fds[0]);
+    } catch (...) {
+        ::close(fds[0]);
+        unmap();
+        throw;
+    }
+    ::close(fds[0]);
+    if (std::memcmp(layout->magic, SHM_CHANNEL_MAGIC,
+                    sizeof(SHM_CHANNEL_MAGIC)) != 0) {
+        unmap();
+        throw std::runtime_error("not an ArtiKV channel");
+    }
+    requests = ShmRing(&layout->requests, layout->request_data,
+                       ShmChannelLayout::REQUEST_BYTES);
+    responses = ShmRing(&layout->responses, layout->response_data,
+                        ShmChannelLayout::RESPONSE_BYTES);
+}
+
+ShmClient::~ShmClient() { unmap(); }
+
+void ShmClient::unmap() {
+    if (layout != nullptr) {
+        munmap(layout, sizeof(ShmChannelLayout));
+        layout = nullptr;
+    }
+    for (int *fd : {&socket_fd, &request_fd, &response_fd}) {
+        if (*fd != -1) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+std::optional<std::span<const uint8_t>> ShmClient::get(std::string_view key) {
+    auto response = call(ShmOp::Get, key, {});
+    if (response.status == ShmStatus::NotFound) {
+        return std::nullopt;
+    }
+    if (response.status == ShmStatus::WrongType) {
+        throw std::runtime_error("key holds a value of another type");
+    }
+    if (response.status != ShmStatus::Ok) {
+        throw std::runtime_error("value too large for the shared buffer");
+    }
+    return std::span<const uint8_t>(layout->values + response.value_offset,
+                                    response.value_len);
+}
+
+void ShmClient::set(std::string_view key, std::string_view value) {
+    if (call(ShmOp::Set, key, value).status != ShmStatus::Ok) {
+        throw std::runtime_error("key is reserved");
+    }
+}
+
+bool ShmClient::del(std::string_view key) {
+    return call(ShmOp::Del, key, {}).status == ShmStatus::Ok;
+}
+
+ShmResponse ShmClient::call(ShmOp op, std::string_view key,
+                            std::string_view value) {
+    // The previous value is no longer referenced once a new call starts.
+    layout->values_tail.store(value_end, std::memory_order_release);
+    ShmRequest request{op, uint32_t(key.size()), uint32_t(value.size())};
+    if (sizeof(request) + key.size() + value.size() > requests.maxRecord()) {
+        throw std::length_error("request too large for the shared ring");
+    }
+    // Calls are synchronous, so the ring is empty unless the server stalled.
+    if (!requests.push({bytes(request), bytes(key), bytes(value)})) {
+        throw std::runtime_error("request ring full");
+    }
+    if (requests.consumerSleeping()) {
+        signal(request_fd);
+    }
+
+    auto record = responses.front();
+    for (unsigned spin = 0; record.empty() && spin < busy_poll_spins; spin++) {
+        record = responses.front();
+    }
+    while (record.empty()) {
+        if (responses.sleep()) {
+            pollfd fds[2] = {{response_fd, POLLIN, 0}, {socket_fd, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+                fail("poll");
+            }
+            if (fds[1].revents != 0) {
+                throw std::runtime_error("server closed the channel");
+            }
+            if (fds[0].revents & POLLIN) {
+                uint64_t count;
+                [[maybe_unused]] auto n = read(response_fd, &count, sizeof(count));
+            }
+            responses.wake();
+        }
+        record = responses.front();
+    }
+    ShmResponse response;
+    std::memcpy(&response, record.data(), sizeof(response));
+    responses.pop();
+    value_end = response.value_end;
+    return response;
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace artikv {
+
+/**
+ * Shared-memory transport for clients on the same host.
+ *
+ * A client connects to the server's Unix socket and receives, over
+ * SCM_RIGHTS, a `memfd` holding one `ShmChannelLayout` plus two eventfds.
+ * Requests travel through an SPSC ring written by the client, responses
+ * through one written by the server. A value is not copied into the response:
+ * the server places it in the channel's value buffer and replies with its
+ * offset, and the client hands the region back with its next request.
+ *
+ * A side that finds its ring empty raises the ring's `consumer_sleeping`
+ * flag before blocking on its eventfd, and the producer only signals the
+ * eventfd while that flag is set, so a busy-polling consumer costs the
+ * producer no syscalls. The Unix socket stays open as the liveness signal:
+ * the channel is torn down when either side closes it.
+ */
+inline constexpr char SHM_CHANNEL_MAGIC[8] = {'A', 'R', 'T', 'I',
+                                              'K', 'V', 'C', '1'};
+
+enum class ShmOp : uint8_t { Get = 1, Set = 2, Del = 3 };
+enum class ShmStatus : uint32_t {
+  Ok,
+  NotFound,
+  TooLarge,
+  BadRequest,
+  // The key holds a collection rather than a string.
+  WrongType,
+};
+
+// Header of every request record; the key bytes follow, then the value.
+struct ShmRequest {
+  ShmOp op;
+  uint32_t key_len;
+  uint32_t val_len;
+};
+
+struct ShmResponse {
+  ShmStatus status;
+  uint32_t value_len;
+  // Where the value starts in the value buffer.
+  uint64_t value_offset;
+  // Value buffer position to release once the client is done with it.
+  uint64_t value_end;
+};
+
+struct ShmRingState {
+  alignas(64) std::atomic<uint64_t> head; // advanced by the producer
+  alignas(64) std::atomic<uint64_t> tail; // advanced by the consumer
+  std::atomic<uint32_t> consumer_sleeping;
+};
+
+/**
+ * @class ShmRing
+ * @brief Byte ring with one producer and one consumer in different processes.
+ *
+ * Records are an 8-byte header holding the u32 payload length, followed by
+ * the payload padded to 8 bytes. A record never wraps; the producer fills
+ * the end of the buffer with a padding record instead.
+ */
+class ShmRing {
+public:
+  ShmRing() = default;
+  ShmRing(ShmRingState *state, uint8_t *data, size_t capacity)
+      : state(state), data(data), capacity(capacity) {}
+
+  // Producer: appends the concatenation of `parts` as one record, or returns
+  // false if it does not fit right now.
+  bool push(std::initializer_list<std::span<const uint8_t>> parts);
+  // Producer: whether the consumer asked to be woken up.
+  bool consumerSleeping() const;
+
+  // Consumer: the oldest record, or an empty span if there is none.
+  std::span<const uint8_t> front();
+  void pop();
+  // Consumer: announces that it is about to block. Returns false, and stays
+  // awake, if a record arrived in the meantime.
+  bool sleep();
+  void wake();
+
+  // Largest payload `push` can ever accept.
+  size_t maxRecord() const { return capacity / 2 - sizeof(uint64_t); }
+
+private:
+  ShmRingState *state = nullptr;
+  uint8_t *data = nullptr;
+  size_t capacity = 0;
+};
+
+struct ShmChannelLayout {
+  static constexpr size_t REQUEST_BYTES = 1 << 20;
+  static constexpr size_t RESPONSE_BYTES = 64 << 10;
+  static constexpr size_t VALUE_BYTES = 4 << 20;
+  // Largest value a response carries. A value never wraps, so one larger
+  // than half the buffer might not fit behind the last one even once the
+  // client released everything.
+  static constexpr size_t MAX_VALUE = VALUE_BYTES / 2;
+
+  char magic[8];
+  ShmRingState requests;
+  ShmRingState responses;
+  alignas(64) std::atomic<uint64_t> values_head; // advanced by the server
+  alignas(64) std::atomic<uint64_t> values_tail; // advanced by the client
+  alignas(64) uint8_t request_data[REQUEST_BYTES];
+  uint8_t response_data[RESPONSE_BYTES];
+  uint8_t values[VALUE_BYTES];
+};
+
+/**
+ * @class ShmChannel
+ * @brief Server end of one client's shared-memory channel.
+ */
+class ShmChannel {
+public:
+  // Creates the channel and sends its descriptors over `socket_fd`, which
+  // the channel owns once constructed. Throws std::system_error on failure.
+  explicit ShmChannel(int socket_fd);
+  ~ShmChannel();
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel &operator=(const ShmChannel &) = delete;
+
+  int socketFd() const { return socket_fd; }
+  // Readable when the client signalled new requests.
+  int requestFd() const { return request_fd; }
+
+  // The oldest unanswered request, or an empty span.
+  std::span<const uint8_t> nextRequest() { return requests.front(); }
+  // Answers the oldest request and removes it. A value is copied into the
+  // value buffer first, or answered with TooLarge beyond
+  // `ShmChannelLayout::MAX_VALUE`; returns false, leaving the request
+  // queued, when the buffer or the response ring is full until the client
+  // releases space.
+  bool respond(ShmStatus status, std::span<const uint8_t> value = {});
+  // Signals the client if it is waiting for a response.
+  void notify();
+  bool sleep() { return requests.sleep(); }
+  void wake() { requests.wake(); }
+  // Consumes the eventfd counter after a wakeup.
+  void drainWakeups();
+
+private:
+  int socket_fd;
+  int request_fd = -1;
+  int response_fd = -1;
+  ShmChannelLayout *layout = nullptr;
+  ShmRing requests;
+  ShmRing responses;
+  bool notify_pending = false;
+
+  void unmap();
+};
+
+/**
+ * @class ShmClient
+ * @brief Client end of a shared-memory channel.
+ *
+ * Calls are synchronous and work on string keys. A value returned by `get`
+ * points into the shared value buffer and stays valid until the next call.
+ * `get` throws std::runtime_error for a value too large for the buffer or a
+ * key holding another type, and `set` for a key the server reserves.
+ *
+ * Usage example:
+ * @code
+ *     ShmClient client("/tmp/artikv.sock");
+ *     client.set("key1", "value1");
+ *     auto value = client.get("key1");
+ * @endcode
+ */
+class ShmClient {
+public:
+  // Connects to the server's socket. With `busy_poll_spins` > 0 the client
+  // polls the response ring that many times before blocking. Throws
+  // std::system_error or std::runtime_error on failure.
+  explicit ShmClient(const std::string &socket_path,
+                     unsigned busy_poll_spins = 0);
+  ~ShmClient();
+  ShmClient(const ShmClient &) = delete;
+  ShmClient &operator=(const ShmClient &) = delete;
+
+  std::optional<std::span<const uint8_t>> get(std::string_view key);
+  void set(std::string_view key, std::string_view value);
+  bool del(std::string_view key);
+
+private:
+  int socket_fd = -1;
+  int request_fd = -1;
+  int response_fd = -1;
+  ShmChannelLayout *layout = nullptr;
+  ShmRing requests;
+  ShmRing responses;
+  unsigned busy_poll_spins;
+  // End of the value the last response pointed at, released by the next call.
+  uint64_t value_end = 0;
+
+  void unmap();
+  ShmResponse call(ShmOp op, std::string_view key, std::string_view value);
+};
+
+} // namespace artikv
@@ -0,0 +1,119 @@
+#include "snapshot.hpp"
+#include "checkpoint.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace artikv;
+
+namespace {
+// What the child reports back through the pipe before exiting.
+struct ChildReport {
+    uint64_t keys;
+    uint64_t cow_bytes;
+};
+
+long minorFaults() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+// Sums Private_Dirty over the whole address space of this process.
+size_t privateDirtyBytes() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    if (!smaps) {
+        smaps.open("/proc/self/smaps");
+    }
+    size_t total = 0;
+    std::string line;
+    while (std::getline(smaps, line)) {
+        size_t kb = 0;
+        if (std::sscanf(line.c_str(), "Private_Dirty: %zu kB", &kb) == 1) {
+            total += kb * 1024;
+        }
+    }
+    return total;
+}
+} // namespace
+
+BackgroundSave::~BackgroundSave() {
+    if (child != -1) {
+        int status;
+        waitpid(child, &status, 0);
+        close(stats_fd);
+    }
+}
+
+bool BackgroundSave::start(art::ART &tree, const std::string &path,
+                           size_t parts) {
+    if (child != -1) {
+        return false;
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    faults_at_fork = minorFaults();
+    started = std::chrono::steady_clock::now();
+    auto pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        ChildReport report{};
+        int code = 0;
+        try {
+            report.keys = art::saveCheckpoint(tree, path, parts);
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "background save failed: %s\n", e.what());
+            code = 1;
+        }
+        report.cow_bytes = privateDirtyBytes();
+        [[maybe_unused]] auto n = write(fds[1], &report, sizeof(report));
+        // Skip atexit handlers and static destructors that belong to the
+        // parent's state.
+        _exit(code);
+    }
+    close(fds[1]);
+    child = pid;
+    stats_fd = fds[0];
+    return true;
+}
+
+void BackgroundSave::poll() {
+    if (child == -1) {
+        return;
+    }
+    int status;
+    if (waitpid(child, &status, WNOHANG) == child) {
+        finish(status);
+    }
+}
+
+void BackgroundSave::finish(int status) {
+    ChildReport report{};
+    auto n = read(stats_fd, &report, sizeof(report));
+    close(stats_fd);
+    child = -1;
+    stats_fd = -1;
+    stats.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+               n == sizeof(report);
+    stats.keys = report.keys;
+    stats.cow_bytes = report.cow_bytes;
+    stats.parent_minor_faults = minorFaults() - faults_at_fork;
+    stats.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started);
+    std::fprintf(stderr,
+                 "background save %s: %zu keys in %lld ms, %zu bytes copied "
+                 "on write, %ld parent minor faults\n",
+                 stats.ok ? "done" : "failed", stats.keys,
+                 static_cast<long long>(stats.duration.count()),
+                 stats.cow_bytes, stats.parent_minor_faults);
+}
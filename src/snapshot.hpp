@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+#include "art.hpp"
+
+namespace artikv {
+
+// Outcome of the last finished background save.
+struct SnapshotStats {
+  bool ok = false;
+  size_t keys = 0;
+  // Bytes the child ended up owning privately, i.e. the pages copied on
+  // write because either process touched them after the fork.
+  size_t cow_bytes = 0;
+  // Minor page faults the serving process took while the child was running;
+  // after a fork these are mostly copy-on-write faults on tree pages.
+  long parent_minor_faults = 0;
+  std::chrono::milliseconds duration{0};
+};
+
+/**
+ * @class BackgroundSave
+ * @brief BGSAVE-style checkpoint taken by a forked child.
+ *
+ * `start` forks. The child sees a frozen copy of the whole address space,
+ * streams the tree to the checkpoint file through the ordered iterator and
+ * exits, while the parent returns immediately and keeps serving; the kernel
+ * copies only the pages the parent writes to in the meantime. `poll` reaps
+ * the child without blocking and collects its statistics.
+ *
+ * Other threads must be parked, holding no locks, when `start` is called,
+ * as only the calling thread survives in the child.
+ */
+class BackgroundSave {
+public:
+  ~BackgroundSave();
+
+  // Returns false if a save is already running or the fork failed. With
+  // `parts` > 1 the child writes that many range files on its own threads.
+  bool start(art::ART &tree, const std::string &path, size_t parts = 1);
+  void poll();
+  bool running() const { return child != -1; }
+  const SnapshotStats &last() const { return stats; }
+
+private:
+  pid_t child = -1;
+  int stats_fd = -1;
+  long faults_at_fork = 0;
+  std::chrono::steady_clock::time_point started;
+  SnapshotStats stats;
+
+  void finish(int status);
+};
+
+} // namespace artikv
@@ -0,0 +1,621 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <netinet/in.h>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "gtest/gtest.h"
+#include "art.hpp"
+#include "checkpoint.hpp"
+#include "executor.hpp"
+#include "resp.hpp"
+#include "server.hpp"
+#include "shm_transport.hpp"
+
+using namespace artikv;
+using namespace std;
+
+namespace {
+// End of the RESP reply that starts at `pos`, or npos if it has not fully
+// arrived. Streamed arrays end at their "." marker.
+size_t replyEnd(string_view in, size_t pos) {
+    auto eol = in.find("\r\n", pos);
+    if (eol == string_view::npos) {
+        return eol;
+    }
+    auto next = eol + 2;
+    auto header = in.substr(pos + 1, eol - pos - 1);
+    switch (in[pos]) {
+    case '$': {
+        auto len = stol(string(header));
+        if (len < 0) {
+            return next;
+        }
+        return in.size() < next + len + 2 ? string_view::npos : next + len + 2;
+    }
+    case '%':
+    case '*': {
+        if (header == "?") {
+            while (next != string_view::npos && next < in.size() &&
+                   in[next] != '.') {
+                next = replyEnd(in, next);
+            }
+            return next == string_view::npos || next + 3 > in.size()
+                       ? string_view::npos
+                       : next + 3;
+        }
+        auto count = stol(string(header)) * (in[pos] == '%' ? 2 : 1);
+        for (long i = 0; i < count; i++) {
+            if (next >= in.size()) {
+                return string_view::npos;
+            }
+            next = replyEnd(in, next);
+            if (next == string_view::npos) {
+                return next;
+            }
+        }
+        return next;
+    }
+    default:
+        return next;
+    }
+}
+
+int freePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+    ::close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// A client connection to the server on `port`.
+class Client {
+public:
+    explicit Client(uint16_t port) { connect(port); }
+    ~Client() { ::close(fd); }
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    // Sends `args` as one RESP command and returns the raw reply.
+    string call(const vector<string> &args) {
+        string request = "*" + to_string(args.size()) + "\r\n";
+        for (auto &arg : args) {
+            request += "$" + to_string(arg.size()) + "\r\n" + arg + "\r\n";
+        }
+        send(request);
+        return reply();
+    }
+    void send(string_view bytes) {
+        while (!bytes.empty()) {
+            auto n = write(fd, bytes.data(), bytes.size());
+            ASSERT_GT(n, 0);
+            bytes.remove_prefix(n);
+        }
+    }
+    // The next reply, or what arrived before the server closed the
+    // connection.
+    string reply() {
+        size_t end;
+        while ((end = pending.empty() ? string::npos
+                                      : replyEnd(pending, 0)) == string::npos) {
+            char buf[65536];
+            auto n = read(fd, buf, sizeof(buf));
+            if (n <= 0) {
+                return exchange(pending, string());
+            }
+            pending.append(buf, n);
+        }
+        auto out = pending.substr(0, end);
+        pending.erase(0, end);
+        return out;
+    }
+
+private:
+    int fd = -1;
+    string pending;
+
+    void connect(uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        for (int attempt = 0; attempt < 500; attempt++) {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&addr),
+                          sizeof(addr)) == 0) {
+                return;
+            }
+            ::close(fd);
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        fd = -1;
+        ADD_FAILURE() << "server did not come up";
+    }
+};
+
+// A server running in a child process, started from the checkpoint in
+// `config` if there is one, like main does.
+class ServerChild {
+public:
+    explicit ServerChild(Config config) : port(uint16_t(freePort())) {
+        config.port = port;
+        pid = fork();
+        if (pid == 0) {
+            art::ART tree;
+            if (filesystem::exists(config.checkpointPath())) {
+                art::loadCheckpoint(tree, config.checkpointPath());
+            }
+            Server server(tree, config);
+            server.run();
+            _exit(0);
+        }
+    }
+    ~ServerChild() {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+
+    uint16_t port;
+
+private:
+    pid_t pid;
+};
+
+// A server running in a child process, and one client connection to it.
+class ServerProcess : public ServerChild, public Client {
+public:
+    explicit ServerProcess(Config config = {})
+        : ServerChild(std::move(config)), Client(port) {}
+};
+
+// The elements of an array reply, whether counted or streamed.
+vector<string> elements(const string &reply) {
+    vector<string> out;
+    size_t pos = reply.find("\r\n") + 2;
+    while (pos < reply.size() && reply[pos] == '$') {
+        auto end = replyEnd(reply, pos);
+        auto body = reply.find("\r\n", pos) + 2;
+        out.push_back(reply.substr(body, end - 2 - body));
+        pos = end;
+    }
+    return out;
+}
+
+// Waits up to a few seconds for `done`.
+template <typename Pred> bool eventually(Pred done) {
+    for (int i = 0; i < 500 && !done(); i++) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return done();
+}
+} // namespace
+
+TEST(Resp, ParsesArraysAndInlineCommands){
+    size_t consumed = 0;
+    vector<string> argv;
+    string_view set = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$5\r\nva\r\nl\r\n";
+    ASSERT_EQ(parseCommand(set, consumed, argv), ParseStatus::Ok);
+    EXPECT_EQ(consumed, set.size());
+    EXPECT_EQ(argv, (vector<string>{"SET", "k", "va\r\nl"}));
+
+    string_view empty = "*2\r\n$3\r\nGET\r\n$0\r\n\r\n";
+    ASSERT_EQ(parseCommand(empty, consumed, argv), ParseStatus::Ok);
+    EXPECT_EQ(argv, (vector<string>{"GET", ""}));
+
+    string_view line = "  SET  k v\r\n";
+    ASSERT_EQ(parseCommand(line, consumed, argv), ParseStatus::Ok);
+    EXPECT_EQ(consumed, line.size());
+    EXPECT_EQ(argv, (vector<string>{"SET", "k", "v"}));
+    ASSERT_EQ(parseCommand("PING\n", consumed, argv), ParseStatus::Ok);
+    EXPECT_EQ(consumed, 5u);
+    EXPECT_EQ(argv, (vector<string>{"PING"}));
+}
+
+TEST(Resp, WaitsForIncompleteInput){
+    string full = "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n";
+    size_t consumed = 0;
+    vector<string> argv;
+    // Every strict prefix is a command still on its way.
+    for (size_t n = 0; n < full.size(); n++) {
+        EXPECT_EQ(parseCommand(string_view(full).substr(0, n), consumed, argv),
+                  ParseStatus::Incomplete)
+            << n;
+    }
+    EXPECT_EQ(parseCommand("GET key", consumed, argv), ParseStatus::Incomplete);
+}
+
+TEST(Resp, RejectsMalformedInput){
+    size_t consumed = 0;
+    vector<string> argv;
+    for (string_view bad : {
+             "*x\r\n",
+             "*-1\r\n",
+             "*1\r\n:3\r\n",
+             "*1\r\n$-2\r\n",
+             "*1\r\n$3x\r\nGET\r\n",
+             // A bulk string must end right after its length.
+             "*1\r\n$3\r\nGETX\r\n",
+             "*2\r\n$3\r\nGET\n\n$1\r\nk\r\n",
+         }) {
+        EXPECT_EQ(parseCommand(bad, consumed, argv), ParseStatus::Error)
+            << bad;
+    }
+}
+
+TEST(Resp, SplitsPipelinedCommands){
+    string input = "*1\r\n$4\r\nPING\r\nECHO hi\r\n*2\r\n$3\r\nGET\r\n$1\r\nk";
+    vector<vector<string>> commands;
+    size_t offset = 0;
+    while (true) {
+        size_t consumed = 0;
+        vector<string> argv;
+        auto status =
+            parseCommand(string_view(input).substr(offset), consumed, argv);
+        if (status != ParseStatus::Ok) {
+            EXPECT_EQ(status, ParseStatus::Incomplete);
+            break;
+        }
+        commands.push_back(argv);
+        offset += consumed;
+    }
+    ASSERT_EQ(commands.size(), 2u);
+    EXPECT_EQ(commands[0], (vector<string>{"PING"}));
+    EXPECT_EQ(commands[1], (vector<string>{"ECHO", "hi"}));
+    // The rest completes once its last bytes arrive.
+    input += "\r\n";
+    size_t consumed = 0;
+    vector<string> argv;
+    ASSERT_EQ(parseCommand(string_view(input).substr(offset), consumed, argv),
+              ParseStatus::Ok);
+    EXPECT_EQ(argv, (vector<string>{"GET", "k"}));
+    EXPECT_EQ(offset + consumed, input.size());
+}
+
+TEST(Executor, RunsJobsChunkByChunk){
+    Executor executor(2);
+    atomic<int> chunks{0};
+    atomic<int> finished{0};
+    for (int j = 0; j < 10; j++) {
+        executor.submit([&, left = 20]() mutable {
+            chunks++;
+            if (--left > 0) {
+                return true;
+            }
+            finished++;
+            return false;
+        });
+    }
+    ASSERT_TRUE(eventually([&] { return finished == 10; }));
+    EXPECT_EQ(chunks.load(), 200);
+}
+
+TEST(Executor, IdleWorkersSteal){
+    Executor executor(2);
+    atomic<bool> release{false};
+    atomic<int> stolen{0};
+    // Jobs go to the workers in turn: the first blocks worker 0, so the
+    // third and fifth, queued behind it, only run if worker 1 takes them.
+    executor.submit([&] {
+        while (!release) {
+            this_thread::yield();
+        }
+        return false;
+    });
+    for (int j = 0; j < 4; j++) {
+        executor.submit([&] {
+            stolen++;
+            return false;
+        });
+    }
+    EXPECT_TRUE(eventually([&] { return stolen == 4; }));
+    release = true;
+}
+
+TEST(Executor, PauseHoldsWorkersBetweenChunks){
+    Executor executor(2);
+    atomic<bool> stop{false};
+    atomic<int> chunks{0};
+    for (int j = 0; j < 3; j++) {
+        executor.submit([&] {
+            chunks++;
+            return !stop;
+        });
+    }
+    ASSERT_TRUE(eventually([&] { return chunks > 100; }));
+    executor.pause();
+    auto paused = chunks.load();
+    this_thread::sleep_for(chrono::milliseconds(50));
+    EXPECT_EQ(chunks.load(), paused);
+    executor.resume();
+    EXPECT_TRUE(eventually([&] { return chunks > paused + 100; }));
+    stop = true;
+}
+
+TEST(Server, PointCommands){
+    ServerProcess server;
+    EXPECT_EQ(server.call({"PING"}), "+PONG\r\n");
+    EXPECT_EQ(server.call({"SET", "k", "v"}), "+OK\r\n");
+    EXPECT_EQ(server.call({"GET", "k"}), "$1\r\nv\r\n");
+    EXPECT_EQ(server.call({"GET", "missing"}), "$-1\r\n");
+    EXPECT_EQ(server.call({"DBSIZE"}), ":1\r\n");
+    EXPECT_EQ(server.call({"DEL", "k", "missing"}), ":1\r\n");
+    EXPECT_EQ(server.call({"GET"}).substr(0, 4), "-ERR");
+    EXPECT_EQ(server.call({"NOPE"}).substr(0, 4), "-ERR");
+    // Pipelined, inline and array commands in one write.
+    server.send("SET a 1\r\n*2\r\n$3\r\nGET\r\n$1\r\na\r\nDEL a\r\n");
+    EXPECT_EQ(server.reply(), "+OK\r\n");
+    EXPECT_EQ(server.reply(), "$1\r\n1\r\n");
+    EXPECT_EQ(server.reply(), ":1\r\n");
+    // A bulk string without its CRLF ends the connection.
+    server.send("*2\r\n$3\r\nGET\r\n$1\r\nkX\r\nPING\r\n");
+    EXPECT_EQ(server.reply(), "-ERR Protocol error\r\n");
+    EXPECT_EQ(server.reply(), "");
+}
+
+TEST(Server, SharedMemoryChannel){
+    Config config;
+    config.shm_socket =
+        testing::TempDir() + "artikv_shm_" + to_string(getpid()) + ".sock";
+    ServerProcess server(config);
+    // Once the loop answers, the channel socket is listening too.
+    ASSERT_EQ(server.call({"PING"}), "+PONG\r\n");
+    auto text = [](optional<span<const uint8_t>> v) {
+        return v ? string(v->begin(), v->end()) : string("<none>");
+    };
+    for (unsigned spins : {0u, 1000u}) {
+        ShmClient client(config.shm_socket, spins);
+        client.set("k", "v");
+        EXPECT_EQ(text(client.get("k")), "v");
+        EXPECT_TRUE(client.del("k"));
+        EXPECT_FALSE(client.del("k"));
+        EXPECT_EQ(text(client.get("k")), "<none>");
+        // Enough small requests to wrap both rings many times over.
+        for (int i = 0; i < 20000; i++) {
+            auto k = "key" + to_string(i % 500);
+            client.set(k, string(100, char('a' + i % 26)));
+            ASSERT_EQ(text(client.get(k)), string(100, char('a' + i % 26)));
+        }
+        // The server blocks while the client is quiet and wakes for it.
+        this_thread::sleep_for(chrono::milliseconds(300));
+        EXPECT_EQ(text(client.get("key1")).size(), 100u);
+    }
+
+    // Large values wrap the value buffer; those beyond the limit are refused
+    // without stalling the channel.
+    auto limit = ShmChannelLayout::MAX_VALUE;
+    for (size_t size : {size_t(1) << 20, limit, limit + 1, (size_t(7) << 19)}) {
+        EXPECT_EQ(server.call({"SET", "big" + to_string(size),
+                               string(size, 'x')}),
+                  "+OK\r\n");
+    }
+    ShmClient client(config.shm_socket);
+    mt19937 rng(3);
+    for (int i = 0; i < 50; i++) {
+        size_t size = i % 2 ? limit : size_t(1) << 20;
+        auto v = client.get("big" + to_string(size));
+        ASSERT_TRUE(v);
+        ASSERT_EQ(v->size(), size);
+        if (rng() % 4 == 0) {
+            EXPECT_THROW(client.get("big" + to_string(limit + 1)),
+                         runtime_error);
+            EXPECT_THROW(client.get("big" + to_string(size_t(7) << 19)),
+                         runtime_error);
+        }
+    }
+    EXPECT_EQ(text(client.get("key2")).size(), 100u);
+
+    // The channel serves strings only.
+    EXPECT_EQ(server.call({"HSET", "hash", "f", "v"}), ":1\r\n");
+    EXPECT_THROW(client.get("hash"), runtime_error);
+    EXPECT_THROW(client.set("\xFFhash", "v"), runtime_error);
+    EXPECT_TRUE(client.del("hash"));
+    EXPECT_EQ(server.call({"TYPE", "hash"}), "+none\r\n");
+    unlink(config.shm_socket.c_str());
+}
+
+TEST(Server, BusyPollLeavesRoomForSockets){
+    Config config;
+    config.shm_socket =
+        testing::TempDir() + "artikv_poll_" + to_string(getpid()) + ".sock";
+    config.shm_busy_poll_us = 200000;
+    ServerProcess server(config);
+    ASSERT_EQ(server.call({"PING"}), "+PONG\r\n");
+    // Steady shared-memory traffic for longer than the socket waits.
+    atomic<bool> stop{false};
+    thread busy([&] {
+        ShmClient client(config.shm_socket, 1000);
+        for (int i = 0; !stop.load(); i++) {
+            client.set("busy" + to_string(i % 100), "v");
+        }
+    });
+    this_thread::sleep_for(chrono::milliseconds(100));
+    for (int i = 0; i < 5; i++) {
+        auto start = chrono::steady_clock::now();
+        EXPECT_EQ(server.call({"PING"}), "+PONG\r\n");
+        EXPECT_LT(chrono::steady_clock::now() - start, chrono::seconds(1));
+    }
+    stop = true;
+    busy.join();
+    unlink(config.shm_socket.c_str());
+}
+
+TEST(Server, OffloadedScansFollowTheProtocol){
+    ServerProcess server;
+    string sets;
+    for (int i = 0; i < 3000; i++) {
+        sets += "SET k" + to_string(10000 + i) + " v" + to_string(i) + "\r\n";
+    }
+    server.send(sets);
+    for (int i = 0; i < 3000; i++) {
+        ASSERT_EQ(server.reply(), "+OK\r\n");
+    }
+    // RESP2 gets the length up front.
+    auto reply = server.call({"SCAN", "k", "2500"});
+    ASSERT_EQ(reply.substr(0, 7), "*5000\r\n");
+    auto items = elements(reply);
+    ASSERT_EQ(items.size(), 5000u);
+    EXPECT_EQ(items[0], "k10000");
+    EXPECT_EQ(items[4999], "v2499");
+
+    EXPECT_EQ(server.call({"HELLO", "4"}).substr(0, 8), "-NOPROTO");
+    EXPECT_EQ(server.call({"HELLO", "3"}),
+              "%2\r\n$6\r\nserver\r\n$6\r\nartikv\r\n"
+              "$5\r\nproto\r\n:3\r\n");
+    reply = server.call({"SCAN", "k10500", "5000"});
+    ASSERT_EQ(reply.substr(0, 4), "*?\r\n");
+    EXPECT_EQ(reply.substr(reply.size() - 3), ".\r\n");
+    items = elements(reply);
+    ASSERT_EQ(items.size(), 5000u);
+    EXPECT_EQ(items[0], "k10500");
+    EXPECT_EQ(items[4998], "k12999");
+    // Small scans stay on the loop.
+    EXPECT_EQ(server.call({"SCAN", "k12998", "10"}),
+              "*4\r\n$6\r\nk12998\r\n$5\r\nv2998\r\n"
+              "$6\r\nk12999\r\n$5\r\nv2999\r\n");
+    EXPECT_EQ(server.call({"HELLO", "2"}).substr(0, 4), "*4\r\n");
+
+    EXPECT_EQ(server.call({"DELPREFIX", "k11"}), ":1000\r\n");
+    EXPECT_EQ(server.call({"DELPREFIX", "k11"}), ":0\r\n");
+    EXPECT_EQ(server.call({"COUNTPREFIX", "k1"}), ":2000\r\n");
+    EXPECT_EQ(server.call({"DBSIZE"}), ":2000\r\n");
+    EXPECT_EQ(server.call({"GET", "k10999"}), "$4\r\nv999\r\n");
+    EXPECT_EQ(server.call({"GET", "k11000"}), "$-1\r\n");
+}
+
+TEST(Server, SlowClientDoesNotHoldWorkers){
+    Config config;
+    config.scan_threads = 1;
+    ServerProcess server(config);
+    string value(16 << 10, 'x');
+    for (int i = 0; i < 2000; i++) {
+        ASSERT_EQ(server.call({"SET", "big" + to_string(10000 + i), value}),
+                  "+OK\r\n");
+    }
+    // 32 MiB of streamed reply the client does not read for now.
+    ASSERT_EQ(server.call({"HELLO", "3"}).substr(0, 4), "%2\r\n");
+    server.send("*3\r\n$4\r\nSCAN\r\n$3\r\nbig\r\n$4\r\n2000\r\n");
+    this_thread::sleep_for(chrono::milliseconds(200));
+    // The scan waits for its client off the pool; other connections still
+    // get both the loop and the only worker.
+    Client other(server.port);
+    EXPECT_EQ(other.call({"PING"}), "+PONG\r\n");
+    EXPECT_EQ(other.call({"COUNTPREFIX", "big"}), ":2000\r\n");
+    auto items = elements(server.reply());
+    ASSERT_EQ(items.size(), 4000u);
+    EXPECT_EQ(items[3998], "big11999");
+    EXPECT_EQ(items[3999], value);
+    EXPECT_EQ(server.call({"PING"}), "+PONG\r\n");
+}
+
+TEST(Server, CollectionsShareTheKeyspaceAndCheckpoint){
+    Config config;
+    config.dir = testing::TempDir();
+    config.dbfilename = "artikv_keyspace_" + to_string(getpid()) + ".akv";
+    filesystem::remove(config.checkpointPath());
+    string wrong = "-WRONGTYPE";
+    {
+        ServerProcess server(config);
+        EXPECT_EQ(server.call({"SET", "s", "v"}), "+OK\r\n");
+        EXPECT_EQ(server.call({"HSET", "h", "f", "v"}), ":1\r\n");
+        EXPECT_EQ(server.call({"SADD", "st", "m"}), ":1\r\n");
+        EXPECT_EQ(server.call({"RPUSH", "l", "a", "b"}), ":2\r\n");
+        EXPECT_EQ(server.call({"HSET", "s", "f", "v"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"SADD", "h", "x"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"LPUSH", "st", "x"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"GET", "l"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"TYPE", "h"}), "+hash\r\n");
+        EXPECT_EQ(server.call({"TYPE", "s"}), "+string\r\n");
+        EXPECT_EQ(server.call({"DBSIZE"}), ":4\r\n");
+        EXPECT_EQ(server.call({"HSET", "h", "g", "w"}), ":1\r\n");
+        EXPECT_EQ(server.call({"DBSIZE"}), ":4\r\n");
+        EXPECT_NE(server.call({"INFO"}).find("\r\nkeys:4\r\n"), string::npos);
+        // The collections' own tree keys are out of reach of string commands.
+        EXPECT_EQ(server.call({"SET", "\xFFh", "x"}).substr(0, 4), "-ERR");
+        EXPECT_EQ(server.call({"GET", string("\xFFh\0\0", 4)}), "$-1\r\n");
+        EXPECT_EQ(server.call({"SCAN", "", "100"}),
+                  "*2\r\n$1\r\ns\r\n$1\r\nv\r\n");
+        EXPECT_EQ(server.call({"COUNTPREFIX", ""}), ":1\r\n");
+        // SET replaces a value of another type; DEL counts each key once.
+        EXPECT_EQ(server.call({"SET", "h", "now a string"}), "+OK\r\n");
+        EXPECT_EQ(server.call({"HLEN", "h"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"DBSIZE"}), ":4\r\n");
+        EXPECT_EQ(server.call({"DEL", "h", "st", "st"}), ":2\r\n");
+        EXPECT_EQ(server.call({"HSET", "h2", "f", "v2"}), ":1\r\n");
+        EXPECT_EQ(server.call({"DBSIZE"}), ":3\r\n");
+        EXPECT_EQ(server.call({"SAVE"}), "+OK\r\n");
+    }
+    ServerProcess server(config);
+    EXPECT_EQ(server.call({"DBSIZE"}), ":3\r\n");
+    EXPECT_EQ(server.call({"GET", "s"}), "$1\r\nv\r\n");
+    EXPECT_EQ(server.call({"HGET", "h2", "f"}), "$2\r\nv2\r\n");
+    EXPECT_EQ(server.call({"LRANGE", "l", "0", "-1"}),
+              "*2\r\n$1\r\na\r\n$1\r\nb\r\n");
+    EXPECT_EQ(server.call({"TYPE", "st"}), "+none\r\n");
+    // Removing every string leaves the collections.
+    EXPECT_EQ(server.call({"DELPREFIX", ""}), ":1\r\n");
+    EXPECT_EQ(server.call({"DBSIZE"}), ":2\r\n");
+    EXPECT_EQ(server.call({"HGET", "h2", "f"}), "$2\r\nv2\r\n");
+    filesystem::remove(config.checkpointPath());
+}
+
+TEST(Server, SortedSetsShareTheKeyspaceAndCheckpoint){
+    Config config;
+    config.dir = testing::TempDir();
+    config.dbfilename = "artikv_zsets_" + to_string(getpid()) + ".akv";
+    config.save_parts = 2;
+    filesystem::remove(config.checkpointPath());
+    string wrong = "-WRONGTYPE";
+    {
+        ServerProcess server(config);
+        EXPECT_EQ(server.call({"ZADD", "z", "2", "b", "1", "a", "3", "c"}),
+                  ":3\r\n");
+        EXPECT_EQ(server.call({"ZADD", "z", "0.5", "c"}), ":0\r\n");
+        EXPECT_EQ(server.call({"SET", "s", "v"}), "+OK\r\n");
+        EXPECT_EQ(server.call({"ZADD", "s", "1", "m"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"ZSCORE", "s", "m"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"HSET", "z", "f", "v"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"GET", "z"}).substr(0, 10), wrong);
+        EXPECT_EQ(server.call({"TYPE", "z"}), "+zset\r\n");
+        EXPECT_EQ(server.call({"DBSIZE"}), ":2\r\n");
+        EXPECT_EQ(server.call({"ZADD", "gone", "1", "m"}), ":1\r\n");
+        EXPECT_EQ(server.call({"DEL", "gone", "gone"}), ":1\r\n");
+        EXPECT_EQ(server.call({"ZCARD", "gone"}), ":0\r\n");
+        EXPECT_EQ(server.call({"ZADD", "empty", "1", "m"}), ":1\r\n");
+        EXPECT_EQ(server.call({"ZREM", "empty", "m", "m"}), ":1\r\n");
+        EXPECT_EQ(server.call({"TYPE", "empty"}), "+none\r\n");
+        EXPECT_EQ(server.call({"SAVE"}), "+OK\r\n");
+    }
+    ServerProcess server(config);
+    EXPECT_EQ(server.call({"DBSIZE"}), ":2\r\n");
+    EXPECT_EQ(server.call({"ZRANGE", "z", "0", "-1", "WITHSCORES"}),
+              "*6\r\n$1\r\nc\r\n$3\r\n0.5\r\n$1\r\na\r\n$1\r\n1\r\n"
+              "$1\r\nb\r\n$1\r\n2\r\n");
+    EXPECT_EQ(server.call({"ZRANK", "z", "b"}), ":2\r\n");
+    EXPECT_EQ(server.call({"ZSCORE", "z", "a"}), "$1\r\n1\r\n");
+    EXPECT_EQ(server.call({"ZADD", "s", "1", "m"}).substr(0, 10), wrong);
+    EXPECT_EQ(server.call({"SET", "z", "now a string"}), "+OK\r\n");
+    EXPECT_EQ(server.call({"ZCARD", "z"}).substr(0, 10), wrong);
+    EXPECT_EQ(server.call({"DBSIZE"}), ":2\r\n");
+    for (auto &entry : filesystem::directory_iterator(config.dir)) {
+        if (entry.path().filename().string().starts_with(config.dbfilename)) {
+            filesystem::remove(entry.path());
+        }
+    }
+}
@@ -1,8 +1,32 @@
+#include <algorithm>
+#include <cmath>
 #include <complex>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <set>
 #include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
 #include "gtest/gtest.h"
 #include "art.hpp"
+#include "artikv_c.h"
+#include "checkpoint.hpp"
+#include "collections.hpp"
+#include "combining.hpp"
+#include "frozen_trie.hpp"
+#include "hybrid.hpp"
+#include "key_compressor.hpp"
+#include "masstree.hpp"
+#include "node_arena.hpp"
+#include "shared_art.hpp"
+#include "sorted_set.hpp"
 #include "slice.hpp"
+#include "tid_index.hpp"
+#include "value_store.hpp"
 
 
 int main(int argc, char **argv) {
@@ -26,4 +50,1805 @@ TEST(Art, Add){
     art.insert(key, std::string("world"));
 
     art.search(key);
-}
\ No newline at end of file
+}
+
+static Slice key(const std::string &s) { return std::string_view(s); }
+
+static std::string get(ART &art, std::string_view key) {
+    auto value = art.search(key);
+    if (!value) {
+        return "<none>";
+    }
+    return std::string(value->begin(), value->end());
+}
+
+TEST(Art, InsertSearchRemove){
+    auto art = ART();
+    art.insert(std::string_view("a"), std::string("1"));
+    art.insert(std::string_view("ab"), std::string("2"));
+    art.insert(std::string_view("abc"), std::string("3"));
+    art.insert(std::string_view("abd"), std::string("4"));
+    art.insert(std::string_view("b"), std::string("5"));
+    EXPECT_EQ(art.size(), 5);
+    EXPECT_EQ(get(art, "a"), "1");
+    EXPECT_EQ(get(art, "ab"), "2");
+    EXPECT_EQ(get(art, "abc"), "3");
+    EXPECT_EQ(get(art, "abd"), "4");
+    EXPECT_EQ(get(art, "b"), "5");
+    EXPECT_EQ(get(art, "abe"), "<none>");
+    EXPECT_EQ(get(art, ""), "<none>");
+
+    art.insert(std::string_view("ab"), std::string("22"));
+    EXPECT_EQ(art.size(), 5);
+    EXPECT_EQ(get(art, "ab"), "22");
+
+    art.remove(std::string_view("ab"));
+    art.remove(std::string_view("missing"));
+    EXPECT_EQ(art.size(), 4);
+    EXPECT_EQ(get(art, "ab"), "<none>");
+    EXPECT_EQ(get(art, "abc"), "3");
+    art.remove(std::string_view("abc"));
+    art.remove(std::string_view("abd"));
+    EXPECT_EQ(get(art, "a"), "1");
+    EXPECT_EQ(get(art, "b"), "5");
+    EXPECT_EQ(art.size(), 2);
+}
+
+TEST(Art, LongPrefixSplit){
+    auto art = ART();
+    std::string base(40, 'x');
+    art.insert(key(base + "1"), std::string("1"));
+    art.insert(key(base + "2"), std::string("2"));
+    auto fork = base.substr(0, 25) + "y";
+    art.insert(key(fork), std::string("3"));
+    art.insert(key(base.substr(0, 30)), std::string("4"));
+    EXPECT_EQ(get(art, base + "1"), "1");
+    EXPECT_EQ(get(art, base + "2"), "2");
+    EXPECT_EQ(get(art, fork), "3");
+    EXPECT_EQ(get(art, base.substr(0, 30)), "4");
+    EXPECT_EQ(get(art, base.substr(0, 29) + "z"), "<none>");
+    art.remove(key(fork));
+    art.remove(key(base + "1"));
+    EXPECT_EQ(get(art, base + "2"), "2");
+    EXPECT_EQ(get(art, base.substr(0, 30)), "4");
+}
+
+TEST(Art, GrowAndShrink){
+    auto art = ART();
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5000; i++) {
+        keys.push_back(std::to_string(i * 7919 % 5000) + "-" + std::to_string(i));
+    }
+    for (auto &k : keys) {
+        art.insert(key(k), std::string(k));
+    }
+    EXPECT_EQ(art.size(), keys.size());
+    for (auto &k : keys) {
+        ASSERT_EQ(get(art, k), k);
+    }
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        art.remove(key(keys[i]));
+    }
+    EXPECT_EQ(art.size(), keys.size() / 2);
+    for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQ(get(art, keys[i]), i % 2 ? keys[i] : "<none>");
+    }
+    for (size_t i = 1; i < keys.size(); i += 2) {
+        art.remove(key(keys[i]));
+    }
+    EXPECT_EQ(art.size(), 0);
+}
+
+TEST(Art, ConcurrentReadersNeverMissStableKeys){
+    auto art = ART();
+    constexpr int STABLE = 2000;
+    for (int i = 0; i < STABLE; i++) {
+        art.insert(key("s" + std::to_string(i)), std::to_string(i));
+    }
+    std::atomic<bool> stop{false};
+    std::atomic<int> misses{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < 5; round++) {
+                for (int i = 0; i < 500; i++) {
+                    auto k = "s" + std::to_string(i) + "-w" + std::to_string(t);
+                    art.insert(key(k), std::string("v"));
+                }
+                for (int i = 0; i < 500; i++) {
+                    art.remove(key("s" + std::to_string(i) + "-w" + std::to_string(t)));
+                }
+            }
+        });
+    }
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&] {
+            while (!stop.load()) {
+                for (int i = 0; i < STABLE; i++) {
+                    auto v = art.search(key("s" + std::to_string(i)));
+                    if (!v || std::string(v->begin(), v->end()) != std::to_string(i)) {
+                        misses++;
+                    }
+                }
+            }
+        });
+    }
+    for (int t = 0; t < 4; t++) {
+        threads[t].join();
+    }
+    stop = true;
+    for (size_t t = 4; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    EXPECT_EQ(misses.load(), 0);
+    EXPECT_EQ(art.size(), STABLE);
+}
+
+TEST(CombiningWriter, HotPrefixWriters){
+    auto art = ART();
+    CombiningWriter writer(art);
+    constexpr int THREADS = 4, PER_THREAD = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < PER_THREAD; i++) {
+                auto k = "ts" + std::to_string(i * THREADS + t);
+                writer.insert(key(k), std::string(k));
+                if (i % 4 == 0) {
+                    writer.remove(key(k));
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(art.size(), THREADS * PER_THREAD * 3 / 4);
+    for (int i = 0; i < THREADS * PER_THREAD; i++) {
+        auto k = "ts" + std::to_string(i);
+        ASSERT_EQ(get(art, k), (i / THREADS) % 4 == 0 ? "<none>" : k);
+    }
+}
+
+TEST(CombiningWriter, FailedWriteThrowsOnItsOwnThread){
+    auto art = ART();
+    CombiningWriter writer(art);
+    // Claims more than 4 GiB; the tree rejects it before reading any byte
+    // past the short prefix the batch sort may compare.
+    const uint8_t bytes[16] = {'t', 's'};
+    Slice huge(bytes, std::ptrdiff_t(UINT32_MAX) + 1);
+    EXPECT_THROW(writer.insert(huge, std::string("v")), std::length_error);
+    constexpr int THREADS = 4, PER_THREAD = 2000;
+    std::atomic<int> thrown{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < PER_THREAD; i++) {
+                auto k = "ts" + std::to_string(i * THREADS + t);
+                writer.insert(key(k), std::string(k));
+                if (t == 0 && i % 16 == 0) {
+                    try {
+                        writer.insert(huge, std::string("v"));
+                    } catch (const std::length_error &) {
+                        thrown++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(thrown.load(), PER_THREAD / 16);
+    EXPECT_EQ(art.size(), THREADS * PER_THREAD);
+    writer.remove(std::string_view("ts0"));
+    EXPECT_EQ(get(art, "ts0"), "<none>");
+}
+
+TEST(Art, FingerHints){
+    auto art = ART();
+    ART::Finger finger;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "log/2024/%08d", i);
+        keys.emplace_back(buf);
+    }
+    for (auto &k : keys) {
+        art.insert_hint(finger, key(k), std::string(k));
+    }
+    // The finger must stay correct across structural changes by others.
+    art.insert(std::string_view("log/2023"), std::string("old"));
+    art.remove(key(keys[10]));
+    for (auto &k : keys) {
+        auto v = art.search_hint(finger, key(k));
+        ASSERT_EQ(v ? std::string(v->begin(), v->end()) : "<none>",
+                  k == keys[10] ? "<none>" : k);
+    }
+    EXPECT_FALSE(art.search_hint(finger, std::string_view("log/2024/x")));
+    EXPECT_FALSE(art.search_hint(finger, std::string_view("a")));
+
+    std::vector<Slice> batch;
+    for (size_t i = 0; i < keys.size(); i += 100) {
+        batch.push_back(key(keys[i]));
+    }
+    auto results = art.search_batch(batch);
+    ASSERT_EQ(results.size(), batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        ASSERT_TRUE(results[i]);
+        EXPECT_EQ(std::string(results[i]->begin(), results[i]->end()),
+                  keys[i * 100]);
+    }
+    EXPECT_EQ(art.size(), keys.size());
+}
+
+TEST(Art, IteratorVisitsKeysInOrder){
+    auto art = ART();
+    EXPECT_FALSE(art.begin().valid());
+    std::vector<std::string> keys = {"", "a", "ab", "abc", "b", "ba", "zz"};
+    for (int i = 0; i < 300; i++) {
+        keys.push_back("n" + std::to_string(i));
+    }
+    for (auto it = keys.rbegin(); it != keys.rend(); ++it) {
+        art.insert(key(*it), std::string(*it));
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::string> seen;
+    for (auto it = art.begin(); it.valid(); it.next()) {
+        seen.emplace_back(it.key().begin(), it.key().end());
+        EXPECT_EQ(std::string(it.value().begin(), it.value().end()), seen.back());
+    }
+    EXPECT_EQ(seen, keys);
+}
+
+TEST(Art, IteratorNextBatchIsColumnar){
+    auto art = ART();
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 1000; i++) {
+        auto k = "c" + std::to_string(i);
+        expected[k] = std::string(i % 5, 'x') + k;
+        art.insert(key(k), std::string(expected[k]));
+    }
+    ART::KeyBatch keys;
+    ART::ValueBatch values;
+    auto it = art.begin();
+    EXPECT_EQ(it.next_batch(0, keys, values), 0);
+    EXPECT_EQ(keys.size(), 0);
+    auto want = expected.begin();
+    size_t total = 0;
+    while (auto n = it.next_batch(37, keys, values)) {
+        ASSERT_EQ(keys.size(), n);
+        ASSERT_EQ(values.size(), n);
+        ASSERT_EQ(keys.offsets.back(), keys.data.size());
+        for (size_t i = 0; i < n; i++, ++want) {
+            ASSERT_EQ(std::string(keys[i].begin(), keys[i].end()), want->first);
+            ASSERT_EQ(std::string(values[i].begin(), values[i].end()), want->second);
+        }
+        total += n;
+    }
+    EXPECT_EQ(total, 1000);
+    EXPECT_FALSE(it.valid());
+}
+
+TEST(Art, MinMaxAndPops){
+    auto art = ART();
+    EXPECT_FALSE(art.min());
+    EXPECT_FALSE(art.pop_max());
+    std::map<std::string, std::string> expected;
+    std::mt19937 rng(7);
+    auto add = [&](const std::string &k) {
+        expected[k] = "v" + k;
+        art.insert(key(k), std::string(expected[k]));
+    };
+    for (int i = 0; i < 256; i++) {
+        add(std::string("w") + char(i));
+    }
+    add("");
+    add("w");
+    for (int i = 0; i < 2000; i++) {
+        add("t" + std::to_string(rng() % 100000));
+    }
+    auto str = [](const ARTData &d) { return std::string(d.begin(), d.end()); };
+    for (bool low = true; !expected.empty(); low = !low) {
+        auto [min_key, min_val] = *art.min();
+        auto [max_key, max_val] = *art.max();
+        ASSERT_EQ(str(min_key), expected.begin()->first);
+        ASSERT_EQ(str(max_key), expected.rbegin()->first);
+        ASSERT_EQ(str(max_val), expected.rbegin()->second);
+        auto popped = low ? art.pop_min() : art.pop_max();
+        auto want = low ? expected.begin() : std::prev(expected.end());
+        ASSERT_EQ(str(popped->first), want->first);
+        ASSERT_EQ(str(popped->second), want->second);
+        expected.erase(want);
+        ASSERT_EQ(art.size(), expected.size());
+    }
+    EXPECT_FALSE(art.pop_min());
+}
+
+TEST(Art, ConcurrentPopsTakeEachKeyOnce){
+    auto art = ART();
+    const int total = 20000;
+    for (int i = 0; i < total; i++) {
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), "job%08d", i);
+        art.insert(key(buf), std::string(buf));
+    }
+    std::vector<std::vector<std::string>> popped(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < popped.size(); t++) {
+        threads.emplace_back([&, t] {
+            while (auto kv = t % 2 ? art.pop_max() : art.pop_min()) {
+                popped[t].emplace_back(kv->first.begin(), kv->first.end());
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    std::vector<std::string> all;
+    for (size_t t = 0; t < popped.size(); t++) {
+        // With nothing inserted meanwhile, each thread drains its end in order.
+        auto &p = popped[t];
+        if (t % 2) {
+            EXPECT_TRUE(std::is_sorted(p.rbegin(), p.rend()));
+        } else {
+            EXPECT_TRUE(std::is_sorted(p.begin(), p.end()));
+        }
+        all.insert(all.end(), p.begin(), p.end());
+    }
+    std::sort(all.begin(), all.end());
+    ASSERT_EQ(all.size(), size_t(total));
+    EXPECT_EQ(std::adjacent_find(all.begin(), all.end()), all.end());
+    EXPECT_EQ(art.size(), 0);
+}
+
+TEST(Art, Node48SlotsSurviveChurn){
+    auto art = ART();
+    // Enough fixed children to keep the node a Node48 throughout.
+    for (int b = 0; b < 20; b++) {
+        art.insert(key(std::string("p") + char(0x80 + b)), std::string("x"));
+    }
+    std::atomic<bool> stop{false};
+    std::atomic<int> lost{0};
+    auto churn = [&](std::string k) {
+        while (!stop.load()) {
+            art.insert(key(k), std::string("c"));
+            art.remove(key(k));
+        }
+    };
+    std::thread b(churn, "pB");
+    std::thread c(churn, "pC");
+    // Inserts below byte B race with B's removal and C taking a slot.
+    for (int i = 0; i < 20000; i++) {
+        auto k = "pB" + std::to_string(i);
+        art.insert(key(k), std::string(k));
+        auto v = art.search(key(k));
+        if (!v || std::string(v->begin(), v->end()) != k) {
+            lost++;
+        }
+        art.remove(key(k));
+    }
+    stop = true;
+    b.join();
+    c.join();
+    EXPECT_EQ(lost.load(), 0);
+    size_t visited = 0;
+    for (auto it = art.begin(); it.valid(); it.next()) {
+        EXPECT_TRUE(art.search(key(std::string(it.key().begin(),
+                                               it.key().end()))));
+        visited++;
+    }
+    EXPECT_EQ(visited, art.size());
+    EXPECT_EQ(art.size(), 20u);
+}
+
+TEST(Art, OverwritesInPlace){
+    auto art = ART();
+    art.insert(std::string_view("counter"), std::string(16, 'a'));
+    auto *bytes = art.search(std::string_view("counter"))->data();
+    art.insert(std::string_view("counter"), std::string(16, 'b'));
+    art.insert(std::string_view("counter"), std::string(3, 'c'));
+    EXPECT_EQ(art.search(std::string_view("counter"))->data(), bytes);
+    EXPECT_EQ(get(art, "counter"), "ccc");
+    art.insert(std::string_view("counter"), std::string(40, 'd'));
+    EXPECT_NE(art.search(std::string_view("counter"))->data(), bytes);
+    EXPECT_EQ(get(art, "counter"), std::string(40, 'd'));
+    EXPECT_EQ(art.size(), 1);
+
+    art.set_value_slack(32);
+    art.insert(std::string_view("status"), std::string("ok"));
+    bytes = art.search(std::string_view("status"))->data();
+    art.insert(std::string_view("status"), std::string(30, 'x'));
+    EXPECT_EQ(art.search(std::string_view("status"))->data(), bytes);
+    uint8_t small[4];
+    EXPECT_EQ(art.read(std::string_view("status"), small), 30);
+    EXPECT_FALSE(art.read(std::string_view("missing")));
+
+    // A key that ends at an inner node, as a prefix of others.
+    art.insert(std::string_view("user"), std::string(8, 'u'));
+    art.insert(std::string_view("user:1"), std::string("1"));
+    art.insert(std::string_view("user:2"), std::string("2"));
+    bytes = art.search(std::string_view("user"))->data();
+    art.insert(std::string_view("user"), std::string(20, 'v'));
+    EXPECT_EQ(art.search(std::string_view("user"))->data(), bytes);
+    EXPECT_EQ(get(art, "user"), std::string(20, 'v'));
+    EXPECT_EQ(get(art, "user:1"), "1");
+    EXPECT_EQ(art.size(), 5);
+}
+
+TEST(Art, ReadersNeverSeeTornInPlaceValues){
+    auto art = ART();
+    art.insert(std::string_view("hot"), std::string(64, 'a'));
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    auto uniform = [](std::span<const uint8_t> v) {
+        return !v.empty() && std::count(v.begin(), v.end(), v[0]) == ptrdiff_t(v.size());
+    };
+    for (int t = 0; t < 2; t++) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                auto v = art.read(std::string_view("hot"));
+                if (!v || !uniform(*v)) {
+                    torn++;
+                }
+            }
+        });
+    }
+    readers.emplace_back([&] {
+        std::vector<Slice> batch{std::string_view("hot"), std::string_view("cold"),
+                                 std::string_view("hot")};
+        ART::ValueBatch values;
+        while (!stop.load()) {
+            auto found = art.read_batch(batch, values);
+            if (found != std::pmr::vector<bool>{true, false, true} ||
+                !uniform(values[0]) || !values[1].empty() || !uniform(values[2])) {
+                torn++;
+            }
+        }
+    });
+    for (int i = 0; i < 20000; i++) {
+        art.insert(std::string_view("hot"), std::string(i % 2 ? 64 : 48, char('a' + i % 26)));
+    }
+    stop = true;
+    for (auto &t : readers) {
+        t.join();
+    }
+    EXPECT_EQ(torn.load(), 0);
+}
+
+TEST(Art, LeafFingerprintsRejectMisses){
+    auto art = ART();
+    for (int i = 0; i < 5000; i++) {
+        art.insert(key("fp" + std::to_string(i)), std::to_string(i));
+    }
+    for (int i = 0; i < 5000; i++) {
+        ASSERT_EQ(get(art, "fp" + std::to_string(i)), std::to_string(i));
+        // Same path as a stored key up to its leaf, different key.
+        ASSERT_FALSE(art.search(key("fp" + std::to_string(i) + "x")));
+        ASSERT_FALSE(art.search(key("fp" + std::to_string(i + 5000))));
+    }
+    ASSERT_FALSE(art.search(std::string_view("fp")));
+
+#ifndef ARTIKV_COMPRESSED_REFS
+    LeafNode leaf(std::string_view("apple"), {}, 0,
+                  std::pmr::get_default_resource());
+    NodeRef ref(&leaf);
+    auto [node, tag] = ref.load_tagged();
+    EXPECT_EQ(node, &leaf);
+    EXPECT_NE(tag, 0);
+    EXPECT_EQ(tag, leaf.fingerprint);
+    ref.store(nullptr);
+    EXPECT_EQ(ref.load_tagged().first, nullptr);
+    EXPECT_EQ(ref.load_tagged().second, 0);
+#endif
+}
+
+TEST(Art, DeduplicatesLargeValues){
+    auto art = ART();
+    art.enable_dedup(32);
+    std::string blob(100, 'b');
+    std::string other(100, 'o');
+    for (int i = 0; i < 50; i++) {
+        art.insert(key("cfg" + std::to_string(i)), std::string(blob));
+    }
+    art.insert(std::string_view("small1"), std::string("tiny"));
+    art.insert(std::string_view("small2"), std::string("tiny"));
+    auto *store = art.value_store();
+    ASSERT_NE(store, nullptr);
+    EXPECT_EQ(store->size(), 1);
+    EXPECT_EQ(store->bytes(), 100);
+    EXPECT_EQ(get(art, "cfg7"), blob);
+    EXPECT_EQ(art.search(std::string_view("cfg1"))->data(),
+              art.search(std::string_view("cfg2"))->data());
+
+    // Overwrites and removals move references; the epoch hands back those of
+    // replaced leaves once no reader can see them.
+    for (int i = 0; i < 10; i++) {
+        art.insert(key("cfg" + std::to_string(i)), std::string(other));
+    }
+    for (int i = 10; i < 20; i++) {
+        art.remove(key("cfg" + std::to_string(i)));
+    }
+    art.insert(std::string_view("cfg49"), std::string("now small"));
+    Epoch::global().synchronize();
+    EXPECT_EQ(store->size(), 2);
+    EXPECT_EQ(store->references(), 39);
+    EXPECT_EQ(get(art, "cfg3"), other);
+    EXPECT_EQ(get(art, "cfg30"), blob);
+    EXPECT_EQ(get(art, "cfg49"), "now small");
+    for (int i = 0; i < 10; i++) {
+        art.remove(key("cfg" + std::to_string(i)));
+    }
+    Epoch::global().synchronize();
+    EXPECT_EQ(store->size(), 1);
+    EXPECT_EQ(store->bytes(), 100);
+}
+
+TEST(Art, EvictsAndFaultsInSubtrees){
+    auto art = ART();
+    ART::EvictionOptions options;
+    options.path = testing::TempDir() + "artikv_eviction_test.pages";
+    options.max_resident = 500;
+    options.unit_depth = 6;
+    art.enable_eviction(options);
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 2000; i++) {
+        auto k = "user" + std::to_string(i * 7919 % 2000);
+        expected[k] = std::to_string(i);
+        art.insert(key(k), std::string(expected[k]));
+    }
+    EXPECT_EQ(art.size(), 2000);
+    EXPECT_LT(art.resident(), 1000);
+
+    // Every access path loads what it needs back in.
+    for (auto &[k, v] : expected) {
+        ASSERT_EQ(get(art, k), v);
+    }
+    EXPECT_GT(art.evict(8), 0);
+    {
+        auto it = art.begin();
+        for (auto &[k, v] : expected) {
+            ASSERT_TRUE(it.valid());
+            ASSERT_EQ(std::string(it.key().begin(), it.key().end()), k);
+            it.next();
+        }
+        EXPECT_FALSE(it.valid());
+    }
+    auto smallest = art.min()->first;
+    EXPECT_EQ(std::string(smallest.begin(), smallest.end()), "user0");
+    for (int i = 0; i < 2000; i += 3) {
+        auto k = "user" + std::to_string(i);
+        art.evict(2);
+        art.remove(key(k));
+        expected.erase(k);
+    }
+    EXPECT_EQ(art.size(), expected.size());
+
+    // Readers race the evictor.
+    std::vector<std::thread> readers;
+    std::atomic<bool> ok{true};
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&, t] {
+            int i = 0;
+            for (auto &[k, v] : expected) {
+                if (i++ % 4 != t) {
+                    continue;
+                }
+                auto value = art.read(key(k));
+                if (!value || std::string(value->begin(), value->end()) != v) {
+                    ok = false;
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 50; i++) {
+        art.evict(4);
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    EXPECT_TRUE(ok);
+}
+
+TEST(ValueStore, VerifiesHashCollisions){
+    ValueStore store(std::pmr::get_default_resource(),
+                     [](std::span<const uint8_t>) { return uint64_t(42); });
+    auto bytes = [](std::string_view s) {
+        return std::span(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+    };
+    auto *a = store.acquire(bytes("first value"));
+    auto *b = store.acquire(bytes("other value"));
+    auto *a2 = store.acquire(bytes("first value"));
+    EXPECT_NE(a, b);
+    EXPECT_EQ(a, a2);
+    EXPECT_EQ(store.size(), 2);
+    store.release(a);
+    store.release(a2);
+    EXPECT_EQ(store.size(), 1);
+    EXPECT_EQ(std::string(b->data(), b->data() + b->size), "other value");
+    store.release(b);
+    EXPECT_EQ(store.bytes(), 0);
+}
+
+TEST(Art, LowerBoundAndMerge){
+    auto art = ART();
+    auto other = ART();
+    for (int i = 0; i < 2000; i++) {
+        auto k = "m" + std::to_string(i);
+        (i % 2 ? art : other).insert(key(k), std::string(k));
+    }
+    // Overlapping keys: the other tree's value wins.
+    art.insert(std::string_view("m1"), std::string("old"));
+    other.insert(std::string_view("m1"), std::string("m1"));
+    other.insert(std::string_view("m"), std::string("m"));
+    art.merge(other);
+    EXPECT_EQ(art.size(), 2001);
+    EXPECT_EQ(other.size(), 0);
+    EXPECT_EQ(get(art, "m1"), "m1");
+    EXPECT_EQ(get(art, "m"), "m");
+    for (int i = 0; i < 2000; i++) {
+        ASSERT_EQ(get(art, "m" + std::to_string(i)), "m" + std::to_string(i));
+    }
+
+    auto it = art.lower_bound(std::string_view("m1999x"));
+    ASSERT_TRUE(it.valid());
+    EXPECT_EQ(std::string(it.key().begin(), it.key().end()), "m2");
+    EXPECT_FALSE(art.lower_bound(std::string_view("n")).valid());
+    auto first = art.lower_bound(std::string_view(""));
+    EXPECT_EQ(std::string(first.key().begin(), first.key().end()), "m");
+}
+
+TEST(Art, PmrArenaAndScan){
+#ifdef ARTIKV_COMPRESSED_REFS
+    GTEST_SKIP() << "compressed references need nodes from the node arena";
+#endif
+    std::pmr::unsynchronized_pool_resource pool;
+    {
+        ART art(&pool);
+        for (int i = 0; i < 3000; i++) {
+            art.insert(key("p" + std::to_string(i)), std::string("v") + std::to_string(i));
+        }
+        for (int i = 0; i < 3000; i += 3) {
+            art.remove(key("p" + std::to_string(i)));
+        }
+        art.insert(key("p1"), std::string("new"));
+        EXPECT_EQ(art.size(), 2000);
+        EXPECT_EQ(get(art, "p1"), "new");
+
+        // A per-request arena backs the whole scan result.
+        std::byte buffer[4096];
+        std::pmr::monotonic_buffer_resource scratch(buffer, sizeof(buffer));
+        auto rows = art.scan(std::string_view("p2"), 50, &scratch);
+        ASSERT_EQ(rows.size(), 50);
+        EXPECT_EQ(std::string(rows[0].first.begin(), rows[0].first.end()), "p2");
+        for (size_t i = 1; i < rows.size(); i++) {
+            ASSERT_TRUE(rows[i - 1].first < rows[i].first);
+            auto k = std::string(rows[i].first.begin(), rows[i].first.end());
+            ASSERT_EQ(std::string(rows[i].second.begin(), rows[i].second.end()),
+                      "v" + k.substr(1));
+        }
+        EXPECT_EQ(rows.get_allocator().resource(), &scratch);
+        EXPECT_TRUE(art.scan(std::string_view("q"), 10).empty());
+
+        // Trees on different resources merge by copying.
+        ART other;
+        other.insert(std::string_view("p1"), std::string("other"));
+        other.insert(std::string_view("z"), std::string("z"));
+        art.merge(other);
+        EXPECT_EQ(other.size(), 0);
+        EXPECT_EQ(art.size(), 2001);
+        EXPECT_EQ(get(art, "p1"), "other");
+        EXPECT_EQ(get(art, "z"), "z");
+    }
+    // The tree handed every node back before `pool` goes away.
+    pool.release();
+
+    // Destroying it from inside an epoch would wait on itself.
+    EXPECT_FALSE(Epoch::global().inside());
+    {
+        Epoch::Guard guard;
+        EXPECT_TRUE(Epoch::global().inside());
+#ifndef NDEBUG
+        EXPECT_DEATH({ ART doomed(&pool); }, "inside an epoch");
+#endif
+    }
+}
+
+TEST(NodeArena, KeepsBlocksInRange){
+    NodeArena arena(1 << 20);
+    std::vector<void *> blocks;
+    for (int i = 0; i < 1000; i++) {
+        auto *p = arena.allocate(48, 8);
+        ASSERT_TRUE(arena.contains(p));
+        auto offset = static_cast<std::byte *>(p) - arena.base();
+        ASSERT_GT(offset, 0);
+        ASSERT_EQ(offset % NodeArena::ALIGNMENT, 0);
+        blocks.push_back(p);
+    }
+    for (auto *p : blocks) {
+        arena.deallocate(p, 48, 8);
+    }
+    auto reserved = arena.reserved();
+    for (int i = 0; i < 1000; i++) {
+        blocks[i] = arena.allocate(48, 8);
+    }
+    EXPECT_EQ(arena.reserved(), reserved);
+    EXPECT_THROW(blocks.push_back(arena.allocate(2 << 20, 8)), std::bad_alloc);
+
+    ART art(&NodeArena::global());
+    for (int i = 0; i < 1000; i++) {
+        art.insert(key("n" + std::to_string(i)), std::to_string(i));
+    }
+    for (int i = 0; i < 1000; i += 7) {
+        ASSERT_EQ(get(art, "n" + std::to_string(i)), std::to_string(i));
+    }
+#ifdef ARTIKV_COMPRESSED_REFS
+    EXPECT_EQ(sizeof(NodeRef), 4);
+    NodeArena other(1 << 20);
+    EXPECT_THROW(ART tree(&other), std::invalid_argument);
+#endif
+}
+
+TEST(FrozenTrie, PacksSortedPairs){
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 3000; i++) {
+        expected["f" + std::to_string(i * 13)] = std::string(i % 4, 'v');
+    }
+    expected[""] = "empty key";
+    expected["f1"] = "prefix of f13";
+    std::vector<std::pair<ARTData, ARTData>> pairs;
+    for (auto &[k, v] : expected) {
+        pairs.emplace_back(ARTData(k.begin(), k.end()), ARTData(v.begin(), v.end()));
+    }
+    FrozenTrie trie(pairs);
+    EXPECT_EQ(trie.size(), expected.size());
+    for (auto &[k, v] : expected) {
+        auto value = trie.search(key(k));
+        ASSERT_TRUE(value) << k;
+        ASSERT_EQ(std::string(value->begin(), value->end()), v);
+    }
+    EXPECT_FALSE(trie.search(std::string_view("f")));
+    EXPECT_FALSE(trie.search(std::string_view("f14")));
+    EXPECT_FALSE(trie.search(std::string_view("f130x")));
+    auto it = expected.begin();
+    trie.for_each([&](std::span<const uint8_t> k, std::span<const uint8_t> v) {
+        ASSERT_NE(it, expected.end());
+        EXPECT_EQ(std::string(k.begin(), k.end()), it->first);
+        EXPECT_EQ(std::string(v.begin(), v.end()), it->second);
+        ++it;
+    });
+    EXPECT_EQ(it, expected.end());
+    EXPECT_FALSE(FrozenTrie().search(std::string_view("f1")));
+
+    // The builder takes pairs one at a time, in increasing key order only.
+    auto bytes = [](const std::string &s) {
+        return std::span(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+    };
+    auto text = [](std::optional<std::span<const uint8_t>> v) {
+        return v ? std::string(v->begin(), v->end()) : "<none>";
+    };
+    FrozenTrie::Builder builder;
+    for (auto &[k, v] : expected) {
+        builder.add(bytes(k), bytes(v));
+    }
+    EXPECT_THROW(builder.add(bytes("f1"), bytes("v")), std::invalid_argument);
+    auto streamed = builder.finish();
+    EXPECT_EQ(streamed.size(), expected.size());
+    EXPECT_EQ(streamed.bytes(), trie.bytes());
+    EXPECT_EQ(text(streamed.search(std::string_view("f1"))), "prefix of f13");
+    EXPECT_EQ(text(streamed.search(std::string_view(""))), "empty key");
+    FrozenTrie::Builder single;
+    single.add(bytes("only"), bytes("one"));
+    auto one = single.finish();
+    EXPECT_EQ(one.size(), 1);
+    EXPECT_EQ(text(one.search(std::string_view("only"))), "one");
+    EXPECT_FALSE(one.search(key("onl")));
+}
+
+TEST(Hybrid, MergesWritesIntoFrozenStage){
+    HybridIndex::Options options;
+    options.merge_threshold = 500;
+    HybridIndex index(options);
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 4000; i++) {
+        auto k = "h" + std::to_string(i * 7 % 4000);
+        expected[k] = std::to_string(i);
+        index.insert(key(k), std::string(expected[k]));
+        if (i % 5 == 0) {
+            auto gone = "h" + std::to_string(i / 2);
+            expected.erase(gone);
+            index.remove(key(gone));
+        }
+    }
+    EXPECT_GT(index.frozen_size(), 0);
+    EXPECT_LT(index.dynamic_size(), 1000);
+    auto check = [&] {
+        for (int i = 0; i < 4000; i++) {
+            auto k = "h" + std::to_string(i);
+            auto value = index.search(key(k));
+            auto found = expected.find(k);
+            if (found == expected.end()) {
+                ASSERT_FALSE(value) << k;
+            } else {
+                ASSERT_TRUE(value) << k;
+                ASSERT_EQ(std::string(value->begin(), value->end()), found->second);
+            }
+        }
+    };
+    check();
+    index.merge();
+    EXPECT_EQ(index.dynamic_size(), 0);
+    EXPECT_EQ(index.frozen_size(), expected.size());
+    check();
+
+    // Readers keep finding stable keys while writers force merges.
+    std::atomic<bool> ok{true};
+    std::atomic<bool> stop{false};
+    std::thread reader([&] {
+        while (!stop) {
+            for (auto &[k, v] : expected) {
+                auto value = index.search(key(k));
+                if (!value || std::string(value->begin(), value->end()) != v) {
+                    ok = false;
+                }
+            }
+        }
+    });
+    for (int i = 0; i < 3000; i++) {
+        index.insert(key("new" + std::to_string(i)), std::string("n"));
+    }
+    stop = true;
+    reader.join();
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(index.search(std::string_view("new2999")), ARTData{'n'});
+}
+
+TEST(KeyCompressor, PreservesOrderAndShrinksKeys){
+    std::vector<std::string> urls;
+    for (int i = 0; i < 3000; i++) {
+        urls.push_back("https://www.example.com/products/item" +
+                       std::to_string(i * 37 % 3000) + "/reviews");
+    }
+    std::vector<Slice> sample;
+    for (size_t i = 0; i < urls.size(); i += 3) {
+        sample.push_back(key(urls[i]));
+    }
+    auto compressor = std::make_shared<const KeyCompressor>(sample);
+    EXPECT_GT(compressor->intervals(), 256);
+
+    std::vector<std::string> keys = urls;
+    keys.push_back("");
+    keys.push_back("z");
+    keys.push_back(std::string("\0\xff\xff", 3));
+    keys.push_back(std::string("\xff\xff", 2));
+    keys.push_back("https://www.example.com/products/item");
+    size_t plain = 0, encoded = 0;
+    std::map<std::vector<uint8_t>, std::string> codes;
+    for (auto &k : keys) {
+        std::vector<uint8_t> code;
+        compressor->encode(key(k), code);
+        std::string decoded;
+        compressor->decode(code, decoded);
+        ASSERT_EQ(decoded, k);
+        plain += k.size();
+        encoded += code.size();
+        codes[code] = k;
+    }
+    EXPECT_LT(encoded * 2, plain);
+    // Encoded keys sort like the keys themselves.
+    std::vector<std::string> sorted(keys.begin(), keys.end());
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    ASSERT_EQ(codes.size(), sorted.size());
+    auto it = sorted.begin();
+    for (auto &[code, k] : codes) {
+        EXPECT_EQ(k, *it++);
+    }
+
+    ART art;
+    art.enable_key_compression(compressor);
+    for (auto &url : urls) {
+        art.insert(key(url), std::string(url.substr(24)));
+    }
+    EXPECT_EQ(art.size(), urls.size());
+    EXPECT_EQ(get(art, urls[5]), urls[5].substr(24));
+    EXPECT_FALSE(art.search(std::string_view("https://www.example.com/")));
+    std::sort(urls.begin(), urls.end());
+    size_t i = 0;
+    for (auto it = art.begin(); it.valid(); it.next(), i++) {
+        ASSERT_EQ(std::string(it.key().begin(), it.key().end()), urls[i]);
+    }
+    EXPECT_EQ(i, urls.size());
+    auto entries = art.scan(key(urls[100]), 2);
+    ASSERT_EQ(entries.size(), 2);
+    EXPECT_EQ(std::string(entries[1].first.begin(), entries[1].first.end()),
+              urls[101]);
+    auto first = art.pop_min();
+    ASSERT_TRUE(first);
+    EXPECT_EQ(std::string(first->first.begin(), first->first.end()), urls[0]);
+    art.remove(key(urls[1]));
+    EXPECT_FALSE(art.search(key(urls[1])));
+    auto smallest = art.min();
+    ASSERT_TRUE(smallest);
+    EXPECT_EQ(std::string(smallest->first.begin(), smallest->first.end()),
+              urls[2]);
+
+    // Merging into a tree without the compressor decodes the keys.
+    ART other;
+    other.merge(art);
+    EXPECT_EQ(art.size(), 0);
+    EXPECT_EQ(get(other, urls[7]), urls[7].substr(24));
+}
+
+TEST(TidIndex, LoadsKeysFromRecords){
+    // Records own the keys; the index only holds their positions.
+    std::vector<std::string> records;
+    TidIndex index([&](uint64_t tid, std::vector<uint8_t> &key) {
+        key.insert(key.end(), records[tid].begin(), records[tid].end());
+    });
+    std::map<std::string, uint64_t> expected;
+    for (int i = 0; i < 3000; i++) {
+        auto k = "customer/region-" + std::to_string(i % 7) + "/account/" +
+                 std::to_string(i * 13 % 3000);
+        if (i % 10 == 0) {
+            k.resize(k.size() - 1);
+        }
+        records.push_back(k);
+        auto old = index.insert(key(k), records.size() - 1);
+        EXPECT_EQ(old.has_value(), expected.count(k) == 1);
+        expected[k] = records.size() - 1;
+    }
+    EXPECT_EQ(index.size(), expected.size());
+    EXPECT_GT(index.bytes(), 0);
+    for (auto &[k, tid] : expected) {
+        ASSERT_EQ(index.search(key(k)), tid) << k;
+    }
+    EXPECT_FALSE(index.search(std::string_view("customer/region-1/account/")));
+    EXPECT_FALSE(index.search(std::string_view("customer/region-9/account/1")));
+
+    size_t n = 0;
+    for (auto it = expected.begin(); it != expected.end(); n++) {
+        if (n % 3 == 0) {
+            EXPECT_EQ(index.remove(key(it->first)), it->second);
+            it = expected.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    EXPECT_FALSE(index.remove(std::string_view("customer/")));
+    EXPECT_EQ(index.size(), expected.size());
+    for (auto &[k, tid] : expected) {
+        ASSERT_EQ(index.search(key(k)), tid) << k;
+    }
+
+    auto from = expected.lower_bound("customer/region-3/account/2");
+    auto tids = index.scan(std::string_view("customer/region-3/account/2"), 50);
+    ASSERT_EQ(tids.size(), 50);
+    for (auto tid : tids) {
+        EXPECT_EQ(tid, from->second);
+        ++from;
+    }
+    EXPECT_EQ(index.scan(std::string_view(""), SIZE_MAX).size(), expected.size());
+    EXPECT_TRUE(index.scan(std::string_view("d"), 10).empty());
+
+    for (auto &[k, tid] : expected) {
+        index.remove(key(k));
+    }
+    EXPECT_EQ(index.size(), 0);
+    EXPECT_EQ(index.bytes(), 0);
+    EXPECT_THROW(index.insert(std::string_view("k"), TidIndex::MAX_TID + 1),
+                 std::invalid_argument);
+}
+
+TEST(Art, RankCountsKeysBelow){
+    ART art;
+    art.enable_rank();
+    std::set<std::string> expected;
+    std::mt19937 rng(7);
+    auto check = [&] {
+        size_t i = 0;
+        for (auto &k : expected) {
+            ASSERT_EQ(art.rank(key(k)), i) << k;
+            auto it = art.seek_rank(i);
+            ASSERT_TRUE(it.valid());
+            ASSERT_EQ(std::string(it.key().begin(), it.key().end()), k);
+            i++;
+        }
+        EXPECT_FALSE(art.seek_rank(expected.size()).valid());
+        for (auto probe : {"", "k", "k5", "k50x", "k999999", "z"}) {
+            auto below = std::distance(expected.begin(),
+                                       expected.lower_bound(probe));
+            EXPECT_EQ(art.rank(std::string_view(probe)), size_t(below)) << probe;
+        }
+    };
+    for (int i = 0; i < 3000; i++) {
+        // Short numbers are prefixes of longer ones, so prefix leaves count.
+        auto k = "k" + std::to_string(rng() % 5000);
+        expected.insert(k);
+        art.insert(key(k), std::string("v"));
+    }
+    check();
+    for (int i = 0; i < 1500; i++) {
+        auto k = "k" + std::to_string(rng() % 5000);
+        expected.erase(k);
+        art.remove(key(k));
+    }
+    auto popped = art.pop_min();
+    ASSERT_TRUE(popped);
+    expected.erase(expected.begin());
+    check();
+}
+
+TEST(SortedSet, RanksAndRanges){
+    SortedSet set;
+    std::map<std::string, double> scores;
+    std::mt19937 rng(11);
+    for (int i = 0; i < 2000; i++) {
+        auto member = "player" + std::to_string(rng() % 1500);
+        double score = double(int(rng() % 400)) - 200;
+        EXPECT_EQ(set.add(key(member), score), scores.count(member) == 0);
+        scores[member] = score;
+        if (i % 7 == 0) {
+            auto gone = "player" + std::to_string(rng() % 1500);
+            EXPECT_EQ(set.remove(key(gone)), scores.erase(gone) == 1);
+        }
+    }
+    EXPECT_EQ(set.add(std::string_view("neg-zero"), -0.0), true);
+    scores["neg-zero"] = 0.0;
+    EXPECT_THROW(set.add(std::string_view("nan"), std::nan("")),
+                 std::invalid_argument);
+    ASSERT_EQ(set.size(), scores.size());
+
+    std::vector<std::pair<double, std::string>> order;
+    for (auto &[member, score] : scores) {
+        order.emplace_back(score, member);
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); i++) {
+        auto &[score, member] = order[i];
+        ASSERT_EQ(set.score(key(member)), score);
+        ASSERT_EQ(set.rank(key(member)), i) << member;
+    }
+    EXPECT_FALSE(set.rank(std::string_view("nobody")));
+
+    auto range = set.range(100, 109);
+    ASSERT_EQ(range.size(), 10);
+    for (size_t i = 0; i < range.size(); i++) {
+        EXPECT_EQ(std::string(range[i].first.begin(), range[i].first.end()),
+                  order[100 + i].second);
+        EXPECT_EQ(range[i].second, order[100 + i].first);
+    }
+    EXPECT_EQ(set.range(0, SIZE_MAX).size(), order.size());
+    EXPECT_TRUE(set.range(order.size(), order.size() + 5).empty());
+
+    auto first = std::lower_bound(order.begin(), order.end(),
+                                  std::make_pair(-10.0, std::string()));
+    auto last = std::upper_bound(order.begin(), order.end(),
+                                 std::make_pair(10.0, std::string("~")));
+    auto within = set.range_by_score(-10, 10);
+    ASSERT_EQ(within.size(), size_t(last - first));
+    auto page = set.range_by_score(-10, 10, 3, 5);
+    ASSERT_EQ(page.size(), 5);
+    for (size_t i = 0; i < page.size(); i++) {
+        EXPECT_EQ(std::string(page[i].first.begin(), page[i].first.end()),
+                  first[3 + i].second);
+    }
+    EXPECT_TRUE(set.range_by_score(1000, 2000).empty());
+}
+
+TEST(Art, RemovePrefixDropsSubtree){
+    for (bool ranked : {false, true}) {
+        ART art;
+        if (ranked) {
+            art.enable_rank();
+        }
+        std::map<std::string, std::string> expected;
+        std::mt19937 rng(5);
+        // Long shared paths put prefixes inside compressed node paths.
+        std::vector<std::string> groups = {"a",
+                                           "ab",
+                                           "abc",
+                                           "user:0000000000000000:",
+                                           "user:0000000000000001:",
+                                           "z"};
+        for (int i = 0; i < 4000; i++) {
+            auto k =
+                groups[rng() % groups.size()] + std::to_string(rng() % 300);
+            expected[k] = k;
+            art.insert(key(k), std::string(k));
+        }
+        auto check = [&](const std::string &prefix) {
+            size_t want = 0;
+            for (auto it = expected.lower_bound(prefix);
+                 it != expected.end() && it->first.starts_with(prefix);) {
+                it = expected.erase(it);
+                want++;
+            }
+            EXPECT_EQ(art.remove_prefix(std::string_view(prefix)), want)
+                << prefix;
+            ASSERT_EQ(art.size(), expected.size());
+            auto it = art.begin();
+            for (auto &[k, v] : expected) {
+                ASSERT_TRUE(it.valid());
+                ASSERT_EQ(std::string(it.key().begin(), it.key().end()), k);
+                it.next();
+            }
+            EXPECT_FALSE(it.valid());
+            if (ranked) {
+                size_t i = 0;
+                for (auto &[k, v] : expected) {
+                    ASSERT_EQ(art.rank(key(k)), i++) << k;
+                }
+            }
+        };
+        check("user:0000000000000001:");
+        check("user:00000");
+        check("abc12");
+        check("ab");
+        check("missing");
+        auto some = expected.begin()->first;
+        check(some);
+        check("");
+        EXPECT_EQ(art.size(), 0);
+        art.insert(key(some), std::string("back"));
+        EXPECT_EQ(art.size(), 1);
+    }
+}
+
+TEST(Art, DetachPrefixReleasesLater){
+    ART art;
+    for (int i = 0; i < 3000; i++) {
+        art.insert(key("user:" + std::to_string(i)), std::to_string(i));
+        art.insert(key("item:" + std::to_string(i)), std::to_string(i));
+    }
+    auto users = art.detach_prefix(std::string_view("user:"));
+    ASSERT_TRUE(users);
+    EXPECT_FALSE(art.search(key("user:7")));
+    EXPECT_TRUE(art.search(key("item:7")));
+    // Still counted until released, which another thread does.
+    EXPECT_EQ(art.size(), 6000);
+    size_t released = 0;
+    std::thread([&] { released = users.release(); }).join();
+    EXPECT_EQ(released, 3000);
+    EXPECT_FALSE(users);
+    EXPECT_EQ(art.size(), 3000);
+
+    EXPECT_FALSE(art.detach_prefix(std::string_view("user:")));
+    auto ones = art.detach_prefix(std::string_view("item:1"), 1111);
+    EXPECT_EQ(art.size(), 3000 - 1111);
+    EXPECT_EQ(ones.release(), 1111);
+    EXPECT_EQ(art.size(), 3000 - 1111);
+    {
+        auto dropped = art.detach_prefix(std::string_view("item:2"));
+    }
+    EXPECT_EQ(art.size(), 3000 - 2 * 1111);
+    EXPECT_TRUE(art.search(key("item:0")));
+
+    // A ranked tree knows the count as soon as the pairs are unlinked.
+    ART ranked;
+    ranked.enable_rank();
+    for (int i = 0; i < 1000; i++) {
+        ranked.insert(key("k" + std::to_string(i)), std::string("v"));
+    }
+    auto nines = ranked.detach_prefix(std::string_view("k9"));
+    EXPECT_EQ(ranked.size(), 889);
+    EXPECT_EQ(nines.release(), 111);
+    EXPECT_EQ(ranked.size(), 889);
+}
+
+TEST(Art, LearnedRootFollowsDrift){
+    ART art;
+    art.enable_learned_root(8);
+    auto id = [](uint64_t n) {
+        std::string k(8, '\0');
+        for (int i = 7; i >= 0; i--, n >>= 8) {
+            k[i] = char(n & 0xFF);
+        }
+        return k;
+    };
+    constexpr uint64_t CLUSTER = uint64_t(1) << 40;
+    constexpr uint64_t DRIFT = uint64_t(1) << 50;
+    // A monotonic range and a clustered one with gaps.
+    for (uint64_t i = 0; i < 50000; i++) {
+        art.insert(key(id(i)), std::to_string(i));
+    }
+    for (uint64_t i = 0; i < 20000; i++) {
+        art.insert(key(id(CLUSTER + 3 * i)), std::to_string(i));
+    }
+    EXPECT_GT(art.retrain_learned_root(), 0u);
+    auto check = [&](uint64_t n, std::optional<std::string> want) {
+        auto v = art.search(key(id(n)));
+        ASSERT_EQ(v.has_value(), want.has_value()) << n;
+        if (want) {
+            ASSERT_EQ(std::string(v->begin(), v->end()), *want) << n;
+        }
+    };
+    for (uint64_t i = 0; i < 20000; i++) {
+        check(CLUSTER + 3 * i, std::to_string(i));
+        check(CLUSTER + 3 * i + 1, std::nullopt);
+    }
+    check(CLUSTER - 1, std::nullopt);
+    check(DRIFT, std::nullopt);
+    EXPECT_FALSE(art.search(std::string_view("abc")));
+
+    // Keys move to a new range while readers keep finding the cluster.
+    std::atomic<bool> stop{false};
+    std::atomic<int> misses{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; t++) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                for (uint64_t i = 0; i < 20000; i += 7) {
+                    auto v = art.search(key(id(CLUSTER + 3 * i)));
+                    if (!v || std::string(v->begin(), v->end()) !=
+                                  std::to_string(i)) {
+                        misses++;
+                    }
+                }
+            }
+        });
+    }
+    for (uint64_t i = 0; i < 20000; i++) {
+        art.insert(key(id(DRIFT + i * 11)), std::to_string(i));
+        art.remove(key(id(i)));
+    }
+    stop = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(misses.load(), 0);
+    for (uint64_t i = 0; i < 50000; i++) {
+        check(i, i < 20000 ? std::nullopt
+                           : std::optional<std::string>(std::to_string(i)));
+    }
+    for (uint64_t i = 0; i < 20000; i++) {
+        check(DRIFT + i * 11, std::to_string(i));
+    }
+    EXPECT_GT(art.retrain_learned_root(), 0u);
+    EXPECT_THROW(art.enable_learned_root(9), std::invalid_argument);
+}
+
+TEST(Art, LearnedRootRepairsAnchorsFromWriters){
+    ART art;
+    art.enable_learned_root(8);
+    // Subtree `a` holds key `b` at the last byte.
+    auto id = [](uint64_t a, uint64_t b) {
+        std::string k(8, '\0');
+        k[5] = char(a);
+        k[7] = char(b);
+        return k;
+    };
+    for (uint64_t a = 0; a < 100; a++) {
+        for (uint64_t b = 0; b < 4; b++) {
+            art.insert(key(id(a, b)), std::to_string(a * 4 + b));
+        }
+    }
+    ASSERT_EQ(art.retrain_learned_root(), 100u);
+    EXPECT_EQ(art.learned_jumps(), 100u);
+    auto found = [&](uint64_t a, uint64_t b) {
+        auto v = art.search(key(id(a, b)));
+        return v && std::string(v->begin(), v->end()) ==
+                        std::to_string(a * 4 + b);
+    };
+
+    // Growing one subtree moves only its jump.
+    art.insert(key(id(7, 4)), std::to_string(7 * 4 + 4));
+    EXPECT_EQ(art.learned_jumps(), 100u);
+    EXPECT_TRUE(found(7, 4));
+    EXPECT_TRUE(found(8, 3));
+
+    // Collapsing one into a leaf drops only its jump.
+    for (uint64_t b = 1; b < 4; b++) {
+        art.remove(key(id(9, b)));
+    }
+    EXPECT_EQ(art.learned_jumps(), 99u);
+    EXPECT_TRUE(found(9, 0));
+    EXPECT_FALSE(art.search(key(id(9, 1))));
+
+    // Keys outside the model are no misses, so writes keep the model.
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_FALSE(art.search(key(id(200, 0))));
+        EXPECT_FALSE(art.search(key(id(7, 99))));
+    }
+    art.insert(key(id(9, 1)), std::to_string(9 * 4 + 1));
+    EXPECT_EQ(art.learned_jumps(), 99u);
+
+    // Covered keys that descend are, but only the next write retrains.
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(found(9, 1));
+    }
+    EXPECT_EQ(art.learned_jumps(), 99u);
+    art.insert(key(id(1, 0)), std::to_string(1 * 4 + 0));
+    EXPECT_EQ(art.learned_jumps(), 100u);
+    for (uint64_t a = 0; a < 100; a++) {
+        EXPECT_TRUE(found(a, 0)) << a;
+    }
+}
+
+TEST(Art, BucketsHoldBottomLeaves){
+    for (bool ranked : {false, true}) {
+        ART art;
+        if (ranked) {
+            art.enable_rank();
+        }
+        art.enable_buckets(4);
+        EXPECT_THROW(art.enable_eviction({}), std::invalid_argument);
+        std::map<std::string, std::string> expected;
+        std::mt19937 rng(11);
+        auto check = [&] {
+            ASSERT_EQ(art.size(), expected.size());
+            auto it = art.begin();
+            size_t i = 0;
+            for (auto &[k, v] : expected) {
+                ASSERT_TRUE(it.valid());
+                ASSERT_EQ(std::string(it.key().begin(), it.key().end()), k);
+                ASSERT_EQ(std::string(it.value().begin(), it.value().end()), v);
+                auto found = art.search(key(k));
+                ASSERT_TRUE(found) << k;
+                if (ranked) {
+                    ASSERT_EQ(art.rank(key(k)), i) << k;
+                    auto at = art.seek_rank(i);
+                    ASSERT_TRUE(at.valid());
+                    ASSERT_EQ(std::string(at.key().begin(), at.key().end()), k);
+                }
+                it.next();
+                i++;
+            }
+            EXPECT_FALSE(it.valid());
+            for (auto probe : {"", "b", "b1", "b12x", "b4999", "c"}) {
+                auto want = expected.lower_bound(probe);
+                auto got = art.lower_bound(std::string_view(probe));
+                ASSERT_EQ(got.valid(), want != expected.end()) << probe;
+                if (got.valid()) {
+                    EXPECT_EQ(std::string(got.key().begin(), got.key().end()),
+                              want->first)
+                        << probe;
+                }
+            }
+        };
+        for (int i = 0; i < 3000; i++) {
+            // Short numbers are prefixes of longer ones, so buckets mix keys
+            // that end at different depths.
+            auto k = "b" + std::to_string(rng() % 5000);
+            auto v = std::to_string(i);
+            if (i % 10 == 0) {
+                v.resize(200, 'x');
+            }
+            expected[k] = v;
+            art.insert(key(k), std::string(v));
+        }
+        check();
+        for (int i = 0; i < 1500; i++) {
+            auto k = "b" + std::to_string(rng() % 5000);
+            expected.erase(k);
+            art.remove(key(k));
+            EXPECT_FALSE(art.search(key(k)));
+        }
+        check();
+        for (int i = 0; i < 20; i++) {
+            auto low = art.pop_min();
+            ASSERT_TRUE(low);
+            EXPECT_EQ(std::string(low->first.begin(), low->first.end()),
+                      expected.begin()->first);
+            expected.erase(expected.begin());
+            auto high = art.pop_max();
+            ASSERT_TRUE(high);
+            EXPECT_EQ(std::string(high->first.begin(), high->first.end()),
+                      expected.rbegin()->first);
+            expected.erase(std::prev(expected.end()));
+        }
+        check();
+        for (auto prefix : {"b12", "b3", "b49"}) {
+            size_t want = 0;
+            for (auto it = expected.lower_bound(prefix);
+                 it != expected.end() && it->first.starts_with(prefix);) {
+                it = expected.erase(it);
+                want++;
+            }
+            EXPECT_EQ(art.remove_prefix(std::string_view(prefix)), want)
+                << prefix;
+        }
+        check();
+    }
+
+    // Readers find every key that stays while writers split and shrink the
+    // buckets around it.
+    ART art;
+    art.enable_buckets();
+    for (int i = 0; i < 20000; i += 2) {
+        art.insert(key(std::to_string(i)), std::to_string(i));
+    }
+    std::atomic<bool> stop{false};
+    std::atomic<int> misses{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; t++) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                for (int i = 0; i < 20000; i += 14) {
+                    auto v = art.search(key(std::to_string(i)));
+                    if (!v || std::string(v->begin(), v->end()) !=
+                                  std::to_string(i)) {
+                        misses++;
+                    }
+                }
+            }
+        });
+    }
+    for (int i = 1; i < 20000; i += 2) {
+        art.insert(key(std::to_string(i)), std::to_string(i));
+    }
+    for (int i = 1; i < 20000; i += 2) {
+        art.remove(key(std::to_string(i)));
+    }
+    stop = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(misses.load(), 0);
+    EXPECT_EQ(art.size(), 10000u);
+    EXPECT_THROW(art.enable_buckets(1), std::invalid_argument);
+}
+
+TEST(Collections, HashSetListAndDrop){
+    ART tree;
+    tree.insert(std::string_view("plain"), std::string("value"));
+    Collections collections(tree);
+    std::string big = "big", other("big\0", 4), tags = "tags", queue = "queue";
+    for (int i = 0; i < 1000; i++) {
+        auto field = "f" + std::to_string(i);
+        EXPECT_TRUE(collections.hset(key(big), key(field), key("v" + field)));
+    }
+    EXPECT_FALSE(collections.hset(key(big), key("f1"), key("new")));
+    EXPECT_TRUE(collections.hset(key(other), key("f1"), key("other")));
+    EXPECT_EQ(collections.size(key(big)), 1000);
+    auto value = collections.hget(key(big), key("f1"));
+    ASSERT_TRUE(value);
+    EXPECT_EQ(std::string(value->begin(), value->end()), "new");
+    EXPECT_TRUE(collections.hdel(key(big), key("f2")));
+    EXPECT_FALSE(collections.hget(key(big), key("f2")));
+    auto page = collections.elements(key(big), key("f99"), 3);
+    ASSERT_EQ(page.size(), 3);
+    EXPECT_EQ(std::string(page[0].first.begin(), page[0].first.end()), "f99");
+    EXPECT_EQ(std::string(page[1].first.begin(), page[1].first.end()), "f990");
+
+    EXPECT_TRUE(collections.sadd(key(tags), key("x")));
+    EXPECT_FALSE(collections.sadd(key(tags), key("x")));
+    EXPECT_TRUE(collections.sismember(key(tags), key("x")));
+    EXPECT_THROW(collections.push(key(tags), key("x"), false),
+                 std::invalid_argument);
+    EXPECT_TRUE(collections.srem(key(tags), key("x")));
+    EXPECT_EQ(collections.type(key(tags)), Collections::Type::None);
+
+    for (int i = 0; i < 10; i++) {
+        collections.push(key(queue), key(std::to_string(i)), i % 2 == 0);
+    }
+    // 8 6 4 2 0 1 3 5 7 9
+    auto items = collections.range(key(queue), 1, -2);
+    ASSERT_EQ(items.size(), 8);
+    EXPECT_EQ(std::string(items[0].begin(), items[0].end()), "6");
+    EXPECT_EQ(std::string(items[7].begin(), items[7].end()), "7");
+    auto last = collections.index(key(queue), -1);
+    EXPECT_EQ(std::string(last->begin(), last->end()), "9");
+    auto head = collections.pop(key(queue), true);
+    EXPECT_EQ(std::string(head->begin(), head->end()), "8");
+    EXPECT_EQ(collections.size(key(queue)), 9);
+    EXPECT_EQ(collections.count(), 3);
+
+    EXPECT_TRUE(collections.drop(key(big)));
+    EXPECT_FALSE(collections.drop(key(big)));
+    EXPECT_EQ(collections.type(key(big)), Collections::Type::None);
+    EXPECT_EQ(collections.size(key(other)), 1);
+    EXPECT_EQ(collections.count(), 2);
+    // Header and element pairs, next to the tree's own.
+    EXPECT_EQ(collections.pairs(), 2 + 1 + 9);
+    EXPECT_EQ(tree.size(), collections.pairs() + 1);
+
+    // Collections on a tree that already holds some find them again.
+    Collections reopened(tree);
+    EXPECT_EQ(reopened.count(), 2);
+    EXPECT_EQ(reopened.pairs(), collections.pairs());
+    EXPECT_EQ(reopened.type(key(queue)), Collections::Type::List);
+    EXPECT_EQ(reopened.size(key(other)), 1);
+}
+
+TEST(Collections, SortedSetMembersAndNames){
+    ART tree;
+    Collections collections(tree);
+    std::string board("board\0a", 7), other = "other";
+    EXPECT_TRUE(collections.zadd(key(board), key("carol"), 3.5));
+    EXPECT_TRUE(collections.zadd(key(board), key("alice"), -1));
+    EXPECT_FALSE(collections.zadd(key(board), key("carol"), 7));
+    EXPECT_TRUE(collections.zadd(key(other), key("x"), 0));
+    EXPECT_TRUE(collections.sadd(key("set"), key("x")));
+    EXPECT_EQ(collections.type(key(board)), Collections::Type::Zset);
+    EXPECT_THROW(collections.hset(key(board), key("f"), key("v")),
+                 std::invalid_argument);
+    auto members = collections.zmembers(key(board), std::string_view(), 10);
+    ASSERT_EQ(members.size(), 2);
+    EXPECT_EQ(std::string(members[0].first.begin(), members[0].first.end()),
+              "alice");
+    EXPECT_EQ(members[0].second, -1);
+    EXPECT_EQ(members[1].second, 7);
+    EXPECT_EQ(collections.zscore(key(board), key("carol")), 7);
+    EXPECT_FALSE(collections.zscore(key(board), key("bob")));
+    EXPECT_FALSE(collections.zscore(key("missing"), key("carol")));
+    EXPECT_THROW(collections.zscore(key("set"), key("x")),
+                 std::invalid_argument);
+    auto names = collections.names(Collections::Type::Zset);
+    ASSERT_EQ(names.size(), 2);
+    EXPECT_EQ(std::string(names[0].begin(), names[0].end()), board);
+    EXPECT_EQ(std::string(names[1].begin(), names[1].end()), other);
+    EXPECT_TRUE(collections.zrem(key(other), key("x")));
+    EXPECT_EQ(collections.names(Collections::Type::Zset).size(), 1);
+    EXPECT_EQ(collections.names(Collections::Type::Set).size(), 1);
+}
+
+TEST(Masstree, MatchesOrderedMap){
+    Masstree tree;
+    std::map<std::string, std::string> expected;
+    std::mt19937 rng(17);
+    // Long shared prefixes, zero bytes that padding must not confuse, and
+    // keys that are prefixes of others, across several 8-byte slices.
+    auto randomKey = [&] {
+        static const std::string parts[] = {
+            "tenant-000017/", "region-eu/", "bucket-0003/", std::string(3, '\0'),
+            "object-", "x"};
+        std::string k;
+        auto n = rng() % 6;
+        for (size_t i = 0; i < n; i++) {
+            k += parts[rng() % std::size(parts)];
+        }
+        return k + std::to_string(rng() % 50);
+    };
+    for (int i = 0; i < 20000; i++) {
+        auto k = randomKey();
+        if (rng() % 4 == 0) {
+            EXPECT_EQ(tree.remove(key(k)), expected.erase(k) == 1) << i;
+        } else {
+            auto v = std::to_string(i);
+            EXPECT_EQ(tree.insert(key(k), key(v)), !expected.contains(k));
+            expected[k] = v;
+        }
+    }
+    ASSERT_EQ(tree.size(), expected.size());
+    EXPECT_GT(tree.layers(), 0);
+    for (auto &[k, v] : expected) {
+        auto found = tree.search(key(k));
+        ASSERT_TRUE(found) << k;
+        ASSERT_EQ(std::string(found->begin(), found->end()), v);
+    }
+    EXPECT_FALSE(tree.search(std::string_view("tenant-000017/")));
+
+    auto all = tree.scan(std::string_view(), SIZE_MAX);
+    ASSERT_EQ(all.size(), expected.size());
+    auto it = expected.begin();
+    for (auto &[k, v] : all) {
+        ASSERT_EQ(std::string(k.begin(), k.end()), it->first);
+        ASSERT_EQ(std::string(v.begin(), v.end()), it->second);
+        ++it;
+    }
+    for (int i = 0; i < 200; i++) {
+        auto start = randomKey();
+        auto page = tree.scan(key(start), 20);
+        auto want = expected.lower_bound(start);
+        for (auto &[k, v] : page) {
+            ASSERT_NE(want, expected.end());
+            ASSERT_EQ(std::string(k.begin(), k.end()), want->first) << start;
+            ++want;
+        }
+        EXPECT_TRUE(page.size() == 20 || want == expected.end());
+    }
+
+    for (auto &[k, v] : expected) {
+        ASSERT_TRUE(tree.remove(key(k)));
+    }
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_EQ(tree.layers(), 0);
+    EXPECT_EQ(tree.bytes(), 0);
+}
+
+TEST(Checkpoint, RoundTrip){
+    auto path = testing::TempDir() + "artikv_checkpoint_test.akv";
+    auto art = ART();
+    for (int i = 0; i < 1000; i++) {
+        art.insert(key("k" + std::to_string(i)), std::string(i % 7, 'v'));
+    }
+    EXPECT_EQ(saveCheckpoint(art, path), 1000);
+    auto restored = ART();
+    EXPECT_EQ(loadCheckpoint(restored, path), 1000);
+    EXPECT_EQ(restored.size(), 1000);
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(get(restored, "k" + std::to_string(i)), std::string(i % 7, 'v'));
+    }
+    std::remove(path.c_str());
+}
+
+TEST(Checkpoint, ParallelRoundTrip){
+    auto path = testing::TempDir() + "artikv_parallel_test.akv";
+    auto art = ART();
+    for (int i = 0; i < 5000; i++) {
+        art.insert(key("p" + std::to_string(i * 7919 % 5000)), std::to_string(i));
+    }
+    EXPECT_EQ(saveCheckpoint(art, path, 4), 5000);
+    auto restored = ART();
+    EXPECT_EQ(loadCheckpoint(restored, path), 5000);
+    EXPECT_EQ(restored.size(), 5000);
+    for (int i = 0; i < 5000; i++) {
+        ASSERT_EQ(get(restored, "p" + std::to_string(i * 7919 % 5000)),
+                  std::to_string(i));
+    }
+    // Each save replaces the previous one's parts, whatever their number.
+    auto parts = [&] {
+        std::vector<std::string> names;
+        auto dir = std::filesystem::path(path).parent_path();
+        auto base = std::filesystem::path(path).filename().string() + ".";
+        for (auto &entry : std::filesystem::directory_iterator(dir)) {
+            auto name = entry.path().filename().string();
+            if (name.starts_with(base)) {
+                names.push_back(name);
+            }
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    };
+    EXPECT_EQ(parts().size(), 4u);
+    art.insert(key("extra"), std::string("1"));
+    EXPECT_EQ(saveCheckpoint(art, path, 2), 5001);
+    auto names = parts();
+    ASSERT_EQ(names.size(), 2u);
+    EXPECT_EQ(names[0], "artikv_parallel_test.akv.2.part0");
+    auto again = ART();
+    EXPECT_EQ(loadCheckpoint(again, path), 5001);
+    EXPECT_EQ(saveCheckpoint(art, path, 1), 5001);
+    EXPECT_TRUE(parts().empty());
+    std::remove(path.c_str());
+}
+
+static std::string get(SharedART &art, std::string_view key) {
+    auto value = art.search(key);
+    if (!value) {
+        return "<none>";
+    }
+    return std::string(value->begin(), value->end());
+}
+
+TEST(SharedArt, MatchesMapAndReusesMemory){
+    int fd = SharedART::create(16 << 20);
+    SharedART writer(fd, SharedART::Role::Writer);
+    SharedART reader(fd, SharedART::Role::Reader);
+    EXPECT_THROW(SharedART(fd, SharedART::Role::Writer), std::runtime_error);
+    close(fd);
+
+    std::map<std::string, std::string> model;
+    std::minstd_rand rng(7);
+    for (int i = 0; i < 20000; i++) {
+        auto k = std::string(rng() % 3, 'p') + std::to_string(rng() % 600);
+        if (rng() % 3 == 0) {
+            writer.remove(key(k));
+            model.erase(k);
+        } else {
+            writer.insert(key(k), std::to_string(i));
+            model[k] = std::to_string(i);
+        }
+    }
+    EXPECT_EQ(writer.size(), model.size());
+    for (auto &[k, v] : model) {
+        ASSERT_EQ(get(reader, k), v);
+    }
+    EXPECT_EQ(get(reader, "missing"), "<none>");
+
+    // Overwrites retire the old leaves, whose blocks get reused.
+    auto used = writer.used();
+    for (int i = 0; i < 20000; i++) {
+        writer.insert(key(model.begin()->first), std::to_string(i));
+    }
+    EXPECT_LT(writer.used(), used + 64 * 1024);
+    for (auto &[k, v] : model) {
+        writer.remove(key(k));
+    }
+    EXPECT_EQ(writer.size(), 0);
+    EXPECT_EQ(get(reader, model.begin()->first), "<none>");
+}
+
+TEST(SharedArt, ReaderInAnotherProcess){
+    int fd = SharedART::create(16 << 20);
+    SharedART writer(fd, SharedART::Role::Writer);
+    for (int i = 0; i < 1000; i++) {
+        writer.insert(key("stable" + std::to_string(i)), std::to_string(i));
+    }
+    auto pid = fork();
+    if (pid == 0) {
+        SharedART reader(fd, SharedART::Role::Reader);
+        while (!reader.search(std::string_view("done"))) {
+            for (int i = 0; i < 1000; i++) {
+                auto v = reader.search(key("stable" + std::to_string(i)));
+                if (!v || std::string(v->begin(), v->end()) != std::to_string(i)) {
+                    _exit(1);
+                }
+            }
+        }
+        _exit(0);
+    }
+    close(fd);
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 1000; i++) {
+            writer.insert(key("churn" + std::to_string(i)), std::to_string(round));
+        }
+        for (int i = 0; i < 1000; i++) {
+            writer.remove(key("churn" + std::to_string(i)));
+        }
+    }
+    writer.insert(std::string_view("done"), std::string_view(""));
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+TEST(CApi, BatchesAndIterators){
+    artikv_db *db = nullptr;
+    ASSERT_EQ(artikv_open(nullptr, &db), ARTIKV_OK);
+    std::string keys, values;
+    std::vector<uint64_t> key_offsets{0}, value_offsets{0};
+    for (int i = 99; i >= 0; i--) {
+        keys += "c" + std::to_string(i);
+        values += "v" + std::to_string(i);
+        key_offsets.push_back(keys.size());
+        value_offsets.push_back(values.size());
+    }
+    // A repeated key keeps the last value.
+    keys += "c7";
+    values += "last";
+    key_offsets.push_back(keys.size());
+    value_offsets.push_back(values.size());
+    auto bytes = [](const std::string &s) {
+        return reinterpret_cast<const uint8_t *>(s.data());
+    };
+    ASSERT_EQ(artikv_put_batch(db, bytes(keys), key_offsets.data(), bytes(values),
+                               value_offsets.data(), key_offsets.size() - 1),
+              ARTIKV_OK);
+    EXPECT_EQ(artikv_size(db), 100);
+
+    std::string wanted = "c7missingc42";
+    uint64_t wanted_offsets[] = {0, 2, 9, 12};
+    artikv_batch batch;
+    ASSERT_EQ(artikv_multi_get(db, bytes(wanted), wanted_offsets, 3, &batch),
+              ARTIKV_OK);
+    ASSERT_EQ(batch.count, 3);
+    EXPECT_TRUE(batch.found[0] && !batch.found[1] && batch.found[2]);
+    auto entry = [](const artikv_batch &b, const uint8_t *data, size_t i) {
+        return std::string(data + b.offsets[i], data + b.offsets[i + 1]);
+    };
+    EXPECT_EQ(entry(batch, batch.data, 0), "last");
+    EXPECT_EQ(entry(batch, batch.data, 1), "");
+    EXPECT_EQ(entry(batch, batch.data, 2), "v42");
+    artikv_batch_free(&batch);
+
+    char buf[2];
+    size_t len = 0;
+    EXPECT_EQ(artikv_get(db, bytes(std::string("c42")), 3, reinterpret_cast<uint8_t *>(buf),
+                         sizeof(buf), &len),
+              ARTIKV_BUFFER_TOO_SMALL);
+    EXPECT_EQ(len, 3);
+    EXPECT_EQ(artikv_delete(db, bytes(std::string("c42")), 3), ARTIKV_OK);
+    EXPECT_EQ(artikv_delete(db, bytes(std::string("c42")), 3), ARTIKV_NOT_FOUND);
+
+    artikv_iter *iter = nullptr;
+    ASSERT_EQ(artikv_iter_open(db, bytes(std::string("c9")), 2, &iter), ARTIKV_OK);
+    const uint8_t *k;
+    ASSERT_TRUE(artikv_iter_valid(iter));
+    artikv_iter_key(iter, &k, &len);
+    EXPECT_EQ(std::string(k, k + len), "c9");
+    artikv_iter_next(iter);
+    ASSERT_EQ(artikv_iter_next_batch(iter, 5, &batch), ARTIKV_OK);
+    ASSERT_EQ(batch.count, 5);
+    EXPECT_EQ(std::string(batch.keys + batch.key_offsets[0],
+                          batch.keys + batch.key_offsets[1]), "c90");
+    EXPECT_EQ(entry(batch, batch.data, 4), "v94");
+    artikv_batch_free(&batch);
+    ASSERT_EQ(artikv_iter_next_batch(iter, 100, &batch), ARTIKV_OK);
+    EXPECT_EQ(batch.count, 5);
+    artikv_batch_free(&batch);
+    artikv_iter_close(iter);
+    artikv_close(db);
+}